@@ -0,0 +1,1029 @@
+#pragma once
+#include<iostream>
+#include<fstream>
+#include<iomanip>
+#include<string>
+#include<vector>
+#include<chrono>
+#include<cstdio>
+#include<random>
+#include<algorithm>
+
+#include "libs.h"
+#include "OBJImporter.h"
+#include "OBJLoader.h"
+#include "TextureImporter.h"
+
+//Command line benchmarks, run with "ProjectInk --bench"
+class Benchmark
+{
+private:
+	static double now()
+	{
+		return std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+	}
+
+	//Best of a few runs, in milliseconds
+	template<typename Function>
+	static double measure(Function function, const int runs = 3)
+	{
+		double best = 0.0;
+		for (int i = 0; i < runs; i++)
+		{
+			const double start = now();
+			function();
+			const double time = now() - start;
+			if (i == 0 || time < best)
+				best = time;
+		}
+		return best;
+	}
+
+	//Hidden window, only needed for the context
+	static GLFWwindow* createContext()
+	{
+		if (glfwInit() == GLFW_FALSE)
+		{
+			std::cout << "ERROR::BENCHMARK::GLFW_INIT_FAILED" << "\n";
+			return nullptr;
+		}
+
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+		GLFWwindow* window = glfwCreateWindow(256, 256, "benchmark", NULL, NULL);
+		if (window == nullptr)
+		{
+			std::cout << "ERROR::BENCHMARK::GLFW_WINDOW_FAILED" << "\n";
+			glfwTerminate();
+			return nullptr;
+		}
+
+		glfwMakeContextCurrent(window);
+		glfwSwapInterval(0);
+
+		glewExperimental = GL_TRUE;
+		if (glewInit() != GLEW_OK)
+		{
+			std::cout << "ERROR::BENCHMARK::GLEW_INIT_FAILED" << "\n";
+			glfwDestroyWindow(window);
+			glfwTerminate();
+			return nullptr;
+		}
+
+		return window;
+	}
+
+	static void destroyContext(GLFWwindow* window)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+
+	//Stand in for a model in the scene tree benchmark
+	struct BenchmarkObject
+	{
+		AABB box;
+
+		const AABB& getBounds() const { return this->box; }
+	};
+
+	//UV sphere written as quads, so the size of the file can be scaled freely
+	static void writeSphereOBJ(const char* fileName, const int segments)
+	{
+		std::ofstream out(fileName);
+		const int rings = segments / 2;
+
+		out << "# generated benchmark sphere\n";
+		for (int r = 0; r <= rings; r++)
+		{
+			for (int s = 0; s <= segments; s++)
+			{
+				const float theta = 3.14159265f * r / rings;
+				const float phi = 2.f * 3.14159265f * s / segments;
+				const float x = sinf(theta) * cosf(phi);
+				const float y = cosf(theta);
+				const float z = sinf(theta) * sinf(phi);
+
+				out << "v " << x << " " << y << " " << z << "\n";
+				out << "vt " << static_cast<float>(s) / segments << " " << static_cast<float>(r) / rings << "\n";
+				out << "vn " << x << " " << y << " " << z << "\n";
+			}
+		}
+
+		for (int r = 0; r < rings; r++)
+		{
+			for (int s = 0; s < segments; s++)
+			{
+				const int a = r * (segments + 1) + s + 1;
+				const int b = a + segments + 1;
+				out << "f " << a << "/" << a << "/" << a << " "
+					<< b << "/" << b << "/" << b << " "
+					<< b + 1 << "/" << b + 1 << "/" << b + 1 << " "
+					<< a + 1 << "/" << a + 1 << "/" << a + 1 << "\n";
+			}
+		}
+	}
+
+	static void importOBJ(const char* fileName)
+	{
+		uint64_t size = 0;
+		int64_t modified = 0;
+		MappedFile::getStamp(fileName, size, modified);
+
+		const std::string cacheFile = OBJImporter::getCachePath(fileName);
+		std::remove(cacheFile.c_str());
+
+		size_t vertices = 0;
+		const double legacy = measure([&]() { vertices = loadOBJ(fileName).size(); }, 1);
+		const double parsed = measure([&]() { vertices = OBJImporter::load(fileName, false, false).vertices.size(); });
+		const double cold = measure([&]() { OBJImporter::load(fileName); }, 1);
+		const double cached = measure([&]() { vertices = OBJImporter::load(fileName).vertices.size(); });
+
+		const double megabytes = static_cast<double>(size) / (1024.0 * 1024.0);
+		std::cout << std::left << std::setw(28) << fileName << std::right
+			<< std::setw(10) << std::fixed << std::setprecision(1) << size / 1024.0
+			<< std::setw(10) << vertices
+			<< std::setw(12) << std::setprecision(2) << legacy
+			<< std::setw(12) << parsed
+			<< std::setw(12) << cold
+			<< std::setw(12) << cached
+			<< std::setw(12) << std::setprecision(1) << megabytes / (parsed / 1000.0)
+			<< "\n";
+	}
+
+	static void weldOBJ(const char* fileName)
+	{
+		MeshData mesh = OBJImporter::load(fileName, false, false);
+		const OBJImporter::WeldStats stats = OBJImporter::weld(mesh);
+
+		std::cout << std::left << std::setw(28) << fileName << std::right
+			<< std::setw(10) << stats.verticesBefore
+			<< std::setw(10) << stats.verticesAfter
+			<< std::setw(10) << stats.indices
+			<< std::setw(8) << OBJImporter::getIndexSize(stats.verticesAfter) * 8
+			<< std::setw(12) << stats.bytesBefore
+			<< std::setw(12) << stats.bytesAfter
+			<< std::setw(10) << std::fixed << std::setprecision(2)
+			<< static_cast<double>(stats.bytesBefore) / stats.bytesAfter << "x"
+			<< std::setw(10) << static_cast<double>(stats.verticesBefore) / stats.verticesAfter << "x"
+			<< "\n";
+	}
+
+	//Simulated post-transform cache of a welded mesh in file order and in the order import leaves it.
+	//shuffle scrambles the triangles first, like an exporter that writes them in no particular order
+	static void optimizeOBJ(const char* fileName, const bool shuffle = false)
+	{
+		MeshData mesh = OBJImporter::load(fileName, false, false);
+		OBJImporter::weld(mesh);
+
+		if (shuffle)
+		{
+			std::vector<size_t> order(mesh.indices.size() / 3);
+			for (size_t i = 0; i < order.size(); i++)
+				order[i] = i;
+			std::shuffle(order.begin(), order.end(), std::mt19937(1));
+
+			std::vector<GLuint> indices;
+			indices.reserve(mesh.indices.size());
+			for (size_t i : order)
+				indices.insert(indices.end(), mesh.indices.begin() + i * 3, mesh.indices.begin() + i * 3 + 3);
+			mesh.indices.swap(indices);
+		}
+
+		MeshData optimized;
+		const double time = measure([&]()
+		{
+			optimized = mesh;
+			OBJImporter::optimize(optimized);
+		});
+
+		const VertexCacheStats before = MeshOptimizer::analyzeVertexCache(mesh.indices);
+		const VertexCacheStats after = MeshOptimizer::analyzeVertexCache(optimized.indices);
+
+		const std::string name = std::string(fileName) + (shuffle ? " (shuffled)" : "");
+		std::cout << std::left << std::setw(28) << name << std::right
+			<< std::setw(10) << mesh.indices.size() / 3
+			<< std::setw(12) << std::fixed << std::setprecision(3) << before.acmr
+			<< std::setw(12) << after.acmr
+			<< std::setw(12) << before.atvr
+			<< std::setw(12) << after.atvr
+			<< std::setw(10) << std::setprecision(1) << time
+			<< "\n";
+	}
+
+	//Level of detail chain of a welded mesh: triangles and error per level, and what building it costs
+	static void simplifyOBJ(const char* fileName)
+	{
+		MeshData mesh = OBJImporter::load(fileName, false);
+
+		std::vector<MeshLOD> lods;
+		const double time = measure([&]()
+		{
+			lods = MeshSimplifier::buildLODs(mesh.vertices.data(), mesh.vertices.size(), mesh.indices);
+		}, 1);
+
+		AABB box;
+		BoundingSphere sphere;
+		computeBounds(mesh.vertices.data(), static_cast<unsigned>(mesh.vertices.size()), box, sphere);
+		const float radius = sphere.radius;
+
+		std::cout << std::left << std::setw(28) << fileName << std::right
+			<< std::setw(10) << mesh.indices.size() / 3
+			<< std::setw(10) << std::fixed << std::setprecision(1) << time
+			<< "   ";
+		for (auto& i : lods)
+		{
+			std::cout << " " << i.indices.size() / 3 << " (" << std::setprecision(2)
+				<< (radius > 0.f ? 100.f * i.error / radius : 0.f) << "%)";
+		}
+		std::cout << "\n";
+	}
+
+	//Vertex buffer size of a welded mesh in the format import picks, and the error that format introduced
+	static void compactOBJ(const char* fileName)
+	{
+		MeshData mesh = OBJImporter::load(fileName, false);
+
+		VertexFormat format;
+		VertexError error;
+		const double time = measure([&]() { format = OBJImporter::chooseFormat(mesh, VertexTolerance(), &error); });
+
+		const size_t fullBytes = mesh.vertices.size() * sizeof(Vertex);
+		const size_t compactBytes = mesh.vertices.size() * format.getStride();
+
+		std::cout << std::left << std::setw(28) << fileName << std::right
+			<< std::setw(10) << mesh.vertices.size()
+			<< std::setw(16) << format.getName()
+			<< std::setw(12) << fullBytes
+			<< std::setw(12) << compactBytes
+			<< std::setw(10) << std::fixed << std::setprecision(2)
+			<< static_cast<double>(fullBytes) / compactBytes << "x"
+			<< std::setw(12) << std::setprecision(5) << error.position
+			<< std::setw(10) << std::setprecision(3) << error.normal
+			<< std::setw(12) << std::setprecision(5) << error.texcoord
+			<< std::setw(10) << std::setprecision(1) << time
+			<< "\n";
+	}
+
+	//Decode + glGenerateMipmap through Texture against the mapped .tex file, video memory of the whole chain
+	static void textures(const char* fileName)
+	{
+		std::remove(TextureImporter::getCachePath(fileName).c_str());
+
+		const double png = measure([&]()
+		{
+			Texture texture(fileName, GL_TEXTURE_2D);
+			glFinish();
+		});
+
+		const double convert = measure([&]() { TextureImporter::convertToCache(fileName); }, 1);
+
+		TextureInfo info = TextureInfo();
+		const double cached = measure([&]()
+		{
+			GLuint id = TextureImporter::load(fileName, TextureImporter::FORMAT_AUTO, &info);
+			glFinish();
+			glDeleteTextures(1, &id);
+		});
+
+		size_t pngBytes = 0;
+		for (uint32_t width = info.width, height = info.height; ; width = std::max(1u, width / 2), height = std::max(1u, height / 2))
+		{
+			pngBytes += static_cast<size_t>(width) * height * 4;
+			if (width == 1 && height == 1)
+				break;
+		}
+
+		const char* formats[] = { "RGBA8", "BC1", "BC3" };
+		std::cout << std::left << std::setw(34) << fileName << std::right
+			<< std::setw(11) << std::to_string(info.width) + "x" + std::to_string(info.height)
+			<< std::setw(8) << (info.format < 3 ? formats[info.format] : "?")
+			<< std::fixed << std::setprecision(2)
+			<< std::setw(10) << png
+			<< std::setw(12) << convert
+			<< std::setw(10) << cached
+			<< std::setw(10) << std::setprecision(0) << pngBytes / 1024.0
+			<< std::setw(10) << info.bytes / 1024.0
+			<< "\n";
+	}
+
+	//Objects at a constant density, so the camera sees about the same amount at every scene size
+	static void sceneTree(const int count)
+	{
+		const float spacing = 10.f;
+		const float extent = spacing * std::cbrt(static_cast<float>(count)) * 0.5f;
+
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> position(-extent, extent);
+		std::uniform_real_distribution<float> size(0.25f, 1.f);
+		std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+		std::vector<BenchmarkObject> objects(count);
+		for (auto& i : objects)
+		{
+			const glm::vec3 center(position(random), position(random), position(random));
+			const glm::vec3 half(size(random), size(random), size(random));
+			i.box = AABB(center - half, center + half);
+		}
+
+		DynamicAABBTree<BenchmarkObject> tree;
+		std::vector<int> proxies(count);
+		const double build = measure([&]()
+		{
+			for (int i = 0; i < count; i++)
+				proxies[i] = tree.insert(&objects[i]);
+		}, 1);
+
+		const Frustum frustum(glm::perspective(glm::radians(90.f), 16.f / 9.f, 0.1f, 50.f)
+			* glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f)));
+
+		size_t flatVisible = 0;
+		const double flat = measure([&]()
+		{
+			flatVisible = 0;
+			for (auto& i : objects)
+			{
+				if (frustum.intersects(i.box))
+					++flatVisible;
+			}
+		});
+
+		std::vector<BenchmarkObject*> result;
+		const double query = measure([&]()
+		{
+			result.clear();
+			tree.queryFrustum(frustum, result);
+		});
+
+		if (result.size() != flatVisible)
+			std::cout << "ERROR::BENCHMARK::SCENE_TREE_MISMATCH: " << result.size() << " != " << flatVisible << "\n";
+
+		const int rays = 1000;
+		const double raycast = measure([&]()
+		{
+			std::mt19937 rayRandom(2);
+			for (int i = 0; i < rays; i++)
+			{
+				float distance = 0.f;
+				const glm::vec3 direction = glm::normalize(glm::vec3(unit(rayRandom), unit(rayRandom), unit(rayRandom)) + glm::vec3(0.f, 0.f, 0.01f));
+				tree.raycast(glm::vec3(0.f), direction, 100.f, distance);
+			}
+		});
+
+		const int spheres = 1000;
+		size_t overlaps = 0;
+		const double sphere = measure([&]()
+		{
+			std::mt19937 sphereRandom(3);
+			overlaps = 0;
+			for (int i = 0; i < spheres; i++)
+			{
+				result.clear();
+				tree.querySphere(BoundingSphere(glm::vec3(position(sphereRandom), position(sphereRandom), position(sphereRandom)), 5.f), result);
+				overlaps += result.size();
+			}
+		});
+
+		//A tenth of the scene moves a little every frame, most stay within their fat box
+		const int moving = count / 10;
+		int reinserted = 0;
+		const double refit = measure([&]()
+		{
+			std::mt19937 moveRandom(4);
+			reinserted = 0;
+			for (int i = 0; i < moving; i++)
+			{
+				const glm::vec3 offset = glm::vec3(unit(moveRandom), unit(moveRandom), unit(moveRandom)) * 0.15f;
+				objects[i].box = AABB(objects[i].box.min + offset, objects[i].box.max + offset);
+				if (tree.move(proxies[i]))
+					++reinserted;
+			}
+		}, 1);
+
+		std::cout << std::right << std::setw(10) << count
+			<< std::setw(8) << tree.getHeight()
+			<< std::setw(12) << std::fixed << std::setprecision(1) << build
+			<< std::setw(10) << flatVisible
+			<< std::setw(12) << std::setprecision(3) << flat
+			<< std::setw(12) << query
+			<< std::setw(10) << std::setprecision(2) << raycast * 1000.0 / rays
+			<< std::setw(10) << sphere * 1000.0 / spheres
+			<< std::setw(12) << std::setprecision(3) << refit
+			<< std::setw(10) << reinserted
+			<< "\n";
+	}
+
+	//Per frame transform cost: rebuilding every matrix with the glm chain against the dirty flagged system
+	static void transforms(const int count)
+	{
+		std::mt19937 random(5);
+		std::uniform_real_distribution<float> position(-100.f, 100.f);
+		std::uniform_real_distribution<float> angle(0.f, 360.f);
+
+		std::vector<glm::vec3> positions(count);
+		std::vector<glm::vec3> rotations(count);
+		for (int i = 0; i < count; i++)
+		{
+			positions[i] = glm::vec3(position(random), position(random), position(random));
+			rotations[i] = glm::vec3(angle(random), angle(random), angle(random));
+		}
+
+		std::vector<glm::mat4> matrices(count);
+		const double chain = measure([&]()
+		{
+			for (int i = 0; i < count; i++)
+			{
+				glm::mat4 ModelMatrix(1.f);
+				ModelMatrix = glm::translate(ModelMatrix, glm::vec3(0.f));
+				ModelMatrix = glm::rotate(ModelMatrix, glm::radians(rotations[i].x), glm::vec3(1.f, 0.f, 0.f));
+				ModelMatrix = glm::rotate(ModelMatrix, glm::radians(rotations[i].y), glm::vec3(0.f, 1.f, 0.f));
+				ModelMatrix = glm::rotate(ModelMatrix, glm::radians(rotations[i].z), glm::vec3(0.f, 0.f, 1.f));
+				ModelMatrix = glm::translate(ModelMatrix, positions[i]);
+				ModelMatrix = glm::scale(ModelMatrix, glm::vec3(1.f));
+				matrices[i] = ModelMatrix;
+			}
+		});
+
+		TransformSystem& system = TransformSystem::get();
+		std::vector<int> handles(count);
+		for (int i = 0; i < count; i++)
+			handles[i] = system.create(positions[i], glm::vec3(0.f), rotations[i]);
+		system.update();
+
+		const double idle = measure([&]() { system.update(); });
+
+		const int moving = count / 10;
+		const double some = measure([&]()
+		{
+			for (int i = 0; i < moving; i++)
+				system.rotate(handles[i], glm::vec3(1.f, 0.f, 0.f));
+			system.update();
+		});
+
+		const double all = measure([&]()
+		{
+			for (int i = 0; i < count; i++)
+				system.rotate(handles[i], glm::vec3(1.f, 0.f, 0.f));
+			system.update();
+		});
+
+		for (auto& i : handles)
+			system.destroy(i);
+		system.update();
+
+		std::cout << std::right << std::setw(10) << count
+			<< std::fixed << std::setprecision(3)
+			<< std::setw(12) << chain
+			<< std::setw(12) << idle
+			<< std::setw(12) << some
+			<< std::setw(12) << all
+			<< "\n";
+	}
+
+	//One frame of CPU side scene work with every model moving: transforms, bounds, culling and packet building
+	static void jobs(const int count, const unsigned threads, Geometry* geometry, Material* material, Texture* texture, UniformCache* program)
+	{
+		std::mt19937 random(6);
+		std::uniform_real_distribution<float> position(-200.f, 200.f);
+
+		std::vector<Mesh*> meshes;
+		meshes.push_back(new Mesh(GeometryRegistry::get().share(geometry)));
+
+		std::vector<Model*> models;
+		for (int i = 0; i < count; i++)
+			models.push_back(new Model(glm::vec3(position(random), position(random), position(random)), material, texture, texture, meshes));
+
+		JobSystem jobs(threads - 1);
+		FrustumCuller culler;
+		RenderQueue queue;
+		std::vector<DrawList> lists(jobs.getThreadCount());
+		const Frustum frustum(glm::perspective(glm::radians(90.f), 1.f, 0.1f, 1000.f)
+			* glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f)));
+
+		double update = 0.0;
+		double cull = 0.0;
+		double packets = 0.0;
+		const int frames = 10;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (auto& i : models)
+				i->rotate(glm::vec3(0.f, 1.f, 0.f));
+
+			double start = now();
+			TransformSystem::get().update(&jobs);
+			jobs.parallelFor(models.size(), [&](const size_t first, const size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+					models[i]->update();
+			}, 64);
+			update += now() - start;
+
+			start = now();
+			culler.begin();
+			for (auto& i : models)
+				i->cull(culler);
+			culler.cull(frustum, &jobs);
+			cull += now() - start;
+
+			start = now();
+			for (auto& i : lists)
+				i.clear();
+			jobs.parallelFor(models.size(), [&](const size_t first, const size_t last)
+			{
+				DrawList& list = lists[jobs.getCurrentThread()];
+				for (size_t i = first; i < last; i++)
+					models[i]->submit(list, program);
+			}, 64);
+			queue.begin(glm::vec3(0.f), 1000.f);
+			for (auto& i : lists)
+				queue.merge(i);
+			packets += now() - start;
+		}
+
+		std::cout << std::right << std::setw(10) << count
+			<< std::setw(10) << threads
+			<< std::fixed << std::setprecision(3)
+			<< std::setw(12) << update / frames
+			<< std::setw(12) << cull / frames
+			<< std::setw(12) << packets / frames
+			<< std::setw(12) << (update + cull + packets) / frames
+			<< "\n";
+
+		for (auto*& i : models)
+			delete i;
+		for (auto*& i : meshes)
+			delete i;
+	}
+
+	//CPU binning of one frame's lights into the froxel grid, GL only for the clusterer's buffers
+	static void lightClustering(const int count, const unsigned threads)
+	{
+		std::mt19937 random(9);
+		std::uniform_real_distribution<float> horizontal(-100.f, 100.f);
+		std::uniform_real_distribution<float> vertical(-10.f, 10.f);
+		std::uniform_real_distribution<float> radius(1.f, 4.f);
+
+		std::vector<Light> lights;
+		lights.reserve(count);
+		for (int i = 0; i < count; i++)
+			lights.push_back(Light(glm::vec3(horizontal(random), vertical(random), horizontal(random)), glm::vec3(1.f), radius(random)));
+
+		JobSystem jobs(threads - 1);
+		LightClusterer clusterer;
+		const glm::mat4 ViewMatrix = glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+		const glm::mat4 ProjectionMatrix = glm::perspective(glm::radians(90.f), 16.f / 9.f, 0.1f, 200.f);
+
+		const double build = measure([&]()
+		{
+			clusterer.build(lights, ViewMatrix, ProjectionMatrix, 0.1f, 200.f, 1280, 720, &jobs);
+		}, 10);
+
+		const LightClusterStats& stats = clusterer.getStats();
+		std::cout << std::right << std::setw(10) << count
+			<< std::setw(10) << threads
+			<< std::fixed << std::setprecision(3)
+			<< std::setw(12) << build
+			<< std::setw(10) << stats.visibleLights
+			<< std::setw(10) << stats.occupiedClusters
+			<< std::setprecision(1)
+			<< std::setw(10) << (stats.occupiedClusters > 0 ? static_cast<double>(stats.indices) / stats.occupiedClusters : 0.0)
+			<< std::setw(10) << stats.maxPerCluster
+			<< "\n";
+	}
+
+public:
+	static void jobs()
+	{
+		GLFWwindow* window = createContext();
+		if (window == nullptr)
+			return;
+
+		{
+			Shader shader(4, 6, "vertex_core.glsl", "fragment_core.glsl");
+			UniformBuffer drawBuffer(sizeof(DrawData), BLOCK_DRAW);
+			UniformCache program(&shader, &drawBuffer);
+			Texture texture("Images/Box.png", GL_TEXTURE_2D);
+			Material material(glm::vec3(0.1f), glm::vec3(1.f), glm::vec3(2.f), 0, 1);
+
+			Pyramid pyramid;
+			Geometry* geometry = GeometryRegistry::get().acquire(&pyramid);
+
+			std::cout << "Scene work per frame, every model moving (ms)\n";
+			std::cout << std::right << std::setw(10) << "models"
+				<< std::setw(10) << "threads"
+				<< std::setw(12) << "update"
+				<< std::setw(12) << "cull"
+				<< std::setw(12) << "packets"
+				<< std::setw(12) << "total"
+				<< "\n";
+
+			const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+			const int counts[] = { 10000, 50000 };
+			for (int count : counts)
+			{
+				for (unsigned threads = 1; threads < hardware; threads *= 2)
+					jobs(count, threads, geometry, &material, &texture, &program);
+				jobs(count, hardware, geometry, &material, &texture, &program);
+			}
+
+			GeometryRegistry::get().release(geometry);
+		}
+
+		destroyContext(window);
+	}
+
+	static void lightClustering()
+	{
+		GLFWwindow* window = createContext();
+		if (window == nullptr)
+			return;
+
+		std::cout << "Light clustering, " << LightClusterer::GRID_X << "x" << LightClusterer::GRID_Y << "x" << LightClusterer::GRID_Z
+			<< " froxels, CPU binning per frame\n";
+		std::cout << std::right << std::setw(10) << "lights"
+			<< std::setw(10) << "threads"
+			<< std::setw(12) << "build ms"
+			<< std::setw(10) << "visible"
+			<< std::setw(10) << "occupied"
+			<< std::setw(10) << "avg"
+			<< std::setw(10) << "max"
+			<< "\n";
+
+		const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+		const int counts[] = { 1000, 10000 };
+		for (int count : counts)
+		{
+			for (unsigned threads = 1; threads < hardware; threads *= 2)
+				lightClustering(count, threads);
+			lightClustering(count, hardware);
+		}
+
+		destroyContext(window);
+	}
+
+	static void transforms()
+	{
+		std::cout << "Transforms per frame (ms)\n";
+		std::cout << std::right << std::setw(10) << "objects"
+			<< std::setw(12) << "glm chain"
+			<< std::setw(12) << "static"
+			<< std::setw(12) << "10% moved"
+			<< std::setw(12) << "all moved"
+			<< "\n";
+
+		transforms(10000);
+		transforms(100000);
+	}
+
+	static void sceneTree()
+	{
+		std::cout << "Scene tree (frustum sees about the same number of objects at every size)\n";
+		std::cout << std::right << std::setw(10) << "objects"
+			<< std::setw(8) << "height"
+			<< std::setw(12) << "build ms"
+			<< std::setw(10) << "visible"
+			<< std::setw(12) << "flat ms"
+			<< std::setw(12) << "tree ms"
+			<< std::setw(10) << "ray us"
+			<< std::setw(10) << "sphere us"
+			<< std::setw(12) << "refit ms"
+			<< std::setw(10) << "reinsert"
+			<< "\n";
+
+		sceneTree(10000);
+		sceneTree(100000);
+		sceneTree(1000000);
+	}
+
+	static void weldOBJ()
+	{
+		std::cout << "Vertex welding\n";
+		std::cout << std::left << std::setw(28) << "file" << std::right
+			<< std::setw(10) << "verts in"
+			<< std::setw(10) << "verts out"
+			<< std::setw(10) << "indices"
+			<< std::setw(8) << "bits"
+			<< std::setw(12) << "bytes in"
+			<< std::setw(12) << "bytes out"
+			<< std::setw(11) << "memory"
+			<< std::setw(11) << "vs work"
+			<< "\n";
+
+		weldOBJ("OBJFiles/cube.obj");
+		weldOBJ("OBJFiles/Grass_Block.obj");
+		weldOBJ("OBJFiles/sphere.obj");
+	}
+
+	static void compactOBJ()
+	{
+		std::cout << "Compact vertex formats (position error relative to the extent, normal in degrees)\n";
+		std::cout << std::left << std::setw(28) << "file" << std::right
+			<< std::setw(10) << "verts"
+			<< std::setw(16) << "format"
+			<< std::setw(12) << "bytes in"
+			<< std::setw(12) << "bytes out"
+			<< std::setw(11) << "memory"
+			<< std::setw(12) << "position"
+			<< std::setw(10) << "normal"
+			<< std::setw(12) << "texcoord"
+			<< std::setw(10) << "pick ms"
+			<< "\n";
+
+		compactOBJ("OBJFiles/cube.obj");
+		compactOBJ("OBJFiles/Grass_Block.obj");
+		compactOBJ("OBJFiles/sphere.obj");
+
+		const std::string fileName = "bench_sphere_512.obj";
+		writeSphereOBJ(fileName.c_str(), 512);
+		compactOBJ(fileName.c_str());
+		std::remove(fileName.c_str());
+	}
+
+	static void optimizeOBJ()
+	{
+		std::cout << "Vertex cache order (FIFO cache of " << MeshOptimizer::CACHE_SIZE << ", ACMR per triangle, ATVR per vertex)\n";
+		std::cout << std::left << std::setw(28) << "file" << std::right
+			<< std::setw(10) << "triangles"
+			<< std::setw(12) << "ACMR in"
+			<< std::setw(12) << "ACMR out"
+			<< std::setw(12) << "ATVR in"
+			<< std::setw(12) << "ATVR out"
+			<< std::setw(10) << "ms"
+			<< "\n";
+
+		optimizeOBJ("OBJFiles/cube.obj");
+		optimizeOBJ("OBJFiles/Grass_Block.obj");
+		optimizeOBJ("OBJFiles/sphere.obj");
+		optimizeOBJ("OBJFiles/sphere.obj", true);
+
+		const std::string fileName = "bench_sphere_512.obj";
+		writeSphereOBJ(fileName.c_str(), 512);
+		optimizeOBJ(fileName.c_str());
+		optimizeOBJ(fileName.c_str(), true);
+		std::remove(fileName.c_str());
+	}
+
+	static void simplifyOBJ()
+	{
+		std::cout << "Level of detail chains (triangles per level, error relative to the radius)\n";
+		std::cout << std::left << std::setw(28) << "file" << std::right
+			<< std::setw(10) << "triangles"
+			<< std::setw(10) << "build ms"
+			<< "    levels"
+			<< "\n";
+
+		simplifyOBJ("OBJFiles/sphere.obj");
+
+		const int segments[] = { 128, 512 };
+		for (int i : segments)
+		{
+			const std::string fileName = "bench_sphere_" + std::to_string(i) + ".obj";
+			writeSphereOBJ(fileName.c_str(), i);
+			simplifyOBJ(fileName.c_str());
+			std::remove(fileName.c_str());
+		}
+	}
+
+	//CPU time to submit one draw: the old per draw uniform calls by name against the cached/UBO path
+	static void uniformSubmission(const int draws = 20000)
+	{
+		GLFWwindow* window = createContext();
+		if (window == nullptr)
+			return;
+
+		{
+			Shader shader(4, 6, "vertex_core.glsl", "fragment_core.glsl");
+			UniformBuffer frameBuffer(sizeof(FrameData), BLOCK_FRAME);
+			UniformBuffer drawBuffer(sizeof(DrawData), BLOCK_DRAW);
+			UniformCache program(&shader, &drawBuffer);
+			frameBuffer.bind();
+			drawBuffer.bind();
+
+			Texture diffuse("Images/Box.png", GL_TEXTURE_2D);
+			Texture specular("Images/Box_specular.png", GL_TEXTURE_2D);
+			Material material(glm::vec3(0.1f), glm::vec3(1.f), glm::vec3(2.f), 0, 1);
+
+			Pyramid pyramid;
+			std::vector<Mesh*> meshes;
+			meshes.push_back(new Mesh(&pyramid));
+			Model model(glm::vec3(0.f), &material, &diffuse, &specular, meshes);
+			Mesh& mesh = *meshes[0];
+			TransformSystem::get().update();
+
+			const glm::mat4 ModelMatrix(1.f);
+
+			glFinish();
+			const double byName = measure([&]()
+			{
+				for (int i = 0; i < draws; i++)
+				{
+					shader.setVec3f(glm::vec3(0.1f), "material.ambient");
+					shader.setVec3f(glm::vec3(1.f), "material.diffuse");
+					shader.setVec3f(glm::vec3(2.f), "material.specular");
+					shader.set1i(0, "material.diffuseTex");
+					shader.set1i(1, "material.specularTex");
+					shader.use();
+					diffuse.bind(0);
+					specular.bind(1);
+					shader.setMat4fv(ModelMatrix, "ModelMatrix");
+					shader.use();
+					glBindVertexArray(mesh.getGeometry()->getVAO());
+					mesh.getGeometry()->draw();
+					glBindVertexArray(0);
+					glUseProgram(0);
+					glActiveTexture(0);
+					glBindTexture(GL_TEXTURE_2D, 0);
+				}
+				glFinish();
+			});
+
+			const double cached = measure([&]()
+			{
+				for (int i = 0; i < draws; i++)
+				{
+					model.render(&program);
+				}
+				glFinish();
+			});
+
+			//Every draw gets its own range of the ring, one region fits all of them
+			StreamBuffer stream(draws * 256);
+			UniformBuffer streamedBuffer(sizeof(DrawData), BLOCK_DRAW, &stream);
+			UniformCache streamedProgram(&shader, &streamedBuffer);
+			const double streamed = measure([&]()
+			{
+				stream.beginFrame();
+				for (int i = 0; i < draws; i++)
+				{
+					model.render(&streamedProgram);
+				}
+				glFinish();
+			});
+			drawBuffer.bind();
+
+			std::cout << "Uniform submission (" << draws << " draws, includes glFinish)\n";
+			std::cout << std::fixed << std::setprecision(3)
+				<< "  by name         " << byName * 1000.0 / draws << " us/draw\n"
+				<< "  cached + UBO    " << cached * 1000.0 / draws << " us/draw\n"
+				<< "  cached + stream " << streamed * 1000.0 / draws << " us/draw"
+				<< " (overflows " << stream.getOverflows() << ")\n";
+
+			for (auto*& i : meshes)
+				delete i;
+		}
+
+		destroyContext(window);
+	}
+
+	//Distinct geometry drawn instanced: one draw and one VAO per geometry with its own buffers, against
+	//multi draws from the shared buffers of the GeometryPool
+	static void multiDraw(const int count = 2000)
+	{
+		GLFWwindow* window = createContext();
+		if (window == nullptr)
+			return;
+
+		{
+			Shader shader(4, 6, "vertex_instanced.glsl", "fragment_core.glsl");
+			UniformBuffer frameBuffer(sizeof(FrameData), BLOCK_FRAME);
+			UniformBuffer drawBuffer(sizeof(DrawData), BLOCK_DRAW);
+			UniformCache program(&shader, &drawBuffer);
+			frameBuffer.bind();
+			drawBuffer.bind();
+
+			Texture diffuse("Images/Box.png", GL_TEXTURE_2D);
+			Texture specular("Images/Box_specular.png", GL_TEXTURE_2D);
+			Material material(glm::vec3(0.1f), glm::vec3(1.f), glm::vec3(2.f), 0, 1);
+
+			std::cout << "Multi draw (" << count << " distinct geometries, includes glFinish)\n";
+			std::cout << std::left << std::setw(16) << "buffers" << std::right
+				<< std::setw(10) << "draws"
+				<< std::setw(10) << "VAO"
+				<< std::setw(12) << "ms"
+				<< "\n";
+
+			//The pyramid comes without indices, only indexed geometry is pooled
+			Pyramid pyramid;
+			std::vector<Vertex> vertices(pyramid.getVertices(), pyramid.getVertices() + pyramid.getnrOfVertices());
+			std::vector<GLuint> indices(vertices.size());
+			for (size_t i = 0; i < indices.size(); i++)
+				indices[i] = static_cast<GLuint>(i);
+
+			for (int pooled = 0; pooled < 2; pooled++)
+			{
+				GeometryPool::get().setEnabled(pooled == 1);
+
+				//Every geometry a little different, so they cannot share an instanced draw
+				std::vector<Geometry*> geometries;
+				for (int i = 0; i < count; i++)
+				{
+					std::vector<Vertex> shifted = vertices;
+					shifted[0].position.y += i * 0.0001f;
+					geometries.push_back(GeometryRegistry::get().acquire(shifted.data(), static_cast<unsigned>(shifted.size()),
+						indices.data(), static_cast<unsigned>(indices.size())));
+				}
+
+				InstanceRenderer instances;
+				RenderQueue queue;
+				const double time = measure([&]()
+				{
+					queue.begin(glm::vec3(0.f), 1000.f);
+					instances.begin();
+					for (int i = 0; i < count; i++)
+						instances.add(geometries[i], &material, &diffuse, &specular,
+							glm::translate(glm::mat4(1.f), glm::vec3(i % 50 - 25.f, i / 50 - 20.f, -50.f)));
+					instances.submit(queue, &program);
+					queue.execute();
+					glFinish();
+				});
+
+				const RenderQueueStats& stats = queue.getStats();
+				std::cout << std::left << std::setw(16) << (pooled == 1 ? "pooled" : "per geometry") << std::right
+					<< std::setw(10) << stats.drawCalls
+					<< std::setw(10) << stats.vaoBinds
+					<< std::fixed << std::setprecision(3)
+					<< std::setw(12) << time
+					<< "\n";
+
+				for (auto*& i : geometries)
+					GeometryRegistry::get().release(i);
+			}
+			GeometryPool::get().setEnabled(true);
+		}
+
+		destroyContext(window);
+	}
+
+	static void importOBJ()
+	{
+		std::cout << "OBJ import (" << std::thread::hardware_concurrency() << " hardware threads)\n";
+		std::cout << std::left << std::setw(28) << "file" << std::right
+			<< std::setw(10) << "KB"
+			<< std::setw(10) << "vertices"
+			<< std::setw(12) << "loadOBJ ms"
+			<< std::setw(12) << "parse ms"
+			<< std::setw(12) << "+cache ms"
+			<< std::setw(12) << "cached ms"
+			<< std::setw(12) << "parse MB/s"
+			<< "\n";
+
+		importOBJ("OBJFiles/cube.obj");
+		importOBJ("OBJFiles/Grass_Block.obj");
+		importOBJ("OBJFiles/sphere.obj");
+
+		const int segments[] = { 128, 512, 1024 };
+		for (int i : segments)
+		{
+			const std::string fileName = "bench_sphere_" + std::to_string(i) + ".obj";
+			writeSphereOBJ(fileName.c_str(), i);
+			importOBJ(fileName.c_str());
+			std::remove(fileName.c_str());
+			std::remove(OBJImporter::getCachePath(fileName.c_str()).c_str());
+		}
+	}
+
+	static void textures()
+	{
+		GLFWwindow* window = createContext();
+		if (window == nullptr)
+			return;
+
+		std::cout << "Texture loading (ms, KB of video memory with every mip level)\n";
+		std::cout << std::left << std::setw(34) << "file" << std::right
+			<< std::setw(11) << "size"
+			<< std::setw(8) << "format"
+			<< std::setw(10) << "png"
+			<< std::setw(12) << "convert"
+			<< std::setw(10) << ".tex"
+			<< std::setw(10) << "png KB"
+			<< std::setw(10) << ".tex KB"
+			<< "\n";
+
+		textures("Images/Box.png");
+		textures("Images/Box_specular.png");
+		textures("Images/Ricardo_Kantov.png");
+		textures("Images/Ricardo_Kantov_specular.png");
+
+		destroyContext(window);
+	}
+
+	static void run()
+	{
+		importOBJ();
+		weldOBJ();
+		optimizeOBJ();
+		simplifyOBJ();
+		compactOBJ();
+		uniformSubmission();
+		multiDraw();
+		sceneTree();
+		transforms();
+		jobs();
+		lightClustering();
+		textures();
+	}
+};
@@ -0,0 +1,245 @@
+#pragma once
+#include<cmath>
+#include<cfloat>
+
+#include<glm.hpp>
+#include<vec3.hpp>
+#include<vec4.hpp>
+#include<mat4x4.hpp>
+
+#include "Vertex.h"
+
+struct AABB
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	AABB() : min(FLT_MAX), max(-FLT_MAX) {}
+
+	AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+	bool isEmpty() const { return this->min.x > this->max.x; }
+
+	glm::vec3 getCenter() const { return (this->min + this->max) * 0.5f; }
+
+	glm::vec3 getExtent() const { return (this->max - this->min) * 0.5f; }
+
+	float getSurfaceArea() const
+	{
+		const glm::vec3 size = this->max - this->min;
+		return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	void expand(const glm::vec3& point)
+	{
+		this->min = glm::min(this->min, point);
+		this->max = glm::max(this->max, point);
+	}
+
+	void expand(const AABB& box)
+	{
+		this->min = glm::min(this->min, box.min);
+		this->max = glm::max(this->max, box.max);
+	}
+
+	bool contains(const AABB& box) const
+	{
+		return this->min.x <= box.min.x && this->min.y <= box.min.y && this->min.z <= box.min.z
+			&& box.max.x <= this->max.x && box.max.y <= this->max.y && box.max.z <= this->max.z;
+	}
+
+	bool overlaps(const AABB& box) const
+	{
+		return this->min.x <= box.max.x && box.min.x <= this->max.x
+			&& this->min.y <= box.max.y && box.min.y <= this->max.y
+			&& this->min.z <= box.max.z && box.min.z <= this->max.z;
+	}
+
+	bool overlaps(const glm::vec3& center, const float radius) const
+	{
+		const glm::vec3 offset = glm::clamp(center, this->min, this->max) - center;
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+
+	//Slab test, inverseDirection is 1 / direction per axis. distance is where the ray enters the box (0 when inside)
+	bool intersectRay(const glm::vec3& origin, const glm::vec3& inverseDirection, const float maxDistance, float& distance) const
+	{
+		const glm::vec3 t0 = (this->min - origin) * inverseDirection;
+		const glm::vec3 t1 = (this->max - origin) * inverseDirection;
+		const glm::vec3 tNear = glm::min(t0, t1);
+		const glm::vec3 tFar = glm::max(t0, t1);
+
+		const float enter = std::fmax(std::fmax(tNear.x, tNear.y), std::fmax(tNear.z, 0.f));
+		const float exit = std::fmin(std::fmin(tFar.x, tFar.y), std::fmin(tFar.z, maxDistance));
+
+		distance = enter;
+		return enter <= exit;
+	}
+
+	static AABB merge(const AABB& a, const AABB& b)
+	{
+		return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+	}
+
+	//Box around the transformed box (Arvo), cheaper than transforming all 8 corners
+	AABB transform(const glm::mat4& matrix) const
+	{
+		if (this->isEmpty())
+			return *this;
+
+		const glm::vec3 center(matrix * glm::vec4(this->getCenter(), 1.f));
+		const glm::vec3 extent = this->getExtent();
+
+		glm::vec3 newExtent(0.f);
+		for (int i = 0; i < 3; i++)
+		{
+			newExtent[i] = std::fabs(matrix[0][i]) * extent.x
+				+ std::fabs(matrix[1][i]) * extent.y
+				+ std::fabs(matrix[2][i]) * extent.z;
+		}
+
+		return AABB(center - newExtent, center + newExtent);
+	}
+};
+
+struct BoundingSphere
+{
+	glm::vec3 center;
+	float radius;
+
+	BoundingSphere() : center(0.f), radius(0.f) {}
+
+	BoundingSphere(const glm::vec3& center, const float radius) : center(center), radius(radius) {}
+
+	//Radius grows with the largest axis scale of the matrix
+	BoundingSphere transform(const glm::mat4& matrix) const
+	{
+		const float scaleX = glm::dot(glm::vec3(matrix[0]), glm::vec3(matrix[0]));
+		const float scaleY = glm::dot(glm::vec3(matrix[1]), glm::vec3(matrix[1]));
+		const float scaleZ = glm::dot(glm::vec3(matrix[2]), glm::vec3(matrix[2]));
+		const float scale = std::sqrt(std::fmax(scaleX, std::fmax(scaleY, scaleZ)));
+
+		return BoundingSphere(glm::vec3(matrix * glm::vec4(this->center, 1.f)), this->radius * scale);
+	}
+};
+
+//Local bounds of a vertex array, the sphere is centered on the box
+static void computeBounds(const Vertex* vertexArray, const unsigned nrOfVertices, AABB& box, BoundingSphere& sphere)
+{
+	box = AABB();
+	for (unsigned i = 0; i < nrOfVertices; i++)
+		box.expand(vertexArray[i].position);
+
+	if (box.isEmpty())
+	{
+		box = AABB(glm::vec3(0.f), glm::vec3(0.f));
+		sphere = BoundingSphere();
+		return;
+	}
+
+	const glm::vec3 center = box.getCenter();
+	float radiusSquared = 0.f;
+	for (unsigned i = 0; i < nrOfVertices; i++)
+	{
+		const glm::vec3 offset = vertexArray[i].position - center;
+		radiusSquared = std::fmax(radiusSquared, glm::dot(offset, offset));
+	}
+
+	sphere = BoundingSphere(center, std::sqrt(radiusSquared));
+}
+
+//Six planes pointing inwards, extracted from ProjectionMatrix * ViewMatrix (Gribb/Hartmann)
+class Frustum
+{
+private:
+	glm::vec4 planes[6];
+
+public:
+	enum plane_enum { LEFT_PLANE = 0, RIGHT_PLANE, BOTTOM_PLANE, TOP_PLANE, NEAR_PLANE, FAR_PLANE };
+	enum classify_enum { OUTSIDE = 0, INTERSECTS, INSIDE };
+
+	//Every plane bit set
+	static const unsigned ALL_PLANES = 0x3F;
+
+	Frustum()
+	{
+		for (auto& i : this->planes)
+			i = glm::vec4(0.f, 0.f, 0.f, 1.f);
+	}
+
+	Frustum(const glm::mat4& ViewProjectionMatrix)
+	{
+		const glm::mat4& m = ViewProjectionMatrix;
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+			rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+		this->planes[LEFT_PLANE] = rows[3] + rows[0];
+		this->planes[RIGHT_PLANE] = rows[3] - rows[0];
+		this->planes[BOTTOM_PLANE] = rows[3] + rows[1];
+		this->planes[TOP_PLANE] = rows[3] - rows[1];
+		this->planes[NEAR_PLANE] = rows[3] + rows[2];
+		this->planes[FAR_PLANE] = rows[3] - rows[2];
+
+		for (auto& i : this->planes)
+			i = i / glm::length(glm::vec3(i));
+	}
+
+	const glm::vec4& getPlane(const int i) const { return this->planes[i]; }
+
+	//False when the box is completely behind one plane
+	bool intersects(const AABB& box) const
+	{
+		for (const auto& i : this->planes)
+		{
+			const glm::vec3 positive(
+				i.x > 0.f ? box.max.x : box.min.x,
+				i.y > 0.f ? box.max.y : box.min.y,
+				i.z > 0.f ? box.max.z : box.min.z);
+
+			if (glm::dot(glm::vec3(i), positive) + i.w < 0.f)
+				return false;
+		}
+		return true;
+	}
+
+	//Only tests the planes set in planeMask and clears the ones the box is completely in front of,
+	//so children of a box that passed a plane never test it again
+	classify_enum classify(const AABB& box, unsigned& planeMask) const
+	{
+		for (int p = 0; p < 6; p++)
+		{
+			if ((planeMask & (1u << p)) == 0)
+				continue;
+
+			const glm::vec4& i = this->planes[p];
+			const glm::vec3 normal(i);
+			const glm::vec3 positive(
+				i.x > 0.f ? box.max.x : box.min.x,
+				i.y > 0.f ? box.max.y : box.min.y,
+				i.z > 0.f ? box.max.z : box.min.z);
+			const glm::vec3 negative(
+				i.x > 0.f ? box.min.x : box.max.x,
+				i.y > 0.f ? box.min.y : box.max.y,
+				i.z > 0.f ? box.min.z : box.max.z);
+
+			if (glm::dot(normal, positive) + i.w < 0.f)
+				return OUTSIDE;
+
+			if (glm::dot(normal, negative) + i.w >= 0.f)
+				planeMask &= ~(1u << p);
+		}
+
+		return planeMask == 0 ? INSIDE : INTERSECTS;
+	}
+
+	bool intersects(const BoundingSphere& sphere) const
+	{
+		for (const auto& i : this->planes)
+		{
+			if (glm::dot(glm::vec3(i), sphere.center) + i.w < -sphere.radius)
+				return false;
+		}
+		return true;
+	}
+};
@@ -0,0 +1,486 @@
+#pragma once
+#include<iostream>
+#include<vector>
+#include<algorithm>
+
+#include<glm.hpp>
+#include<vec3.hpp>
+
+#include "Bounds.h"
+
+//Dynamic bounding volume hierarchy, one leaf per object.
+//Leaves store the object's box grown by a margin, so small movements only refit the object and leave the tree alone.
+//New leaves are placed next to the sibling that adds the least surface area (SAH) and the tree is kept balanced
+//with rotations on the way up.
+//T has to provide "const AABB& getBounds() const", leaves test against it so queries stay exact.
+template<typename T>
+class DynamicAABBTree
+{
+private:
+	static const int NULL_NODE = -1;
+
+	struct Node
+	{
+		AABB box;
+		T* userData;
+
+		//Parent while in use, next free node otherwise
+		int parent;
+		int child1;
+		int child2;
+
+		//0 for a leaf, -1 when free
+		int height;
+
+		bool isLeaf() const { return this->child1 == NULL_NODE; }
+	};
+
+	std::vector<Node> nodes;
+	int root;
+	int freeList;
+	int leaves;
+
+	float margin;
+
+	//Reused by every query
+	std::vector<int> stack;
+	std::vector<std::pair<int, unsigned>> frustumStack;
+
+	int allocateNode()
+	{
+		if (this->freeList == NULL_NODE)
+		{
+			Node node;
+			node.parent = NULL_NODE;
+			node.height = -1;
+			this->nodes.push_back(node);
+			this->freeList = static_cast<int>(this->nodes.size() - 1);
+		}
+
+		const int id = this->freeList;
+		Node& node = this->nodes[id];
+		this->freeList = node.parent;
+
+		node.parent = NULL_NODE;
+		node.child1 = NULL_NODE;
+		node.child2 = NULL_NODE;
+		node.height = 0;
+		node.userData = nullptr;
+
+		return id;
+	}
+
+	void freeNode(const int id)
+	{
+		this->nodes[id].parent = this->freeList;
+		this->nodes[id].height = -1;
+		this->freeList = id;
+	}
+
+	//Cheapest sibling by surface area: the new parent costs its area, every ancestor grows by its enlargement
+	int findSibling(const AABB& box) const
+	{
+		int index = this->root;
+		while (!this->nodes[index].isLeaf())
+		{
+			const Node& node = this->nodes[index];
+			const float nodeArea = node.box.getSurfaceArea();
+			const float combinedArea = AABB::merge(node.box, box).getSurfaceArea();
+
+			//Pairing with this node
+			const float cost = 2.f * combinedArea;
+
+			//Passed down to the children
+			const float inheritanceCost = 2.f * (combinedArea - nodeArea);
+
+			float childCost[2];
+			const int children[2] = { node.child1, node.child2 };
+			for (int i = 0; i < 2; i++)
+			{
+				const Node& child = this->nodes[children[i]];
+				const float enlarged = AABB::merge(child.box, box).getSurfaceArea();
+
+				if (child.isLeaf())
+					childCost[i] = enlarged + inheritanceCost;
+				else
+					childCost[i] = enlarged - child.box.getSurfaceArea() + inheritanceCost;
+			}
+
+			if (cost < childCost[0] && cost < childCost[1])
+				break;
+
+			index = childCost[0] < childCost[1] ? node.child1 : node.child2;
+		}
+
+		return index;
+	}
+
+	void insertLeaf(const int leaf)
+	{
+		if (this->root == NULL_NODE)
+		{
+			this->root = leaf;
+			this->nodes[leaf].parent = NULL_NODE;
+			return;
+		}
+
+		const AABB box = this->nodes[leaf].box;
+		const int sibling = this->findSibling(box);
+
+		const int oldParent = this->nodes[sibling].parent;
+		const int newParent = this->allocateNode();
+		this->nodes[newParent].parent = oldParent;
+		this->nodes[newParent].box = AABB::merge(box, this->nodes[sibling].box);
+		this->nodes[newParent].height = this->nodes[sibling].height + 1;
+		this->nodes[newParent].child1 = sibling;
+		this->nodes[newParent].child2 = leaf;
+		this->nodes[sibling].parent = newParent;
+		this->nodes[leaf].parent = newParent;
+
+		if (oldParent != NULL_NODE)
+		{
+			if (this->nodes[oldParent].child1 == sibling)
+				this->nodes[oldParent].child1 = newParent;
+			else
+				this->nodes[oldParent].child2 = newParent;
+		}
+		else
+			this->root = newParent;
+
+		this->refitAncestors(this->nodes[leaf].parent);
+	}
+
+	void removeLeaf(const int leaf)
+	{
+		if (leaf == this->root)
+		{
+			this->root = NULL_NODE;
+			return;
+		}
+
+		const int parent = this->nodes[leaf].parent;
+		const int grandParent = this->nodes[parent].parent;
+		const int sibling = this->nodes[parent].child1 == leaf ? this->nodes[parent].child2 : this->nodes[parent].child1;
+
+		if (grandParent != NULL_NODE)
+		{
+			if (this->nodes[grandParent].child1 == parent)
+				this->nodes[grandParent].child1 = sibling;
+			else
+				this->nodes[grandParent].child2 = sibling;
+
+			this->nodes[sibling].parent = grandParent;
+			this->freeNode(parent);
+
+			this->refitAncestors(grandParent);
+		}
+		else
+		{
+			this->root = sibling;
+			this->nodes[sibling].parent = NULL_NODE;
+			this->freeNode(parent);
+		}
+	}
+
+	void refitAncestors(int index)
+	{
+		while (index != NULL_NODE)
+		{
+			index = this->balance(index);
+
+			Node& node = this->nodes[index];
+			const Node& child1 = this->nodes[node.child1];
+			const Node& child2 = this->nodes[node.child2];
+
+			node.height = 1 + std::max(child1.height, child2.height);
+			node.box = AABB::merge(child1.box, child2.box);
+
+			index = node.parent;
+		}
+	}
+
+	//Promotes a grandchild when one side is more than one level deeper, returns the new root of the subtree
+	int balance(const int a)
+	{
+		Node& A = this->nodes[a];
+		if (A.isLeaf() || A.height < 2)
+			return a;
+
+		const int b = A.child1;
+		const int c = A.child2;
+		const int difference = this->nodes[c].height - this->nodes[b].height;
+
+		if (difference > 1)
+			return this->rotate(a, c, b);
+		if (difference < -1)
+			return this->rotate(a, b, c);
+
+		return a;
+	}
+
+	//Lifts the deeper child "up" into the place of a, a takes the shallower grandchild's place under it
+	int rotate(const int a, const int up, const int other)
+	{
+		Node& A = this->nodes[a];
+		Node& U = this->nodes[up];
+		const int f = U.child1;
+		const int g = U.child2;
+		Node& F = this->nodes[f];
+		Node& G = this->nodes[g];
+
+		U.child1 = a;
+		U.parent = A.parent;
+		A.parent = up;
+
+		if (U.parent != NULL_NODE)
+		{
+			if (this->nodes[U.parent].child1 == a)
+				this->nodes[U.parent].child1 = up;
+			else
+				this->nodes[U.parent].child2 = up;
+		}
+		else
+			this->root = up;
+
+		//Keep the deeper grandchild under up
+		const int keep = F.height > G.height ? f : g;
+		const int give = keep == f ? g : f;
+
+		U.child2 = keep;
+		if (A.child1 == up)
+			A.child1 = give;
+		else
+			A.child2 = give;
+		this->nodes[give].parent = a;
+
+		const Node& stays = this->nodes[other];
+		const Node& given = this->nodes[give];
+		A.box = AABB::merge(stays.box, given.box);
+		A.height = 1 + std::max(stays.height, given.height);
+
+		const Node& kept = this->nodes[keep];
+		U.box = AABB::merge(A.box, kept.box);
+		U.height = 1 + std::max(A.height, kept.height);
+
+		return up;
+	}
+
+	AABB fatten(const AABB& box) const
+	{
+		return AABB(box.min - glm::vec3(this->margin), box.max + glm::vec3(this->margin));
+	}
+
+public:
+	DynamicAABBTree(const float margin = 0.1f)
+	{
+		this->root = NULL_NODE;
+		this->freeList = NULL_NODE;
+		this->leaves = 0;
+		this->margin = margin;
+	}
+
+	~DynamicAABBTree()
+	{
+
+	}
+
+	//Accessors
+	int getLeafCount() const { return this->leaves; }
+
+	int getHeight() const { return this->root == NULL_NODE ? 0 : this->nodes[this->root].height; }
+
+	size_t getNodeCount() const { return this->nodes.size(); }
+
+	const AABB& getFatBounds(const int proxy) const { return this->nodes[proxy].box; }
+
+	T* getUserData(const int proxy) const { return this->nodes[proxy].userData; }
+
+	//Functions
+
+	//Returns the proxy id used to move and remove the object
+	int insert(T* userData)
+	{
+		const int proxy = this->allocateNode();
+		this->nodes[proxy].box = this->fatten(userData->getBounds());
+		this->nodes[proxy].userData = userData;
+
+		this->insertLeaf(proxy);
+		++this->leaves;
+
+		return proxy;
+	}
+
+	void remove(const int proxy)
+	{
+		this->removeLeaf(proxy);
+		this->freeNode(proxy);
+		--this->leaves;
+	}
+
+	//Call after the object's bounds changed, returns true when it had to be reinserted
+	bool move(const int proxy)
+	{
+		const AABB& box = this->nodes[proxy].userData->getBounds();
+		if (this->nodes[proxy].box.contains(box))
+			return false;
+
+		this->removeLeaf(proxy);
+		this->nodes[proxy].box = this->fatten(box);
+		this->insertLeaf(proxy);
+
+		return true;
+	}
+
+	//Subtrees completely outside are skipped, subtrees completely inside are taken without another test
+	void queryFrustum(const Frustum& frustum, std::vector<T*>& result)
+	{
+		if (this->root == NULL_NODE)
+			return;
+
+		this->frustumStack.clear();
+		this->frustumStack.push_back(std::make_pair(this->root, Frustum::ALL_PLANES));
+
+		while (!this->frustumStack.empty())
+		{
+			const int index = this->frustumStack.back().first;
+			unsigned planeMask = this->frustumStack.back().second;
+			this->frustumStack.pop_back();
+
+			const Node& node = this->nodes[index];
+			if (node.isLeaf())
+			{
+				if (frustum.classify(node.userData->getBounds(), planeMask) != Frustum::OUTSIDE)
+					result.push_back(node.userData);
+				continue;
+			}
+
+			switch (frustum.classify(node.box, planeMask))
+			{
+			case Frustum::OUTSIDE:
+				break;
+			case Frustum::INSIDE:
+				this->collect(index, result);
+				break;
+			default:
+				this->frustumStack.push_back(std::make_pair(node.child1, planeMask));
+				this->frustumStack.push_back(std::make_pair(node.child2, planeMask));
+				break;
+			}
+		}
+	}
+
+	//Every leaf below index
+	void collect(const int index, std::vector<T*>& result)
+	{
+		const size_t base = this->stack.size();
+		this->stack.push_back(index);
+
+		while (this->stack.size() > base)
+		{
+			const Node& node = this->nodes[this->stack.back()];
+			this->stack.pop_back();
+
+			if (node.isLeaf())
+				result.push_back(node.userData);
+			else
+			{
+				this->stack.push_back(node.child1);
+				this->stack.push_back(node.child2);
+			}
+		}
+	}
+
+	//Closest object whose bounds the ray hits within maxDistance, nullptr if none
+	T* raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance)
+	{
+		T* closest = nullptr;
+		if (this->root == NULL_NODE)
+			return closest;
+
+		const glm::vec3 inverseDirection(1.f / direction.x, 1.f / direction.y, 1.f / direction.z);
+
+		this->stack.clear();
+		this->stack.push_back(this->root);
+
+		while (!this->stack.empty())
+		{
+			const Node& node = this->nodes[this->stack.back()];
+			this->stack.pop_back();
+
+			float hit = 0.f;
+			if (!node.box.intersectRay(origin, inverseDirection, maxDistance, hit))
+				continue;
+
+			if (node.isLeaf())
+			{
+				if (node.userData->getBounds().intersectRay(origin, inverseDirection, maxDistance, hit))
+				{
+					//Shrinking the ray prunes everything behind this hit
+					maxDistance = hit;
+					distance = hit;
+					closest = node.userData;
+				}
+				continue;
+			}
+
+			//Nearer child on top, so the ray is shortened as early as possible
+			float hit1 = 0.f;
+			float hit2 = 0.f;
+			const bool first = this->nodes[node.child1].box.intersectRay(origin, inverseDirection, maxDistance, hit1);
+			const bool second = this->nodes[node.child2].box.intersectRay(origin, inverseDirection, maxDistance, hit2);
+			const int child1 = node.child1;
+			const int child2 = node.child2;
+
+			if (first && second && hit1 < hit2)
+			{
+				this->stack.push_back(child2);
+				this->stack.push_back(child1);
+			}
+			else
+			{
+				if (first)
+					this->stack.push_back(child1);
+				if (second)
+					this->stack.push_back(child2);
+			}
+		}
+
+		return closest;
+	}
+
+	void querySphere(const BoundingSphere& sphere, std::vector<T*>& result)
+	{
+		if (this->root == NULL_NODE)
+			return;
+
+		this->stack.clear();
+		this->stack.push_back(this->root);
+
+		while (!this->stack.empty())
+		{
+			const Node& node = this->nodes[this->stack.back()];
+			this->stack.pop_back();
+
+			if (!node.box.overlaps(sphere.center, sphere.radius))
+				continue;
+
+			if (node.isLeaf())
+			{
+				if (node.userData->getBounds().overlaps(sphere.center, sphere.radius))
+					result.push_back(node.userData);
+			}
+			else
+			{
+				this->stack.push_back(node.child1);
+				this->stack.push_back(node.child2);
+			}
+		}
+	}
+
+	void printStats() const
+	{
+		std::cout << "DYNAMICAABBTREE::LEAVES: " << this->leaves
+			<< " NODES: " << this->nodes.size()
+			<< " HEIGHT: " << this->getHeight() << "\n";
+	}
+};
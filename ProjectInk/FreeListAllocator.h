@@ -0,0 +1,207 @@
+#pragma once
+#include<vector>
+#include<map>
+#include<algorithm>
+#include<iterator>
+
+#include<glew.h>
+
+//Hands out ranges of a buffer that lives elsewhere, in whatever unit the owner counts in (vertices, indices).
+//Free ranges are kept sorted by offset and merged with their neighbours when a block comes back, a request
+//takes the smallest free range it fits in. Blocks are referred to by handle, so compact can move them
+//to the front and the owners only ever look their offset up again
+class FreeListAllocator
+{
+private:
+	struct Block
+	{
+		GLuint offset;
+		GLuint size;
+		bool live;
+	};
+
+	std::vector<Block> blocks;
+	std::vector<unsigned> freeHandles;
+
+	//Offset to size of every free range
+	std::map<GLuint, GLuint> freeRanges;
+
+	GLuint capacity;
+	GLuint used;
+
+	unsigned addBlock(const GLuint offset, const GLuint size)
+	{
+		Block block;
+		block.offset = offset;
+		block.size = size;
+		block.live = true;
+
+		if (this->freeHandles.empty())
+		{
+			this->blocks.push_back(block);
+			return static_cast<unsigned>(this->blocks.size() - 1);
+		}
+
+		const unsigned handle = this->freeHandles.back();
+		this->freeHandles.pop_back();
+		this->blocks[handle] = block;
+		return handle;
+	}
+
+public:
+	enum : unsigned { INVALID = 0xFFFFFFFFu };
+
+	//A block moved by compact, in the units of the allocator
+	struct Move
+	{
+		GLuint from;
+		GLuint to;
+		GLuint size;
+	};
+
+	FreeListAllocator(const GLuint capacity = 0)
+	{
+		this->capacity = capacity;
+		this->used = 0;
+		if (capacity > 0)
+			this->freeRanges[0] = capacity;
+	}
+
+	//Accessors
+	GLuint getCapacity() const { return this->capacity; }
+
+	GLuint getUsed() const { return this->used; }
+
+	GLuint getOffset(const unsigned handle) const { return this->blocks[handle].offset; }
+
+	GLuint getSize(const unsigned handle) const { return this->blocks[handle].size; }
+
+	bool isEmpty() const { return this->blocks.size() == this->freeHandles.size(); }
+
+	unsigned getFreeRangeCount() const { return static_cast<unsigned>(this->freeRanges.size()); }
+
+	//Free space between blocks, everything but the free range at the end
+	GLuint getHoleSize() const
+	{
+		GLuint free = this->capacity - this->used;
+		if (!this->freeRanges.empty())
+		{
+			const auto& last = *this->freeRanges.rbegin();
+			if (last.first + last.second == this->capacity)
+				free -= last.second;
+		}
+
+		return free;
+	}
+
+	//Functions
+
+	//INVALID when no free range is large enough, the owner grows the buffer and compacts then
+	unsigned allocate(const GLuint size)
+	{
+		if (size == 0)
+			return this->addBlock(0, 0);
+
+		auto best = this->freeRanges.end();
+		for (auto i = this->freeRanges.begin(); i != this->freeRanges.end(); ++i)
+		{
+			if (i->second >= size && (best == this->freeRanges.end() || i->second < best->second))
+			{
+				best = i;
+				if (best->second == size)
+					break;
+			}
+		}
+
+		if (best == this->freeRanges.end())
+			return INVALID;
+
+		const GLuint offset = best->first;
+		const GLuint rest = best->second - size;
+		this->freeRanges.erase(best);
+		if (rest > 0)
+			this->freeRanges[offset + size] = rest;
+
+		this->used += size;
+		return this->addBlock(offset, size);
+	}
+
+	void release(const unsigned handle)
+	{
+		Block& block = this->blocks[handle];
+		if (!block.live)
+			return;
+
+		block.live = false;
+		this->freeHandles.push_back(handle);
+		if (block.size == 0)
+			return;
+
+		this->used -= block.size;
+		GLuint offset = block.offset;
+		GLuint size = block.size;
+
+		//Merge with the free range after, then the one before
+		auto next = this->freeRanges.lower_bound(offset);
+		if (next != this->freeRanges.end() && next->first == offset + size)
+		{
+			size += next->second;
+			next = this->freeRanges.erase(next);
+		}
+		if (next != this->freeRanges.begin())
+		{
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == offset)
+			{
+				offset = previous->first;
+				size += previous->second;
+				this->freeRanges.erase(previous);
+			}
+		}
+
+		this->freeRanges[offset] = size;
+	}
+
+	//Moves every block to the front in the order they are in now and makes the rest one free range of
+	//a buffer of the new capacity. Returns what the owner has to copy, from the old buffer to a new one
+	std::vector<Move> compact(const GLuint capacity)
+	{
+		std::vector<unsigned> live;
+		for (unsigned i = 0; i < this->blocks.size(); i++)
+		{
+			if (this->blocks[i].live && this->blocks[i].size > 0)
+				live.push_back(i);
+		}
+		std::sort(live.begin(), live.end(), [this](const unsigned a, const unsigned b)
+		{
+			return this->blocks[a].offset < this->blocks[b].offset;
+		});
+
+		std::vector<Move> moves;
+		GLuint offset = 0;
+		for (unsigned i : live)
+		{
+			Block& block = this->blocks[i];
+			Move move;
+			move.from = block.offset;
+			move.to = offset;
+			move.size = block.size;
+
+			//Blocks that were next to each other are copied in one go
+			if (!moves.empty() && moves.back().from + moves.back().size == move.from && moves.back().to + moves.back().size == move.to)
+				moves.back().size += move.size;
+			else
+				moves.push_back(move);
+
+			block.offset = offset;
+			offset += block.size;
+		}
+
+		this->capacity = std::max(capacity, offset);
+		this->freeRanges.clear();
+		if (this->capacity > offset)
+			this->freeRanges[offset] = this->capacity - offset;
+
+		return moves;
+	}
+};
@@ -0,0 +1,228 @@
+#pragma once
+#include<iostream>
+#include<vector>
+
+#include<xmmintrin.h>
+#ifdef __AVX__
+#include<immintrin.h>
+#endif
+
+#include "Bounds.h"
+#include "Mesh.h"
+#include "JobSystem.h"
+
+//Visible against culled meshes of the last cull pass
+struct FrustumCullerStats
+{
+	unsigned tested;
+	unsigned visible;
+	unsigned culled;
+};
+
+//Batch frustum culling of world space boxes.
+//Boxes are kept as structure of arrays so the kernel tests 4 (SSE) or 8 (AVX) of them per plane at once.
+//A box is outside when its most positive corner is behind any plane: sum over the axes of max(n * min, n * max) + d < 0
+class FrustumCuller
+{
+private:
+	std::vector<Mesh*> meshes;
+
+	std::vector<float> minX;
+	std::vector<float> minY;
+	std::vector<float> minZ;
+	std::vector<float> maxX;
+	std::vector<float> maxY;
+	std::vector<float> maxZ;
+
+	std::vector<unsigned char> results;
+
+	FrustumCullerStats stats;
+
+	//Widest kernel, the arrays are padded to a multiple of it
+	static const size_t LANES = 8;
+
+	void cullSSE(const Frustum& frustum, const size_t first, const size_t last)
+	{
+		__m128 planes[6][4];
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4& plane = frustum.getPlane(p);
+			planes[p][0] = _mm_set1_ps(plane.x);
+			planes[p][1] = _mm_set1_ps(plane.y);
+			planes[p][2] = _mm_set1_ps(plane.z);
+			planes[p][3] = _mm_set1_ps(plane.w);
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+
+		for (size_t i = first; i < last; i += 4)
+		{
+			const __m128 x0 = _mm_loadu_ps(&this->minX[i]);
+			const __m128 y0 = _mm_loadu_ps(&this->minY[i]);
+			const __m128 z0 = _mm_loadu_ps(&this->minZ[i]);
+			const __m128 x1 = _mm_loadu_ps(&this->maxX[i]);
+			const __m128 y1 = _mm_loadu_ps(&this->maxY[i]);
+			const __m128 z1 = _mm_loadu_ps(&this->maxZ[i]);
+
+			__m128 outside = _mm_setzero_ps();
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 distance = _mm_max_ps(_mm_mul_ps(planes[p][0], x0), _mm_mul_ps(planes[p][0], x1));
+				distance = _mm_add_ps(distance, _mm_max_ps(_mm_mul_ps(planes[p][1], y0), _mm_mul_ps(planes[p][1], y1)));
+				distance = _mm_add_ps(distance, _mm_max_ps(_mm_mul_ps(planes[p][2], z0), _mm_mul_ps(planes[p][2], z1)));
+				distance = _mm_add_ps(distance, planes[p][3]);
+
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+			}
+
+			const int mask = _mm_movemask_ps(outside);
+			for (size_t j = 0; j < 4; j++)
+				this->results[i + j] = (mask >> j & 1) == 0;
+		}
+	}
+
+#ifdef __AVX__
+	void cullAVX(const Frustum& frustum, const size_t first, const size_t last)
+	{
+		__m256 planes[6][4];
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4& plane = frustum.getPlane(p);
+			planes[p][0] = _mm256_set1_ps(plane.x);
+			planes[p][1] = _mm256_set1_ps(plane.y);
+			planes[p][2] = _mm256_set1_ps(plane.z);
+			planes[p][3] = _mm256_set1_ps(plane.w);
+		}
+
+		const __m256 zero = _mm256_setzero_ps();
+
+		for (size_t i = first; i < last; i += 8)
+		{
+			const __m256 x0 = _mm256_loadu_ps(&this->minX[i]);
+			const __m256 y0 = _mm256_loadu_ps(&this->minY[i]);
+			const __m256 z0 = _mm256_loadu_ps(&this->minZ[i]);
+			const __m256 x1 = _mm256_loadu_ps(&this->maxX[i]);
+			const __m256 y1 = _mm256_loadu_ps(&this->maxY[i]);
+			const __m256 z1 = _mm256_loadu_ps(&this->maxZ[i]);
+
+			__m256 outside = _mm256_setzero_ps();
+			for (int p = 0; p < 6; p++)
+			{
+				__m256 distance = _mm256_max_ps(_mm256_mul_ps(planes[p][0], x0), _mm256_mul_ps(planes[p][0], x1));
+				distance = _mm256_add_ps(distance, _mm256_max_ps(_mm256_mul_ps(planes[p][1], y0), _mm256_mul_ps(planes[p][1], y1)));
+				distance = _mm256_add_ps(distance, _mm256_max_ps(_mm256_mul_ps(planes[p][2], z0), _mm256_mul_ps(planes[p][2], z1)));
+				distance = _mm256_add_ps(distance, planes[p][3]);
+
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, zero, _CMP_LT_OQ));
+			}
+
+			const int mask = _mm256_movemask_ps(outside);
+			for (size_t j = 0; j < 8; j++)
+				this->results[i + j] = (mask >> j & 1) == 0;
+		}
+	}
+#endif
+
+public:
+	FrustumCuller()
+	{
+		this->stats = FrustumCullerStats();
+	}
+
+	~FrustumCuller()
+	{
+
+	}
+
+	//Accessors
+	const FrustumCullerStats& getStats() const { return this->stats; }
+
+	size_t getCount() const { return this->meshes.size(); }
+
+	bool isVisible(const size_t index) const { return this->results[index] != 0; }
+
+	//Functions
+	void begin()
+	{
+		this->meshes.clear();
+		this->minX.clear();
+		this->minY.clear();
+		this->minZ.clear();
+		this->maxX.clear();
+		this->maxY.clear();
+		this->maxZ.clear();
+	}
+
+	//Expects the mesh to be updated this frame, returns its index in the results
+	size_t add(Mesh* mesh)
+	{
+		const AABB& box = mesh->getWorldBounds();
+
+		this->meshes.push_back(mesh);
+		this->minX.push_back(box.min.x);
+		this->minY.push_back(box.min.y);
+		this->minZ.push_back(box.min.z);
+		this->maxX.push_back(box.max.x);
+		this->maxY.push_back(box.max.y);
+		this->maxZ.push_back(box.max.z);
+
+		return this->meshes.size() - 1;
+	}
+
+	//Tests every mesh added since begin and flags it visible or culled, split over the job threads when given
+	void cull(const Frustum& frustum, JobSystem* jobs = nullptr)
+	{
+		const size_t count = this->minX.size();
+		const size_t padded = (count + LANES - 1) / LANES * LANES;
+
+		//Padding lanes are tested but never read back
+		this->minX.resize(padded, 0.f);
+		this->minY.resize(padded, 0.f);
+		this->minZ.resize(padded, 0.f);
+		this->maxX.resize(padded, 0.f);
+		this->maxY.resize(padded, 0.f);
+		this->maxZ.resize(padded, 0.f);
+		this->results.resize(padded);
+
+		auto kernel = [&](const size_t first, const size_t last)
+		{
+#ifdef __AVX__
+			this->cullAVX(frustum, first * LANES, last * LANES);
+#else
+			this->cullSSE(frustum, first * LANES, last * LANES);
+#endif
+		};
+
+		if (jobs != nullptr)
+			jobs->parallelFor(padded / LANES, kernel, 64);
+		else
+			kernel(0, padded / LANES);
+
+		this->minX.resize(count);
+		this->minY.resize(count);
+		this->minZ.resize(count);
+		this->maxX.resize(count);
+		this->maxY.resize(count);
+		this->maxZ.resize(count);
+		this->results.resize(count);
+
+		this->stats = FrustumCullerStats();
+		this->stats.tested = static_cast<unsigned>(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			if (this->results[i])
+				++this->stats.visible;
+		}
+		this->stats.culled = this->stats.tested - this->stats.visible;
+
+		for (size_t i = 0; i < count; i++)
+			this->meshes[i]->setVisible(this->results[i] != 0);
+	}
+
+	void printStats() const
+	{
+		std::cout << "FRUSTUMCULLER::TESTED: " << this->stats.tested
+			<< " VISIBLE: " << this->stats.visible
+			<< " CULLED: " << this->stats.culled << "\n";
+	}
+};
@@ -0,0 +1,548 @@
+#pragma once
+#include<iostream>
+#include<vector>
+#include<unordered_map>
+#include<cstdint>
+
+#include<glew.h>
+
+//GL work issued during one frame. The redundant counters are calls that set state to the value it already had
+struct GLFrameStats
+{
+	//A multi draw counts once, its commands are counted apart
+	unsigned draws;
+	unsigned indirectCommands;
+	unsigned instances;
+	unsigned dispatches;
+	uint64_t triangles;
+
+	unsigned programBinds;
+	unsigned vaoBinds;
+	unsigned textureBinds;
+	unsigned uniformUploads;
+	unsigned bufferUploads;
+	uint64_t bufferBytes;
+
+	unsigned redundantProgramBinds;
+	unsigned redundantVaoBinds;
+	unsigned redundantTextureBinds;
+	unsigned redundantUniformUploads;
+};
+
+//Sits between the engine and GLEW: the GL entry points below are redefined to these wrappers,
+//which count the call, compare it against a shadow copy of the bound state and forward it.
+//It has to be included after glew.h and before any code that should be measured, define
+//GL_INTERCEPT_DISABLED to call GL directly again.
+//The shadow state is only right as long as every call goes through here, so it assumes a single context.
+class GLInterceptor
+{
+private:
+	GLFrameStats current;
+	GLFrameStats last;
+	unsigned frames;
+
+	//Shadow state
+	GLuint program;
+	GLuint vao;
+	GLuint activeUnit;
+	std::unordered_map<uint64_t, GLuint> textures;
+	std::unordered_map<uint64_t, uint64_t> uniforms;
+
+	GLInterceptor()
+	{
+		this->current = GLFrameStats();
+		this->last = GLFrameStats();
+		this->frames = 0;
+
+		this->program = 0;
+		this->vao = 0;
+		this->activeUnit = 0;
+	}
+
+	~GLInterceptor()
+	{
+
+	}
+
+	GLInterceptor(const GLInterceptor&) = delete;
+	GLInterceptor& operator=(const GLInterceptor&) = delete;
+
+	static uint64_t hash(const void* data, const size_t size, uint64_t seed = 14695981039346656037ull)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			seed ^= bytes[i];
+			seed *= 1099511628211ull;
+		}
+		return seed;
+	}
+
+	static uint64_t triangles(const GLenum mode, const GLsizei count)
+	{
+		switch (mode)
+		{
+		case GL_TRIANGLES:
+			return static_cast<uint64_t>(count / 3);
+		case GL_TRIANGLE_STRIP:
+		case GL_TRIANGLE_FAN:
+			return count > 2 ? static_cast<uint64_t>(count - 2) : 0;
+		default:
+			return 0;
+		}
+	}
+
+	void draw(const GLenum mode, const GLsizei count, const GLsizei instances)
+	{
+		++this->current.draws;
+		this->current.instances += static_cast<unsigned>(instances);
+		this->current.triangles += triangles(mode, count) * static_cast<uint64_t>(instances);
+	}
+
+	//Location -1 is ignored by GL, so writing it is as wasted as writing the same value twice.
+	//A transposed matrix upload of the same floats is a different value, the flag goes into the hash
+	void uniform(const GLuint program, const GLint location, const void* data, const size_t size, const GLboolean transpose = GL_FALSE)
+	{
+		++this->current.uniformUploads;
+
+		if (location < 0)
+		{
+			++this->current.redundantUniformUploads;
+			return;
+		}
+
+		const uint64_t key = static_cast<uint64_t>(program) << 32 | static_cast<uint32_t>(location);
+		const uint64_t value = hash(data, size, hash(&transpose, sizeof(transpose)));
+
+		auto found = this->uniforms.find(key);
+		if (found != this->uniforms.end() && found->second == value)
+			++this->current.redundantUniformUploads;
+		else
+			this->uniforms[key] = value;
+	}
+
+	//Linking or deleting a program resets its uniforms
+	void forgetUniforms(const GLuint program)
+	{
+		for (auto i = this->uniforms.begin(); i != this->uniforms.end();)
+		{
+			if (static_cast<GLuint>(i->first >> 32) == program)
+				i = this->uniforms.erase(i);
+			else
+				++i;
+		}
+	}
+
+	void bufferUpload(const GLsizeiptr size)
+	{
+		++this->current.bufferUploads;
+		this->current.bufferBytes += static_cast<uint64_t>(size);
+	}
+
+public:
+	static GLInterceptor& get()
+	{
+		static GLInterceptor instance;
+		return instance;
+	}
+
+	//Accessors
+
+	//Counters of the last finished frame
+	const GLFrameStats& getFrameStats() const { return this->last; }
+
+	//Counters of the frame still being recorded
+	const GLFrameStats& getCurrentStats() const { return this->current; }
+
+	unsigned getFrameCount() const { return this->frames; }
+
+	//Functions
+
+	//Work of one command of a multi draw, the wrapper only sees the call since the commands are in a buffer
+	void indirectCommand(const GLenum mode, const GLsizei count, const GLsizei instances)
+	{
+		++this->current.indirectCommands;
+		this->current.instances += static_cast<unsigned>(instances);
+		this->current.triangles += triangles(mode, count) * static_cast<uint64_t>(instances);
+	}
+
+	void endFrame()
+	{
+		this->last = this->current;
+		this->current = GLFrameStats();
+		++this->frames;
+	}
+
+	void printStats() const
+	{
+		std::cout << "GLINTERCEPTOR::DRAWS: " << this->last.draws
+			<< " INDIRECT_COMMANDS: " << this->last.indirectCommands
+			<< " DISPATCHES: " << this->last.dispatches
+			<< " INSTANCES: " << this->last.instances
+			<< " TRIANGLES: " << this->last.triangles
+			<< " PROGRAM: " << this->last.programBinds << "/" << this->last.redundantProgramBinds
+			<< " VAO: " << this->last.vaoBinds << "/" << this->last.redundantVaoBinds
+			<< " TEXTURE: " << this->last.textureBinds << "/" << this->last.redundantTextureBinds
+			<< " UNIFORM: " << this->last.uniformUploads << "/" << this->last.redundantUniformUploads
+			<< " (calls/redundant)"
+			<< " BUFFER_UPLOADS: " << this->last.bufferUploads << " (" << this->last.bufferBytes << " bytes)\n";
+	}
+
+	//Wrappers
+	static void drawArrays(GLenum mode, GLint first, GLsizei count)
+	{
+		get().draw(mode, count, 1);
+		glDrawArrays(mode, first, count);
+	}
+
+	static void drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+	{
+		get().draw(mode, count, 1);
+		glDrawElements(mode, count, type, indices);
+	}
+
+	static void drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances)
+	{
+		get().draw(mode, count, instances);
+		glDrawArraysInstanced(mode, first, count, instances);
+	}
+
+	static void drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances)
+	{
+		get().draw(mode, count, instances);
+		glDrawElementsInstanced(mode, count, type, indices, instances);
+	}
+
+	static void drawArraysInstancedBaseInstance(GLenum mode, GLint first, GLsizei count, GLsizei instances, GLuint baseInstance)
+	{
+		get().draw(mode, count, instances);
+		glDrawArraysInstancedBaseInstance(mode, first, count, instances, baseInstance);
+	}
+
+	static void drawElementsInstancedBaseInstance(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances, GLuint baseInstance)
+	{
+		get().draw(mode, count, instances);
+		glDrawElementsInstancedBaseInstance(mode, count, type, indices, instances, baseInstance);
+	}
+
+	static void drawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint baseVertex)
+	{
+		get().draw(mode, count, 1);
+		glDrawElementsBaseVertex(mode, count, type, indices, baseVertex);
+	}
+
+	static void drawElementsInstancedBaseVertexBaseInstance(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances,
+		GLint baseVertex, GLuint baseInstance)
+	{
+		get().draw(mode, count, instances);
+		glDrawElementsInstancedBaseVertexBaseInstance(mode, count, type, indices, instances, baseVertex, baseInstance);
+	}
+
+	//Instances and triangles come from indirectCommand
+	static void multiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride)
+	{
+		++get().current.draws;
+		glMultiDrawElementsIndirect(mode, type, indirect, drawCount, stride);
+	}
+
+	static void multiDrawArraysIndirect(GLenum mode, const void* indirect, GLsizei drawCount, GLsizei stride)
+	{
+		++get().current.draws;
+		glMultiDrawArraysIndirect(mode, indirect, drawCount, stride);
+	}
+
+	//The draw count is read from a buffer, see GPUCuller. Core in 4.6, the ARB versions are the same call
+	static void multiDrawElementsIndirectCount(GLenum mode, GLenum type, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride)
+	{
+		++get().current.draws;
+		glMultiDrawElementsIndirectCount(mode, type, indirect, drawCount, maxDrawCount, stride);
+	}
+
+	static void multiDrawElementsIndirectCountARB(GLenum mode, GLenum type, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride)
+	{
+		++get().current.draws;
+		glMultiDrawElementsIndirectCountARB(mode, type, indirect, drawCount, maxDrawCount, stride);
+	}
+
+	static void multiDrawArraysIndirectCount(GLenum mode, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride)
+	{
+		++get().current.draws;
+		glMultiDrawArraysIndirectCount(mode, indirect, drawCount, maxDrawCount, stride);
+	}
+
+	static void multiDrawArraysIndirectCountARB(GLenum mode, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride)
+	{
+		++get().current.draws;
+		glMultiDrawArraysIndirectCountARB(mode, indirect, drawCount, maxDrawCount, stride);
+	}
+
+	static void dispatchCompute(GLuint groupsX, GLuint groupsY, GLuint groupsZ)
+	{
+		++get().current.dispatches;
+		glDispatchCompute(groupsX, groupsY, groupsZ);
+	}
+
+	static void useProgram(GLuint program)
+	{
+		GLInterceptor& self = get();
+		++self.current.programBinds;
+		if (self.program == program)
+			++self.current.redundantProgramBinds;
+		self.program = program;
+
+		glUseProgram(program);
+	}
+
+	static void linkProgram(GLuint program)
+	{
+		get().forgetUniforms(program);
+		glLinkProgram(program);
+	}
+
+	static void deleteProgram(GLuint program)
+	{
+		get().forgetUniforms(program);
+		glDeleteProgram(program);
+	}
+
+	static void bindVertexArray(GLuint array)
+	{
+		GLInterceptor& self = get();
+		++self.current.vaoBinds;
+		if (self.vao == array)
+			++self.current.redundantVaoBinds;
+		self.vao = array;
+
+		glBindVertexArray(array);
+	}
+
+	static void deleteVertexArrays(GLsizei n, const GLuint* arrays)
+	{
+		GLInterceptor& self = get();
+		for (GLsizei i = 0; i < n; i++)
+		{
+			if (arrays[i] == self.vao)
+				self.vao = 0;
+		}
+
+		glDeleteVertexArrays(n, arrays);
+	}
+
+	static void activeTexture(GLenum texture)
+	{
+		if (texture >= GL_TEXTURE0)
+			get().activeUnit = texture - GL_TEXTURE0;
+
+		glActiveTexture(texture);
+	}
+
+	static void bindTexture(GLenum target, GLuint texture)
+	{
+		GLInterceptor& self = get();
+		++self.current.textureBinds;
+
+		GLuint& bound = self.textures[static_cast<uint64_t>(self.activeUnit) << 32 | target];
+		if (bound == texture)
+			++self.current.redundantTextureBinds;
+		bound = texture;
+
+		glBindTexture(target, texture);
+	}
+
+	static void deleteTextures(GLsizei n, const GLuint* textures)
+	{
+		GLInterceptor& self = get();
+		for (auto& i : self.textures)
+		{
+			for (GLsizei j = 0; j < n; j++)
+			{
+				if (i.second == textures[j])
+					i.second = 0;
+			}
+		}
+
+		glDeleteTextures(n, textures);
+	}
+
+	static void uniform1i(GLint location, GLint v0)
+	{
+		get().uniform(get().program, location, &v0, sizeof(v0));
+		glUniform1i(location, v0);
+	}
+
+	static void uniform1f(GLint location, GLfloat v0)
+	{
+		get().uniform(get().program, location, &v0, sizeof(v0));
+		glUniform1f(location, v0);
+	}
+
+	static void uniform2fv(GLint location, GLsizei count, const GLfloat* value)
+	{
+		get().uniform(get().program, location, value, sizeof(GLfloat) * 2 * count);
+		glUniform2fv(location, count, value);
+	}
+
+	static void uniform3fv(GLint location, GLsizei count, const GLfloat* value)
+	{
+		get().uniform(get().program, location, value, sizeof(GLfloat) * 3 * count);
+		glUniform3fv(location, count, value);
+	}
+
+	static void uniform4fv(GLint location, GLsizei count, const GLfloat* value)
+	{
+		get().uniform(get().program, location, value, sizeof(GLfloat) * 4 * count);
+		glUniform4fv(location, count, value);
+	}
+
+	static void uniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+	{
+		get().uniform(get().program, location, value, sizeof(GLfloat) * 9 * count, transpose);
+
+		glUniformMatrix3fv(location, count, transpose, value);
+	}
+
+	static void uniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+	{
+		get().uniform(get().program, location, value, sizeof(GLfloat) * 16 * count, transpose);
+
+		glUniformMatrix4fv(location, count, transpose, value);
+	}
+
+	static void programUniform1i(GLuint program, GLint location, GLint v0)
+	{
+		get().uniform(program, location, &v0, sizeof(v0));
+		glProgramUniform1i(program, location, v0);
+	}
+
+	static void programUniform1f(GLuint program, GLint location, GLfloat v0)
+	{
+		get().uniform(program, location, &v0, sizeof(v0));
+		glProgramUniform1f(program, location, v0);
+	}
+
+	static void programUniform3fv(GLuint program, GLint location, GLsizei count, const GLfloat* value)
+	{
+		get().uniform(program, location, value, sizeof(GLfloat) * 3 * count);
+		glProgramUniform3fv(program, location, count, value);
+	}
+
+	static void programUniform4fv(GLuint program, GLint location, GLsizei count, const GLfloat* value)
+	{
+		get().uniform(program, location, value, sizeof(GLfloat) * 4 * count);
+		glProgramUniform4fv(program, location, count, value);
+	}
+
+	static void programUniformMatrix4fv(GLuint program, GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+	{
+		get().uniform(program, location, value, sizeof(GLfloat) * 16 * count, transpose);
+
+		glProgramUniformMatrix4fv(program, location, count, transpose, value);
+	}
+
+	static void bufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+	{
+		get().bufferUpload(size);
+		glBufferData(target, size, data, usage);
+	}
+
+	static void bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+	{
+		get().bufferUpload(size);
+		glBufferSubData(target, offset, size, data);
+	}
+
+	static void namedBufferData(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage)
+	{
+		get().bufferUpload(size);
+		glNamedBufferData(buffer, size, data, usage);
+	}
+
+	static void namedBufferSubData(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data)
+	{
+		get().bufferUpload(size);
+		glNamedBufferSubData(buffer, offset, size, data);
+	}
+};
+
+//Everything included after this point calls the wrappers
+#ifndef GL_INTERCEPT_DISABLED
+#undef glDrawArrays
+#undef glDrawElements
+#undef glDrawArraysInstanced
+#undef glDrawElementsInstanced
+#undef glDrawArraysInstancedBaseInstance
+#undef glDrawElementsInstancedBaseInstance
+#undef glDrawElementsBaseVertex
+#undef glDrawElementsInstancedBaseVertexBaseInstance
+#undef glMultiDrawElementsIndirect
+#undef glMultiDrawArraysIndirect
+#undef glMultiDrawElementsIndirectCount
+#undef glMultiDrawElementsIndirectCountARB
+#undef glMultiDrawArraysIndirectCount
+#undef glMultiDrawArraysIndirectCountARB
+#undef glDispatchCompute
+#undef glUseProgram
+#undef glLinkProgram
+#undef glDeleteProgram
+#undef glBindVertexArray
+#undef glDeleteVertexArrays
+#undef glActiveTexture
+#undef glBindTexture
+#undef glDeleteTextures
+#undef glUniform1i
+#undef glUniform1f
+#undef glUniform2fv
+#undef glUniform3fv
+#undef glUniform4fv
+#undef glUniformMatrix3fv
+#undef glUniformMatrix4fv
+#undef glProgramUniform1i
+#undef glProgramUniform1f
+#undef glProgramUniform3fv
+#undef glProgramUniform4fv
+#undef glProgramUniformMatrix4fv
+#undef glBufferData
+#undef glBufferSubData
+#undef glNamedBufferData
+#undef glNamedBufferSubData
+
+#define glDrawArrays GLInterceptor::drawArrays
+#define glDrawElements GLInterceptor::drawElements
+#define glDrawArraysInstanced GLInterceptor::drawArraysInstanced
+#define glDrawElementsInstanced GLInterceptor::drawElementsInstanced
+#define glDrawArraysInstancedBaseInstance GLInterceptor::drawArraysInstancedBaseInstance
+#define glDrawElementsInstancedBaseInstance GLInterceptor::drawElementsInstancedBaseInstance
+#define glDrawElementsBaseVertex GLInterceptor::drawElementsBaseVertex
+#define glDrawElementsInstancedBaseVertexBaseInstance GLInterceptor::drawElementsInstancedBaseVertexBaseInstance
+#define glMultiDrawElementsIndirect GLInterceptor::multiDrawElementsIndirect
+#define glMultiDrawArraysIndirect GLInterceptor::multiDrawArraysIndirect
+#define glMultiDrawElementsIndirectCount GLInterceptor::multiDrawElementsIndirectCount
+#define glMultiDrawElementsIndirectCountARB GLInterceptor::multiDrawElementsIndirectCountARB
+#define glMultiDrawArraysIndirectCount GLInterceptor::multiDrawArraysIndirectCount
+#define glMultiDrawArraysIndirectCountARB GLInterceptor::multiDrawArraysIndirectCountARB
+#define glDispatchCompute GLInterceptor::dispatchCompute
+#define glUseProgram GLInterceptor::useProgram
+#define glLinkProgram GLInterceptor::linkProgram
+#define glDeleteProgram GLInterceptor::deleteProgram
+#define glBindVertexArray GLInterceptor::bindVertexArray
+#define glDeleteVertexArrays GLInterceptor::deleteVertexArrays
+#define glActiveTexture GLInterceptor::activeTexture
+#define glBindTexture GLInterceptor::bindTexture
+#define glDeleteTextures GLInterceptor::deleteTextures
+#define glUniform1i GLInterceptor::uniform1i
+#define glUniform1f GLInterceptor::uniform1f
+#define glUniform2fv GLInterceptor::uniform2fv
+#define glUniform3fv GLInterceptor::uniform3fv
+#define glUniform4fv GLInterceptor::uniform4fv
+#define glUniformMatrix3fv GLInterceptor::uniformMatrix3fv
+#define glUniformMatrix4fv GLInterceptor::uniformMatrix4fv
+#define glProgramUniform1i GLInterceptor::programUniform1i
+#define glProgramUniform1f GLInterceptor::programUniform1f
+#define glProgramUniform3fv GLInterceptor::programUniform3fv
+#define glProgramUniform4fv GLInterceptor::programUniform4fv
+#define glProgramUniformMatrix4fv GLInterceptor::programUniformMatrix4fv
+#define glBufferData GLInterceptor::bufferData
+#define glBufferSubData GLInterceptor::bufferSubData
+#define glNamedBufferData GLInterceptor::namedBufferData
+#define glNamedBufferSubData GLInterceptor::namedBufferSubData
+#endif
@@ -0,0 +1,731 @@
+#pragma once
+#include<iostream>
+#include<fstream>
+#include<sstream>
+#include<string>
+#include<vector>
+#include<map>
+#include<tuple>
+#include<algorithm>
+#include<cstring>
+
+#include<glew.h>
+#include "GLInterceptor.h"
+
+#include<glm.hpp>
+#include<mat4x4.hpp>
+#include<gtc/type_ptr.hpp>
+
+#include "Geometry.h"
+#include "Texture.h"
+#include "TextureArray.h"
+#include "Material.h"
+#include "MaterialTable.h"
+#include "UniformCache.h"
+#include "Bounds.h"
+
+//Everything cull_compute.glsl knows about one object, see ObjectData there
+struct GPUObject
+{
+	glm::mat4 ModelMatrix;
+	glm::ivec4 indices;
+	glm::vec4 boundsMin;
+	glm::vec4 boundsMax;
+
+	//x is the command the object is drawn by, -1 once removed
+	glm::ivec4 command;
+};
+
+//One command as GL reads it followed by where its instances start and the group it is drawn in.
+//Commands without indices are DrawArraysIndirectCommand, their base instance sits in draw.baseVertex
+struct GPUDrawCommand
+{
+	DrawElementsIndirectCommand draw;
+	GLuint instanceOffset;
+	GLuint group;
+	GLuint groupFirst;
+};
+
+struct GPUCullerStats
+{
+	unsigned objects;
+	unsigned groups;
+	unsigned commands;
+	unsigned layoutBuilds;
+
+	//Commands drawn, from the draw counts of a cull a frame or more ago
+	unsigned draws;
+
+	//Object data uploaded by the last cull
+	size_t uploadedBytes;
+};
+
+//Culls and draws objects without the CPU looking at them every frame. Objects are registered once with their
+//draw matrix and world bounds and only uploaded again when they change. Every frame cull_compute.glsl tests
+//all of them against the frustum and the depth pyramid of the last frame and writes the visible ones as
+//instances of their geometry's command, compact_compute.glsl then packs the commands that got any and
+//counts them, so render draws each group (a VAO with its textures) with one glMultiDrawElementsIndirectCount.
+//Without GL 4.6 or ARB_indirect_parameters the commands are drawn as they are, empty ones included.
+//Geometry in a GeometryPool shares the VAO, so most of a scene ends up in very few groups.
+//Occlusion uses last frame's depth seen from last frame's camera: what it hid is drawn again a frame
+//after it comes into view, and every mesh is drawn at full detail, levels of detail are not selected
+class GPUCuller
+{
+private:
+	enum : GLuint { BINDING_OBJECTS = 5, BINDING_COMMANDS, BINDING_INSTANCES, BINDING_DRAW_COUNTS, BINDING_DRAWS };
+	enum : GLuint { TEXTURE_UNIT = 5, WORK_GROUP_SIZE = 64, PYRAMID_GROUP_SIZE = 8, NONE = 0xFFFFFFFFu };
+	enum indirect_count_enum { INDIRECT_COUNT_NONE = 0, INDIRECT_COUNT_ARB, INDIRECT_COUNT_CORE };
+
+	//Everything that shares a VAO, program state and textures, drawn with one call
+	struct Group
+	{
+		Geometry* geometry;
+		Material* material;
+		Texture* diffuseTex;
+		Texture* specularTex;
+		TextureArray* diffuseArray;
+		TextureArray* specularArray;
+
+		//A command per geometry, in this order from firstCommand on
+		std::vector<Geometry*> geometries;
+		GLuint firstCommand;
+	};
+
+	typedef std::tuple<GLuint, GLenum, Material*, Texture*, Texture*, TextureArray*, TextureArray*> GroupKey;
+
+	//Group and geometry within it of every object
+	struct Slot
+	{
+		unsigned group;
+		unsigned geometry;
+	};
+
+	GLuint cullProgram;
+	GLuint compactProgram;
+	GLuint pyramidProgram;
+	GLint planesLocation;
+	GLint pyramidViewProjectionLocation;
+	GLint objectCountLocation;
+	GLint occlusionLocation;
+	GLint commandCountLocation;
+	GLint sourceLevelLocation;
+	GLint scaleLocation;
+	indirect_count_enum indirectCount;
+
+	std::vector<GPUObject> objects;
+	std::vector<Slot> slots;
+	std::vector<Group> groups;
+	std::map<GroupKey, unsigned> groupLookup;
+	std::vector<GPUDrawCommand> commands;
+	std::vector<Geometry*> commandGeometries;
+
+	//Commands as built, copied over commandBuffer every frame to zero the instance counts
+	GLuint templateBuffer;
+	GLuint commandBuffer;
+	GLuint objectBuffer;
+	GLuint instanceBuffer;
+	GLuint drawCountBuffer;
+	GLuint drawBuffer;
+
+	//Copy of the draw counts, read once its fence passed so the CPU never waits on the GPU
+	GLuint readbackBuffer;
+	GLsync readbackFence;
+	std::vector<GLuint> drawCounts;
+
+	//Objects changed since the last upload, [first, last)
+	size_t dirtyFirst;
+	size_t dirtyLast;
+	bool layoutChanged;
+
+	//Depth pyramid, built from the depth buffer after the scene
+	GLuint depthTexture;
+	GLuint pyramidTexture;
+	int pyramidWidth;
+	int pyramidHeight;
+	GLint pyramidLevels;
+	bool pyramidValid;
+	bool occlusion;
+	glm::mat4 ViewProjectionMatrix;
+	glm::mat4 pyramidViewProjectionMatrix;
+
+	GPUCullerStats stats;
+
+	GPUCuller(const GPUCuller&) = delete;
+	GPUCuller& operator=(const GPUCuller&) = delete;
+
+	static GLuint loadProgram(const char* fileName)
+	{
+		std::ifstream in(fileName);
+		if (!in.is_open())
+		{
+			std::cout << "ERROR::GPUCULLER::COULD_NOT_OPEN_FILE: " << fileName << "\n";
+			return 0;
+		}
+
+		std::stringstream source;
+		source << in.rdbuf();
+		const std::string text = source.str();
+		const GLchar* src = text.c_str();
+
+		char infoLog[512];
+		GLint success = 0;
+
+		GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+		glShaderSource(shader, 1, &src, NULL);
+		glCompileShader(shader);
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shader, 512, NULL, infoLog);
+			std::cout << "ERROR::GPUCULLER::COULD_NOT_COMPILE_SHADER: " << fileName << "\n" << infoLog << "\n";
+			glDeleteShader(shader);
+			return 0;
+		}
+
+		GLuint program = glCreateProgram();
+		glAttachShader(program, shader);
+		glLinkProgram(program);
+		glDeleteShader(shader);
+
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(program, 512, NULL, infoLog);
+			std::cout << "ERROR::GPUCULLER::COULD_NOT_LINK_PROGRAM: " << fileName << "\n" << infoLog << "\n";
+			glDeleteProgram(program);
+			return 0;
+		}
+
+		return program;
+	}
+
+	static indirect_count_enum findIndirectCount()
+	{
+		GLint major = 0;
+		GLint minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		if (major > 4 || (major == 4 && minor >= 6))
+			return INDIRECT_COUNT_CORE;
+
+		GLint extensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+		for (GLint i = 0; i < extensions; i++)
+		{
+			const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+			if (name != nullptr && std::strcmp(name, "GL_ARB_indirect_parameters") == 0)
+				return INDIRECT_COUNT_ARB;
+		}
+
+		return INDIRECT_COUNT_NONE;
+	}
+
+	unsigned addObject(Geometry* geometry, Material* material, Texture* diffuseTex, Texture* specularTex,
+		TextureArray* diffuseArray, TextureArray* specularArray, const glm::ivec4& indices,
+		const glm::mat4& ModelMatrix, const AABB& bounds)
+	{
+		//Array groups read the material per instance, so it does not split them
+		const GroupKey key(geometry->getVAO(), geometry->getNrOfIndices() > 0 ? geometry->getIndexType() : 0,
+			diffuseArray != nullptr ? nullptr : material, diffuseTex, specularTex, diffuseArray, specularArray);
+
+		auto found = this->groupLookup.find(key);
+		if (found == this->groupLookup.end())
+		{
+			Group group;
+			group.geometry = geometry;
+			group.material = material;
+			group.diffuseTex = diffuseTex;
+			group.specularTex = specularTex;
+			group.diffuseArray = diffuseArray;
+			group.specularArray = specularArray;
+			group.firstCommand = 0;
+
+			found = this->groupLookup.insert(std::make_pair(key, static_cast<unsigned>(this->groups.size()))).first;
+			this->groups.push_back(group);
+		}
+
+		Group& group = this->groups[found->second];
+		Slot slot;
+		slot.group = found->second;
+		slot.geometry = static_cast<unsigned>(std::find(group.geometries.begin(), group.geometries.end(), geometry) - group.geometries.begin());
+		if (slot.geometry == group.geometries.size())
+			group.geometries.push_back(geometry);
+
+		GPUObject object;
+		object.indices = indices;
+		object.command = glm::ivec4(-1, 0, 0, 0);
+		this->objects.push_back(object);
+		this->slots.push_back(slot);
+		this->update(static_cast<unsigned>(this->objects.size() - 1), ModelMatrix, bounds);
+
+		//Instance ranges of every command move along
+		this->layoutChanged = true;
+		return static_cast<unsigned>(this->objects.size() - 1);
+	}
+
+	//Pooled geometry moves when its buffer is rebuilt or compacted
+	bool commandsMoved() const
+	{
+		for (size_t i = 0; i < this->commands.size(); i++)
+		{
+			const Geometry* geometry = this->commandGeometries[i];
+			if (geometry->getNrOfIndices() > 0 && (this->commands[i].draw.firstIndex != geometry->getFirstIndex()
+				|| this->commands[i].draw.baseVertex != geometry->getBaseVertex()))
+				return true;
+		}
+
+		return false;
+	}
+
+	//Commands in group order, every one followed by room for all of its objects, and every object pointed at its command
+	void buildLayout()
+	{
+		std::vector<std::vector<GLuint>> counts(this->groups.size());
+		for (size_t i = 0; i < this->groups.size(); i++)
+			counts[i].assign(this->groups[i].geometries.size(), 0);
+		for (auto& i : this->slots)
+		{
+			if (i.geometry != NONE)
+				++counts[i.group][i.geometry];
+		}
+
+		this->commands.clear();
+		this->commandGeometries.clear();
+		GLuint instance = 0;
+		for (size_t g = 0; g < this->groups.size(); g++)
+		{
+			Group& group = this->groups[g];
+			group.firstCommand = static_cast<GLuint>(this->commands.size());
+
+			for (size_t c = 0; c < group.geometries.size(); c++)
+			{
+				Geometry* geometry = group.geometries[c];
+				GPUDrawCommand command = GPUDrawCommand();
+				if (geometry->getNrOfIndices() > 0)
+				{
+					command.draw.count = geometry->getNrOfIndices();
+					command.draw.firstIndex = geometry->getFirstIndex();
+					command.draw.baseVertex = geometry->getBaseVertex();
+					command.draw.baseInstance = instance;
+				}
+				else
+				{
+					command.draw.count = geometry->getNrOfVertices();
+					command.draw.baseVertex = static_cast<GLint>(instance);
+				}
+				command.instanceOffset = instance;
+				command.group = static_cast<GLuint>(g);
+				command.groupFirst = group.firstCommand;
+
+				this->commands.push_back(command);
+				this->commandGeometries.push_back(geometry);
+				instance += counts[g][c];
+			}
+		}
+
+		for (size_t i = 0; i < this->objects.size(); i++)
+		{
+			const Slot& slot = this->slots[i];
+			this->objects[i].command.x = slot.geometry != NONE ? static_cast<GLint>(this->groups[slot.group].firstCommand + slot.geometry) : -1;
+		}
+
+		const GLsizeiptr commandBytes = this->commands.size() * sizeof(GPUDrawCommand);
+		glNamedBufferData(this->templateBuffer, commandBytes, this->commands.data(), GL_STATIC_DRAW);
+		glNamedBufferData(this->commandBuffer, commandBytes, NULL, GL_DYNAMIC_COPY);
+		glNamedBufferData(this->drawBuffer, commandBytes, NULL, GL_DYNAMIC_COPY);
+		glNamedBufferData(this->drawCountBuffer, this->groups.size() * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+		glNamedBufferData(this->readbackBuffer, this->groups.size() * sizeof(GLuint), NULL, GL_STREAM_READ);
+		this->drawCounts.resize(this->groups.size());
+		if (this->readbackFence != 0)
+		{
+			glDeleteSync(this->readbackFence);
+			this->readbackFence = 0;
+		}
+		glNamedBufferData(this->instanceBuffer, std::max<GLuint>(instance, 1) * sizeof(InstanceData), NULL, GL_DYNAMIC_COPY);
+		glNamedBufferData(this->objectBuffer, this->objects.size() * sizeof(GPUObject), this->objects.data(), GL_DYNAMIC_DRAW);
+		this->stats.uploadedBytes += this->objects.size() * sizeof(GPUObject);
+
+		this->dirtyFirst = this->objects.size();
+		this->dirtyLast = 0;
+		this->layoutChanged = false;
+		++this->stats.layoutBuilds;
+	}
+
+	//One upload spanning every changed object, cheaper than a call per object even with unchanged ones in between
+	void upload()
+	{
+		if (this->dirtyFirst >= this->dirtyLast)
+			return;
+
+		const GLsizeiptr size = (this->dirtyLast - this->dirtyFirst) * sizeof(GPUObject);
+		glNamedBufferSubData(this->objectBuffer, this->dirtyFirst * sizeof(GPUObject), size, &this->objects[this->dirtyFirst]);
+		this->stats.uploadedBytes += static_cast<size_t>(size);
+
+		this->dirtyFirst = this->objects.size();
+		this->dirtyLast = 0;
+	}
+
+	//Only once the copy finished, otherwise the last counts stay
+	void readDrawCounts()
+	{
+		if (this->readbackFence == 0)
+			return;
+
+		const GLenum result = glClientWaitSync(this->readbackFence, 0, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+			return;
+
+		glDeleteSync(this->readbackFence);
+		this->readbackFence = 0;
+
+		glGetNamedBufferSubData(this->readbackBuffer, 0, this->drawCounts.size() * sizeof(GLuint), this->drawCounts.data());
+		this->stats.draws = 0;
+		for (auto& i : this->drawCounts)
+			this->stats.draws += i;
+	}
+
+	void createPyramid(const int width, const int height)
+	{
+		glDeleteTextures(1, &this->depthTexture);
+		glDeleteTextures(1, &this->pyramidTexture);
+
+		this->pyramidWidth = width;
+		this->pyramidHeight = height;
+		this->pyramidLevels = 1;
+		while ((std::max(width, height) >> this->pyramidLevels) > 0)
+			++this->pyramidLevels;
+
+		glCreateTextures(GL_TEXTURE_2D, 1, &this->depthTexture);
+		glTextureStorage2D(this->depthTexture, 1, GL_DEPTH_COMPONENT24, width, height);
+		glTextureParameteri(this->depthTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTextureParameteri(this->depthTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glCreateTextures(GL_TEXTURE_2D, 1, &this->pyramidTexture);
+		glTextureStorage2D(this->pyramidTexture, this->pyramidLevels, GL_R32F, width, height);
+		glTextureParameteri(this->pyramidTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTextureParameteri(this->pyramidTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		this->pyramidValid = false;
+	}
+
+public:
+	GPUCuller()
+	{
+		this->cullProgram = loadProgram("cull_compute.glsl");
+		this->compactProgram = loadProgram("compact_compute.glsl");
+		this->pyramidProgram = loadProgram("depth_pyramid_compute.glsl");
+
+		this->planesLocation = glGetUniformLocation(this->cullProgram, "planes");
+		this->pyramidViewProjectionLocation = glGetUniformLocation(this->cullProgram, "pyramidViewProjection");
+		this->objectCountLocation = glGetUniformLocation(this->cullProgram, "objectCount");
+		this->occlusionLocation = glGetUniformLocation(this->cullProgram, "occlusion");
+		this->commandCountLocation = glGetUniformLocation(this->compactProgram, "commandCount");
+		this->sourceLevelLocation = glGetUniformLocation(this->pyramidProgram, "sourceLevel");
+		this->scaleLocation = glGetUniformLocation(this->pyramidProgram, "scale");
+
+		this->indirectCount = findIndirectCount();
+
+		glCreateBuffers(1, &this->templateBuffer);
+		glCreateBuffers(1, &this->commandBuffer);
+		glCreateBuffers(1, &this->objectBuffer);
+		glCreateBuffers(1, &this->instanceBuffer);
+		glCreateBuffers(1, &this->drawCountBuffer);
+		glCreateBuffers(1, &this->drawBuffer);
+		glCreateBuffers(1, &this->readbackBuffer);
+		this->readbackFence = 0;
+
+		this->dirtyFirst = 0;
+		this->dirtyLast = 0;
+		this->layoutChanged = false;
+
+		this->depthTexture = 0;
+		this->pyramidTexture = 0;
+		this->pyramidWidth = 0;
+		this->pyramidHeight = 0;
+		this->pyramidLevels = 0;
+		this->pyramidValid = false;
+		this->occlusion = true;
+		this->ViewProjectionMatrix = glm::mat4(1.f);
+		this->pyramidViewProjectionMatrix = glm::mat4(1.f);
+
+		this->stats = GPUCullerStats();
+	}
+
+	~GPUCuller()
+	{
+		glDeleteProgram(this->cullProgram);
+		glDeleteProgram(this->compactProgram);
+		glDeleteProgram(this->pyramidProgram);
+
+		glDeleteBuffers(1, &this->templateBuffer);
+		glDeleteBuffers(1, &this->commandBuffer);
+		glDeleteBuffers(1, &this->objectBuffer);
+		glDeleteBuffers(1, &this->instanceBuffer);
+		glDeleteBuffers(1, &this->drawCountBuffer);
+		glDeleteBuffers(1, &this->drawBuffer);
+		glDeleteBuffers(1, &this->readbackBuffer);
+		if (this->readbackFence != 0)
+			glDeleteSync(this->readbackFence);
+
+		glDeleteTextures(1, &this->depthTexture);
+		glDeleteTextures(1, &this->pyramidTexture);
+	}
+
+	//Accessors
+
+	//All three compute programs built
+	bool isSupported() const { return this->cullProgram != 0 && this->compactProgram != 0 && this->pyramidProgram != 0; }
+
+	//Draws only the commands that got instances, otherwise every command is drawn
+	bool usesIndirectCount() const { return this->indirectCount != INDIRECT_COUNT_NONE; }
+
+	bool usesOcclusion() const { return this->occlusion; }
+
+	size_t getObjectCount() const { return this->objects.size(); }
+
+	const GPUCullerStats& getStats() const { return this->stats; }
+
+	//Instances written by the last cull. Reads the commands back, so it waits for the GPU: for benchmarks,
+	//the stats only use the draw counts
+	unsigned readVisibleCount() const
+	{
+		if (this->commands.empty())
+			return 0;
+
+		std::vector<GPUDrawCommand> culled(this->commands.size());
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glGetNamedBufferSubData(this->commandBuffer, 0, culled.size() * sizeof(GPUDrawCommand), culled.data());
+
+		unsigned visible = 0;
+		for (auto& i : culled)
+			visible += i.draw.instanceCount;
+
+		return visible;
+	}
+
+	//Modifiers
+
+	//Frustum culling only while off
+	void setOcclusion(const bool occlusion) { this->occlusion = occlusion; }
+
+	//Functions
+
+	//Returns the handle update and remove take. Geometry without indices is drawn with glMultiDrawArraysIndirect
+	unsigned add(Geometry* geometry, Material* material, Texture* diffuseTex, Texture* specularTex,
+		const glm::mat4& ModelMatrix, const AABB& bounds)
+	{
+		return this->addObject(geometry, material, diffuseTex, specularTex, nullptr, nullptr,
+			glm::ivec4(0, 0, material->getIndex(), 0), ModelMatrix, bounds);
+	}
+
+	unsigned add(Geometry* geometry, Material* material, const TextureLayer& diffuse, const TextureLayer& specular,
+		const glm::mat4& ModelMatrix, const AABB& bounds)
+	{
+		return this->addObject(geometry, material, nullptr, nullptr, diffuse.array, specular.array,
+			glm::ivec4(diffuse.layer, specular.layer, material->getIndex(), 0), ModelMatrix, bounds);
+	}
+
+	//Only needed when the object moved, it is uploaded with the next cull
+	void update(const unsigned handle, const glm::mat4& ModelMatrix, const AABB& bounds)
+	{
+		GPUObject& object = this->objects[handle];
+		object.ModelMatrix = ModelMatrix;
+		object.boundsMin = glm::vec4(bounds.min, 1.f);
+		object.boundsMax = glm::vec4(bounds.max, 1.f);
+
+		this->dirtyFirst = std::min<size_t>(this->dirtyFirst, handle);
+		this->dirtyLast = std::max<size_t>(this->dirtyLast, handle + 1);
+	}
+
+	//The handle stays taken, the object is no longer drawn
+	void remove(const unsigned handle)
+	{
+		this->slots[handle].geometry = NONE;
+		this->layoutChanged = true;
+	}
+
+	//Tests every object on the GPU and writes the commands render draws. Call it before render
+	void cull(const glm::mat4& ViewProjectionMatrix)
+	{
+		this->ViewProjectionMatrix = ViewProjectionMatrix;
+		this->stats.uploadedBytes = 0;
+		if (!this->isSupported() || this->objects.empty())
+			return;
+
+		this->readDrawCounts();
+		if (this->layoutChanged || this->commandsMoved())
+			this->buildLayout();
+		this->upload();
+
+		this->stats.objects = static_cast<unsigned>(this->objects.size());
+		this->stats.groups = static_cast<unsigned>(this->groups.size());
+		this->stats.commands = static_cast<unsigned>(this->commands.size());
+
+		const Frustum frustum(ViewProjectionMatrix);
+		glm::vec4 planes[6];
+		for (int i = 0; i < 6; i++)
+			planes[i] = frustum.getPlane(i);
+
+		glProgramUniform4fv(this->cullProgram, this->planesLocation, 6, &planes[0].x);
+		glProgramUniformMatrix4fv(this->cullProgram, this->pyramidViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(this->pyramidViewProjectionMatrix));
+		glProgramUniform1i(this->cullProgram, this->objectCountLocation, static_cast<GLint>(this->objects.size()));
+		glProgramUniform1i(this->cullProgram, this->occlusionLocation, this->occlusion && this->pyramidValid ? 1 : 0);
+
+		//Instance counts back to zero, the rest of every command stays as built
+		glCopyNamedBufferSubData(this->templateBuffer, this->commandBuffer, 0, 0, this->commands.size() * sizeof(GPUDrawCommand));
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_OBJECTS, this->objectBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_COMMANDS, this->commandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_INSTANCES, this->instanceBuffer);
+
+		//Units 0-4 belong to the scene, leave unit 0 active for everyone else
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D, this->pyramidTexture);
+		glActiveTexture(GL_TEXTURE0);
+
+		glUseProgram(this->cullProgram);
+		glDispatchCompute((static_cast<GLuint>(this->objects.size()) + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE, 1, 1);
+
+		if (this->usesIndirectCount())
+		{
+			glClearNamedBufferData(this->drawCountBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_DRAW_COUNTS, this->drawCountBuffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_DRAWS, this->drawBuffer);
+
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			glProgramUniform1i(this->compactProgram, this->commandCountLocation, static_cast<GLint>(this->commands.size()));
+			glUseProgram(this->compactProgram);
+			glDispatchCompute((static_cast<GLuint>(this->commands.size()) + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE, 1, 1);
+		}
+
+		//Without counts every command is drawn
+		const bool readback = this->usesIndirectCount() && this->readbackFence == 0;
+		if (!this->usesIndirectCount())
+			this->stats.draws = static_cast<unsigned>(this->commands.size());
+
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | (readback ? GL_BUFFER_UPDATE_BARRIER_BIT : 0));
+
+		//A few bytes per group, read by a later cull once the GPU got here
+		if (readback)
+		{
+			glCopyNamedBufferSubData(this->drawCountBuffer, this->readbackBuffer, 0, 0, this->drawCounts.size() * sizeof(GLuint));
+			this->readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+	}
+
+	//A multi draw per group of what the last cull kept, with a program reading vertex_instanced.glsl's attributes
+	void render(UniformCache* program)
+	{
+		if (!this->isSupported() || this->commands.empty())
+			return;
+
+		//Only uploads when a material changed since the last frame
+		MaterialTable::get().upload();
+
+		program->getShader()->use();
+
+		const bool count = this->usesIndirectCount();
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, count ? this->drawBuffer : this->commandBuffer);
+		if (count)
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, this->drawCountBuffer);
+
+		for (size_t g = 0; g < this->groups.size(); g++)
+		{
+			const Group& group = this->groups[g];
+
+			//Plain textures on units 0 and 1, arrays on 2 and 3, like RenderQueue
+			if (group.diffuseArray != nullptr)
+			{
+				group.diffuseArray->bind(2);
+				group.specularArray->bind(3);
+			}
+			else
+			{
+				group.diffuseTex->bind(0);
+				group.specularTex->bind(1);
+			}
+
+			group.geometry->setInstanceBuffer(this->instanceBuffer);
+			program->getDrawData().ModelMatrix = glm::mat4(1.f);
+			program->getDrawData().indices = glm::ivec4(0, 0, group.material->getIndex(), 0);
+			program->setMat4fv(glm::mat4(1.f), UNIFORM_MODEL_MATRIX);
+			program->commitDrawData();
+
+			glBindVertexArray(group.geometry->getVAO());
+
+			const GLvoid* indirect = reinterpret_cast<const GLvoid*>(group.firstCommand * sizeof(GPUDrawCommand));
+			const GLintptr drawCount = static_cast<GLintptr>(g * sizeof(GLuint));
+			const GLsizei maxDrawCount = static_cast<GLsizei>(group.geometries.size());
+			const GLsizei stride = sizeof(GPUDrawCommand);
+
+			if (group.geometry->getNrOfIndices() > 0)
+			{
+				const GLenum type = group.geometry->getIndexType();
+				if (this->indirectCount == INDIRECT_COUNT_CORE)
+					glMultiDrawElementsIndirectCount(GL_TRIANGLES, type, indirect, drawCount, maxDrawCount, stride);
+				else if (this->indirectCount == INDIRECT_COUNT_ARB)
+					glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, type, indirect, drawCount, maxDrawCount, stride);
+				else
+					glMultiDrawElementsIndirect(GL_TRIANGLES, type, indirect, maxDrawCount, stride);
+			}
+			else
+			{
+				if (this->indirectCount == INDIRECT_COUNT_CORE)
+					glMultiDrawArraysIndirectCount(GL_TRIANGLES, indirect, drawCount, maxDrawCount, stride);
+				else if (this->indirectCount == INDIRECT_COUNT_ARB)
+					glMultiDrawArraysIndirectCountARB(GL_TRIANGLES, indirect, drawCount, maxDrawCount, stride);
+				else
+					glMultiDrawArraysIndirect(GL_TRIANGLES, indirect, maxDrawCount, stride);
+			}
+		}
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		if (count)
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+	}
+
+	//After the scene, from the depth buffer of the bound read framebuffer. The next cull tests against it
+	void buildDepthPyramid(const int width, const int height)
+	{
+		if (!this->isSupported() || width <= 0 || height <= 0)
+			return;
+
+		if (width != this->pyramidWidth || height != this->pyramidHeight)
+			this->createPyramid(width, height);
+
+		glCopyTextureSubImage2D(this->depthTexture, 0, 0, 0, 0, 0, width, height);
+
+		glUseProgram(this->pyramidProgram);
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+		for (GLint level = 0; level < this->pyramidLevels; level++)
+		{
+			glBindTexture(GL_TEXTURE_2D, level == 0 ? this->depthTexture : this->pyramidTexture);
+			glBindImageTexture(0, this->pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+			glProgramUniform1i(this->pyramidProgram, this->sourceLevelLocation, level == 0 ? 0 : level - 1);
+			glProgramUniform1i(this->pyramidProgram, this->scaleLocation, level == 0 ? 1 : 2);
+
+			const GLuint levelWidth = static_cast<GLuint>(std::max(width >> level, 1));
+			const GLuint levelHeight = static_cast<GLuint>(std::max(height >> level, 1));
+			glDispatchCompute((levelWidth + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, (levelHeight + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		}
+		glActiveTexture(GL_TEXTURE0);
+
+		this->pyramidViewProjectionMatrix = this->ViewProjectionMatrix;
+		this->pyramidValid = true;
+	}
+
+	void printStats() const
+	{
+		static const char* paths[] = { "none", "arb", "core" };
+
+		std::cout << "GPUCULLER::OBJECTS: " << this->stats.objects
+			<< " GROUPS: " << this->stats.groups
+			<< " COMMANDS: " << this->stats.commands
+			<< " DRAWS: " << this->stats.draws
+			<< " INDIRECT_COUNT: " << paths[this->indirectCount]
+			<< " OCCLUSION: " << (this->occlusion && this->pyramidValid ? "on" : "off")
+			<< " UPLOADED_BYTES: " << this->stats.uploadedBytes
+			<< " LAYOUT_BUILDS: " << this->stats.layoutBuilds << "\n";
+	}
+};
@@ -79,8 +79,29 @@ void Game::initMatrices()
 
 void Game::initShaders()
 {
+	//4 MB a frame hold the blocks of about 16k draws at a 256 byte alignment, or 50k instances
+	this->streamBuffer = new StreamBuffer(4 * 1024 * 1024);
+	this->frameBuffer = new UniformBuffer(sizeof(FrameData), BLOCK_FRAME, this->streamBuffer);
+	this->drawBuffer = new UniformBuffer(sizeof(DrawData), BLOCK_DRAW, this->streamBuffer);
+
 	this->shaders.push_back(new Shader (this->GL_VERSION_MAJOR, this->GL_VIRSION_MINOR,
 		"vertex_core.glsl", "fragment_core.glsl"));
+
+	this->shaders.push_back(new Shader(this->GL_VERSION_MAJOR, this->GL_VIRSION_MINOR,
+		"vertex_instanced.glsl", "fragment_core.glsl"));
+
+	this->shaders.push_back(new Shader(this->GL_VERSION_MAJOR, this->GL_VIRSION_MINOR,
+		"vertex_array.glsl", "fragment_array.glsl"));
+
+	this->shaders.push_back(new Shader(this->GL_VERSION_MAJOR, this->GL_VIRSION_MINOR,
+		"vertex_instanced.glsl", "fragment_array.glsl"));
+
+	this->shaders.push_back(new Shader(this->GL_VERSION_MAJOR, this->GL_VIRSION_MINOR,
+		"shadow_vertex.glsl", "shadow_fragment.glsl"));
+
+	//Reflect once after linking
+	for (auto& i : this->shaders)
+		this->uniformCaches.push_back(new UniformCache(i, this->drawBuffer));
 }
 
 void Game::initTextures()
@@ -93,6 +114,21 @@ void Game::initTextures()
 	this->textures.push_back(new Texture("Images/Ricardo_Kantov.png", GL_TEXTURE_2D));
 
 	this->textures.push_back(new Texture("Images/Ricardo_Kantov_specular.png", GL_TEXTURE_2D));
+
+	//Every image is resampled to one layer size, so all models sample the same pair of arrays
+	const char* files[] = { "Images/Box.png", "Images/Box_specular.png",
+		"Images/Ricardo_Kantov.png", "Images/Ricardo_Kantov_specular.png" };
+	for (auto* i : files)
+		this->textureLayers.push_back(TextureArrayRegistry::get().acquire(i, 512, 512));
+
+	this->useTextureArrays = true;
+	for (auto& i : this->textureLayers)
+	{
+		if (!i.isValid())
+			this->useTextureArrays = false;
+	}
+
+	TextureArrayRegistry::get().printStats();
 }
 
 void Game::initMaterials()
@@ -157,28 +193,116 @@ void Game::initModels()
 
 	for (auto*& i : meshes)
 		delete i;
+
+	//Only the sphere is expected to move, the pyramids stay in the cached shadow maps and hide what is behind them
+	for (size_t i = 0; i < 3; i++)
+	{
+		this->models[i]->setStatic(true);
+		this->models[i]->setOccluder(true);
+	}
+
+	//Each model samples the layers that hold its own textures
+	if (this->useTextureArrays)
+	{
+		for (auto& i : this->models)
+		{
+			const auto diffuse = std::find(this->textures.begin(), this->textures.end(), i->getDiffuseTexture());
+			const auto specular = std::find(this->textures.begin(), this->textures.end(), i->getSpecularTexture());
+			i->setTextureLayers(this->textureLayers[diffuse - this->textures.begin()],
+				this->textureLayers[specular - this->textures.begin()]);
+		}
+	}
+
+	GeometryRegistry::get().printStats();
+	GeometryPool::get().printStats();
 }
 
 void Game::initLights()
 {
-	this->lights.push_back(new glm::vec3(0.f, 0.f, 1.f));
+	//Reaches as far as the camera sees, so its falloff is no more than a rounding error in view
+	this->lights.push_back(Light(glm::vec3(0.f, 0.f, 1.f), glm::vec3(1.f), this->farPlane, 1.f));
+
+	//Two shadowed lights over the models, refreshed when the budget allows.
+	//Scaling to thousands of lights is measured in Benchmark::lightClustering
+	this->lights.push_back(Light(glm::vec3(1.f, 3.f, 1.f), glm::vec3(1.f, 0.8f, 0.6f), 8.f, 1.f));
+	this->lights.back().setCastsShadows(true);
+	this->lights.push_back(Light(glm::vec3(4.f, 3.f, 2.f), glm::vec3(0.6f, 0.8f, 1.f), 8.f, 1.f));
+	this->lights.back().setCastsShadows(true);
+
+	this->lightClusterer = new LightClusterer();
+
+	this->sun = DirectionalLight(glm::vec3(-0.4f, -1.f, -0.3f), glm::vec3(1.f, 0.95f, 0.85f), 0.4f);
+	this->sun.setCastsShadows(true);
+
+	//64 tiles of 512, the two cubes and four cascades take 16. 12 shadow passes per frame at most
+	this->shadowMapper = new ShadowMapper(4096, 512, 12);
 }
 
-void Game::intiUniforms()
+void Game::initRenderers()
+{
+	this->renderQueue = new RenderQueue(this->streamBuffer);
+	this->instanceRenderer = new InstanceRenderer(this->streamBuffer);
+	this->frustumCuller = new FrustumCuller();
+	this->useInstancing = true;
+
+	//Simplified levels may be off by a pixel on screen, a quarter of that keeps them from popping
+	this->lodSelector = new LODSelector(1.f, 0.25f);
+
+	//All on the CPU, occluders are drawn with at most 512 triangles each
+	this->occlusionCuller = new OcclusionCuller(512);
+	this->useOcclusionCulling = true;
+
+	//Opt in with F2 where the compute shaders built. It draws at full detail without the CPU occlusion culler,
+	//so the CPU path stays the default
+	this->gpuCuller = new GPUCuller();
+	this->useGPUCulling = false;
+
+	//One worker per remaining core, the main thread keeps the GL context and helps while it waits
+	this->jobSystem = new JobSystem();
+	this->drawLists.resize(this->jobSystem->getThreadCount());
+}
+
+void Game::initScene()
 {
-	this->shaders[SHADER_CORE_PROGRAM]->setMat4fv(ViewMatrix, "ViewMatrix");
-	this->shaders[SHADER_CORE_PROGRAM]->setMat4fv(ProjectionMatrix, "ProjectionMatrix");
+	this->sceneTree = new DynamicAABBTree<Model>();
 
-	this->shaders[SHADER_CORE_PROGRAM]->setVec3f(*this->lights[0], "lightPos0");
+	//Bounds need the world matrices
+	TransformSystem::get().update(this->jobSystem);
+	for (auto& i : this->models)
+	{
+		i->update();
+		i->setProxy(this->sceneTree->insert(i));
+		if (this->gpuCuller->isSupported())
+			i->addGPUObjects(*this->gpuCuller);
+	}
+
+	this->sceneTree->printStats();
+}
+
+void Game::intiUniforms()
+{
+	this->frameBuffer->bind();
+	this->drawBuffer->bind();
+
+	this->frameData.ViewMatrix = this->ViewMatrix;
+	this->frameData.ProjectionMatrix = this->ProjectionMatrix;
+	this->frameData.cameraPos = glm::vec4(this->camPosition, 1.f);
+	this->frameData.lightPos0 = glm::vec4(this->lights[0].getPosition(), 1.f);
+	this->lightClusterer->writeFrameData(this->frameData);
+	this->shadowMapper->writeFrameData(this->frameData);
+	this->frameBuffer->update(&this->frameData, sizeof(FrameData));
+
+	for (auto& i : this->uniformCaches)
+	{
+		i->setMat4fv(ViewMatrix, UNIFORM_VIEW_MATRIX);
+		i->setMat4fv(ProjectionMatrix, UNIFORM_PROJECTION_MATRIX);
+	}
 }
 
 void Game::updateUniforms()
 {
 	//Update View Matrix(camera)
 	this->ViewMatrix = this->camera.getViewMatrix();
-	this->shaders[SHADER_CORE_PROGRAM]->setMat4fv(this->ViewMatrix, "ViewMatrix");
-	this->shaders[SHADER_CORE_PROGRAM]->setVec3f(this->camera.getPosition(), "cameraPos");
-	this->shaders[SHADER_CORE_PROGRAM]->setVec3f(*this->lights[0], "lightPos0");
 
 	//Update Framebuffer Size and Projection matrix
 	glfwGetFramebufferSize(this->window, &this->framebufferWidth, &this->framebufferHeight);
@@ -187,7 +311,31 @@ void Game::updateUniforms()
 		static_cast<float>(this->framebufferWidth) / this->framebufferHeight,
 		this->nearPlane,
 		this->farPlane);
-	this->shaders[SHADER_CORE_PROGRAM]->setMat4fv(this->ProjectionMatrix, "ProjectionMatrix");
+
+	//One upload for everything that only changes per frame
+	this->frameData.ViewMatrix = this->ViewMatrix;
+	this->frameData.ProjectionMatrix = this->ProjectionMatrix;
+	this->frameData.cameraPos = glm::vec4(this->camera.getPosition(), 1.f);
+	this->frameData.lightPos0 = glm::vec4(this->lights[0].getPosition(), 1.f);
+
+	//Shadow views are picked first, every light carries its first view into the clusters
+	this->shadowMapper->update(this->lights, this->sun, this->ViewMatrix, this->ProjectionMatrix, this->nearPlane);
+	this->shadowMapper->writeFrameData(this->frameData);
+
+	//Lights are binned against this frame's view, the grid travels with the frame block
+	this->lightClusterer->build(this->lights, this->ViewMatrix, this->ProjectionMatrix,
+		this->nearPlane, this->farPlane, this->framebufferWidth, this->framebufferHeight, this->jobSystem);
+	this->lightClusterer->upload();
+	this->lightClusterer->writeFrameData(this->frameData);
+
+	this->frameBuffer->update(&this->frameData, sizeof(FrameData));
+
+	//Shaders that still declare the plain uniforms
+	for (auto& i : this->uniformCaches)
+	{
+		i->setMat4fv(this->ViewMatrix, UNIFORM_VIEW_MATRIX);
+		i->setMat4fv(this->ProjectionMatrix, UNIFORM_PROJECTION_MATRIX);
+	}
 }
 
 //Constractor/Destractors
@@ -203,6 +351,26 @@ Game::Game(const char* title,
 {
 	//init variables
 	this->window = nullptr;
+	this->streamBuffer = nullptr;
+	this->frameBuffer = nullptr;
+	this->drawBuffer = nullptr;
+	this->renderQueue = nullptr;
+	this->instanceRenderer = nullptr;
+	this->frustumCuller = nullptr;
+	this->sceneTree = nullptr;
+	this->lodSelector = nullptr;
+	this->occlusionCuller = nullptr;
+	this->gpuCuller = nullptr;
+	this->jobSystem = nullptr;
+	this->lightClusterer = nullptr;
+	this->shadowMapper = nullptr;
+	this->traceKeyPressed = false;
+	this->cullingKeyPressed = false;
+	this->useInstancing = true;
+	this->useGPUCulling = false;
+	this->useOcclusionCulling = false;
+	this->useTextureArrays = false;
+	this->statsTimer = 0.f;
 	this->framebufferHeight = this->WINDOW_HEIGHT;
 	this->framebufferWidth = this->WINDOW_WIDTH;
 
@@ -237,6 +405,8 @@ Game::Game(const char* title,
 	this->initOBJModels();
 	this->initModels();
 	this->initLights();
+	this->initRenderers();
+	this->initScene();
 	this->intiUniforms();
 }
 
@@ -245,16 +415,31 @@ Game::~Game()
 	glfwDestroyWindow(this->window);
 	glfwTerminate();
 
+	for (auto*& i : this->uniformCaches)
+		delete i;
 	for (auto*& i : this->shaders)
 		delete i;
 	for (auto*& i : this->textures)
 		delete i;
+	TextureArrayRegistry::get().clear();
 	for (auto*& i : this->materials)
 		delete i;
+	MaterialTable::get().clear();
 	for (auto*& i : this->models)
 		delete i;
-	for (auto*& i : this->lights)
-		delete i;
+	delete this->lightClusterer;
+	delete this->shadowMapper;
+	delete this->sceneTree;
+	delete this->frustumCuller;
+	delete this->lodSelector;
+	delete this->occlusionCuller;
+	delete this->gpuCuller;
+	delete this->instanceRenderer;
+	delete this->renderQueue;
+	delete this->frameBuffer;
+	delete this->drawBuffer;
+	delete this->streamBuffer;
+	delete this->jobSystem;
 }
 
 //Accessors
@@ -263,6 +448,12 @@ int Game::getWindowShouldClose()
 	return glfwWindowShouldClose(this->window);
 }
 
+//Counters of the last finished frame, GL calls only go through the interceptor unless GL_INTERCEPT_DISABLED is defined
+const GLFrameStats& Game::getGLStats() const
+{
+	return GLInterceptor::get().getFrameStats();
+}
+
 //Modifiers
 void Game::setWindowShouldClose()
 {
@@ -285,6 +476,26 @@ void Game::updateKeyboardInput()
 		glfwSetWindowShouldClose(this->window, GLFW_TRUE);
 	}
 
+	//Profiler, the last 120 frames as a Chrome trace
+	if (glfwGetKey(this->window, GLFW_KEY_F12) == GLFW_PRESS)
+	{
+		if (!this->traceKeyPressed)
+			Profiler::get().writeTrace("trace.json", 120);
+		this->traceKeyPressed = true;
+	}
+	else
+		this->traceKeyPressed = false;
+
+	//Culling, on the GPU or on the CPU
+	if (glfwGetKey(this->window, GLFW_KEY_F2) == GLFW_PRESS)
+	{
+		if (!this->cullingKeyPressed && this->gpuCuller->isSupported())
+			this->useGPUCulling = !this->useGPUCulling;
+		this->cullingKeyPressed = true;
+	}
+	else
+		this->cullingKeyPressed = false;
+
 	//Camera
 	if (glfwGetKey(this->window, GLFW_KEY_W) == GLFW_PRESS)
 	{
@@ -334,12 +545,14 @@ void Game::updateMouseInput()
 	//move light
 	if (glfwGetMouseButton(this->window, GLFW_MOUSE_BUTTON_1) == GLFW_PRESS)
 	{
-		*this->lights[0] = this->camera.getPosition();
+		this->lights[0].setPosition(this->camera.getPosition());
 	}
 
 }	
 void Game::updateInput()
 {
+	PROFILE_SCOPE("Game::updateInput");
+
 	glfwPollEvents();
 	this->updateKeyboardInput();
 	this->updateMouseInput();
@@ -348,10 +561,48 @@ void Game::updateInput()
 
 void Game::update()
 {
+	PROFILE_SCOPE("Game::update");
+
 	//UPDATE Input 
 	this->updateDt();
 	this->updateInput();
 
+	//Only transforms that changed are recomputed, nothing happens in a frame where nothing moved
+	{
+		PROFILE_SCOPE("TransformSystem::update");
+		TransformSystem::get().update(this->jobSystem);
+	}
+
+	this->jobSystem->parallelFor(this->models.size(), [this](const size_t first, const size_t last)
+	{
+		PROFILE_SCOPE("Model::update");
+		for (size_t i = first; i < last; i++)
+			this->models[i]->update();
+	}, 64);
+
+	//Models that moved out of their fat box are reinserted, the rest stay where they are
+	{
+		PROFILE_SCOPE("DynamicAABBTree::move");
+		this->movedModels.clear();
+		for (auto& i : this->models)
+		{
+			if (i->hasMoved())
+			{
+				this->sceneTree->move(i->getProxy());
+				this->movedModels.push_back(i);
+			}
+		}
+	}
+
+	//Only the models that moved are uploaded again, also while the CPU path is in use so switching back needs nothing
+	{
+		PROFILE_SCOPE("GPUCuller::update");
+		for (auto& i : this->movedModels)
+		{
+			i->updateGPUObjects(*this->gpuCuller);
+		}
+	}
+
 	/*this->models[0]->rotate(glm::vec3(0.f,1.f,0.f));
 	this->models[1]->rotate(glm::vec3(0.f,-1.f,0.f));
 	this->models[2]->rotate(glm::vec3(0.f,-1.f,1.f));*/
@@ -359,31 +610,185 @@ void Game::update()
 
 void Game::render()
 {
-	//uptade
-	
+	PROFILE_SCOPE("Game::render");
 
 	//clear
 	glClearColor(0.f, 0.f, 0.f, 1.f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
+	//Next region of the ring, only waits when the GPU is a whole ring behind
+	this->streamBuffer->beginFrame();
+	PROFILE_COUNTER("StreamWait", this->streamBuffer->getWaitTime());
+
+	//Closes the holes geometry released since the last frame left in the shared buffers
+	GeometryPool::get().defragment();
+
+	//Every model can cast a shadow, not only the visible ones
+	{
+		PROFILE_SCOPE("Game::shadowCasters");
+
+		this->shadowMapper->begin();
+		for (auto& i : this->models)
+		{
+			i->addShadowCasters(*this->shadowMapper);
+		}
+	}
+
 	//update the uniforms
-	this->updateUniforms();
+	{
+		PROFILE_SCOPE("Game::updateUniforms");
+		this->updateUniforms();
+	}
+
+	//The scene tree rejects whole groups of models, the meshes of the rest are culled in one batch.
+	//Nothing outside the view reaches the queue
+	const Frustum frustum(this->ProjectionMatrix * this->ViewMatrix);
+	if (this->useGPUCulling)
+	{
+		PROFILE_SCOPE("GPUCuller::cull");
+		PROFILE_GPU("Cull");
+		this->gpuCuller->cull(this->ProjectionMatrix * this->ViewMatrix);
+	}
+	else
+	{
+		PROFILE_SCOPE("Game::cull");
+
+		this->visibleModels.clear();
+		this->sceneTree->queryFrustum(frustum, this->visibleModels);
+
+		this->frustumCuller->begin();
+		for (auto& i : this->visibleModels)
+		{
+			i->cull(*this->frustumCuller);
+		}
+		this->frustumCuller->cull(frustum, this->jobSystem);
+	}
+
+	//Meshes the occluders hide are dropped before they pick a level or reach the queue
+	if (!this->useGPUCulling && this->useOcclusionCulling)
+	{
+		PROFILE_SCOPE("Game::occlusionCull");
+
+		this->occlusionCuller->begin(this->ProjectionMatrix * this->ViewMatrix);
+		for (auto& i : this->visibleModels)
+		{
+			i->cull(*this->occlusionCuller);
+		}
+		this->occlusionCuller->cull(this->jobSystem);
+		PROFILE_COUNTER("Occluded", this->occlusionCuller->getStats().occluded);
+		PROFILE_COUNTER("OcclusionRasterize", this->occlusionCuller->getStats().rasterizeTime);
+	}
+
+	//Only the visible meshes pick a level, from their size on screen
+	if (!this->useGPUCulling)
+	{
+		PROFILE_SCOPE("Game::selectLOD");
+
+		this->lodSelector->begin(this->camera.getPosition(), this->ProjectionMatrix, this->framebufferHeight);
+		for (auto& i : this->visibleModels)
+		{
+			i->selectLOD(*this->lodSelector);
+		}
+		PROFILE_COUNTER("Triangles", this->lodSelector->getTriangles());
+	}
+
+	//Shadow maps the budget picked this frame, the scene samples the atlas afterwards
+	this->shadowMapper->render(this->uniformCaches[SHADER_SHADOW], this->framebufferWidth, this->framebufferHeight);
 
 	//Render Uniforms
-	for (auto& i :this->models)
+	if (!this->useGPUCulling)
 	{
-		i->render(this->shaders[SHADER_CORE_PROGRAM]);
+		PROFILE_SCOPE("Game::submit");
+
+		this->renderQueue->begin(this->camera.getPosition(), this->farPlane);
+		if (this->useInstancing)
+		{
+			this->instanceRenderer->begin();
+			for (auto& i : this->visibleModels)
+			{
+				i->submit(*this->instanceRenderer);
+			}
+			this->instanceRenderer->submit(*this->renderQueue,
+				this->uniformCaches[this->useTextureArrays ? SHADER_INSTANCED_ARRAY : SHADER_INSTANCED]);
+		}
+		else
+		{
+			//Packets are built on every thread, only the merged list is submitted on this one
+			UniformCache* program = this->uniformCaches[this->useTextureArrays ? SHADER_ARRAY : SHADER_CORE_PROGRAM];
+			for (auto& i : this->drawLists)
+				i.clear();
+
+			this->jobSystem->parallelFor(this->visibleModels.size(), [this, program](const size_t first, const size_t last)
+			{
+				PROFILE_SCOPE("Model::submit");
+				DrawList& list = this->drawLists[this->jobSystem->getCurrentThread()];
+				for (size_t i = first; i < last; i++)
+					this->visibleModels[i]->submit(list, program);
+			}, 64);
+
+			for (auto& i : this->drawLists)
+				this->renderQueue->merge(i);
+		}
+	}
+
+	if (this->useGPUCulling)
+	{
+		PROFILE_SCOPE("GPUCuller::render");
+		PROFILE_GPU("Scene");
+		this->gpuCuller->render(this->uniformCaches[this->useTextureArrays ? SHADER_INSTANCED_ARRAY : SHADER_INSTANCED]);
+	}
+	else
+	{
+		PROFILE_SCOPE("RenderQueue::execute");
+		PROFILE_GPU("Scene");
+		this->renderQueue->execute();
+	}
+
+	//This frame's depth is what the next frame's occlusion test sees
+	if (this->useGPUCulling)
+	{
+		PROFILE_SCOPE("GPUCuller::buildDepthPyramid");
+		PROFILE_GPU("DepthPyramid");
+		this->gpuCuller->buildDepthPyramid(this->framebufferWidth, this->framebufferHeight);
+	}
+
+	//Counters are per frame, printed once a second
+	this->statsTimer += this->dt;
+	if (this->statsTimer >= 1.f)
+	{
+		//The GPU path keeps no visible list, GPUCuller reports what it drew instead
+		if (this->useGPUCulling)
+			std::cout << "SCENE::MODELS: " << this->models.size() << "\n";
+		else
+			std::cout << "SCENE::MODELS: " << this->models.size()
+				<< " IN FRUSTUM: " << this->visibleModels.size() << "\n";
+		if (this->useGPUCulling)
+			this->gpuCuller->printStats();
+		else
+		{
+			this->frustumCuller->printStats();
+			if (this->useOcclusionCulling)
+				this->occlusionCuller->printStats();
+			this->lodSelector->printStats();
+			this->renderQueue->printStats();
+		}
+		MaterialTable::get().printStats();
+		this->lightClusterer->printStats();
+		this->shadowMapper->printStats();
+		this->streamBuffer->printStats();
+		Profiler::get().printStats();
+		GLInterceptor::get().printStats();
+		this->statsTimer = 0.f;
 	}
-	
 
 	//end draw 
-	glfwSwapBuffers(window);
-	glFlush();
+	{
+		PROFILE_SCOPE("Game::swapBuffers");
+		glfwSwapBuffers(window);
+		glFlush();
+	}
 
-	glBindVertexArray(0);
-	glUseProgram(0);
-	glActiveTexture(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLInterceptor::get().endFrame();
 }
 
 //Static functions
@@ -3,7 +3,7 @@
 #include "Camera.h"
 
 //ENUMERATIONS
-enum shader_enum {SHADER_CORE_PROGRAM=0};
+enum shader_enum {SHADER_CORE_PROGRAM=0, SHADER_INSTANCED, SHADER_ARRAY, SHADER_INSTANCED_ARRAY, SHADER_SHADOW};
 enum texture_enum {
 	TEX_BOX = 0, TEX_BOX_SPECULAR, TEX_RICARDO_KANTOV, TEX_RICARDO_KANTOV_SPECULAR,};
 enum material_enum {MAT_1 = 0};
@@ -52,18 +52,61 @@ private:
 	float farPlane;
 	//Shaders
 	std::vector<Shader*> shaders;
+	std::vector<UniformCache*> uniformCaches;
+
+	//Uniform blocks, streamed through the ring together with the instances
+	StreamBuffer* streamBuffer;
+	UniformBuffer* frameBuffer;
+	UniformBuffer* drawBuffer;
+	FrameData frameData;
 
 	//Textures
 	std::vector<Texture*> textures;
 
+	//The same textures as layers of shared arrays, indexed by texture_enum
+	std::vector<TextureLayer> textureLayers;
+	bool useTextureArrays;
+
 	//Materials
 	std::vector<Material*> materials;
 
 	//Models
 	std::vector<Model*> models;
 
-	//Lights
-	std::vector<glm::vec3*> lights;
+	//Rendering
+	RenderQueue* renderQueue;
+	InstanceRenderer* instanceRenderer;
+	FrustumCuller* frustumCuller;
+	DynamicAABBTree<Model>* sceneTree;
+	std::vector<Model*> visibleModels;
+	std::vector<Model*> movedModels;
+	LODSelector* lodSelector;
+
+	//Drops visible meshes hidden behind the occluder models, before they pick a level
+	OcclusionCuller* occlusionCuller;
+	bool useOcclusionCulling;
+
+	//Culls and draws the whole scene on the GPU instead, at full detail. F2 switches paths
+	GPUCuller* gpuCuller;
+	bool useGPUCulling;
+	bool cullingKeyPressed;
+
+	//Jobs
+	JobSystem* jobSystem;
+	std::vector<DrawList> drawLists;
+	bool useInstancing;
+	float statsTimer;
+
+	//Lights, the first one follows the camera on click
+	std::vector<Light> lights;
+	LightClusterer* lightClusterer;
+
+	//Shadows of the sun and of the lights that cast them
+	DirectionalLight sun;
+	ShadowMapper* shadowMapper;
+
+	//Profiling
+	bool traceKeyPressed;
 
 	//Private Function
 	void initGLFW();
@@ -79,6 +122,8 @@ private:
 	void initOBJModels();
 	void initModels();
 	void initLights();
+	void initRenderers();
+	void initScene();
 	void intiUniforms();
 
 	void updateUniforms();
@@ -96,6 +141,7 @@ public:
 
 	//Accessors
 	int getWindowShouldClose();
+	const GLFrameStats& getGLStats() const;
 	//Modifiers
 	void setWindowShouldClose();
 	//Functions
@@ -0,0 +1,459 @@
+#pragma once
+#include<iostream>
+#include<string>
+#include<vector>
+#include<cstddef>
+
+#include<glew.h>
+
+#include<glm.hpp>
+#include<mat4x4.hpp>
+
+#include "Vertex.h"
+#include "VertexFormat.h"
+#include "GeometryPool.h"
+#include "Bounds.h"
+#include "MeshSimplifier.h"
+
+//One entry of the instance buffer, attributes 4-7 take the matrix and 8 the indices, laid out as in DrawData
+struct InstanceData
+{
+	glm::mat4 ModelMatrix;
+	glm::ivec4 indices;
+};
+
+//One draw of glMultiDrawElementsIndirect, laid out as GL reads it
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "DrawElementsIndirectCommand does not match the GL layout");
+
+//Vertex and index buffers of one piece of geometry, uploaded once and shared by every Mesh drawing it.
+//Simplified levels of detail are Geometry as well: they draw their own range of the parent's index buffer
+//through the parent's VAO, so a level change never changes render state.
+//The vertex buffer is stored in a VertexFormat, vertexArray always keeps the full vertices.
+//Indexed geometry lives in the GeometryBuffer of its format unless the GeometryPool is disabled: it shares
+//the VAO with everything else there and is drawn from its blocks with a base vertex
+class Geometry
+{
+private:
+	std::string key;
+
+	//Owner of the buffers, nullptr unless this is a level of detail
+	Geometry* parent;
+	std::vector<Geometry*> lods;
+	GLuint firstIndex;
+	float lodError;
+
+	Vertex* vertexArray;
+	unsigned nrOfVertices;
+	GLuint* indexArray;
+	unsigned nrOfIndices;
+	GLenum indexType;
+
+	VertexFormat format;
+	glm::mat4 decodeMatrix;
+
+	//Local space bounds, computed once from vertexArray
+	AABB bounds;
+	BoundingSphere sphere;
+
+	GLuint VAO;
+	GLuint VBO;
+	GLuint EBO;
+
+	//Shared buffers and the blocks in them, nullptr when the buffers above are this geometry's own
+	GeometryBuffer* pool;
+	unsigned vertexBlock;
+	unsigned indexBlock;
+
+	//Per instance model matrices, attributes 4-7
+	GLuint instanceBuffer;
+
+	unsigned references;
+
+	Geometry(const Geometry&) = delete;
+	Geometry& operator=(const Geometry&) = delete;
+
+	//Places the vertices and every level's indices in the pool, 16 bit indices whenever every vertex fits in them
+	void initPool()
+	{
+		std::vector<GLuint> indices(this->indexArray, this->indexArray + this->nrOfIndices);
+		for (auto* i : this->lods)
+			indices.insert(indices.end(), i->indexArray, i->indexArray + i->nrOfIndices);
+
+		std::vector<GLushort> shortIndices;
+		this->indexType = GL_UNSIGNED_INT;
+		if (this->nrOfVertices <= 65536)
+		{
+			shortIndices.resize(indices.size());
+			for (size_t i = 0; i < indices.size(); i++)
+				shortIndices[i] = static_cast<GLushort>(indices[i]);
+			this->indexType = GL_UNSIGNED_SHORT;
+		}
+
+		std::vector<unsigned char> packed;
+		if (!this->format.isFull())
+			packed = this->format.pack(this->vertexArray, this->nrOfVertices, this->decodeMatrix);
+
+		this->pool = GeometryPool::get().acquire(this->format, this->indexType);
+		this->pool->allocate(packed.empty() ? static_cast<const void*>(this->vertexArray) : packed.data(), this->nrOfVertices,
+			shortIndices.empty() ? static_cast<const void*>(indices.data()) : shortIndices.data(), static_cast<GLuint>(indices.size()),
+			this->vertexBlock, this->indexBlock);
+
+		this->VAO = this->pool->getVAO();
+		this->VBO = 0;
+		this->EBO = 0;
+
+		for (auto* i : this->lods)
+		{
+			i->VAO = this->VAO;
+			i->indexType = this->indexType;
+			i->pool = this->pool;
+			i->vertexBlock = this->vertexBlock;
+			i->indexBlock = this->indexBlock;
+		}
+	}
+
+	void initVAO()
+	{
+		if (this->nrOfIndices > 0 && GeometryPool::get().isEnabled())
+		{
+			this->initPool();
+			return;
+		}
+
+		//create VAO
+		glCreateVertexArrays(1, &this->VAO);
+		glBindVertexArray(this->VAO);
+
+		//gen vao and bind and send data
+
+		glGenBuffers(1, &this->VBO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+		if (this->format.isFull())
+			glBufferData(GL_ARRAY_BUFFER, this->nrOfVertices * sizeof(Vertex), this->vertexArray, GL_STATIC_DRAW);
+		else
+		{
+			const std::vector<unsigned char> packed = this->format.pack(this->vertexArray, this->nrOfVertices, this->decodeMatrix);
+			glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+		}
+
+		//gen ebo and bind and sent data, 16 bit indices whenever every vertex fits in them.
+		//Levels of detail follow the full detail indices in the same buffer
+		this->indexType = GL_UNSIGNED_INT;
+		if (this->nrOfIndices > 0)
+		{
+			glGenBuffers(1, &this->EBO);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+
+			std::vector<GLuint> indices(this->indexArray, this->indexArray + this->nrOfIndices);
+			for (auto* i : this->lods)
+				indices.insert(indices.end(), i->indexArray, i->indexArray + i->nrOfIndices);
+
+			if (this->nrOfVertices <= 65536)
+			{
+				std::vector<GLushort> shortIndices(indices.size());
+				for (size_t i = 0; i < indices.size(); i++)
+				{
+					shortIndices[i] = static_cast<GLushort>(indices[i]);
+				}
+
+				this->indexType = GL_UNSIGNED_SHORT;
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+			}
+			else
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+		}
+
+
+		//set vertex attribpointers enable (input assebmly)
+		this->format.setAttributes();
+
+		//Bind VAO 0
+		glBindVertexArray(0);
+
+		for (auto* i : this->lods)
+		{
+			i->VAO = this->VAO;
+			i->VBO = this->VBO;
+			i->EBO = this->EBO;
+			i->indexType = this->indexType;
+		}
+	}
+
+	//Where this level's indices start in the bound index buffer
+	const GLvoid* getIndexOffset() const
+	{
+		const size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		return reinterpret_cast<const GLvoid*>(static_cast<size_t>(this->getFirstIndex()) * indexSize);
+	}
+
+	//A level of detail of parent, its indices start at firstIndex in the parent's index buffer
+	Geometry(Geometry* parent, const MeshLOD& lod, const GLuint firstIndex)
+	{
+		this->key = parent->key;
+		this->references = 0;
+		this->parent = parent;
+		this->firstIndex = firstIndex;
+		this->lodError = lod.error;
+
+		this->vertexArray = parent->vertexArray;
+		this->nrOfVertices = parent->nrOfVertices;
+		this->nrOfIndices = static_cast<unsigned>(lod.indices.size());
+		this->indexArray = new GLuint[this->nrOfIndices];
+		for (size_t i = 0; i < this->nrOfIndices; i++)
+		{
+			this->indexArray[i] = lod.indices[i];
+		}
+
+		this->format = parent->format;
+		this->decodeMatrix = parent->decodeMatrix;
+		this->bounds = parent->bounds;
+		this->sphere = parent->sphere;
+
+		//Set with the parent's upload
+		this->VAO = 0;
+		this->VBO = 0;
+		this->EBO = 0;
+		this->pool = nullptr;
+		this->vertexBlock = 0;
+		this->indexBlock = 0;
+		this->indexType = GL_UNSIGNED_INT;
+		this->instanceBuffer = 0;
+	}
+
+public:
+	//lods are coarser levels over the same vertices, coarsest last
+	Geometry(const std::string& key,
+		const Vertex* vertexArray,
+		const unsigned& nrOfVertices,
+		const GLuint* indexArray,
+		const unsigned& nrOfIndices,
+		const std::vector<MeshLOD>& lods = std::vector<MeshLOD>(),
+		const VertexFormat& format = VertexFormat())
+	{
+		this->key = key;
+		this->references = 0;
+		this->parent = nullptr;
+		this->firstIndex = 0;
+		this->lodError = 0.f;
+
+		this->nrOfVertices = nrOfVertices;
+		this->nrOfIndices = nrOfIndices;
+
+		this->vertexArray = new Vertex[this->nrOfVertices];
+		for (size_t i = 0; i < nrOfVertices; i++)
+		{
+			this->vertexArray[i] = vertexArray[i];
+		}
+		this->indexArray = new GLuint[this->nrOfIndices];
+		for (size_t i = 0; i < nrOfIndices; i++)
+		{
+			this->indexArray[i] = indexArray[i];
+		}
+
+		computeBounds(this->vertexArray, this->nrOfVertices, this->bounds, this->sphere);
+
+		this->format = format;
+		this->decodeMatrix = format.isQuantized() ? VertexFormat::getDecodeMatrix(this->bounds) : glm::mat4(1.f);
+
+		//Levels without indices to share have nothing to draw from
+		GLuint firstIndex = this->nrOfIndices;
+		for (size_t i = 0; i < lods.size() && this->nrOfIndices > 0; i++)
+		{
+			this->lods.push_back(new Geometry(this, lods[i], firstIndex));
+			firstIndex += static_cast<GLuint>(lods[i].indices.size());
+		}
+
+		this->EBO = 0;
+		this->pool = nullptr;
+		this->vertexBlock = 0;
+		this->indexBlock = 0;
+		this->instanceBuffer = 0;
+		this->initVAO();
+	}
+
+	~Geometry()
+	{
+		delete[] this->indexArray;
+
+		if (this->parent != nullptr)
+			return;
+
+		for (auto*& i : this->lods)
+			delete i;
+
+		if (this->pool != nullptr)
+			GeometryPool::get().release(this->pool, this->vertexBlock, this->indexBlock);
+		else
+		{
+			glDeleteVertexArrays(1, &this->VAO);
+			glDeleteBuffers(1, &this->VBO);
+			if (this->nrOfIndices > 0)
+				glDeleteBuffers(1, &this->EBO);
+		}
+
+		delete[] this->vertexArray;
+	}
+
+	//Accessors
+	const std::string& getKey() const { return this->key; }
+
+	const Vertex* getVertexArray() const { return this->vertexArray; }
+
+	unsigned getNrOfVertices() const { return this->nrOfVertices; }
+
+	const GLuint* getIndexArray() const { return this->indexArray; }
+
+	unsigned getNrOfIndices() const { return this->nrOfIndices; }
+
+	unsigned getNrOfTriangles() const { return (this->nrOfIndices > 0 ? this->nrOfIndices : this->nrOfVertices) / 3; }
+
+	GLenum getIndexType() const { return this->indexType; }
+
+	const AABB& getBounds() const { return this->bounds; }
+
+	const BoundingSphere& getBoundingSphere() const { return this->sphere; }
+
+	GLuint getVAO() const { return this->VAO; }
+
+	bool isPooled() const { return this->pool != nullptr; }
+
+	//First index of this level in the bound index buffer, blocks move when the pool compacts
+	GLuint getFirstIndex() const { return (this->pool != nullptr ? this->pool->getFirstIndex(this->indexBlock) : 0) + this->firstIndex; }
+
+	//Added to every index, 0 for geometry with its own buffers
+	GLint getBaseVertex() const { return this->pool != nullptr ? this->pool->getBaseVertex(this->vertexBlock) : 0; }
+
+	//Instanced draw of this level for glMultiDrawElementsIndirect, only for geometry with indices
+	DrawElementsIndirectCommand getIndirectCommand(const GLuint instances, const GLuint baseInstance) const
+	{
+		DrawElementsIndirectCommand command;
+		command.count = this->nrOfIndices;
+		command.instanceCount = instances;
+		command.firstIndex = this->getFirstIndex();
+		command.baseVertex = this->getBaseVertex();
+		command.baseInstance = baseInstance;
+		return command;
+	}
+
+	const VertexFormat& getVertexFormat() const { return this->format; }
+
+	//Model space from the positions in the vertex buffer, identity unless they are quantized
+	const glm::mat4& getDecodeMatrix() const { return this->decodeMatrix; }
+
+	//What the shaders take as ModelMatrix to place this geometry with ModelMatrix
+	glm::mat4 getDrawMatrix(const glm::mat4& ModelMatrix) const
+	{
+		return this->format.isQuantized() ? ModelMatrix * this->decodeMatrix : ModelMatrix;
+	}
+
+	unsigned getReferences() const { return this->references; }
+
+	//Full detail plus every simplified level
+	unsigned getLODCount() const { return static_cast<unsigned>(this->lods.size()) + 1; }
+
+	//0 is this geometry, higher levels are coarser, past the last one the coarsest is returned
+	Geometry* getLOD(const unsigned lod)
+	{
+		if (lod == 0 || this->lods.empty())
+			return this;
+
+		return this->lods[lod <= this->lods.size() ? lod - 1 : this->lods.size() - 1];
+	}
+
+	//How far a level's surface may be from the full detail one, in model units
+	float getLODError(const unsigned lod) const
+	{
+		if (lod == 0 || this->lods.empty())
+			return this->lodError;
+
+		return this->lods[lod <= this->lods.size() ? lod - 1 : this->lods.size() - 1]->lodError;
+	}
+
+	//Bytes this geometry occupies in VRAM, a level of detail only counts its indices
+	size_t getSizeInBytes() const
+	{
+		const size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		if (this->parent != nullptr)
+			return this->nrOfIndices * indexSize;
+
+		size_t bytes = this->nrOfVertices * this->format.getStride() + this->nrOfIndices * indexSize;
+		for (auto* i : this->lods)
+			bytes += i->getSizeInBytes();
+		return bytes;
+	}
+
+	//Functions
+	void addReference()
+	{
+		++this->references;
+	}
+
+	//Returns true when the last reference is gone
+	bool removeReference()
+	{
+		return --this->references == 0;
+	}
+
+	//Sources the per instance model matrix (attributes 4-7) from the given buffer, only touches the VAO when it changes
+	void setInstanceBuffer(const GLuint buffer)
+	{
+		if (this->parent != nullptr)
+		{
+			this->parent->setInstanceBuffer(buffer);
+			return;
+		}
+
+		//A pooled VAO is shared, so is the buffer it sources
+		GLuint& current = this->pool != nullptr ? this->pool->getInstanceBuffer() : this->instanceBuffer;
+		if (current == buffer)
+			return;
+
+		glBindVertexArray(this->VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		for (GLuint i = 0; i < 4; i++)
+		{
+			glVertexAttribPointer(4 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLvoid*)(sizeof(glm::vec4) * i));
+			glEnableVertexAttribArray(4 + i);
+			glVertexAttribDivisor(4 + i, 1);
+		}
+		glVertexAttribIPointer(8, 4, GL_INT, sizeof(InstanceData), (GLvoid*)offsetof(InstanceData, indices));
+		glEnableVertexAttribArray(8);
+		glVertexAttribDivisor(8, 1);
+		glBindVertexArray(0);
+
+		current = buffer;
+	}
+
+	//Expects the VAO to be bound
+	void draw() const
+	{
+		if (this->nrOfIndices == 0)
+			glDrawArrays(GL_TRIANGLES, 0, this->nrOfVertices);
+		else if (this->pool != nullptr)
+			glDrawElementsBaseVertex(GL_TRIANGLES, this->nrOfIndices, this->indexType, this->getIndexOffset(), this->getBaseVertex());
+		else
+			glDrawElements(GL_TRIANGLES, this->nrOfIndices, this->indexType, this->getIndexOffset());
+	}
+
+	//Expects the VAO to be bound and an instance buffer to be set
+	void drawInstanced(const GLsizei instances, const GLuint baseInstance) const
+	{
+		if (this->nrOfIndices == 0)
+			glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, this->nrOfVertices, instances, baseInstance);
+		else if (this->pool != nullptr)
+			glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, this->nrOfIndices, this->indexType, this->getIndexOffset(),
+				instances, this->getBaseVertex(), baseInstance);
+		else
+			glDrawElementsInstancedBaseInstance(GL_TRIANGLES, this->nrOfIndices, this->indexType, this->getIndexOffset(),
+				instances, baseInstance);
+	}
+};
@@ -0,0 +1,286 @@
+#pragma once
+#include<iostream>
+#include<vector>
+#include<algorithm>
+
+#include<glew.h>
+
+#include "VertexFormat.h"
+#include "FreeListAllocator.h"
+
+//One vertex and one index buffer shared by all geometry of a VertexFormat and index type, behind one VAO.
+//Geometry is placed with a FreeListAllocator and drawn with a base vertex, so its indices stay local and
+//everything in here draws without a VAO change, or with a single glMultiDrawElementsIndirect.
+//When a request does not fit the buffers are rebuilt larger, compacted on the way
+class GeometryBuffer
+{
+private:
+	VertexFormat format;
+	GLenum indexType;
+	GLsizeiptr indexSize;
+
+	GLuint VAO;
+	GLuint VBO;
+	GLuint EBO;
+
+	//Per instance attributes 4-8 of the VAO are sourced from this buffer
+	GLuint instanceBuffer;
+
+	FreeListAllocator vertices;
+	FreeListAllocator indices;
+
+	//Counters
+	unsigned rebuilds;
+	size_t movedBytes;
+
+	GeometryBuffer(const GeometryBuffer&) = delete;
+	GeometryBuffer& operator=(const GeometryBuffer&) = delete;
+
+	static GLuint copy(const GLuint from, const GLsizeiptr capacity, const std::vector<FreeListAllocator::Move>& moves,
+		const GLsizeiptr unit, size_t& movedBytes)
+	{
+		GLuint to = 0;
+		glCreateBuffers(1, &to);
+		glNamedBufferData(to, capacity, NULL, GL_STATIC_DRAW);
+
+		for (auto& i : moves)
+		{
+			glCopyNamedBufferSubData(from, to, i.from * unit, i.to * unit, i.size * unit);
+			movedBytes += static_cast<size_t>(i.size * unit);
+		}
+
+		glDeleteBuffers(1, &from);
+		return to;
+	}
+
+	//New buffers of the given capacities with every live block moved to the front
+	void rebuild(const GLuint vertexCapacity, const GLuint indexCapacity)
+	{
+		const GLsizeiptr stride = this->format.getStride();
+		this->VBO = copy(this->VBO, static_cast<GLsizeiptr>(vertexCapacity) * stride, this->vertices.compact(vertexCapacity), stride, this->movedBytes);
+		this->EBO = copy(this->EBO, static_cast<GLsizeiptr>(indexCapacity) * this->indexSize, this->indices.compact(indexCapacity), this->indexSize, this->movedBytes);
+
+		glBindVertexArray(this->VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+		this->format.setAttributes();
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+		glBindVertexArray(0);
+
+		++this->rebuilds;
+	}
+
+	static GLuint grow(const GLuint capacity, const GLuint used, const GLuint size, const GLuint minimum)
+	{
+		GLuint grown = std::max(capacity * 2, minimum);
+		while (grown < used + size)
+			grown *= 2;
+
+		return grown;
+	}
+
+public:
+	//Vertices the buffers start with, indices are three times as many
+	enum : GLuint { MIN_CAPACITY = 65536 };
+
+	GeometryBuffer(const VertexFormat& format, const GLenum indexType)
+		: vertices(0), indices(0)
+	{
+		this->format = format;
+		this->indexType = indexType;
+		this->indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		this->instanceBuffer = 0;
+		this->rebuilds = 0;
+		this->movedBytes = 0;
+
+		glCreateVertexArrays(1, &this->VAO);
+		glCreateBuffers(1, &this->VBO);
+		glCreateBuffers(1, &this->EBO);
+	}
+
+	~GeometryBuffer()
+	{
+		glDeleteVertexArrays(1, &this->VAO);
+		glDeleteBuffers(1, &this->VBO);
+		glDeleteBuffers(1, &this->EBO);
+	}
+
+	//Accessors
+	const VertexFormat& getFormat() const { return this->format; }
+
+	GLenum getIndexType() const { return this->indexType; }
+
+	GLuint getVAO() const { return this->VAO; }
+
+	//The instance buffer the VAO sources right now, see Geometry::setInstanceBuffer
+	GLuint& getInstanceBuffer() { return this->instanceBuffer; }
+
+	GLint getBaseVertex(const unsigned vertexBlock) const { return static_cast<GLint>(this->vertices.getOffset(vertexBlock)); }
+
+	GLuint getFirstIndex(const unsigned indexBlock) const { return this->indices.getOffset(indexBlock); }
+
+	bool isEmpty() const { return this->vertices.isEmpty() && this->indices.isEmpty(); }
+
+	const FreeListAllocator& getVertexAllocator() const { return this->vertices; }
+
+	const FreeListAllocator& getIndexAllocator() const { return this->indices; }
+
+	size_t getVertexBytes() const { return static_cast<size_t>(this->vertices.getCapacity()) * this->format.getStride(); }
+
+	size_t getIndexBytes() const { return static_cast<size_t>(this->indices.getCapacity()) * this->indexSize; }
+
+	unsigned getRebuilds() const { return this->rebuilds; }
+
+	size_t getMovedBytes() const { return this->movedBytes; }
+
+	//Functions
+
+	//Places vertexCount vertices in this buffer's format, already packed, and their indices
+	void allocate(const void* vertexData, const GLuint vertexCount, const void* indexData, const GLuint indexCount,
+		unsigned& vertexBlock, unsigned& indexBlock)
+	{
+		vertexBlock = this->vertices.allocate(vertexCount);
+		indexBlock = this->indices.allocate(indexCount);
+		if (vertexBlock == FreeListAllocator::INVALID || indexBlock == FreeListAllocator::INVALID)
+		{
+			//Back in, so the rebuild does not copy half an allocation
+			if (vertexBlock != FreeListAllocator::INVALID)
+				this->vertices.release(vertexBlock);
+			if (indexBlock != FreeListAllocator::INVALID)
+				this->indices.release(indexBlock);
+
+			const GLuint vertexCapacity = vertexBlock == FreeListAllocator::INVALID
+				? grow(this->vertices.getCapacity(), this->vertices.getUsed(), vertexCount, MIN_CAPACITY) : this->vertices.getCapacity();
+			const GLuint indexCapacity = indexBlock == FreeListAllocator::INVALID
+				? grow(this->indices.getCapacity(), this->indices.getUsed(), indexCount, MIN_CAPACITY * 3) : this->indices.getCapacity();
+			this->rebuild(vertexCapacity, indexCapacity);
+
+			vertexBlock = this->vertices.allocate(vertexCount);
+			indexBlock = this->indices.allocate(indexCount);
+		}
+
+		const GLsizeiptr stride = this->format.getStride();
+		glNamedBufferSubData(this->VBO, this->vertices.getOffset(vertexBlock) * stride, vertexCount * stride, vertexData);
+		glNamedBufferSubData(this->EBO, this->indices.getOffset(indexBlock) * this->indexSize, indexCount * this->indexSize, indexData);
+	}
+
+	void release(const unsigned vertexBlock, const unsigned indexBlock)
+	{
+		this->vertices.release(vertexBlock);
+		this->indices.release(indexBlock);
+	}
+
+	//Compacts once the holes left by released geometry are a quarter of a buffer, returns whether it did
+	bool defragment()
+	{
+		const GLuint vertexHoles = this->vertices.getHoleSize();
+		const GLuint indexHoles = this->indices.getHoleSize();
+		if ((vertexHoles == 0 || vertexHoles * 4 < this->vertices.getCapacity())
+			&& (indexHoles == 0 || indexHoles * 4 < this->indices.getCapacity()))
+			return false;
+
+		this->rebuild(this->vertices.getCapacity(), this->indices.getCapacity());
+		return true;
+	}
+};
+
+//Every GeometryBuffer, one per VertexFormat and index type. Geometry with indices is placed here unless
+//the pool is disabled, a buffer is freed with the last geometry in it
+class GeometryPool
+{
+private:
+	std::vector<GeometryBuffer*> buffers;
+	bool enabled;
+
+	//Counters
+	unsigned compactions;
+
+	GeometryPool()
+	{
+		this->enabled = true;
+		this->compactions = 0;
+	}
+
+	~GeometryPool()
+	{
+
+	}
+
+	GeometryPool(const GeometryPool&) = delete;
+	GeometryPool& operator=(const GeometryPool&) = delete;
+
+public:
+	static GeometryPool& get()
+	{
+		static GeometryPool instance;
+		return instance;
+	}
+
+	//Accessors
+	bool isEnabled() const { return this->enabled; }
+
+	size_t getBufferCount() const { return this->buffers.size(); }
+
+	//Modifiers
+
+	//Only affects geometry created afterwards
+	void setEnabled(const bool enabled) { this->enabled = enabled; }
+
+	//Functions
+	GeometryBuffer* acquire(const VertexFormat& format, const GLenum indexType)
+	{
+		for (auto* i : this->buffers)
+		{
+			if (i->getFormat() == format && i->getIndexType() == indexType)
+				return i;
+		}
+
+		this->buffers.push_back(new GeometryBuffer(format, indexType));
+		return this->buffers.back();
+	}
+
+	void release(GeometryBuffer* buffer, const unsigned vertexBlock, const unsigned indexBlock)
+	{
+		buffer->release(vertexBlock, indexBlock);
+		if (!buffer->isEmpty())
+			return;
+
+		this->buffers.erase(std::find(this->buffers.begin(), this->buffers.end(), buffer));
+		delete buffer;
+	}
+
+	//Cheap unless geometry was released, call it between frames
+	void defragment()
+	{
+		for (auto* i : this->buffers)
+		{
+			if (i->defragment())
+				++this->compactions;
+		}
+	}
+
+	void printStats() const
+	{
+		size_t vertexBytes = 0;
+		size_t usedVertexBytes = 0;
+		size_t indexBytes = 0;
+		size_t usedIndexBytes = 0;
+		unsigned rebuilds = 0;
+		size_t movedBytes = 0;
+		for (auto* i : this->buffers)
+		{
+			vertexBytes += i->getVertexBytes();
+			usedVertexBytes += static_cast<size_t>(i->getVertexAllocator().getUsed()) * i->getFormat().getStride();
+			indexBytes += i->getIndexBytes();
+			usedIndexBytes += static_cast<size_t>(i->getIndexAllocator().getUsed()) * (i->getIndexType() == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+			rebuilds += i->getRebuilds();
+			movedBytes += i->getMovedBytes();
+		}
+
+		std::cout << "GEOMETRYPOOL::BUFFERS: " << this->buffers.size()
+			<< " VERTEX_BYTES: " << usedVertexBytes << "/" << vertexBytes
+			<< " INDEX_BYTES: " << usedIndexBytes << "/" << indexBytes
+			<< " REBUILDS: " << rebuilds
+			<< " COMPACTIONS: " << this->compactions
+			<< " MOVED_BYTES: " << movedBytes << "\n";
+	}
+};
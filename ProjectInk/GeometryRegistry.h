@@ -0,0 +1,181 @@
+#pragma once
+#include<iostream>
+#include<string>
+#include<unordered_map>
+#include<typeinfo>
+#include<cstdint>
+
+#include "Geometry.h"
+#include "Primitives.h"
+#include "OBJImporter.h"
+
+//Owns every Geometry, keyed by where it came from, so identical sources are uploaded once.
+//Meshes acquire a handle and release it when they are destroyed; the buffers are freed with the last handle.
+class GeometryRegistry
+{
+private:
+	std::unordered_map<std::string, Geometry*> geometries;
+
+	//Counters
+	unsigned requests;
+	unsigned hits;
+	unsigned anonymous;
+	size_t uploadedBytes;
+	size_t avoidedBytes;
+	size_t compactedBytes;
+
+	GeometryRegistry()
+	{
+		this->requests = 0;
+		this->hits = 0;
+		this->anonymous = 0;
+		this->uploadedBytes = 0;
+		this->avoidedBytes = 0;
+		this->compactedBytes = 0;
+	}
+
+	GeometryRegistry(const GeometryRegistry&) = delete;
+	GeometryRegistry& operator=(const GeometryRegistry&) = delete;
+
+	static uint64_t hashBytes(const void* data, const size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+		return hash;
+	}
+
+	Geometry* find(const std::string& key)
+	{
+		++this->requests;
+
+		auto found = this->geometries.find(key);
+		if (found == this->geometries.end())
+			return nullptr;
+
+		++this->hits;
+		this->avoidedBytes += found->second->getSizeInBytes();
+		found->second->addReference();
+		return found->second;
+	}
+
+	Geometry* create(const std::string& key,
+		const Vertex* vertexArray, const unsigned nrOfVertices,
+		const GLuint* indexArray, const unsigned nrOfIndices,
+		const std::vector<MeshLOD>& lods = std::vector<MeshLOD>(), const VertexFormat& format = VertexFormat())
+	{
+		Geometry* geometry = new Geometry(key, vertexArray, nrOfVertices, indexArray, nrOfIndices, lods, format);
+		geometry->addReference();
+		this->uploadedBytes += geometry->getSizeInBytes();
+		this->compactedBytes += nrOfVertices * (sizeof(Vertex) - format.getStride());
+
+		if (key.empty())
+			++this->anonymous;
+		else
+			this->geometries[key] = geometry;
+
+		return geometry;
+	}
+
+public:
+	static GeometryRegistry& get()
+	{
+		static GeometryRegistry instance;
+		return instance;
+	}
+
+	//Accessors
+	unsigned getRequests() const { return this->requests; }
+
+	unsigned getHits() const { return this->hits; }
+
+	size_t getUniqueCount() const { return this->geometries.size() + this->anonymous; }
+
+	size_t getUploadedBytes() const { return this->uploadedBytes; }
+
+	size_t getAvoidedBytes() const { return this->avoidedBytes; }
+
+	//Vertex buffer bytes saved by compact vertex formats
+	size_t getCompactedBytes() const { return this->compactedBytes; }
+
+	//Functions
+
+	//Geometry that is not shared, e.g. built at runtime from raw arrays
+	Geometry* acquire(const Vertex* vertexArray, const unsigned nrOfVertices,
+		const GLuint* indexArray, const unsigned nrOfIndices)
+	{
+		++this->requests;
+		return this->create("", vertexArray, nrOfVertices, indexArray, nrOfIndices);
+	}
+
+	//Primitives are keyed by type and contents, so every Pyramid shares one set of buffers
+	Geometry* acquire(Primitives* primitive)
+	{
+		uint64_t hash = hashBytes(primitive->getVertices(), primitive->getnrOfVertices() * sizeof(Vertex));
+		hash = hashBytes(primitive->getIndices(), primitive->getnrOfIndices() * sizeof(GLuint), hash);
+
+		const std::string key = std::string("primitive:") + typeid(*primitive).name() + ":" + std::to_string(hash);
+
+		Geometry* geometry = this->find(key);
+		if (geometry)
+			return geometry;
+
+		return this->create(key,
+			primitive->getVertices(), primitive->getnrOfVertices(),
+			primitive->getIndices(), primitive->getnrOfIndices());
+	}
+
+	//OBJ files are keyed by path and import options, a hit skips the import as well as the upload.
+	//Levels of detail are built on import and kept in the .mesh cache, compact vertices are uploaded
+	//in the smallest VertexFormat within the default tolerance
+	Geometry* acquireOBJ(const char* fileName, const bool weldVertices = true, const bool generateLODs = true,
+		const bool compactVertices = true)
+	{
+		const std::string key = std::string("obj:") + fileName + (weldVertices ? "|weld" : "") +
+			(weldVertices && generateLODs ? "|lod" : "") + (compactVertices ? "|compact" : "");
+
+		Geometry* geometry = this->find(key);
+		if (geometry)
+			return geometry;
+
+		MeshData mesh = OBJImporter::load(fileName, true, weldVertices, generateLODs, compactVertices);
+		return this->create(key,
+			mesh.vertices.data(), static_cast<unsigned>(mesh.vertices.size()),
+			mesh.indices.empty() ? NULL : mesh.indices.data(), static_cast<unsigned>(mesh.indices.size()),
+			mesh.lods, mesh.format);
+	}
+
+	//Another handle to geometry that is already registered, e.g. when a Mesh is copied
+	Geometry* share(Geometry* geometry)
+	{
+		++this->requests;
+		++this->hits;
+		this->avoidedBytes += geometry->getSizeInBytes();
+		geometry->addReference();
+		return geometry;
+	}
+
+	void release(Geometry* geometry)
+	{
+		if (geometry == nullptr || !geometry->removeReference())
+			return;
+
+		if (geometry->getKey().empty())
+			--this->anonymous;
+		else
+			this->geometries.erase(geometry->getKey());
+
+		delete geometry;
+	}
+
+	void printStats() const
+	{
+		std::cout << "GEOMETRY::REQUESTS: " << this->requests
+			<< " UNIQUE: " << this->getUniqueCount()
+			<< " SHARED: " << this->hits
+			<< " UPLOADED_BYTES: " << this->uploadedBytes
+			<< " AVOIDED_BYTES: " << this->avoidedBytes
+			<< " COMPACTED_BYTES: " << this->compactedBytes << "\n";
+	}
+};
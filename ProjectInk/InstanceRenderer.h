@@ -0,0 +1,232 @@
+#pragma once
+#include<iostream>
+#include<vector>
+#include<map>
+#include<tuple>
+#include<cstring>
+
+#include<glew.h>
+
+#include<glm.hpp>
+#include<mat4x4.hpp>
+
+#include "Geometry.h"
+#include "Shader.h"
+#include "Texture.h"
+#include "TextureArray.h"
+#include "Material.h"
+#include "UniformCache.h"
+#include "RenderQueue.h"
+#include "StreamBuffer.h"
+
+//Groups everything that shares geometry, material and textures and draws each group with one instanced call.
+//The model matrices of all groups are packed into a single instance buffer that is uploaded once per frame,
+//every group then goes to the RenderQueue as one instanced packet.
+//With a StreamBuffer the instances are written straight into the ring, their place in it is folded into the
+//base instance of every group, so the instance attributes stay pointed at the start of the ring.
+//Textures from arrays only key a group by their arrays, the layers and the material index travel with every
+//instance, so models that differ in both still share one draw.
+class InstanceRenderer
+{
+private:
+	struct Batch
+	{
+		Geometry* geometry;
+		Material* material;
+		Texture* diffuseTex;
+		Texture* specularTex;
+		TextureArray* diffuseArray;
+		TextureArray* specularArray;
+
+		std::vector<InstanceData> matrices;
+		GLuint baseInstance;
+	};
+
+	typedef std::tuple<Geometry*, Material*, Texture*, Texture*, TextureArray*, TextureArray*> BatchKey;
+
+	std::vector<Batch> batches;
+	std::map<BatchKey, size_t> lookup;
+
+	std::vector<InstanceData> instances;
+	GLuint instanceBuffer;
+	size_t instanceCapacity;
+
+	//Buffer the instances of this frame are in, the ring or instanceBuffer
+	StreamBuffer* stream;
+	GLuint currentBuffer;
+
+	//Counters of the last frame
+	unsigned drawCalls;
+	unsigned instanceCount;
+
+	InstanceRenderer(const InstanceRenderer&) = delete;
+	InstanceRenderer& operator=(const InstanceRenderer&) = delete;
+
+	//Array batches read the material per instance, so it does not split them
+	static BatchKey getKey(Geometry* geometry, Material* material, Texture* diffuseTex, Texture* specularTex,
+		TextureArray* diffuseArray, TextureArray* specularArray)
+	{
+		return BatchKey(geometry, diffuseArray != nullptr ? nullptr : material, diffuseTex, specularTex, diffuseArray, specularArray);
+	}
+
+	Batch& getBatch(Geometry* geometry, Material* material, Texture* diffuseTex, Texture* specularTex,
+		TextureArray* diffuseArray, TextureArray* specularArray)
+	{
+		const BatchKey key = getKey(geometry, material, diffuseTex, specularTex, diffuseArray, specularArray);
+
+		auto found = this->lookup.find(key);
+		if (found == this->lookup.end())
+		{
+			Batch batch;
+			batch.geometry = geometry;
+			batch.material = material;
+			batch.diffuseTex = diffuseTex;
+			batch.specularTex = specularTex;
+			batch.diffuseArray = diffuseArray;
+			batch.specularArray = specularArray;
+			batch.baseInstance = 0;
+
+			found = this->lookup.insert(std::make_pair(key, this->batches.size())).first;
+			this->batches.push_back(batch);
+		}
+
+		return this->batches[found->second];
+	}
+
+	void upload()
+	{
+		this->instances.clear();
+		for (auto& i : this->batches)
+		{
+			i.baseInstance = static_cast<GLuint>(this->instances.size());
+			this->instances.insert(this->instances.end(), i.matrices.begin(), i.matrices.end());
+		}
+
+		this->currentBuffer = this->instanceBuffer;
+		if (this->instances.empty())
+			return;
+
+		if (this->stream != nullptr)
+		{
+			const GLsizeiptr size = this->instances.size() * sizeof(InstanceData);
+			GLintptr offset = 0;
+			void* target = this->stream->allocate(size, sizeof(InstanceData), offset);
+			if (target != nullptr)
+			{
+				std::memcpy(target, this->instances.data(), static_cast<size_t>(size));
+
+				const GLuint first = static_cast<GLuint>(offset / sizeof(InstanceData));
+				for (auto& i : this->batches)
+					i.baseInstance += first;
+
+				this->currentBuffer = this->stream->getID();
+				return;
+			}
+		}
+
+		//Grow geometrically and orphan the old storage so the driver does not stall on last frame's draws
+		if (this->instances.size() > this->instanceCapacity)
+			this->instanceCapacity = this->instances.size() + this->instances.size() / 2;
+
+		glBindBuffer(GL_ARRAY_BUFFER, this->instanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, this->instanceCapacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+
+		glBufferSubData(GL_ARRAY_BUFFER, 0, this->instances.size() * sizeof(InstanceData), this->instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+public:
+	InstanceRenderer(StreamBuffer* stream = nullptr)
+	{
+		glGenBuffers(1, &this->instanceBuffer);
+		this->instanceCapacity = 0;
+		this->stream = stream;
+		this->currentBuffer = this->instanceBuffer;
+		this->drawCalls = 0;
+		this->instanceCount = 0;
+	}
+
+	~InstanceRenderer()
+	{
+		glDeleteBuffers(1, &this->instanceBuffer);
+	}
+
+	//Accessors
+	unsigned getDrawCalls() const { return this->drawCalls; }
+
+	unsigned getInstanceCount() const { return this->instanceCount; }
+
+	//Functions
+
+	//Starts a new frame, batches are kept so their storage is reused. Batches nothing was added to in the last
+	//frame are dropped, so no key outlives the geometry or material its pointers belong to
+	void begin()
+	{
+		size_t kept = 0;
+		for (size_t i = 0; i < this->batches.size(); i++)
+		{
+			if (this->batches[i].matrices.empty())
+				continue;
+
+			if (kept != i)
+				this->batches[kept] = std::move(this->batches[i]);
+			this->batches[kept].matrices.clear();
+			++kept;
+		}
+
+		if (kept == this->batches.size())
+			return;
+
+		this->batches.resize(kept);
+		this->lookup.clear();
+		for (size_t i = 0; i < this->batches.size(); i++)
+		{
+			const Batch& batch = this->batches[i];
+			this->lookup.insert(std::make_pair(getKey(batch.geometry, batch.material, batch.diffuseTex, batch.specularTex,
+				batch.diffuseArray, batch.specularArray), i));
+		}
+	}
+
+	void add(Geometry* geometry, Material* material, Texture* diffuseTex, Texture* specularTex, const glm::mat4& ModelMatrix)
+	{
+		InstanceData instance;
+		instance.ModelMatrix = ModelMatrix;
+		instance.indices = glm::ivec4(0, 0, material->getIndex(), 0);
+
+		this->getBatch(geometry, material, diffuseTex, specularTex, nullptr, nullptr).matrices.push_back(instance);
+	}
+
+	void add(Geometry* geometry, Material* material, const TextureLayer& diffuse, const TextureLayer& specular, const glm::mat4& ModelMatrix)
+	{
+		InstanceData instance;
+		instance.ModelMatrix = ModelMatrix;
+		instance.indices = glm::ivec4(diffuse.layer, specular.layer, material->getIndex(), 0);
+
+		this->getBatch(geometry, material, nullptr, nullptr, diffuse.array, specular.array).matrices.push_back(instance);
+	}
+
+	void submit(RenderQueue& queue, UniformCache* program)
+	{
+		this->drawCalls = 0;
+		this->instanceCount = 0;
+
+		this->upload();
+
+		for (auto& i : this->batches)
+		{
+			if (i.matrices.empty())
+				continue;
+
+			i.geometry->setInstanceBuffer(this->currentBuffer);
+			if (i.diffuseArray != nullptr)
+				queue.submit(program, i.geometry, i.material, TextureLayer(i.diffuseArray), TextureLayer(i.specularArray), glm::mat4(1.f),
+					static_cast<GLsizei>(i.matrices.size()), i.baseInstance);
+			else
+				queue.submit(program, i.geometry, i.material, i.diffuseTex, i.specularTex, glm::mat4(1.f),
+					static_cast<GLsizei>(i.matrices.size()), i.baseInstance);
+
+			++this->drawCalls;
+			this->instanceCount += static_cast<unsigned>(i.matrices.size());
+		}
+	}
+};
@@ -0,0 +1,286 @@
+#pragma once
+#include<iostream>
+#include<vector>
+#include<deque>
+#include<memory>
+#include<functional>
+#include<algorithm>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<atomic>
+#include<chrono>
+
+class JobCounter;
+
+struct Job
+{
+	std::function<void()> function;
+	JobCounter* counter;
+};
+
+//Number of unfinished jobs attached to it. Jobs started with runAfter wait until it reaches zero
+class JobCounter
+{
+private:
+	friend class JobSystem;
+
+	std::mutex mutex;
+	int value;
+	std::vector<Job> continuations;
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+public:
+	JobCounter()
+	{
+		this->value = 0;
+	}
+
+	~JobCounter()
+	{
+
+	}
+
+	bool isDone()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->value == 0;
+	}
+};
+
+//Work stealing scheduler. Every thread has its own deque: it pushes and pops its own jobs at the back,
+//idle threads steal from the front of the others. The thread that creates the system is thread 0 and
+//helps out while it waits, so no core sits idle during a wait.
+class JobSystem
+{
+private:
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<std::thread> workers;
+
+	std::mutex sleepMutex;
+	std::condition_variable wakeUp;
+	std::atomic<int> pending;
+	std::atomic<bool> quit;
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	//Queue of the calling thread, threads the system does not own share queue 0
+	static int& getThreadIndex()
+	{
+		thread_local int index = 0;
+		return index;
+	}
+
+	void push(const Job& job)
+	{
+		const int index = getThreadIndex();
+		WorkerQueue& queue = *this->queues[index < static_cast<int>(this->queues.size()) ? index : 0];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(job);
+		}
+
+		++this->pending;
+		this->wakeUp.notify_one();
+	}
+
+	bool pop(Job& job)
+	{
+		const int count = static_cast<int>(this->queues.size());
+		const int index = std::min(getThreadIndex(), count - 1);
+
+		//Own work first, newest first while it is still in cache
+		{
+			WorkerQueue& queue = *this->queues[index];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.jobs.empty())
+			{
+				job = queue.jobs.back();
+				queue.jobs.pop_back();
+				--this->pending;
+				return true;
+			}
+		}
+
+		//Then the oldest, usually biggest, job of someone else
+		for (int i = 1; i < count; i++)
+		{
+			WorkerQueue& queue = *this->queues[(index + i) % count];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.jobs.empty())
+			{
+				job = queue.jobs.front();
+				queue.jobs.pop_front();
+				--this->pending;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void execute(Job& job)
+	{
+		job.function();
+
+		if (job.counter == nullptr)
+			return;
+
+		std::vector<Job> released;
+		{
+			std::lock_guard<std::mutex> lock(job.counter->mutex);
+			if (--job.counter->value == 0)
+				released.swap(job.counter->continuations);
+		}
+
+		for (auto& i : released)
+			this->push(i);
+	}
+
+	bool runOne()
+	{
+		Job job;
+		if (!this->pop(job))
+			return false;
+
+		this->execute(job);
+		return true;
+	}
+
+	void workerLoop(const int index)
+	{
+		getThreadIndex() = index;
+
+		while (!this->quit)
+		{
+			if (this->runOne())
+				continue;
+
+			std::unique_lock<std::mutex> lock(this->sleepMutex);
+			this->wakeUp.wait_for(lock, std::chrono::milliseconds(1), [this]() { return this->pending > 0 || this->quit; });
+		}
+	}
+
+public:
+	//0 workers runs every job on the thread that waits for it
+	JobSystem(const unsigned workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1)
+	{
+		this->pending = 0;
+		this->quit = false;
+
+		for (unsigned i = 0; i <= workerCount; i++)
+			this->queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+
+		getThreadIndex() = 0;
+		for (unsigned i = 1; i <= workerCount; i++)
+			this->workers.push_back(std::thread(&JobSystem::workerLoop, this, static_cast<int>(i)));
+	}
+
+	~JobSystem()
+	{
+		this->quit = true;
+		this->wakeUp.notify_all();
+
+		for (auto& i : this->workers)
+			i.join();
+	}
+
+	//Accessors
+
+	//Workers plus the owning thread
+	unsigned getThreadCount() const { return static_cast<unsigned>(this->queues.size()); }
+
+	//Index of the calling thread, between 0 and getThreadCount() - 1
+	unsigned getCurrentThread() const
+	{
+		const int index = getThreadIndex();
+		return index < static_cast<int>(this->queues.size()) ? static_cast<unsigned>(index) : 0;
+	}
+
+	//Functions
+	void run(const std::function<void()>& function, JobCounter* counter = nullptr)
+	{
+		Job job;
+		job.function = function;
+		job.counter = counter;
+
+		if (counter != nullptr)
+		{
+			std::lock_guard<std::mutex> lock(counter->mutex);
+			++counter->value;
+		}
+
+		this->push(job);
+	}
+
+	//Queued once every job on dependency has finished
+	void runAfter(JobCounter& dependency, const std::function<void()>& function, JobCounter* counter = nullptr)
+	{
+		Job job;
+		job.function = function;
+		job.counter = counter;
+
+		if (counter != nullptr)
+		{
+			std::lock_guard<std::mutex> lock(counter->mutex);
+			++counter->value;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(dependency.mutex);
+			if (dependency.value > 0)
+			{
+				dependency.continuations.push_back(job);
+				return;
+			}
+		}
+
+		this->push(job);
+	}
+
+	//Runs other jobs until the counter reaches zero
+	void wait(JobCounter& counter)
+	{
+		while (!counter.isDone())
+		{
+			if (!this->runOne())
+				std::this_thread::yield();
+		}
+	}
+
+	//function(begin, end) over [0, count) in chunks of grain, 0 picks a few chunks per thread
+	template<typename Function>
+	void parallelFor(const size_t count, Function function, size_t grain = 0)
+	{
+		if (count == 0)
+			return;
+
+		if (grain == 0)
+			grain = std::max<size_t>(1, (count + this->getThreadCount() * 4 - 1) / (this->getThreadCount() * 4));
+
+		//Nothing to share
+		if (grain >= count)
+		{
+			function(static_cast<size_t>(0), count);
+			return;
+		}
+
+		JobCounter counter;
+		for (size_t begin = 0; begin < count; begin += grain)
+		{
+			const size_t end = std::min(count, begin + grain);
+			this->run([&function, begin, end]() { function(begin, end); }, &counter);
+		}
+
+		this->wait(counter);
+	}
+};
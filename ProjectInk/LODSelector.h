@@ -0,0 +1,139 @@
+#pragma once
+#include<iostream>
+#include<cmath>
+
+#include<glm.hpp>
+#include<vec3.hpp>
+#include<mat4x4.hpp>
+
+#include "Geometry.h"
+#include "Bounds.h"
+
+//Picks a level of detail per mesh from how many pixels its simplification error covers on screen: the
+//coarsest level whose error stays under maxPixelError at the mesh's distance. A coarser level is only taken
+//once its error is below (1 - hysteresis) of the limit, so a mesh sitting at a switching distance does not
+//pop back and forth every frame. Going finer happens as soon as the current level gets too coarse.
+class LODSelector
+{
+private:
+	enum { MAX_COUNTED_LEVELS = 8 };
+
+	glm::vec3 cameraPosition;
+
+	//Pixels one unit covers at distance one
+	float projectionScale;
+
+	float maxPixelError;
+	float hysteresis;
+
+	//Counters, per frame
+	unsigned meshes;
+	unsigned switches;
+	size_t triangles;
+	size_t fullTriangles;
+	unsigned levels[MAX_COUNTED_LEVELS];
+
+	//Pixels the error of a level covers, the error scales with the mesh like its bounding sphere does
+	static float getPixelError(const Geometry* geometry, const unsigned lod, const float radiusPixels)
+	{
+		const float localRadius = geometry->getBoundingSphere().radius;
+		return geometry->getLODError(lod) * (localRadius > 0.f ? radiusPixels / localRadius : 0.f);
+	}
+
+public:
+	LODSelector(const float maxPixelError = 1.f, const float hysteresis = 0.25f)
+	{
+		this->cameraPosition = glm::vec3(0.f);
+		this->projectionScale = 1.f;
+		this->maxPixelError = maxPixelError;
+		this->hysteresis = hysteresis;
+		this->begin(this->cameraPosition, glm::mat4(1.f), 1);
+	}
+
+	//Accessors
+	float getMaxPixelError() const { return this->maxPixelError; }
+
+	float getHysteresis() const { return this->hysteresis; }
+
+	unsigned getSwitches() const { return this->switches; }
+
+	//Triangles of the selected levels this frame, and what full detail would have cost
+	size_t getTriangles() const { return this->triangles; }
+
+	size_t getFullTriangles() const { return this->fullTriangles; }
+
+	//Modifiers
+	void setMaxPixelError(const float maxPixelError)
+	{
+		this->maxPixelError = maxPixelError;
+	}
+
+	void setHysteresis(const float hysteresis)
+	{
+		this->hysteresis = hysteresis;
+	}
+
+	//Functions
+
+	//Once per frame, before select. viewportHeight in pixels
+	void begin(const glm::vec3& cameraPosition, const glm::mat4& ProjectionMatrix, const int viewportHeight)
+	{
+		this->cameraPosition = cameraPosition;
+		this->projectionScale = ProjectionMatrix[1][1] * viewportHeight * 0.5f;
+
+		this->meshes = 0;
+		this->switches = 0;
+		this->triangles = 0;
+		this->fullTriangles = 0;
+		for (auto& i : this->levels)
+			i = 0;
+	}
+
+	//Level to draw a mesh with, given the level it was drawn with last frame
+	unsigned select(Geometry* geometry, const BoundingSphere& worldSphere, const unsigned current)
+	{
+		const unsigned count = geometry->getLODCount();
+
+		//Nearest point of the bounds, a camera inside them always sees full detail
+		const float distance = glm::length(worldSphere.center - this->cameraPosition) - worldSphere.radius;
+
+		unsigned lod = 0;
+		if (count > 1 && distance > 0.f)
+		{
+			const float radiusPixels = this->projectionScale * worldSphere.radius / distance;
+
+			//Errors grow with every level, the first one over the limit ends the search
+			while (lod + 1 < count && getPixelError(geometry, lod + 1, radiusPixels) <= this->maxPixelError)
+				++lod;
+
+			if (lod > current)
+			{
+				const float limit = this->maxPixelError * (1.f - this->hysteresis);
+				unsigned coarser = current < count ? current : count - 1;
+				while (coarser < lod && getPixelError(geometry, coarser + 1, radiusPixels) <= limit)
+					++coarser;
+				lod = coarser;
+			}
+		}
+
+		++this->meshes;
+		if (lod != current)
+			++this->switches;
+		this->triangles += geometry->getLOD(lod)->getNrOfTriangles();
+		this->fullTriangles += geometry->getNrOfTriangles();
+		++this->levels[lod < MAX_COUNTED_LEVELS ? lod : MAX_COUNTED_LEVELS - 1];
+
+		return lod;
+	}
+
+	void printStats() const
+	{
+		std::cout << "LOD::MESHES: " << this->meshes
+			<< " SWITCHES: " << this->switches
+			<< " TRIANGLES: " << this->triangles << "/" << this->fullTriangles
+			<< " LEVELS:";
+		for (auto i : this->levels)
+			std::cout << " " << i;
+		std::cout << "\n";
+	}
+};
@@ -1,15 +1,134 @@
 #pragma once
-#include "libs.h"
+#include<glm.hpp>
+#include<vec3.hpp>
+#include<vec4.hpp>
 
+//std430 mirror of one entry of "LightTable" in the fragment shaders
+struct LightData
+{
+	glm::vec4 positionRadius;
+	glm::vec4 colorIntensity;
+
+	//x is the first of the six views in "ShadowTable", -1 without shadows
+	glm::ivec4 shadow;
+};
+
+static_assert(sizeof(LightData) == 48, "LightData does not match the std430 layout");
+
+//Point light with a finite range, nothing is lit beyond the radius.
+//A scene keeps its lights by value in one vector, LightClusterer reads them from there every frame.
+//Lights set to cast shadows get a cube map in the ShadowMapper's atlas, which hands back where it lives.
 class Light
 {
 private:
 	glm::vec3 position;
 	glm::vec3 color;
+	float radius;
+	float intensity;
+
+	bool shadowCaster;
+	int shadowView;
+
+public:
+	Light(const glm::vec3& position = glm::vec3(0.f),
+		const glm::vec3& color = glm::vec3(1.f),
+		const float radius = 10.f,
+		const float intensity = 1.f)
+	{
+		this->position = position;
+		this->color = color;
+		this->radius = radius;
+		this->intensity = intensity;
+		this->shadowCaster = false;
+		this->shadowView = -1;
+	}
+
+	~Light()
+	{
+
+	}
+
+	//Accessors
+	const glm::vec3& getPosition() const { return this->position; }
+
+	const glm::vec3& getColor() const { return this->color; }
+
+	float getRadius() const { return this->radius; }
+
+	float getIntensity() const { return this->intensity; }
+
+	bool castsShadows() const { return this->shadowCaster; }
+
+	int getShadowView() const { return this->shadowView; }
+
+	LightData getData() const
+	{
+		LightData data;
+		data.positionRadius = glm::vec4(this->position, this->radius);
+		data.colorIntensity = glm::vec4(this->color, this->intensity);
+		data.shadow = glm::ivec4(this->shadowView, 0, 0, 0);
+		return data;
+	}
+
+	//Modifiers
+	void setPosition(const glm::vec3& position) { this->position = position; }
+
+	void setColor(const glm::vec3& color) { this->color = color; }
+
+	void setRadius(const float radius) { this->radius = radius; }
+
+	void setIntensity(const float intensity) { this->intensity = intensity; }
+
+	void setCastsShadows(const bool shadowCaster) { this->shadowCaster = shadowCaster; }
+
+	//Set by the ShadowMapper every frame
+	void setShadowView(const int shadowView) { this->shadowView = shadowView; }
+};
+
+//Light from infinitely far away, the same direction everywhere. A scene has at most one, its sun,
+//which the ShadowMapper covers with cascades
+class DirectionalLight
+{
+private:
+	glm::vec3 direction;
+	glm::vec3 color;
+	float intensity;
+
+	bool shadowCaster;
 
 public:
-	Light();
+	DirectionalLight(const glm::vec3& direction = glm::vec3(0.f, -1.f, 0.f),
+		const glm::vec3& color = glm::vec3(1.f),
+		const float intensity = 0.f)
+	{
+		this->direction = glm::normalize(direction);
+		this->color = color;
+		this->intensity = intensity;
+		this->shadowCaster = false;
+	}
+
+	~DirectionalLight()
+	{
+
+	}
+
+	//Accessors
+
+	//Where the light travels, away from the sun
+	const glm::vec3& getDirection() const { return this->direction; }
+
+	const glm::vec3& getColor() const { return this->color; }
+
+	float getIntensity() const { return this->intensity; }
+
+	bool castsShadows() const { return this->shadowCaster; }
+
+	//Modifiers
+	void setDirection(const glm::vec3& direction) { this->direction = glm::normalize(direction); }
+
+	void setColor(const glm::vec3& color) { this->color = color; }
 
-	~Light();
+	void setIntensity(const float intensity) { this->intensity = intensity; }
 
-};
\ No newline at end of file
+	void setCastsShadows(const bool shadowCaster) { this->shadowCaster = shadowCaster; }
+};
@@ -0,0 +1,353 @@
+#pragma once
+#include<iostream>
+#include<vector>
+#include<algorithm>
+#include<cstring>
+#include<cmath>
+
+#include<glew.h>
+
+#include<glm.hpp>
+#include<vec3.hpp>
+#include<vec4.hpp>
+#include<mat4x4.hpp>
+
+#include "Light.h"
+#include "UniformBuffer.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+//Per frame counters of the binning pass
+struct LightClusterStats
+{
+	unsigned lights;
+	unsigned visibleLights;
+	unsigned indices;
+	unsigned occupiedClusters;
+	unsigned maxPerCluster;
+	unsigned overflows;
+};
+
+//Clustered forward lighting.
+//The view frustum is cut into a grid of froxels, GRID_X x GRID_Y screen tiles and GRID_Z depth slices that grow
+//exponentially with the distance. Every frame each light's sphere is binned into the froxels its view space
+//bounds overlap, one job per depth slice, and the grid goes to the GPU as three storage buffers:
+//the lights, an (offset, count) pair per froxel and the light indices the pairs point into.
+//A fragment finds its froxel from gl_FragCoord and its view depth and only shades the lights listed there.
+class LightClusterer
+{
+public:
+	enum { GRID_X = 16, GRID_Y = 9, GRID_Z = 24, TILE_COUNT = GRID_X * GRID_Y, CLUSTER_COUNT = TILE_COUNT * GRID_Z };
+
+	//Lights one froxel can list, the rest are dropped and counted as overflows
+	enum { MAX_LIGHTS_PER_CLUSTER = 256 };
+
+	//Shader storage binding points, next to MaterialTable::BINDING
+	enum { BINDING_LIGHTS = 1, BINDING_CLUSTERS = 2, BINDING_INDICES = 3 };
+
+private:
+	//Froxel range of a light, an empty range when it is outside the clustered depth
+	struct LightBounds
+	{
+		int minX, maxX;
+		int minY, maxY;
+		int minZ, maxZ;
+	};
+
+	//Indices of one depth slice, counted and filled by its own job
+	struct Slice
+	{
+		GLuint counts[TILE_COUNT];
+		GLuint offsets[TILE_COUNT];
+		std::vector<GLuint> indices;
+		unsigned overflows;
+	};
+
+	std::vector<LightData> lightData;
+	std::vector<LightBounds> bounds;
+	std::vector<Slice> slices;
+
+	std::vector<GLuint> clusters;
+	std::vector<GLuint> indices;
+
+	GLuint buffers[3];
+	size_t capacities[3];
+
+	float nearPlane;
+	float farPlane;
+	float sliceScale;
+	float sliceBias;
+	int width;
+	int height;
+
+	LightClusterStats stats;
+
+	LightClusterer(const LightClusterer&) = delete;
+	LightClusterer& operator=(const LightClusterer&) = delete;
+
+	int getSlice(const float depth) const
+	{
+		const int slice = static_cast<int>(std::floor(std::log(depth) * this->sliceScale + this->sliceBias));
+		return std::min(std::max(slice, 0), GRID_Z - 1);
+	}
+
+	static int getTile(const float ndc, const int count)
+	{
+		const int tile = static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * count));
+		return std::min(std::max(tile, 0), count - 1);
+	}
+
+	//Screen rect of the sphere's view space box, projected at its nearest and farthest depth so it stays
+	//conservative on both sides of the view axis
+	LightBounds getBounds(const glm::vec3& position, const float radius, const float scaleX, const float scaleY) const
+	{
+		LightBounds result = { 0, -1, 0, -1, 0, -1 };
+
+		const float depth = -position.z;
+		if (depth + radius < this->nearPlane || depth - radius > this->farPlane)
+			return result;
+
+		const float closest = std::max(depth - radius, this->nearPlane);
+		const float farthest = std::min(depth + radius, this->farPlane);
+
+		float minX = 1.f, maxX = -1.f, minY = 1.f, maxY = -1.f;
+		const float xs[2] = { position.x - radius, position.x + radius };
+		const float ys[2] = { position.y - radius, position.y + radius };
+		const float depths[2] = { closest, farthest };
+		for (float d : depths)
+		{
+			for (float x : xs)
+			{
+				minX = std::min(minX, x * scaleX / d);
+				maxX = std::max(maxX, x * scaleX / d);
+			}
+			for (float y : ys)
+			{
+				minY = std::min(minY, y * scaleY / d);
+				maxY = std::max(maxY, y * scaleY / d);
+			}
+		}
+
+		if (maxX < -1.f || minX > 1.f || maxY < -1.f || minY > 1.f)
+			return result;
+
+		result.minX = getTile(minX, GRID_X);
+		result.maxX = getTile(maxX, GRID_X);
+		result.minY = getTile(minY, GRID_Y);
+		result.maxY = getTile(maxY, GRID_Y);
+		result.minZ = this->getSlice(closest);
+		result.maxZ = this->getSlice(farthest);
+		return result;
+	}
+
+	//Counting sort of one slice's (tile, light) pairs into per tile lists
+	void binSlice(const int z)
+	{
+		Slice& slice = this->slices[z];
+		memset(slice.counts, 0, sizeof(slice.counts));
+		slice.overflows = 0;
+
+		for (const LightBounds& i : this->bounds)
+		{
+			if (z < i.minZ || z > i.maxZ)
+				continue;
+
+			for (int y = i.minY; y <= i.maxY; y++)
+				for (int x = i.minX; x <= i.maxX; x++)
+					++slice.counts[y * GRID_X + x];
+		}
+
+		GLuint offset = 0;
+		for (int i = 0; i < TILE_COUNT; i++)
+		{
+			if (slice.counts[i] > MAX_LIGHTS_PER_CLUSTER)
+			{
+				slice.overflows += slice.counts[i] - MAX_LIGHTS_PER_CLUSTER;
+				slice.counts[i] = MAX_LIGHTS_PER_CLUSTER;
+			}
+			slice.offsets[i] = offset;
+			offset += slice.counts[i];
+		}
+
+		slice.indices.resize(offset);
+
+		//Fill again in light order, counts are rebuilt as write cursors
+		GLuint cursors[TILE_COUNT];
+		memset(cursors, 0, sizeof(cursors));
+		for (size_t light = 0; light < this->bounds.size(); light++)
+		{
+			const LightBounds& i = this->bounds[light];
+			if (z < i.minZ || z > i.maxZ)
+				continue;
+
+			for (int y = i.minY; y <= i.maxY; y++)
+			{
+				for (int x = i.minX; x <= i.maxX; x++)
+				{
+					const int tile = y * GRID_X + x;
+					if (cursors[tile] < slice.counts[tile])
+						slice.indices[slice.offsets[tile] + cursors[tile]++] = static_cast<GLuint>(light);
+				}
+			}
+		}
+	}
+
+	void upload(const int buffer, const GLuint binding, const void* data, const size_t size)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->buffers[buffer]);
+
+		//Orphaned every frame like the instance buffer, grown geometrically. Never empty so the binding is valid
+		const size_t bytes = std::max<size_t>(size, 16);
+		if (bytes > this->capacities[buffer])
+			this->capacities[buffer] = bytes + bytes / 2;
+		glBufferData(GL_SHADER_STORAGE_BUFFER, this->capacities[buffer], NULL, GL_STREAM_DRAW);
+		if (size > 0)
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, this->buffers[buffer]);
+	}
+
+public:
+	LightClusterer()
+	{
+		glGenBuffers(3, this->buffers);
+		for (auto& i : this->capacities)
+			i = 0;
+
+		this->slices.resize(GRID_Z);
+		this->clusters.resize(CLUSTER_COUNT * 2);
+
+		this->nearPlane = 0.1f;
+		this->farPlane = 1000.f;
+		this->sliceScale = 0.f;
+		this->sliceBias = 0.f;
+		this->width = 1;
+		this->height = 1;
+		this->stats = LightClusterStats();
+	}
+
+	~LightClusterer()
+	{
+		glDeleteBuffers(3, this->buffers);
+	}
+
+	//Accessors
+	const LightClusterStats& getStats() const { return this->stats; }
+
+	//Offset and count of every froxel, x fastest, then y, then the depth slice
+	const std::vector<GLuint>& getClusters() const { return this->clusters; }
+
+	const std::vector<GLuint>& getIndices() const { return this->indices; }
+
+	//Functions
+
+	//CPU part, runs on the job threads when jobs is set. The planes have to match the projection
+	void build(const std::vector<Light>& lights, const glm::mat4& ViewMatrix, const glm::mat4& ProjectionMatrix,
+		const float nearPlane, const float farPlane, const int width, const int height, JobSystem* jobs = nullptr)
+	{
+		PROFILE_SCOPE("LightClusterer::build");
+
+		this->nearPlane = nearPlane;
+		this->farPlane = farPlane;
+		this->width = std::max(width, 1);
+		this->height = std::max(height, 1);
+
+		//slice = log(depth) * scale + bias puts nearPlane at 0 and farPlane at GRID_Z
+		this->sliceScale = GRID_Z / std::log(farPlane / nearPlane);
+		this->sliceBias = -GRID_Z * std::log(nearPlane) / std::log(farPlane / nearPlane);
+
+		const float scaleX = ProjectionMatrix[0][0];
+		const float scaleY = ProjectionMatrix[1][1];
+
+		this->lightData.resize(lights.size());
+		this->bounds.resize(lights.size());
+
+		auto transform = [&](const size_t first, const size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+			{
+				this->lightData[i] = lights[i].getData();
+				const glm::vec3 position(ViewMatrix * glm::vec4(lights[i].getPosition(), 1.f));
+				this->bounds[i] = this->getBounds(position, lights[i].getRadius(), scaleX, scaleY);
+			}
+		};
+
+		auto bin = [this](const size_t first, const size_t last)
+		{
+			for (size_t z = first; z < last; z++)
+				this->binSlice(static_cast<int>(z));
+		};
+
+		if (jobs != nullptr)
+		{
+			jobs->parallelFor(lights.size(), transform, 256);
+			jobs->parallelFor(GRID_Z, bin, 1);
+		}
+		else
+		{
+			transform(0, lights.size());
+			bin(0, GRID_Z);
+		}
+
+		//Slices are appended in order, their local offsets just move up by everything before them
+		this->stats = LightClusterStats();
+		this->stats.lights = static_cast<unsigned>(lights.size());
+		for (const LightBounds& i : this->bounds)
+		{
+			if (i.maxZ >= i.minZ)
+				++this->stats.visibleLights;
+		}
+
+		this->indices.clear();
+		for (int z = 0; z < GRID_Z; z++)
+		{
+			const Slice& slice = this->slices[z];
+			const GLuint base = static_cast<GLuint>(this->indices.size());
+			for (int i = 0; i < TILE_COUNT; i++)
+			{
+				const int cluster = z * TILE_COUNT + i;
+				this->clusters[cluster * 2] = base + slice.offsets[i];
+				this->clusters[cluster * 2 + 1] = slice.counts[i];
+
+				if (slice.counts[i] > 0)
+					++this->stats.occupiedClusters;
+				this->stats.maxPerCluster = std::max<unsigned>(this->stats.maxPerCluster, slice.counts[i]);
+			}
+			this->indices.insert(this->indices.end(), slice.indices.begin(), slice.indices.end());
+			this->stats.overflows += slice.overflows;
+		}
+		this->stats.indices = static_cast<unsigned>(this->indices.size());
+	}
+
+	//GL part, on the context thread after build
+	void upload()
+	{
+		PROFILE_SCOPE("LightClusterer::upload");
+
+		this->upload(0, BINDING_LIGHTS, this->lightData.data(), this->lightData.size() * sizeof(LightData));
+		this->upload(1, BINDING_CLUSTERS, this->clusters.data(), this->clusters.size() * sizeof(GLuint));
+		this->upload(2, BINDING_INDICES, this->indices.data(), this->indices.size() * sizeof(GLuint));
+	}
+
+	//What the fragment shaders need to find their froxel, goes out with the rest of the frame block
+	void writeFrameData(FrameData& frameData) const
+	{
+		frameData.clusterScale = glm::vec4(
+			static_cast<float>(GRID_X) / this->width,
+			static_cast<float>(GRID_Y) / this->height,
+			this->sliceScale,
+			this->sliceBias);
+		frameData.clusterGrid = glm::ivec4(GRID_X, GRID_Y, GRID_Z, static_cast<int>(this->lightData.size()));
+	}
+
+	void printStats() const
+	{
+		std::cout << "LIGHTCLUSTERER::LIGHTS: " << this->stats.lights
+			<< " VISIBLE: " << this->stats.visibleLights
+			<< " INDICES: " << this->stats.indices
+			<< " OCCUPIED: " << this->stats.occupiedClusters << "/" << CLUSTER_COUNT
+			<< " MAX_PER_CLUSTER: " << this->stats.maxPerCluster
+			<< " OVERFLOWS: " << this->stats.overflows << "\n";
+	}
+};
@@ -0,0 +1,120 @@
+#pragma once
+#include<iostream>
+#include<cstdint>
+#include<sys/types.h>
+#include<sys/stat.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include<windows.h>
+#else
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#endif
+
+//Read only memory mapping of a whole file
+class MappedFile
+{
+private:
+	const char* data;
+	size_t size;
+
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int file;
+#endif
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+	MappedFile(const char* fileName)
+	{
+		this->data = nullptr;
+		this->size = 0;
+
+#ifdef _WIN32
+		this->mapping = NULL;
+		this->file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (this->file == INVALID_HANDLE_VALUE)
+			return;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(this->file, &fileSize) || fileSize.QuadPart == 0)
+			return;
+		this->size = static_cast<size_t>(fileSize.QuadPart);
+
+		this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (this->mapping == NULL)
+			return;
+
+		this->data = static_cast<const char*>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+		this->file = open(fileName, O_RDONLY);
+		if (this->file < 0)
+			return;
+
+		struct stat info;
+		if (fstat(this->file, &info) != 0 || info.st_size == 0)
+			return;
+		this->size = static_cast<size_t>(info.st_size);
+
+		void* view = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, this->file, 0);
+		if (view == MAP_FAILED)
+			return;
+
+		madvise(view, this->size, MADV_SEQUENTIAL);
+		this->data = static_cast<const char*>(view);
+#endif
+	}
+
+	~MappedFile()
+	{
+#ifdef _WIN32
+		if (this->data)
+			UnmapViewOfFile(this->data);
+		if (this->mapping != NULL)
+			CloseHandle(this->mapping);
+		if (this->file != INVALID_HANDLE_VALUE)
+			CloseHandle(this->file);
+#else
+		if (this->data)
+			munmap(const_cast<char*>(this->data), this->size);
+		if (this->file >= 0)
+			close(this->file);
+#endif
+	}
+
+	//Accessors
+	bool isOpen() const { return this->data != nullptr; }
+
+	const char* getData() const { return this->data; }
+
+	size_t getSize() const { return this->size; }
+
+	//Size and modification time, used to tell if a derived cache file is stale
+	static bool getStamp(const char* fileName, uint64_t& size, int64_t& modified)
+	{
+#ifdef _WIN32
+		struct _stat64 info;
+		if (_stat64(fileName, &info) != 0)
+			return false;
+#else
+		struct stat info;
+		if (stat(fileName, &info) != 0)
+			return false;
+#endif
+		size = static_cast<uint64_t>(info.st_size);
+		modified = static_cast<int64_t>(info.st_mtime);
+		return true;
+	}
+};
@@ -8,6 +8,8 @@
 #include<mat4x4.hpp>
 #include<gtc/type_ptr.hpp>
 #include"Shader.h"
+#include"UniformCache.h"
+#include"MaterialTable.h"
 
 class Material
 {
@@ -19,6 +21,21 @@ private:
 	GLint diffuseTex;
 	GLint specularTex;
 
+	//Entry in the MaterialTable, shared with every material of the same values
+	GLint index;
+
+	void updateTable()
+	{
+		MaterialData data;
+		data.ambient = glm::vec4(this->ambient, 1.f);
+		data.diffuse = glm::vec4(this->diffuse, 1.f);
+		data.specular = glm::vec4(this->specular, 1.f);
+
+		//Acquired before the old entry is released, so an unchanged material keeps its index
+		const GLint index = MaterialTable::get().acquire(data);
+		MaterialTable::get().release(this->index);
+		this->index = index;
+	}
 
 public:
 	Material(glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, GLint diffuseTex, GLint specularTex)
@@ -28,21 +45,52 @@ public:
 		this->specular = specular;
 		this->diffuseTex = diffuseTex;
 		this->specularTex = diffuseTex;
+		this->index = -1;
+		this->updateTable();
 	}
 
+	Material(const Material&) = delete;
+	Material& operator=(const Material&) = delete;
+
 	~Material()
 	{
-		
+		MaterialTable::get().release(this->index);
+	}
+
+	//Accessors
+	GLint getIndex() const { return this->index; }
+
+	const glm::vec3& getAmbient() const { return this->ambient; }
+
+	const glm::vec3& getDiffuse() const { return this->diffuse; }
+
+	const glm::vec3& getSpecular() const { return this->specular; }
+
+	//Modifiers
+	void setAmbient(const glm::vec3& ambient)
+	{
+		this->ambient = ambient;
+		this->updateTable();
+	}
+
+	void setDiffuse(const glm::vec3& diffuse)
+	{
+		this->diffuse = diffuse;
+		this->updateTable();
+	}
+
+	void setSpecular(const glm::vec3& specular)
+	{
+		this->specular = specular;
+		this->updateTable();
 	}
 
 	//Functions
-	void sendToShader(Shader& program)
+
+	//The values live in the MaterialTable, a draw only carries the index. Textures are bound to fixed units
+	void sendToShader(UniformCache& program)
 	{
-		program.setVec3f(this->ambient, "material.ambient");
-		program.setVec3f(this->diffuse, "material.diffuse");
-		program.setVec3f(this->specular, "material.specular");
-		program.set1i(this->diffuseTex,"material.diffuseTex");
-		program.set1i(this->specularTex,"material.specularTex");
+		program.getDrawData().indices.z = this->index;
 	}
 
 };
@@ -0,0 +1,171 @@
+#pragma once
+#include<iostream>
+#include<vector>
+#include<unordered_map>
+#include<cstring>
+#include<cstdint>
+
+#include<glew.h>
+
+#include<glm.hpp>
+#include<vec4.hpp>
+
+//std430 mirror of one entry of "MaterialTable" in the fragment shaders
+struct MaterialData
+{
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+};
+
+static_assert(sizeof(MaterialData) == 48, "MaterialData does not match the std430 layout");
+
+//Every material of the scene in one shader storage buffer, shaders fetch their entry by index.
+//Identical materials share an entry, the buffer is only uploaded again in a frame where an entry changed.
+class MaterialTable
+{
+private:
+	std::vector<MaterialData> entries;
+	std::vector<unsigned> references;
+	std::vector<GLint> freeEntries;
+	std::unordered_map<uint64_t, GLint> lookup;
+
+	GLuint buffer;
+	size_t capacity;
+	bool dirty;
+
+	//Counters
+	unsigned requests;
+	unsigned hits;
+	unsigned uploads;
+
+	MaterialTable()
+	{
+		this->buffer = 0;
+		this->capacity = 0;
+		this->dirty = false;
+		this->requests = 0;
+		this->hits = 0;
+		this->uploads = 0;
+	}
+
+	MaterialTable(const MaterialTable&) = delete;
+	MaterialTable& operator=(const MaterialTable&) = delete;
+
+	static uint64_t hash(const MaterialData& data)
+	{
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&data);
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < sizeof(MaterialData); i++)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+		return hash;
+	}
+
+public:
+	//Shader storage binding point of the table
+	enum { BINDING = 0 };
+
+	static MaterialTable& get()
+	{
+		static MaterialTable instance;
+		return instance;
+	}
+
+	//Accessors
+	const MaterialData& getData(const GLint index) const { return this->entries[index]; }
+
+	size_t getUniqueCount() const { return this->entries.size() - this->freeEntries.size(); }
+
+	unsigned getUploads() const { return this->uploads; }
+
+	//Functions
+
+	//Index of an entry holding data, shared when an identical one exists
+	GLint acquire(const MaterialData& data)
+	{
+		++this->requests;
+
+		const uint64_t key = hash(data);
+		auto found = this->lookup.find(key);
+		if (found != this->lookup.end() && memcmp(&this->entries[found->second], &data, sizeof(MaterialData)) == 0)
+		{
+			++this->hits;
+			++this->references[found->second];
+			return found->second;
+		}
+
+		GLint index = 0;
+		if (!this->freeEntries.empty())
+		{
+			index = this->freeEntries.back();
+			this->freeEntries.pop_back();
+			this->entries[index] = data;
+			this->references[index] = 1;
+		}
+		else
+		{
+			index = static_cast<GLint>(this->entries.size());
+			this->entries.push_back(data);
+			this->references.push_back(1);
+		}
+
+		if (found == this->lookup.end())
+			this->lookup[key] = index;
+
+		this->dirty = true;
+		return index;
+	}
+
+	void release(const GLint index)
+	{
+		if (index < 0 || --this->references[index] > 0)
+			return;
+
+		auto found = this->lookup.find(hash(this->entries[index]));
+		if (found != this->lookup.end() && found->second == index)
+			this->lookup.erase(found);
+
+		this->freeEntries.push_back(index);
+	}
+
+	//Before drawing, does nothing while no entry changed. The buffer stays bound to BINDING
+	void upload()
+	{
+		if (!this->dirty || this->entries.empty())
+			return;
+
+		if (this->buffer == 0)
+			glGenBuffers(1, &this->buffer);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->buffer);
+		if (this->entries.size() > this->capacity)
+		{
+			this->capacity = this->entries.size() + this->entries.size() / 2;
+			glBufferData(GL_SHADER_STORAGE_BUFFER, this->capacity * sizeof(MaterialData), NULL, GL_DYNAMIC_DRAW);
+		}
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, this->entries.size() * sizeof(MaterialData), this->entries.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING, this->buffer);
+
+		this->dirty = false;
+		++this->uploads;
+	}
+
+	//Frees the buffer, must run while the context is still current
+	void clear()
+	{
+		glDeleteBuffers(1, &this->buffer);
+		this->buffer = 0;
+		this->capacity = 0;
+		this->dirty = !this->entries.empty();
+	}
+
+	void printStats() const
+	{
+		std::cout << "MATERIALTABLE::REQUESTS: " << this->requests
+			<< " UNIQUE: " << this->getUniqueCount()
+			<< " SHARED: " << this->hits
+			<< " UPLOADS: " << this->uploads << "\n";
+	}
+};
@@ -6,80 +6,46 @@
 #include "Shader.h"
 #include "Texture.h"
 #include "Material.h"
+#include "UniformCache.h"
+#include "Geometry.h"
+#include "Bounds.h"
+#include "GeometryRegistry.h"
+#include "TransformSystem.h"
+#include "Profiler.h"
 
 class Mesh
 {
 private:
-	Vertex* vertexArray;
-	unsigned nrOfVertices;
-	GLuint* indexArray;
-	unsigned nrOfIndices;
+	Geometry* geometry;
 
-	GLuint VAO;
-	GLuint VBO;
-	GLuint EBO;
+	//Handle into the TransformSystem, which owns position, origin, rotation, scale and the ModelMatrix
+	int transform;
 
-	glm::vec3 position;
-	glm::vec3 origin;
-	glm::vec3 rotation;
-	glm::vec3 scale;
+	//World space bounds, follow the ModelMatrix
+	AABB worldBounds;
+	BoundingSphere worldSphere;
 
-	glm::mat4 ModelMatrix;
+	//Result of the last cull pass
+	bool visible;
 
-	void initVAO()	
+	//Level of detail drawn, picked by a LODSelector
+	unsigned lod;
+
+	void updateUniforms(UniformCache* program)
 	{
-		//create VAO
-		glCreateVertexArrays(1, &this->VAO);
-		glBindVertexArray(this->VAO);
-
-		//gen vao and bind and send data
-
-		glGenBuffers(1, &this->VBO);
-		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->nrOfVertices * sizeof(Vertex), this->vertexArray, GL_STATIC_DRAW);
-
-		//gen ebo and bind and sent data
-		if (this->nrOfIndices > 0)
-		{
-			glGenBuffers(1, &this->EBO);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->nrOfIndices * sizeof(GLuint), this->indexArray, GL_STATIC_DRAW);
-		}
-		
+		const glm::mat4 ModelMatrix = this->getDrawMatrix();
 
-		//set vertex attribpointers enable (input assebmly)
-			//GLuint attribloc = glGetAttribLocation(core_program, "vertex_position"); //not important rn, can replace the first 0 in the next line and in the one after it.
-		//position
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, position));
-		glEnableVertexAttribArray(0);
-		//color
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, color));
-		glEnableVertexAttribArray(1);
-		//texcoord
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, texcoord));
-		glEnableVertexAttribArray(2);
-		//normal
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
-		glEnableVertexAttribArray(3);
-
-		//Bind VAO 0
-		glBindVertexArray(0);
+		program->getDrawData().ModelMatrix = ModelMatrix;
+		program->setMat4fv(ModelMatrix, UNIFORM_MODEL_MATRIX);
+		program->commitDrawData();
 	}
 
-	void updateUniforms(Shader* shader)
-	{
-		shader->setMat4fv(this->ModelMatrix, "ModelMatrix");
-	}
-	
-	void updateModelMatrix()
+	void updateBounds()
 	{
-		this->ModelMatrix = glm::mat4(1.f);
-		this->ModelMatrix = glm::translate(this->ModelMatrix, this->origin);
-		this->ModelMatrix = glm::rotate(this->ModelMatrix, glm::radians(this->rotation.x), glm::vec3(1.f, 0.f, 0.f));
-		this->ModelMatrix = glm::rotate(this->ModelMatrix, glm::radians(this->rotation.y), glm::vec3(0.f, 1.f, 0.f));
-		this->ModelMatrix = glm::rotate(this->ModelMatrix, glm::radians(this->rotation.z), glm::vec3(0.f, 0.f, 1.f));
-		this->ModelMatrix = glm::translate(this->ModelMatrix, this->position - this->origin);
-		this->ModelMatrix = glm::scale(this->ModelMatrix, this->scale);
+		const glm::mat4& ModelMatrix = this->getModelMatrix();
+
+		this->worldBounds = this->geometry->getBounds().transform(ModelMatrix);
+		this->worldSphere = this->geometry->getBoundingSphere().transform(ModelMatrix);
 	}
 public:
 	Mesh(Vertex* vertexArray, 
@@ -91,27 +57,12 @@ public:
 		glm::vec3 rotation = glm::vec3(0.f),
 		glm::vec3 scale = glm::vec3(1.f))
 	{
-		this->position = position;
-		this->origin = origin;
-		this->rotation = rotation;
-		this->scale = scale;
-
-		this->nrOfVertices = nrOfVertices;
-		this->nrOfIndices = nrOfIndices;
-
-		this->vertexArray = new Vertex[this->nrOfVertices];
-		for (size_t i = 0; i < nrOfVertices; i++)
-		{
-			this->vertexArray[i] = vertexArray[i];
-		}
-		this->indexArray = new GLuint[this->nrOfIndices];
-		for (size_t i = 0; i < nrOfIndices; i++)
-		{
-			this->indexArray[i] = indexArray[i];
-		}
-
-		this->initVAO();
-		this->updateModelMatrix();
+		this->transform = TransformSystem::get().create(position, origin, rotation, scale);
+
+		this->geometry = GeometryRegistry::get().acquire(vertexArray, nrOfVertices, indexArray, nrOfIndices);
+
+		this->visible = true;
+		this->lod = 0;
 		
 	}
 	
@@ -121,139 +72,182 @@ public:
 		glm::vec3 rotation = glm::vec3(0.f),
 		glm::vec3 scale = glm::vec3(1.f))
 	{
-		this->position = position;
-		this->origin = origin;
-		this->rotation = rotation;
-		this->scale = scale;
-
-		this->nrOfVertices = primitive->getnrOfVertices();
-		this->nrOfIndices = primitive->getnrOfIndices();
-
-		this->vertexArray = new Vertex[this->nrOfVertices];
-		for (size_t i = 0; i < this->nrOfVertices; i++)
-		{
-			this->vertexArray[i] = primitive->getVertices()[i];
-		}
-		this->indexArray = new GLuint[this->nrOfIndices];
-		for (size_t i = 0; i < nrOfIndices; i++)
-		{
-			this->indexArray[i] = primitive->getIndices()[i];
-		}
-
-		this->initVAO();
-		this->updateModelMatrix();
+		this->transform = TransformSystem::get().create(position, origin, rotation, scale);
+
+		this->geometry = GeometryRegistry::get().acquire(primitive);
+
+		this->visible = true;
+		this->lod = 0;
+
+	}
+
+	//Takes over a handle from the GeometryRegistry
+	Mesh(Geometry* geometry,
+		glm::vec3 position = glm::vec3(0.f),
+		glm::vec3 origin = glm::vec3(0.f),
+		glm::vec3 rotation = glm::vec3(0.f),
+		glm::vec3 scale = glm::vec3(1.f))
+	{
+		this->transform = TransformSystem::get().create(position, origin, rotation, scale);
+
+		this->geometry = geometry;
+
+		this->visible = true;
+		this->lod = 0;
 
 	}
 	
+	//Copies share the geometry, only the transform is duplicated
 	Mesh(const Mesh& obj)
 	{
-		this->position = obj.position;
-		this->origin = obj.origin;
-		this->rotation = obj.rotation;
-		this->scale = obj.scale;
-
-		this->nrOfVertices = obj.nrOfVertices;
-		this->nrOfIndices = obj.nrOfIndices;
-
-		this->vertexArray = new Vertex[this->nrOfVertices];
-		for (size_t i = 0; i < this->nrOfVertices; i++)
-		{
-			this->vertexArray[i] = obj.vertexArray[i];
-		}
-		this->indexArray = new GLuint[this->nrOfIndices];
-		for (size_t i = 0; i < nrOfIndices; i++)
-		{
-			this->indexArray[i] = obj.indexArray[i];
-		}
-
-		this->initVAO();
-		this->updateModelMatrix();
+		TransformSystem& transforms = TransformSystem::get();
+		this->transform = transforms.create(transforms.getPosition(obj.transform), transforms.getOrigin(obj.transform),
+			transforms.getRotation(obj.transform), transforms.getScale(obj.transform));
+
+		this->geometry = GeometryRegistry::get().share(obj.geometry);
+
+		this->visible = true;
+		this->lod = 0;
 
 	}
 
 	~Mesh()
 	{
-		glDeleteVertexArrays(1, &this->VAO);
-		glDeleteBuffers(1, &this->VBO);
-		if(this->nrOfIndices > 0)
-		glDeleteBuffers(1, &this->EBO);
-
-		delete[] this->vertexArray;
-		delete[] this->indexArray;
+		GeometryRegistry::get().release(this->geometry);
+		TransformSystem::get().destroy(this->transform);
 	}
 
 	//Accessors
+	Geometry* getGeometry() const
+	{
+		return this->geometry;
+	}
 
+	int getTransform() const
+	{
+		return this->transform;
+	}
 
+	//Valid after TransformSystem::update
+	const glm::mat4& getModelMatrix() const
+	{
+		return TransformSystem::get().getWorldMatrix(this->transform);
+	}
+
+	//The ModelMatrix the shaders take, includes decoding quantized positions
+	glm::mat4 getDrawMatrix() const
+	{
+		return this->geometry->getDrawMatrix(this->getModelMatrix());
+	}
+
+	const AABB& getWorldBounds() const
+	{
+		return this->worldBounds;
+	}
+
+	const BoundingSphere& getWorldSphere() const
+	{
+		return this->worldSphere;
+	}
+
+	bool isVisible() const
+	{
+		return this->visible;
+	}
+
+	unsigned getLOD() const
+	{
+		return this->lod;
+	}
+
+	//The level of detail that is drawn, the full geometry when it has none
+	Geometry* getLODGeometry() const
+	{
+		return this->geometry->getLOD(this->lod);
+	}
 
 	//Modifiers
 
 	void setPosition(const glm::vec3 position)
 	{
-		this->position = position;
+		TransformSystem::get().setPosition(this->transform, position);
 	}
 
 	void setOrigin(const glm::vec3 origin)
 	{
-		this->origin = origin;
+		TransformSystem::get().setOrigin(this->transform, origin);
 	}
 
 	void setRotation(const glm::vec3 rotation)
 	{
-		this->rotation = rotation;
+		TransformSystem::get().setRotation(this->transform, rotation);
 	}
 	
 	void setScale(const glm::vec3 scale)
 	{
-		this->scale = scale;
+		TransformSystem::get().setScale(this->transform, scale);
+	}
+
+	void setVisible(const bool visible)
+	{
+		this->visible = visible;
+	}
+
+	void setLOD(const unsigned lod)
+	{
+		this->lod = lod;
+	}
+
+	//Position, origin, rotation and scale become relative to the parent transform
+	void setParent(const int parent)
+	{
+		TransformSystem::get().setParent(this->transform, parent);
 	}
 
 	//Functions
 
 	void move(const glm::vec3 position)
 	{
-		this->position += position;
+		TransformSystem::get().move(this->transform, position);
 	}
 	
 	void rotate(const glm::vec3 rotation)
 	{
-		this->rotation += rotation;
+		TransformSystem::get().rotate(this->transform, rotation);
 	}
 	
 	void scaleUp(const glm::vec3 scale)
 	{
-		this->scale += scale;
+		TransformSystem::get().scaleUp(this->transform, scale);
 	}
 
 	
-	void update()
+	//After TransformSystem::update, returns true when the ModelMatrix changed
+	bool update()
 	{
-	
+		if (!TransformSystem::get().hasChanged(this->transform))
+			return false;
+
+		this->updateBounds();
+
+		return true;
 	}
 	
-	void render(Shader* shader)
+	void render(UniformCache* program)
 	{
+		PROFILE_SCOPE("Mesh::render");
+
 		//Update uniform
-		this->updateModelMatrix();
-		this->updateUniforms(shader);
+		this->updateUniforms(program);
 
-		shader->use();
+		program->getShader()->use();
 
 		//Bind VAO
-		glBindVertexArray(this->VAO);
+		glBindVertexArray(this->geometry->getVAO());
 		
 		
 		//Render
-		if (this->nrOfIndices == 0)
-			glDrawArrays(GL_TRIANGLES,0,this->nrOfVertices);
-		else
-			glDrawElements(GL_TRIANGLES, this->nrOfIndices, GL_UNSIGNED_INT, 0);
-		
-		//CleanUp
-		glBindVertexArray(0);
-		glUseProgram(0);
-		glActiveTexture(0);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		this->getLODGeometry()->draw();
 	}
 };
 
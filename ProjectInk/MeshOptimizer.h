@@ -0,0 +1,375 @@
+#pragma once
+#include<vector>
+#include<algorithm>
+#include<cstdint>
+#include<cmath>
+
+#include<glew.h>
+
+#include<glm.hpp>
+#include<vec3.hpp>
+
+#include "Vertex.h"
+
+//Post-transform cache behaviour of an index buffer, from a FIFO cache simulation
+struct VertexCacheStats
+{
+	//Vertices transformed per triangle, about 0.5 is the best a closed mesh can do and 3 the worst
+	float acmr;
+
+	//Vertices transformed per vertex the indices reference, 1 is the best
+	float atvr;
+};
+
+//Reorders indexed triangle lists for the GPU, in the order the passes are meant to run:
+//triangles for the post-transform vertex cache (Tipsify, Sander, Nehab and Barczak), then the clusters that
+//pass leaves behind for overdraw, outward facing ones first so they occlude the rest from most directions,
+//then vertices into the order the triangles first use them so vertex fetches stream through memory.
+//None of it changes what is drawn, only the order
+class MeshOptimizer
+{
+private:
+	enum : GLuint { NONE = 0xFFFFFFFFu };
+
+	//Triangles using every vertex
+	struct Adjacency
+	{
+		std::vector<GLuint> offsets;
+		std::vector<GLuint> triangles;
+	};
+
+	static void buildAdjacency(Adjacency& adjacency, const std::vector<GLuint>& indices, const size_t vertexCount)
+	{
+		adjacency.offsets.assign(vertexCount + 1, 0);
+		adjacency.triangles.resize(indices.size());
+
+		for (GLuint i : indices)
+			++adjacency.offsets[i + 1];
+		for (size_t i = 0; i < vertexCount; i++)
+			adjacency.offsets[i + 1] += adjacency.offsets[i];
+
+		std::vector<GLuint> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++)
+			adjacency.triangles[fill[indices[i]]++] = static_cast<GLuint>(i / 3);
+	}
+
+	static size_t getVertexCount(const std::vector<GLuint>& indices)
+	{
+		GLuint count = 0;
+		for (GLuint i : indices)
+			count = std::max(count, i + 1);
+
+		return count;
+	}
+
+	//A FIFO cache kept as the time every vertex entered it, time only advances on a miss.
+	//A vertex is cached while fewer than cacheSize others entered after it
+	struct Cache
+	{
+		std::vector<unsigned> timestamps;
+		unsigned time;
+		unsigned size;
+
+		Cache(const size_t vertexCount, const unsigned size)
+			: timestamps(vertexCount, 0), time(size + 1), size(size) {}
+
+		bool contains(const GLuint vertex) const { return this->time - this->timestamps[vertex] <= this->size; }
+
+		//Returns the number of misses, 0 or 1
+		unsigned access(const GLuint vertex)
+		{
+			if (this->contains(vertex))
+				return 0;
+
+			this->timestamps[vertex] = this->time++;
+			return 1;
+		}
+
+		void flush()
+		{
+			this->time += this->size + 1;
+		}
+	};
+
+	//Tipsify's choice of the next vertex to fan around: the one of the last fan that stays longest in the
+	//cache and still has triangles, as long as those triangles would not push it out. Otherwise a dead end
+	static GLuint getNextVertex(const std::vector<GLuint>& candidates, const std::vector<GLuint>& live, const Cache& cache)
+	{
+		GLuint best = NONE;
+		int bestPriority = -1;
+		for (GLuint v : candidates)
+		{
+			if (live[v] == 0)
+				continue;
+
+			const unsigned age = cache.time - cache.timestamps[v];
+			int priority = 0;
+			if (age + 2 * live[v] <= cache.size)
+				priority = static_cast<int>(age);
+
+			if (priority > bestPriority)
+			{
+				best = v;
+				bestPriority = priority;
+			}
+		}
+
+		return best;
+	}
+
+	//Most recently used vertex that still has triangles, else the next one in input order
+	static GLuint skipDeadEnd(std::vector<GLuint>& deadEnds, const std::vector<GLuint>& live, GLuint& cursor)
+	{
+		while (!deadEnds.empty())
+		{
+			const GLuint v = deadEnds.back();
+			deadEnds.pop_back();
+			if (live[v] > 0)
+				return v;
+		}
+
+		for (; cursor < live.size(); cursor++)
+		{
+			if (live[cursor] > 0)
+				return cursor;
+		}
+
+		return NONE;
+	}
+
+	//Splits every cluster further wherever the triangles so far already reach threshold times the ACMR of
+	//the whole cluster with a cold cache, so starting over cold costs at most that much
+	static std::vector<size_t> splitClusters(const std::vector<GLuint>& indices, const std::vector<size_t>& clusters,
+		const size_t vertexCount, const float threshold, const unsigned cacheSize)
+	{
+		Cache cache(vertexCount, cacheSize);
+		std::vector<size_t> result;
+
+		for (size_t c = 0; c < clusters.size(); c++)
+		{
+			const size_t begin = clusters[c];
+			const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : indices.size() / 3;
+
+			cache.flush();
+			unsigned misses = 0;
+			for (size_t t = begin; t < end; t++)
+			{
+				for (size_t j = 0; j < 3; j++)
+					misses += cache.access(indices[t * 3 + j]);
+			}
+			const float limit = threshold * misses / (end - begin);
+
+			cache.flush();
+			result.push_back(begin);
+			size_t start = begin;
+			misses = 0;
+			for (size_t t = begin; t + 1 < end; t++)
+			{
+				for (size_t j = 0; j < 3; j++)
+					misses += cache.access(indices[t * 3 + j]);
+
+				if (misses <= limit * (t + 1 - start))
+				{
+					cache.flush();
+					result.push_back(t + 1);
+					start = t + 1;
+					misses = 0;
+				}
+			}
+		}
+
+		return result;
+	}
+
+public:
+	//Vertices most GPUs keep after transforming them, small enough to not fit a mesh to one vendor
+	enum { CACHE_SIZE = 16 };
+
+	static VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices, const unsigned cacheSize = CACHE_SIZE)
+	{
+		VertexCacheStats stats = VertexCacheStats();
+		if (indices.empty())
+			return stats;
+
+		const size_t vertexCount = getVertexCount(indices);
+		Cache cache(vertexCount, cacheSize);
+		std::vector<bool> used(vertexCount, false);
+
+		size_t misses = 0;
+		size_t unique = 0;
+		for (GLuint i : indices)
+		{
+			misses += cache.access(i);
+			if (!used[i])
+			{
+				used[i] = true;
+				++unique;
+			}
+		}
+
+		stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+		stats.atvr = static_cast<float>(misses) / unique;
+		return stats;
+	}
+
+	//Tipsify: fans around one vertex at a time and moves on to a neighbour that is still in the cache.
+	//clusters receives the first triangle of every run that started at a dead end, such a run shares little
+	//with the triangles before it and can be moved around as a whole
+	static std::vector<GLuint> optimizeVertexCache(const std::vector<GLuint>& indices, const unsigned cacheSize = CACHE_SIZE,
+		std::vector<size_t>* clusters = nullptr)
+	{
+		std::vector<GLuint> result;
+		result.reserve(indices.size());
+		if (clusters)
+			clusters->clear();
+		if (indices.empty())
+			return result;
+
+		const size_t vertexCount = getVertexCount(indices);
+		Adjacency adjacency;
+		buildAdjacency(adjacency, indices, vertexCount);
+
+		std::vector<GLuint> live(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+			live[i] = adjacency.offsets[i + 1] - adjacency.offsets[i];
+
+		std::vector<bool> emitted(indices.size() / 3, false);
+		std::vector<GLuint> deadEnds;
+		std::vector<GLuint> candidates;
+		Cache cache(vertexCount, cacheSize);
+
+		GLuint cursor = 0;
+		GLuint vertex = skipDeadEnd(deadEnds, live, cursor);
+		bool deadEnd = true;
+		while (vertex != NONE)
+		{
+			if (deadEnd && clusters)
+				clusters->push_back(result.size() / 3);
+
+			candidates.clear();
+			for (GLuint i = adjacency.offsets[vertex]; i < adjacency.offsets[vertex + 1]; i++)
+			{
+				const GLuint triangle = adjacency.triangles[i];
+				if (emitted[triangle])
+					continue;
+
+				for (size_t j = 0; j < 3; j++)
+				{
+					const GLuint v = indices[triangle * 3 + j];
+					result.push_back(v);
+					deadEnds.push_back(v);
+					candidates.push_back(v);
+					--live[v];
+					cache.access(v);
+				}
+				emitted[triangle] = true;
+			}
+
+			vertex = getNextVertex(candidates, live, cache);
+			deadEnd = vertex == NONE;
+			if (deadEnd)
+				vertex = skipDeadEnd(deadEnds, live, cursor);
+		}
+
+		return result;
+	}
+
+	//Cache order first, then its clusters sorted so the ones facing away from the middle of the mesh come first.
+	//threshold is how much worse than the cache order the ACMR may get, smaller clusters sort better
+	static std::vector<GLuint> optimizeOverdraw(const std::vector<GLuint>& indices, const Vertex* vertices,
+		const float threshold = 1.05f, const unsigned cacheSize = CACHE_SIZE)
+	{
+		std::vector<size_t> hardClusters;
+		std::vector<GLuint> ordered = optimizeVertexCache(indices, cacheSize, &hardClusters);
+		if (ordered.empty())
+			return ordered;
+
+		const size_t triangleCount = ordered.size() / 3;
+		const std::vector<size_t> clusters = splitClusters(ordered, hardClusters, getVertexCount(ordered), threshold, cacheSize);
+
+		//Area weighted centroid and normal per cluster
+		std::vector<glm::vec3> centroids(clusters.size(), glm::vec3(0.f));
+		std::vector<glm::vec3> normals(clusters.size(), glm::vec3(0.f));
+		std::vector<float> areas(clusters.size(), 0.f);
+		glm::vec3 meshCentroid(0.f);
+		float meshArea = 0.f;
+
+		for (size_t c = 0; c < clusters.size(); c++)
+		{
+			const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+			for (size_t t = clusters[c]; t < end; t++)
+			{
+				const glm::vec3& a = vertices[ordered[t * 3]].position;
+				const glm::vec3& b = vertices[ordered[t * 3 + 1]].position;
+				const glm::vec3& d = vertices[ordered[t * 3 + 2]].position;
+
+				const glm::vec3 normal = glm::cross(b - a, d - a);
+				const float area = glm::length(normal);
+
+				centroids[c] += (a + b + d) * (area / 3.f);
+				normals[c] += normal;
+				areas[c] += area;
+			}
+
+			meshCentroid += centroids[c];
+			meshArea += areas[c];
+		}
+		if (meshArea > 0.f)
+			meshCentroid = meshCentroid / meshArea;
+
+		std::vector<float> keys(clusters.size(), 0.f);
+		for (size_t c = 0; c < clusters.size(); c++)
+		{
+			const float length = glm::length(normals[c]);
+			if (areas[c] > 0.f && length > 0.f)
+				keys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / length);
+		}
+
+		std::vector<size_t> order(clusters.size());
+		for (size_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) { return keys[a] > keys[b]; });
+
+		std::vector<GLuint> result;
+		result.reserve(ordered.size());
+		for (size_t c : order)
+		{
+			const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+			result.insert(result.end(), ordered.begin() + clusters[c] * 3, ordered.begin() + end * 3);
+		}
+
+		return result;
+	}
+
+	//Moves vertices into the order the indices first use them and rewrites the indices to match.
+	//Unused vertices go last. Returns where every vertex went, for other index lists over the same vertices
+	static std::vector<GLuint> optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+	{
+		std::vector<GLuint> remap(vertices.size(), NONE);
+		GLuint next = 0;
+		for (auto& i : indices)
+		{
+			if (remap[i] == NONE)
+				remap[i] = next++;
+			i = remap[i];
+		}
+		for (auto& i : remap)
+		{
+			if (i == NONE)
+				i = next++;
+		}
+
+		std::vector<Vertex> ordered(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+			ordered[remap[i]] = vertices[i];
+		vertices.swap(ordered);
+
+		return remap;
+	}
+
+	static void remapIndices(std::vector<GLuint>& indices, const std::vector<GLuint>& remap)
+	{
+		for (auto& i : indices)
+			i = remap[i];
+	}
+};
@@ -0,0 +1,612 @@
+#pragma once
+#include<vector>
+#include<algorithm>
+#include<cstring>
+#include<cstdint>
+#include<cmath>
+
+#include<glew.h>
+
+#include<glm.hpp>
+#include<vec3.hpp>
+
+#include "Vertex.h"
+
+//One simplified level of a mesh, indexes the vertices of the full detail level
+struct MeshLOD
+{
+	std::vector<GLuint> indices;
+
+	//How far the surface may have moved from the full detail level, in model units
+	float error;
+};
+
+//Quadric error edge collapse (Garland and Heckbert) on indexed triangle lists.
+//Every collapse merges a vertex into a neighbour that keeps its place, so simplified levels index the
+//original vertices and never invent normals or texcoords. Vertices on an open border only slide along
+//the border, vertices on a UV or normal seam only along the seam and take their copy on the other side
+//with them; anything more tangled than that stays where it is.
+class MeshSimplifier
+{
+private:
+	enum : GLuint { NONE = 0xFFFFFFFFu };
+
+	enum vertex_kind { KIND_MANIFOLD = 0, KIND_BORDER, KIND_SEAM, KIND_LOCKED };
+
+	//Border planes outweigh the surface, outlines and holes are the first thing a coarse level loses
+	static constexpr double BORDER_WEIGHT = 4.0;
+
+	//Collapses that turn a triangle by more than about 75 degrees fold the surface over
+	static constexpr float FLIP_LIMIT = 0.25f;
+
+	//Area weighted sum of squared distances to planes, v'Av + 2b'v + c
+	struct Quadric
+	{
+		double a00, a11, a22, a01, a02, a12;
+		double b0, b1, b2;
+		double c;
+		double weight;
+	};
+
+	struct Collapse
+	{
+		GLuint from;
+		GLuint to;
+		float error;
+	};
+
+	//Outgoing half edges of every vertex
+	struct Adjacency
+	{
+		std::vector<GLuint> offsets;
+		std::vector<GLuint> targets;
+	};
+
+	static void addPlane(Quadric& q, const glm::vec3& normal, const float distance, const double weight)
+	{
+		const double x = normal.x, y = normal.y, z = normal.z, d = distance;
+
+		q.a00 += weight * x * x;
+		q.a11 += weight * y * y;
+		q.a22 += weight * z * z;
+		q.a01 += weight * x * y;
+		q.a02 += weight * x * z;
+		q.a12 += weight * y * z;
+		q.b0 += weight * x * d;
+		q.b1 += weight * y * d;
+		q.b2 += weight * z * d;
+		q.c += weight * d * d;
+		q.weight += weight;
+	}
+
+	static void add(Quadric& q, const Quadric& other)
+	{
+		q.a00 += other.a00;
+		q.a11 += other.a11;
+		q.a22 += other.a22;
+		q.a01 += other.a01;
+		q.a02 += other.a02;
+		q.a12 += other.a12;
+		q.b0 += other.b0;
+		q.b1 += other.b1;
+		q.b2 += other.b2;
+		q.c += other.c;
+		q.weight += other.weight;
+	}
+
+	//Mean squared distance of a point to the planes
+	static float evaluate(const Quadric& q, const glm::vec3& p)
+	{
+		const double x = p.x, y = p.y, z = p.z;
+		const double result =
+			q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+			2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+			2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+
+		return q.weight > 0.0 ? static_cast<float>(std::fabs(result) / q.weight) : 0.f;
+	}
+
+	static void buildAdjacency(Adjacency& adjacency, const std::vector<GLuint>& indices, const size_t vertexCount)
+	{
+		adjacency.offsets.assign(vertexCount + 1, 0);
+		adjacency.targets.resize(indices.size());
+
+		for (GLuint i : indices)
+			++adjacency.offsets[i + 1];
+		for (size_t i = 0; i < vertexCount; i++)
+			adjacency.offsets[i + 1] += adjacency.offsets[i];
+
+		std::vector<GLuint> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (size_t j = 0; j < 3; j++)
+			{
+				const GLuint from = indices[i + j];
+				adjacency.targets[fill[from]++] = indices[i + (j + 1) % 3];
+			}
+		}
+	}
+
+	static bool hasEdge(const Adjacency& adjacency, const GLuint from, const GLuint to)
+	{
+		for (GLuint i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; i++)
+		{
+			if (adjacency.targets[i] == to)
+				return true;
+		}
+
+		return false;
+	}
+
+	//Working state, kept between the levels of a chain so every level continues from the one before
+	struct State
+	{
+		size_t vertexCount;
+		float scale;
+
+		//Positions scaled into the unit cube, so the quadrics stay well conditioned
+		std::vector<glm::vec3> positions;
+
+		//First vertex at the same position, and the next vertex at that position in a closed ring
+		std::vector<GLuint> remap;
+		std::vector<GLuint> wedge;
+
+		std::vector<unsigned char> kind;
+
+		//Next and previous vertex along an open border or seam
+		std::vector<GLuint> loop;
+		std::vector<GLuint> loopback;
+
+		//Indexed by position, see remap
+		std::vector<Quadric> quadrics;
+
+		std::vector<GLuint> indices;
+		float error;
+	};
+
+	static void weldPositions(State& state, const Vertex* vertices)
+	{
+		state.remap.resize(state.vertexCount);
+		state.wedge.resize(state.vertexCount);
+
+		size_t tableSize = 64;
+		while (tableSize < state.vertexCount * 2)
+			tableSize *= 2;
+		const size_t mask = tableSize - 1;
+		std::vector<GLuint> table(tableSize, NONE);
+
+		for (size_t i = 0; i < state.vertexCount; i++)
+		{
+			uint32_t words[3];
+			memcpy(words, &vertices[i].position, sizeof(words));
+			uint32_t hash = 2166136261u;
+			for (uint32_t w : words)
+				hash = (hash ^ w) * 16777619u;
+
+			size_t slot = (hash ^ (hash >> 15)) & mask;
+			while (table[slot] != NONE && memcmp(&vertices[table[slot]].position, &vertices[i].position, sizeof(glm::vec3)) != 0)
+				slot = (slot + 1) & mask;
+
+			if (table[slot] == NONE)
+				table[slot] = static_cast<GLuint>(i);
+
+			const GLuint first = table[slot];
+			state.remap[i] = first;
+			state.wedge[i] = static_cast<GLuint>(i);
+			if (first != i)
+			{
+				state.wedge[i] = state.wedge[first];
+				state.wedge[first] = static_cast<GLuint>(i);
+			}
+		}
+	}
+
+	//An edge only one triangle uses is open. A vertex with a single copy and a single open edge in and out
+	//lies on a border; two copies whose open edges run along the same positions in opposite directions are a seam
+	static void classify(State& state)
+	{
+		const size_t count = state.vertexCount;
+
+		Adjacency adjacency;
+		buildAdjacency(adjacency, state.indices, count);
+
+		//NONE without an open edge, the vertex itself when there is more than one
+		std::vector<GLuint> openOut(count, NONE);
+		std::vector<GLuint> openIn(count, NONE);
+		for (size_t i = 0; i < state.indices.size(); i += 3)
+		{
+			for (size_t j = 0; j < 3; j++)
+			{
+				const GLuint from = state.indices[i + j];
+				const GLuint to = state.indices[i + (j + 1) % 3];
+				if (hasEdge(adjacency, to, from))
+					continue;
+
+				openOut[from] = openOut[from] == NONE ? to : from;
+				openIn[to] = openIn[to] == NONE ? from : to;
+			}
+		}
+
+		state.kind.assign(count, KIND_LOCKED);
+		for (size_t i = 0; i < count; i++)
+		{
+			if (state.remap[i] != i)
+				continue;
+
+			const GLuint out = openOut[i];
+			const GLuint in = openIn[i];
+
+			if (state.wedge[i] == i)
+			{
+				if (out == NONE && in == NONE)
+					state.kind[i] = KIND_MANIFOLD;
+				else if (out != NONE && in != NONE && out != i && in != i)
+					state.kind[i] = KIND_BORDER;
+			}
+			else if (state.wedge[state.wedge[i]] == i)
+			{
+				const GLuint w = state.wedge[i];
+				const GLuint outW = openOut[w];
+				const GLuint inW = openIn[w];
+
+				if (out != NONE && out != i && in != NONE && in != i &&
+					outW != NONE && outW != w && inW != NONE && inW != w &&
+					state.remap[in] == state.remap[outW] && state.remap[out] == state.remap[inW] &&
+					state.remap[in] != state.remap[out])
+					state.kind[i] = KIND_SEAM;
+			}
+		}
+
+		for (size_t i = 0; i < count; i++)
+			state.kind[i] = state.kind[state.remap[i]];
+
+		state.loop.swap(openOut);
+		state.loopback.swap(openIn);
+	}
+
+	static void buildQuadrics(State& state)
+	{
+		state.quadrics.assign(state.vertexCount, Quadric());
+
+		for (size_t i = 0; i < state.indices.size(); i += 3)
+		{
+			const GLuint corners[3] = { state.indices[i], state.indices[i + 1], state.indices[i + 2] };
+			const glm::vec3& p0 = state.positions[corners[0]];
+			const glm::vec3& p1 = state.positions[corners[1]];
+			const glm::vec3& p2 = state.positions[corners[2]];
+
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			const float length = glm::length(normal);
+			if (length <= 0.f)
+				continue;
+			normal = normal / length;
+
+			Quadric plane = Quadric();
+			addPlane(plane, normal, -glm::dot(normal, p0), length * 0.5);
+			for (GLuint j : corners)
+				add(state.quadrics[state.remap[j]], plane);
+
+			//Planes through open edges, standing on the triangle, keep borders and seams in place
+			for (size_t j = 0; j < 3; j++)
+			{
+				const GLuint from = corners[j];
+				const GLuint to = corners[(j + 1) % 3];
+				const unsigned char kind = state.kind[from];
+				if ((kind != KIND_BORDER && kind != KIND_SEAM) || state.loop[from] != to)
+					continue;
+
+				//Both sides of a seam see the edge, it is only added once
+				if (kind == KIND_SEAM && state.remap[from] > state.remap[to])
+					continue;
+
+				const glm::vec3 edge = state.positions[to] - state.positions[from];
+				const float edgeLength = glm::length(edge);
+				if (edgeLength <= 0.f)
+					continue;
+
+				const glm::vec3 edgeNormal = glm::normalize(glm::cross(edge, normal));
+				Quadric edgePlane = Quadric();
+				addPlane(edgePlane, edgeNormal, -glm::dot(edgeNormal, state.positions[from]),
+					edgeLength * edgeLength * (kind == KIND_BORDER ? BORDER_WEIGHT : 1.0));
+				add(state.quadrics[state.remap[from]], edgePlane);
+				add(state.quadrics[state.remap[to]], edgePlane);
+			}
+		}
+	}
+
+	static void init(State& state, const Vertex* vertices, const size_t vertexCount, const std::vector<GLuint>& indices)
+	{
+		state.vertexCount = vertexCount;
+		state.indices = indices;
+		state.error = 0.f;
+
+		glm::vec3 minimum(0.f), maximum(0.f);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			minimum = i == 0 ? vertices[i].position : glm::min(minimum, vertices[i].position);
+			maximum = i == 0 ? vertices[i].position : glm::max(maximum, vertices[i].position);
+		}
+
+		const glm::vec3 extent = maximum - minimum;
+		state.scale = std::fmax(extent.x, std::fmax(extent.y, extent.z));
+		if (state.scale <= 0.f)
+			state.scale = 1.f;
+
+		state.positions.resize(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+			state.positions[i] = (vertices[i].position - minimum) / state.scale;
+
+		weldPositions(state, vertices);
+		classify(state);
+		buildQuadrics(state);
+	}
+
+	static bool canCollapse(const State& state, const GLuint from, const GLuint to)
+	{
+		if (state.remap[from] == state.remap[to])
+			return false;
+
+		switch (state.kind[from])
+		{
+		case KIND_MANIFOLD:
+			return true;
+		case KIND_BORDER:
+		case KIND_SEAM:
+			return state.kind[to] == state.kind[from] && (state.loop[from] == to || state.loopback[from] == to);
+		default:
+			return false;
+		}
+	}
+
+	//Whether moving "from" onto "to" turns another triangle around it too far, or the triangles the edge
+	//removes reach different copies of a target that has several (a pole, the end of a seam), then the
+	//rest of the fan would stretch one copy's texcoords across all of them. siblingTarget is where the
+	//other copy of a seam vertex goes. Neighbours already collapsed in this pass are looked at where they ended up
+	static bool isBlocked(const State& state, const std::vector<GLuint>& triangleOffsets, const std::vector<GLuint>& triangles,
+		const std::vector<GLuint>& collapseRemap, const GLuint from, const GLuint to, const GLuint siblingTarget)
+	{
+		const GLuint position = state.remap[from];
+		const GLuint target = state.remap[to];
+		const glm::vec3& moved = state.positions[to];
+
+		for (GLuint t = triangleOffsets[position]; t < triangleOffsets[position + 1]; t++)
+		{
+			const size_t triangle = triangles[t];
+			GLuint corners[3];
+			int self = -1;
+			int collapses = -1;
+			for (int j = 0; j < 3; j++)
+			{
+				corners[j] = collapseRemap[state.indices[triangle + j]];
+				if (state.remap[corners[j]] == position)
+					self = j;
+				else if (state.remap[corners[j]] == target)
+					collapses = j;
+			}
+
+			if (self < 0)
+				continue;
+
+			if (collapses >= 0)
+			{
+				if (state.wedge[to] != to && corners[collapses] != (corners[self] == from ? to : siblingTarget))
+					return true;
+				continue;
+			}
+
+			const glm::vec3& a = state.positions[corners[(self + 1) % 3]];
+			const glm::vec3& b = state.positions[corners[(self + 2) % 3]];
+			const glm::vec3 before = glm::cross(a - state.positions[corners[self]], b - state.positions[corners[self]]);
+			const glm::vec3 after = glm::cross(a - moved, b - moved);
+
+			if (glm::dot(before, after) < FLIP_LIMIT * glm::length(before) * glm::length(after))
+				return true;
+		}
+
+		return false;
+	}
+
+	//Loops pointing at a collapsed vertex follow it, unless the collapse ran against the loop
+	static void remapLoops(std::vector<GLuint>& loop, const std::vector<GLuint>& collapseRemap)
+	{
+		for (size_t i = 0; i < loop.size(); i++)
+		{
+			if (loop[i] == NONE || loop[i] == i)
+				continue;
+
+			const GLuint next = loop[i];
+			const GLuint target = collapseRemap[next];
+			loop[i] = target == i ? loop[next] : target;
+		}
+	}
+
+	//Passes of independent collapses, cheapest first, until at most targetIndexCount indices are left or
+	//nothing can collapse any more. Returns false when a pass could not collapse anything
+	static bool simplify(State& state, const size_t targetIndexCount)
+	{
+		std::vector<GLuint> triangleOffsets;
+		std::vector<GLuint> triangles;
+		std::vector<Collapse> collapses;
+		std::vector<GLuint> collapseRemap(state.vertexCount);
+		std::vector<unsigned char> locked(state.vertexCount);
+
+		while (state.indices.size() > targetIndexCount)
+		{
+			//Triangles around every position
+			triangleOffsets.assign(state.vertexCount + 1, 0);
+			for (GLuint i : state.indices)
+				++triangleOffsets[state.remap[i] + 1];
+			for (size_t i = 0; i < state.vertexCount; i++)
+				triangleOffsets[i + 1] += triangleOffsets[i];
+			triangles.resize(state.indices.size());
+			std::vector<GLuint> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for (size_t i = 0; i < state.indices.size(); i++)
+				triangles[fill[state.remap[state.indices[i]]]++] = static_cast<GLuint>(i - i % 3);
+
+			//The cheaper direction of every edge that may collapse
+			collapses.clear();
+			for (size_t i = 0; i < state.indices.size(); i += 3)
+			{
+				for (size_t j = 0; j < 3; j++)
+				{
+					const GLuint v0 = state.indices[i + j];
+					const GLuint v1 = state.indices[i + (j + 1) % 3];
+
+					const bool forward = canCollapse(state, v0, v1);
+					const bool backward = canCollapse(state, v1, v0);
+					if (!forward && !backward)
+						continue;
+
+					const float error0 = forward ? evaluate(state.quadrics[state.remap[v0]], state.positions[v1]) : 0.f;
+					const float error1 = backward ? evaluate(state.quadrics[state.remap[v1]], state.positions[v0]) : 0.f;
+
+					Collapse collapse;
+					const bool useForward = forward && (!backward || error0 <= error1);
+					collapse.from = useForward ? v0 : v1;
+					collapse.to = useForward ? v1 : v0;
+					collapse.error = useForward ? error0 : error1;
+					collapses.push_back(collapse);
+				}
+			}
+
+			if (collapses.empty())
+				return false;
+
+			std::sort(collapses.begin(), collapses.end(),
+				[](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+			//Every collapse removes about two triangles. A pass stops well above the error it needs
+			//to reach the goal, so cheap collapses that open up in the next pass go first
+			const size_t goal = (state.indices.size() - targetIndexCount) / 3;
+			const size_t collapseGoal = goal / 2 + 1;
+			const float errorGoal = collapseGoal < collapses.size() ? collapses[collapseGoal].error * 1.5f : collapses.back().error;
+
+			for (size_t i = 0; i < state.vertexCount; i++)
+				collapseRemap[i] = static_cast<GLuint>(i);
+			std::fill(locked.begin(), locked.end(), 0);
+
+			size_t removed = 0;
+			size_t collapsed = 0;
+			for (const Collapse& collapse : collapses)
+			{
+				const GLuint from = collapse.from;
+				const GLuint to = collapse.to;
+				if (locked[state.remap[from]] || locked[state.remap[to]])
+					continue;
+
+				if (collapse.error > errorGoal && collapsed > collapseGoal / 10)
+					break;
+
+				//The copy on the other side of a seam goes to the matching copy of the target
+				GLuint siblingTarget = to;
+				if (state.kind[from] == KIND_SEAM)
+				{
+					const GLuint sibling = state.wedge[from];
+					siblingTarget = state.loop[from] == to ? state.loopback[sibling] : state.loop[sibling];
+					if (siblingTarget == NONE || siblingTarget == sibling || state.remap[siblingTarget] != state.remap[to])
+						continue;
+				}
+
+				if (isBlocked(state, triangleOffsets, triangles, collapseRemap, from, to, siblingTarget))
+					continue;
+
+				collapseRemap[state.wedge[from]] = siblingTarget;
+				collapseRemap[from] = to;
+				add(state.quadrics[state.remap[to]], state.quadrics[state.remap[from]]);
+				locked[state.remap[from]] = 1;
+				locked[state.remap[to]] = 1;
+
+				state.error = std::fmax(state.error, collapse.error);
+				removed += state.kind[from] == KIND_BORDER ? 1 : 2;
+				++collapsed;
+
+				if (removed >= goal)
+					break;
+			}
+
+			if (collapsed == 0)
+				return false;
+
+			remapLoops(state.loop, collapseRemap);
+			remapLoops(state.loopback, collapseRemap);
+
+			//Triangles whose corners met are gone
+			size_t write = 0;
+			for (size_t i = 0; i < state.indices.size(); i += 3)
+			{
+				const GLuint a = collapseRemap[state.indices[i]];
+				const GLuint b = collapseRemap[state.indices[i + 1]];
+				const GLuint c = collapseRemap[state.indices[i + 2]];
+				if (state.remap[a] == state.remap[b] || state.remap[b] == state.remap[c] || state.remap[c] == state.remap[a])
+					continue;
+
+				state.indices[write++] = a;
+				state.indices[write++] = b;
+				state.indices[write++] = c;
+			}
+			state.indices.resize(write);
+		}
+
+		return true;
+	}
+
+	//Square root of the mean squared plane distance, back in model units
+	static float getError(const State& state)
+	{
+		return std::sqrt(state.error) * state.scale;
+	}
+
+public:
+	enum
+	{
+		MAX_LEVELS = 6,
+		MIN_TRIANGLES = 32
+	};
+
+	//Indices of a copy with at most targetIndexCount indices, fewer collapses happen when the rest would
+	//have to move a locked vertex. error receives how far the surface moved, in model units
+	static std::vector<GLuint> simplify(const Vertex* vertices, const size_t vertexCount,
+		const std::vector<GLuint>& indices, const size_t targetIndexCount, float* error = nullptr)
+	{
+		State state;
+		init(state, vertices, vertexCount, indices);
+		simplify(state, targetIndexCount);
+
+		if (error != nullptr)
+			*error = getError(state);
+
+		return state.indices;
+	}
+
+	//Up to maxLevels simplified levels, each with about ratio times the triangles of the one before.
+	//The chain ends early at MIN_TRIANGLES or once a level barely gets smaller than the previous one
+	static std::vector<MeshLOD> buildLODs(const Vertex* vertices, const size_t vertexCount,
+		const std::vector<GLuint>& indices, const size_t maxLevels = MAX_LEVELS, const float ratio = 0.5f)
+	{
+		std::vector<MeshLOD> lods;
+		if (indices.size() < 3 * MIN_TRIANGLES * 2)
+			return lods;
+
+		State state;
+		init(state, vertices, vertexCount, indices);
+
+		for (size_t level = 0; level < maxLevels; level++)
+		{
+			const size_t previous = state.indices.size();
+			const size_t target = static_cast<size_t>(previous / 3 * ratio) * 3;
+			if (target < 3 * MIN_TRIANGLES)
+				break;
+
+			simplify(state, target);
+			if (state.indices.size() * 10 > previous * 9)
+				break;
+
+			MeshLOD lod;
+			lod.indices = state.indices;
+			lod.error = getError(state);
+			lods.push_back(lod);
+		}
+
+		return lods;
+	}
+};
@@ -1,9 +1,19 @@
 #pragma once
 #include "Mesh.h"
 #include "Texture.h"
+#include "TextureArray.h"
 #include "Shader.h"
 #include "Material.h"
-#include "OBJLoader.h"
+#include "GeometryRegistry.h"
+#include "InstanceRenderer.h"
+#include "GPUCuller.h"
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+#include "ShadowMapper.h"
+#include "LODSelector.h"
+#include "Bounds.h"
+#include "TransformSystem.h"
+#include "Profiler.h"
 
 class Model
 {
@@ -11,9 +21,31 @@ private:
 	Material* material;
 	Texture* overrideTextureDiffuse;
 	Texture* overrideTextureSpecular;
+
+	//Used instead of the override textures once set, see setTextureLayers
+	TextureLayer layerDiffuse;
+	TextureLayer layerSpecular;
+
 	std::vector<Mesh*> meshes;
 	glm::vec3 position;
 
+	//Parent of every mesh transform, rotates around the model's position
+	int transform;
+
+	//World bounds of all meshes and the leaf holding them in the scene tree
+	AABB bounds;
+	int proxy;
+	bool moved;
+
+	//Never expected to move, its shadows are cached
+	bool staticGeometry;
+
+	//Solid and large enough to hide others, drawn into the OcclusionCuller's depth buffer
+	bool occluder;
+
+	//Handle of every mesh in the GPUCuller, once added
+	std::vector<unsigned> gpuObjects;
+
 	void updateUniforms()
 	{
 
@@ -31,7 +63,9 @@ public:
 		this->material = material;
 		this->overrideTextureDiffuse = orTexDif;
 		this->overrideTextureSpecular = orTexSpec;
+		this->transform = TransformSystem::get().create(this->position, this->position);
 
+		//Copies only duplicate the transform, the geometry is shared
 		for (auto* i : meshes)
 		{
 			this->meshes.push_back(new Mesh(*i));
@@ -39,9 +73,14 @@ public:
 
 		for (auto& i : this->meshes)
 		{
-			i->move(this->position);
-			i->setOrigin(this->position);
+			i->setParent(this->transform);
 		}
+
+		//Bounds follow with the first update after TransformSystem::update
+		this->proxy = -1;
+		this->moved = false;
+		this->staticGeometry = false;
+		this->occluder = false;
 	}
 
 	//OBJ file loaded model
@@ -56,18 +95,24 @@ public:
 		this->material = material;
 		this->overrideTextureDiffuse = orTexDif;
 		this->overrideTextureSpecular = orTexSpec;
+		this->transform = TransformSystem::get().create(this->position, this->position);
 
-		std::vector<Vertex> mesh = loadOBJ(objFile);
-		this->meshes.push_back(new Mesh(mesh.data(), mesh.size(), NULL, 0, glm::vec3(1.f, 0.f, 0.f),
+		this->meshes.push_back(new Mesh(GeometryRegistry::get().acquireOBJ(objFile),
+			glm::vec3(1.f, 0.f, 0.f),
 			glm::vec3(0),
 			glm::vec3(0),
 			glm::vec3(1)));
 
 		for (auto& i : this->meshes)
 		{
-			i->move(this->position);
-			i->setOrigin(this->position);
+			i->setParent(this->transform);
 		}
+
+		//Bounds follow with the first update after TransformSystem::update
+		this->proxy = -1;
+		this->moved = false;
+		this->staticGeometry = false;
+		this->occluder = false;
 	}
 
 	~Model()
@@ -76,44 +121,269 @@ public:
 		{
 			delete i;
 		}
+
+		TransformSystem::get().destroy(this->transform);
 	}
 
 	//Accessors
+	const AABB& getBounds() const
+	{
+		return this->bounds;
+	}
+
+	int getProxy() const
+	{
+		return this->proxy;
+	}
+
+	//Bounds changed in the last update
+	bool hasMoved() const
+	{
+		return this->moved;
+	}
+
+	Texture* getDiffuseTexture() const
+	{
+		return this->overrideTextureDiffuse;
+	}
+
+	Texture* getSpecularTexture() const
+	{
+		return this->overrideTextureSpecular;
+	}
+
+	bool usesTextureArrays() const
+	{
+		return this->layerDiffuse.isValid() && this->layerSpecular.isValid();
+	}
+
+	bool isStatic() const
+	{
+		return this->staticGeometry;
+	}
+
+	bool isOccluder() const
+	{
+		return this->occluder;
+	}
+
+	//Modifiers
+	void setProxy(const int proxy)
+	{
+		this->proxy = proxy;
+	}
+
+	//Static models are drawn into the cached shadow maps, moving one anyway makes every cached map stale
+	void setStatic(const bool staticGeometry)
+	{
+		this->staticGeometry = staticGeometry;
+	}
+
+	void setOccluder(const bool occluder)
+	{
+		this->occluder = occluder;
+	}
+
+	//Samples both textures from arrays, models sharing the arrays then share batches and binds
+	void setTextureLayers(const TextureLayer& diffuse, const TextureLayer& specular)
+	{
+		this->layerDiffuse = diffuse;
+		this->layerSpecular = specular;
+	}
 
 	//Functions
+	//Moves every mesh through the parent transform
+	void move(const glm::vec3 position)
+	{
+		TransformSystem::get().move(this->transform, position);
+		TransformSystem::get().setOrigin(this->transform, TransformSystem::get().getPosition(this->transform));
+	}
+
 	void rotate(const glm::vec3 rotation)
+	{
+		TransformSystem::get().rotate(this->transform, rotation);
+	}
+
+	//World bounds, once per frame after TransformSystem::update. Only meshes that moved are recomputed
+	void update()
+	{
+		this->moved = false;
+		for (auto& i : this->meshes)
+		{
+			if (i->update())
+				this->moved = true;
+		}
+
+		if (!this->moved)
+			return;
+
+		this->bounds = AABB();
+		for (auto& i : this->meshes)
+		{
+			this->bounds.expand(i->getWorldBounds());
+		}
+	}
+
+	void cull(FrustumCuller& culler)
 	{
 		for (auto& i : this->meshes)
 		{
-			i->rotate(rotation);
+			culler.add(i);
 		}
 	}
 
-	void update()
+	//After frustum culling, only the visible meshes are tested and, for an occluder, drawn
+	void cull(OcclusionCuller& culler)
 	{
-		
+		for (auto& i : this->meshes)
+		{
+			if (!i->isVisible())
+				continue;
+
+			if (this->occluder)
+				culler.addOccluder(i);
+			culler.add(i);
+		}
 	}
 
-	void render(Shader* shader)
+	//Every mesh can cast a shadow, visible or not. Cached maps keep full detail, they are not
+	//rendered again when the camera changes a level
+	void addShadowCasters(ShadowMapper& shadows)
 	{
+		for (auto& i : this->meshes)
+		{
+			shadows.addCaster(this->staticGeometry ? i->getGeometry() : i->getLODGeometry(),
+				i->getDrawMatrix(), i->getWorldBounds(), this->staticGeometry, this->moved);
+		}
+	}
+
+	//Levels of detail of the visible meshes, after culling
+	void selectLOD(LODSelector& selector)
+	{
+		for (auto& i : this->meshes)
+		{
+			if (i->isVisible())
+				i->setLOD(selector.select(i->getGeometry(), i->getWorldSphere(), i->getLOD()));
+		}
+	}
+
+	//Queues a packet per visible mesh, the queue takes care of binding
+	void submit(RenderQueue& queue, UniformCache* program)
+	{
+		for (auto& i : this->meshes)
+		{
+			if (!i->isVisible())
+				continue;
+
+			if (this->usesTextureArrays())
+				queue.submit(program, i->getLODGeometry(), this->material,
+					this->layerDiffuse, this->layerSpecular,
+					i->getDrawMatrix());
+			else
+				queue.submit(program, i->getLODGeometry(), this->material,
+					this->overrideTextureDiffuse, this->overrideTextureSpecular,
+					i->getDrawMatrix());
+		}
+	}
+
+	//Same from a job thread, the list is merged into the queue on the GL thread
+	void submit(DrawList& list, UniformCache* program)
+	{
+		for (auto& i : this->meshes)
+		{
+			if (!i->isVisible())
+				continue;
+
+			if (this->usesTextureArrays())
+				list.submit(program, i->getLODGeometry(), this->material,
+					this->layerDiffuse, this->layerSpecular,
+					i->getDrawMatrix());
+			else
+				list.submit(program, i->getLODGeometry(), this->material,
+					this->overrideTextureDiffuse, this->overrideTextureSpecular,
+					i->getDrawMatrix());
+		}
+	}
+
+	//Hands every mesh to the instanced path instead of drawing it directly
+	void submit(InstanceRenderer& renderer)
+	{
+		for (auto& i : this->meshes)
+		{
+			if (!i->isVisible())
+				continue;
+
+			if (this->usesTextureArrays())
+				renderer.add(i->getLODGeometry(), this->material,
+					this->layerDiffuse, this->layerSpecular,
+					i->getDrawMatrix());
+			else
+				renderer.add(i->getLODGeometry(), this->material,
+					this->overrideTextureDiffuse, this->overrideTextureSpecular,
+					i->getDrawMatrix());
+		}
+	}
+
+	//Leaves culling and drawing of every mesh to the GPU, at full detail
+	void addGPUObjects(GPUCuller& culler)
+	{
+		for (auto& i : this->meshes)
+		{
+			if (this->usesTextureArrays())
+				this->gpuObjects.push_back(culler.add(i->getGeometry(), this->material,
+					this->layerDiffuse, this->layerSpecular,
+					i->getDrawMatrix(), i->getWorldBounds()));
+			else
+				this->gpuObjects.push_back(culler.add(i->getGeometry(), this->material,
+					this->overrideTextureDiffuse, this->overrideTextureSpecular,
+					i->getDrawMatrix(), i->getWorldBounds()));
+		}
+	}
+
+	//After update, nothing is uploaded unless the model moved
+	void updateGPUObjects(GPUCuller& culler)
+	{
+		if (!this->moved || this->gpuObjects.empty())
+			return;
+
+		for (size_t i = 0; i < this->meshes.size(); i++)
+		{
+			culler.update(this->gpuObjects[i], this->meshes[i]->getDrawMatrix(), this->meshes[i]->getWorldBounds());
+		}
+	}
+
+	void render(UniformCache* program)
+	{
+		PROFILE_SCOPE("Model::render");
+
 		//update the uniforms
 		this->updateUniforms();
 
 		//Update Uniforms
-		this->material->sendToShader(*shader);
+		program->getDrawData().indices = glm::ivec4(this->layerDiffuse.layer, this->layerSpecular.layer, 0, 0);
+		this->material->sendToShader(*program);
+		MaterialTable::get().upload();
 
 		//Use a program
-		shader->use();
+		program->getShader()->use();
 
 		//draw
 		for(auto& i : this->meshes)
 		{
 			//Activate texture
-			this->overrideTextureDiffuse->bind(0);
-			this->overrideTextureSpecular->bind(1);
+			if (this->usesTextureArrays())
+			{
+				this->layerDiffuse.array->bind(2);
+				this->layerSpecular.array->bind(3);
+			}
+			else
+			{
+				this->overrideTextureDiffuse->bind(0);
+				this->overrideTextureSpecular->bind(1);
+			}
 
 			//activate shader
-			i->render(shader);
+			i->render(program);
 		}
 	}
 
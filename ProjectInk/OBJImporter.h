@@ -0,0 +1,726 @@
+#pragma once
+#include<iostream>
+#include<fstream>
+#include<string>
+#include<vector>
+#include<thread>
+#include<cstring>
+#include<cstdint>
+#include<cmath>
+
+#include<glew.h>
+
+#include<glm.hpp>
+#include<vec2.hpp>
+#include<vec3.hpp>
+
+#include "Vertex.h"
+#include "MappedFile.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "VertexFormat.h"
+#include "Bounds.h"
+
+//CPU side geometry produced by an import, ready to be handed to a Mesh
+struct MeshData
+{
+	std::vector<Vertex> vertices;
+	std::vector<GLuint> indices;
+
+	//Coarser levels over the same vertices, coarsest last
+	std::vector<MeshLOD> lods;
+
+	//Layout the vertex buffer should use, full unless the import was asked for compact vertices
+	VertexFormat format;
+};
+
+//Wavefront OBJ importer
+//The file is memory mapped, split into line aligned chunks and every chunk is parsed on its own thread.
+//Polygons are fan triangulated and identical vertices are welded into an indexed mesh.
+//Welded meshes are reordered by MeshOptimizer and can carry a chain of simplified levels of detail built by MeshSimplifier.
+//Compact vertices pick the smallest VertexFormat within a tolerance, the cache keeps full vertices either way.
+//The result is written to a binary .mesh cache next to the source, which is read back directly
+//on the next load as long as the source file and the import options did not change.
+class OBJImporter
+{
+private:
+	enum
+	{
+		CACHE_VERSION = 3,
+		MIN_CHUNK_SIZE = 64 * 1024,
+		MAX_THREADS = 16
+	};
+
+	enum corner_bits { CORNER_POSITION = 1, CORNER_TEXCOORD = 2, CORNER_NORMAL = 4 };
+
+	enum cache_flags { CACHE_WELDED = 1, CACHE_LODS = 2 };
+
+	//One triangle corner. Indices are absolute (0 based) unless the matching bit in
+	//"relative" is set, then they are relative to the first element of the owning chunk.
+	struct Corner
+	{
+		int position;
+		int texcoord;
+		int normal;
+		unsigned char present;
+		unsigned char relative;
+	};
+
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> texcoords;
+		std::vector<glm::vec3> normals;
+		std::vector<Corner> corners;
+
+		size_t positionOffset;
+		size_t texcoordOffset;
+		size_t normalOffset;
+		size_t cornerOffset;
+
+		unsigned badIndices;
+	};
+
+	struct CacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceSize;
+		int64_t sourceModified;
+		uint32_t vertexStride;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t flags;
+		uint32_t lodCount;
+	};
+
+	//Follows the indices once per level, the levels' indices come after the last entry
+	struct CacheLOD
+	{
+		uint32_t indexCount;
+		float error;
+	};
+
+	//Parsing
+	static bool isSpace(const char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	static const char* skipSpaces(const char* p, const char* end)
+	{
+		while (p < end && isSpace(*p))
+			++p;
+		return p;
+	}
+
+	//Locale independent float parser, accepts [+-]digits[.digits][(e|E)[+-]digits]
+	static const char* parseFloat(const char* p, const char* end, float& out)
+	{
+		static const double powers[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		p = skipSpaces(p, end);
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		int digits = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+				++digits;
+			}
+			else
+				++exponent;
+			++p;
+		}
+
+		if (p < end && *p == '.')
+		{
+			++p;
+			while (p < end && *p >= '0' && *p <= '9')
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+					++digits;
+					--exponent;
+				}
+				++p;
+			}
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			++p;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+			{
+				negativeExponent = *p == '-';
+				++p;
+			}
+
+			int value = 0;
+			while (p < end && *p >= '0' && *p <= '9')
+			{
+				if (value < 10000)
+					value = value * 10 + (*p - '0');
+				++p;
+			}
+			exponent += negativeExponent ? -value : value;
+		}
+
+		double result = static_cast<double>(mantissa);
+		if (exponent < 0)
+			result = -exponent <= 22 ? result / powers[-exponent] : result * std::pow(10.0, exponent);
+		else if (exponent > 0)
+			result = exponent <= 22 ? result * powers[exponent] : result * std::pow(10.0, exponent);
+
+		out = static_cast<float>(negative ? -result : result);
+		return p;
+	}
+
+	static const char* parseInt(const char* p, const char* end, int& out, bool& valid)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+
+		valid = p < end && *p >= '0' && *p <= '9';
+
+		int value = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			value = value * 10 + (*p - '0');
+			++p;
+		}
+
+		out = negative ? -value : value;
+		return p;
+	}
+
+	//Turns an OBJ index (1 based, or negative = relative to the current end) into a corner index
+	static void resolveIndex(const int index, const size_t count, const unsigned char bit,
+		int& out, Corner& corner, unsigned& badIndices)
+	{
+		if (index > 0)
+		{
+			out = index - 1;
+			corner.present |= bit;
+		}
+		else if (index < 0)
+		{
+			out = static_cast<int>(count) + index;
+			corner.present |= bit;
+			corner.relative |= bit;
+		}
+		else
+			++badIndices;
+	}
+
+	static const char* parseCorner(const char* p, const char* end, Chunk& chunk, Corner& corner)
+	{
+		int index = 0;
+		bool valid = false;
+
+		corner.position = corner.texcoord = corner.normal = 0;
+		corner.present = corner.relative = 0;
+
+		p = parseInt(p, end, index, valid);
+		if (valid)
+			resolveIndex(index, chunk.positions.size(), CORNER_POSITION, corner.position, corner, chunk.badIndices);
+
+		if (p < end && *p == '/')
+		{
+			++p;
+			p = parseInt(p, end, index, valid);
+			if (valid)
+				resolveIndex(index, chunk.texcoords.size(), CORNER_TEXCOORD, corner.texcoord, corner, chunk.badIndices);
+
+			if (p < end && *p == '/')
+			{
+				++p;
+				p = parseInt(p, end, index, valid);
+				if (valid)
+					resolveIndex(index, chunk.normals.size(), CORNER_NORMAL, corner.normal, corner, chunk.badIndices);
+			}
+		}
+
+		//Skip whatever is left of a malformed token
+		while (p < end && !isSpace(*p))
+			++p;
+
+		return p;
+	}
+
+	static void parseChunk(Chunk& chunk)
+	{
+		std::vector<Corner> polygon;
+		const char* p = chunk.begin;
+		const char* end = chunk.end;
+
+		while (p < end)
+		{
+			const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+			if (lineEnd == nullptr)
+				lineEnd = end;
+
+			p = skipSpaces(p, lineEnd);
+
+			if (lineEnd - p > 2 && p[0] == 'v')
+			{
+				glm::vec3 value(0.f);
+				if (isSpace(p[1]))
+				{
+					p = parseFloat(p + 2, lineEnd, value.x);
+					p = parseFloat(p, lineEnd, value.y);
+					p = parseFloat(p, lineEnd, value.z);
+					chunk.positions.push_back(value);
+				}
+				else if (p[1] == 't' && isSpace(p[2]))
+				{
+					p = parseFloat(p + 3, lineEnd, value.x);
+					p = parseFloat(p, lineEnd, value.y);
+					chunk.texcoords.push_back(glm::vec2(value.x, value.y));
+				}
+				else if (p[1] == 'n' && isSpace(p[2]))
+				{
+					p = parseFloat(p + 3, lineEnd, value.x);
+					p = parseFloat(p, lineEnd, value.y);
+					p = parseFloat(p, lineEnd, value.z);
+					chunk.normals.push_back(value);
+				}
+			}
+			else if (lineEnd - p > 1 && p[0] == 'f' && isSpace(p[1]))
+			{
+				polygon.clear();
+				p = skipSpaces(p + 1, lineEnd);
+				while (p < lineEnd)
+				{
+					Corner corner;
+					p = parseCorner(p, lineEnd, chunk, corner);
+					if (corner.present & CORNER_POSITION)
+						polygon.push_back(corner);
+					p = skipSpaces(p, lineEnd);
+				}
+
+				//Fan triangulation, covers the quads in cube.obj and Grass_Block.obj
+				for (size_t i = 1; i + 1 < polygon.size(); i++)
+				{
+					chunk.corners.push_back(polygon[0]);
+					chunk.corners.push_back(polygon[i]);
+					chunk.corners.push_back(polygon[i + 1]);
+				}
+			}
+
+			p = lineEnd + 1;
+		}
+	}
+
+	template<typename Function>
+	static void runParallel(const size_t count, Function function)
+	{
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < count; i++)
+			threads.push_back(std::thread(function, i));
+
+		function(0);
+
+		for (auto& i : threads)
+			i.join();
+	}
+
+	static size_t getThreadCount(const size_t fileSize)
+	{
+		size_t threads = std::thread::hardware_concurrency();
+		if (threads == 0)
+			threads = 1;
+		if (threads > MAX_THREADS)
+			threads = MAX_THREADS;
+
+		size_t bySize = fileSize / MIN_CHUNK_SIZE;
+		if (bySize < 1)
+			bySize = 1;
+
+		return threads < bySize ? threads : bySize;
+	}
+
+	template<typename T>
+	static const T& fetch(const std::vector<T>& values, const int index, const size_t offset,
+		const bool present, const bool relative, unsigned& badIndices)
+	{
+		static const T empty = T();
+
+		if (!present)
+			return empty;
+
+		const long long resolved = static_cast<long long>(index) + (relative ? static_cast<long long>(offset) : 0);
+		if (resolved < 0 || resolved >= static_cast<long long>(values.size()))
+		{
+			++badIndices;
+			return empty;
+		}
+
+		return values[static_cast<size_t>(resolved)];
+	}
+
+	static bool parse(const char* fileName, MeshData& mesh)
+	{
+		MappedFile file(fileName);
+		if (!file.isOpen())
+		{
+			std::cout << "ERROR::OBJIMPORTER::COULD_NOT_OPEN_FILE: " << fileName << "\n";
+			return false;
+		}
+
+		const char* data = file.getData();
+		const char* dataEnd = data + file.getSize();
+
+		//Split into line aligned chunks
+		const size_t threadCount = getThreadCount(file.getSize());
+		std::vector<Chunk> chunks(threadCount);
+		const char* chunkBegin = data;
+		for (size_t i = 0; i < threadCount; i++)
+		{
+			const char* chunkEnd = i + 1 == threadCount ? dataEnd : data + file.getSize() * (i + 1) / threadCount;
+			if (chunkEnd < chunkBegin)
+				chunkEnd = chunkBegin;
+			while (chunkEnd < dataEnd && chunkEnd[-1] != '\n')
+				++chunkEnd;
+
+			chunks[i].begin = chunkBegin;
+			chunks[i].end = chunkEnd;
+			chunks[i].badIndices = 0;
+			chunkBegin = chunkEnd;
+		}
+
+		runParallel(threadCount, [&chunks](size_t i) { parseChunk(chunks[i]); });
+
+		//Chunk offsets into the merged arrays
+		size_t positionCount = 0, texcoordCount = 0, normalCount = 0, cornerCount = 0;
+		for (auto& i : chunks)
+		{
+			i.positionOffset = positionCount;
+			i.texcoordOffset = texcoordCount;
+			i.normalOffset = normalCount;
+			i.cornerOffset = cornerCount;
+
+			positionCount += i.positions.size();
+			texcoordCount += i.texcoords.size();
+			normalCount += i.normals.size();
+			cornerCount += i.corners.size();
+		}
+
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> texcoords;
+		std::vector<glm::vec3> normals;
+		positions.reserve(positionCount);
+		texcoords.reserve(texcoordCount);
+		normals.reserve(normalCount);
+		for (auto& i : chunks)
+		{
+			positions.insert(positions.end(), i.positions.begin(), i.positions.end());
+			texcoords.insert(texcoords.end(), i.texcoords.begin(), i.texcoords.end());
+			normals.insert(normals.end(), i.normals.begin(), i.normals.end());
+		}
+
+		//Expand the corners into vertices, every chunk writes its own range
+		mesh.vertices.resize(cornerCount);
+		mesh.indices.clear();
+
+		runParallel(threadCount, [&](size_t c)
+		{
+			Chunk& chunk = chunks[c];
+			Vertex* out = mesh.vertices.data() + chunk.cornerOffset;
+
+			for (size_t i = 0; i < chunk.corners.size(); i++)
+			{
+				const Corner& corner = chunk.corners[i];
+
+				out[i].position = fetch(positions, corner.position, chunk.positionOffset,
+					(corner.present & CORNER_POSITION) != 0, (corner.relative & CORNER_POSITION) != 0, chunk.badIndices);
+				out[i].color = glm::vec3(1.f);
+				out[i].texcoord = fetch(texcoords, corner.texcoord, chunk.texcoordOffset,
+					(corner.present & CORNER_TEXCOORD) != 0, (corner.relative & CORNER_TEXCOORD) != 0, chunk.badIndices);
+				out[i].normal = fetch(normals, corner.normal, chunk.normalOffset,
+					(corner.present & CORNER_NORMAL) != 0, (corner.relative & CORNER_NORMAL) != 0, chunk.badIndices);
+			}
+		});
+
+		unsigned badIndices = 0;
+		for (auto& i : chunks)
+			badIndices += i.badIndices;
+		if (badIndices > 0)
+			std::cout << "ERROR::OBJIMPORTER::INVALID_INDICES: " << badIndices << " in " << fileName << "\n";
+
+		return true;
+	}
+
+	//Cache
+	static bool readCache(const char* fileName, const std::string& cacheFile, const uint32_t flags, MeshData& mesh)
+	{
+		uint64_t sourceSize = 0;
+		int64_t sourceModified = 0;
+		if (!MappedFile::getStamp(fileName, sourceSize, sourceModified))
+			return false;
+
+		MappedFile file(cacheFile.c_str());
+		if (!file.isOpen() || file.getSize() < sizeof(CacheHeader))
+			return false;
+
+		CacheHeader header;
+		memcpy(&header, file.getData(), sizeof(CacheHeader));
+
+		if (memcmp(header.magic, "PKMH", 4) != 0 ||
+			header.version != CACHE_VERSION ||
+			header.vertexStride != sizeof(Vertex) ||
+			header.flags != flags ||
+			header.sourceSize != sourceSize ||
+			header.sourceModified != sourceModified)
+			return false;
+
+		const size_t vertexBytes = static_cast<size_t>(header.vertexCount) * sizeof(Vertex);
+		const size_t indexBytes = static_cast<size_t>(header.indexCount) * sizeof(GLuint);
+		const size_t tableBytes = static_cast<size_t>(header.lodCount) * sizeof(CacheLOD);
+		if (file.getSize() < sizeof(CacheHeader) + vertexBytes + indexBytes + tableBytes)
+			return false;
+
+		const char* blocks = file.getData() + sizeof(CacheHeader);
+		std::vector<CacheLOD> table(header.lodCount);
+		if (tableBytes > 0)
+			memcpy(table.data(), blocks + vertexBytes + indexBytes, tableBytes);
+
+		size_t lodBytes = 0;
+		for (auto& i : table)
+			lodBytes += static_cast<size_t>(i.indexCount) * sizeof(GLuint);
+		if (file.getSize() != sizeof(CacheHeader) + vertexBytes + indexBytes + tableBytes + lodBytes)
+			return false;
+
+		mesh.vertices.resize(header.vertexCount);
+		mesh.indices.resize(header.indexCount);
+		if (vertexBytes > 0)
+			memcpy(mesh.vertices.data(), blocks, vertexBytes);
+		if (indexBytes > 0)
+			memcpy(mesh.indices.data(), blocks + vertexBytes, indexBytes);
+
+		const char* lodIndices = blocks + vertexBytes + indexBytes + tableBytes;
+		mesh.lods.resize(header.lodCount);
+		for (size_t i = 0; i < table.size(); i++)
+		{
+			mesh.lods[i].error = table[i].error;
+			mesh.lods[i].indices.resize(table[i].indexCount);
+			if (table[i].indexCount > 0)
+				memcpy(mesh.lods[i].indices.data(), lodIndices, table[i].indexCount * sizeof(GLuint));
+			lodIndices += table[i].indexCount * sizeof(GLuint);
+		}
+
+		return true;
+	}
+
+	static void writeCache(const char* fileName, const std::string& cacheFile, const uint32_t flags, const MeshData& mesh)
+	{
+		CacheHeader header;
+		memset(&header, 0, sizeof(CacheHeader));
+		memcpy(header.magic, "PKMH", 4);
+		header.version = CACHE_VERSION;
+		header.vertexStride = sizeof(Vertex);
+		header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+		header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+		header.flags = flags;
+		header.lodCount = static_cast<uint32_t>(mesh.lods.size());
+
+		if (!MappedFile::getStamp(fileName, header.sourceSize, header.sourceModified))
+			return;
+
+		std::ofstream out(cacheFile.c_str(), std::ios::binary | std::ios::trunc);
+		if (!out.is_open())
+		{
+			std::cout << "ERROR::OBJIMPORTER::COULD_NOT_WRITE_CACHE: " << cacheFile << "\n";
+			return;
+		}
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+		if (!mesh.vertices.empty())
+			out.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+		if (!mesh.indices.empty())
+			out.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(GLuint));
+
+		for (auto& i : mesh.lods)
+		{
+			CacheLOD entry;
+			entry.indexCount = static_cast<uint32_t>(i.indices.size());
+			entry.error = i.error;
+			out.write(reinterpret_cast<const char*>(&entry), sizeof(CacheLOD));
+		}
+		for (auto& i : mesh.lods)
+		{
+			if (!i.indices.empty())
+				out.write(reinterpret_cast<const char*>(i.indices.data()), i.indices.size() * sizeof(GLuint));
+		}
+	}
+
+	//Welding
+	static uint32_t hashVertex(const Vertex& vertex)
+	{
+		uint32_t words[sizeof(Vertex) / sizeof(uint32_t)];
+		memcpy(words, &vertex, sizeof(words));
+
+		uint32_t hash = 2166136261u;
+		for (uint32_t i : words)
+			hash = (hash ^ i) * 16777619u;
+
+		return hash ^ (hash >> 15);
+	}
+
+public:
+	struct WeldStats
+	{
+		size_t verticesBefore;
+		size_t verticesAfter;
+		size_t indices;
+		size_t bytesBefore;
+		size_t bytesAfter;
+	};
+
+	//Bytes per index Mesh will upload for this many vertices
+	static size_t getIndexSize(const size_t vertexCount)
+	{
+		return vertexCount <= 65536 ? sizeof(GLushort) : sizeof(GLuint);
+	}
+
+	//Merges bit identical vertices through an open addressing hash table and
+	//replaces the vertex list with the unique vertices plus an index buffer
+	static WeldStats weld(MeshData& mesh)
+	{
+		const size_t count = mesh.indices.empty() ? mesh.vertices.size() : mesh.indices.size();
+
+		WeldStats stats;
+		stats.verticesBefore = mesh.vertices.size();
+		stats.bytesBefore = mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * getIndexSize(mesh.vertices.size());
+
+		size_t tableSize = 64;
+		while (tableSize < count * 2)
+			tableSize *= 2;
+		const size_t mask = tableSize - 1;
+		const GLuint empty = 0xFFFFFFFFu;
+		std::vector<GLuint> table(tableSize, empty);
+
+		std::vector<Vertex> unique;
+		std::vector<GLuint> indices(count);
+		unique.reserve(count / 4 + 1);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const Vertex& vertex = mesh.indices.empty() ? mesh.vertices[i] : mesh.vertices[mesh.indices[i]];
+
+			size_t slot = hashVertex(vertex) & mask;
+			while (table[slot] != empty && memcmp(&unique[table[slot]], &vertex, sizeof(Vertex)) != 0)
+				slot = (slot + 1) & mask;
+
+			if (table[slot] == empty)
+			{
+				table[slot] = static_cast<GLuint>(unique.size());
+				unique.push_back(vertex);
+			}
+
+			indices[i] = table[slot];
+		}
+
+		mesh.vertices.swap(unique);
+		mesh.indices.swap(indices);
+
+		stats.verticesAfter = mesh.vertices.size();
+		stats.indices = mesh.indices.size();
+		stats.bytesAfter = mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * getIndexSize(mesh.vertices.size());
+
+		return stats;
+	}
+
+	//Triangles of every level in vertex cache and overdraw order, then the vertices in the order the
+	//full detail level fetches them. Runs after the levels of detail are built, they follow the vertex remap
+	static void optimize(MeshData& mesh)
+	{
+		if (mesh.indices.empty())
+			return;
+
+		mesh.indices = MeshOptimizer::optimizeOverdraw(mesh.indices, mesh.vertices.data());
+		for (auto& i : mesh.lods)
+			i.indices = MeshOptimizer::optimizeOverdraw(i.indices, mesh.vertices.data());
+
+		const std::vector<GLuint> remap = MeshOptimizer::optimizeVertexFetch(mesh.vertices, mesh.indices);
+		for (auto& i : mesh.lods)
+			MeshOptimizer::remapIndices(i.indices, remap);
+	}
+
+	//"OBJFiles/sphere.obj" -> "OBJFiles/sphere.mesh"
+	static std::string getCachePath(const char* fileName)
+	{
+		std::string path(fileName);
+		const size_t slash = path.find_last_of("/\\");
+		const size_t dot = path.find_last_of('.');
+		if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+			path.erase(dot);
+
+		return path + ".mesh";
+	}
+
+	//Smallest format the vertices of mesh fit in within tolerance
+	static VertexFormat chooseFormat(const MeshData& mesh, const VertexTolerance& tolerance = VertexTolerance(),
+		VertexError* error = nullptr)
+	{
+		AABB bounds;
+		BoundingSphere sphere;
+		computeBounds(mesh.vertices.data(), static_cast<unsigned>(mesh.vertices.size()), bounds, sphere);
+
+		return VertexFormat::choose(mesh.vertices.data(), mesh.vertices.size(), bounds, tolerance, error);
+	}
+
+	//Levels of detail need welded vertices, they are skipped without
+	static MeshData load(const char* fileName, const bool useCache = true, const bool weldVertices = true,
+		const bool generateLODs = false, const bool compactVertices = false)
+	{
+		MeshData mesh;
+		const std::string cacheFile = getCachePath(fileName);
+		const bool lods = weldVertices && generateLODs;
+		const uint32_t flags = (weldVertices ? CACHE_WELDED : 0) | (lods ? CACHE_LODS : 0);
+
+		if (!useCache || !readCache(fileName, cacheFile, flags, mesh))
+		{
+			if (!parse(fileName, mesh))
+				return mesh;
+
+			if (weldVertices)
+				weld(mesh);
+
+			if (lods)
+				mesh.lods = MeshSimplifier::buildLODs(mesh.vertices.data(), mesh.vertices.size(), mesh.indices);
+
+			if (weldVertices)
+				optimize(mesh);
+
+			if (useCache)
+				writeCache(fileName, cacheFile, flags, mesh);
+		}
+
+		if (compactVertices)
+			mesh.format = chooseFormat(mesh);
+
+		return mesh;
+	}
+};
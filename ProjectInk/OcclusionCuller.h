@@ -0,0 +1,617 @@
+#pragma once
+#include<iostream>
+#include<vector>
+#include<unordered_map>
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<cfloat>
+
+#include<xmmintrin.h>
+#ifdef __AVX__
+#include<immintrin.h>
+#endif
+
+#include<glm.hpp>
+#include<mat4x4.hpp>
+
+#include "Bounds.h"
+#include "Geometry.h"
+#include "Mesh.h"
+#include "JobSystem.h"
+
+//Occluders drawn and meshes hidden behind them in the last cull pass
+struct OcclusionCullerStats
+{
+	unsigned occluders;
+
+	//After near plane clipping, only the ones on screen
+	unsigned triangles;
+
+	unsigned tested;
+	unsigned occluded;
+
+	//Transform, binning, rasterization and the hierarchy, then the tests, in milliseconds
+	double rasterizeTime;
+	double testTime;
+};
+
+//Software occlusion culling on the CPU, nothing here touches GL.
+//Occluder meshes are drawn at a coarse level of detail into a small depth buffer: triangles are set up and
+//binned to tiles on every job thread, then every tile is rasterized by one thread, 4 (SSE) or 8 (AVX) pixels
+//of a row at a time. Each tile also builds its part of a min/max depth hierarchy, the coarse levels are built
+//once all tiles are done. A mesh is occluded when its world box, from its nearest corner, is behind the
+//farthest depth of every pixel its screen rectangle covers; the hierarchy answers that for most boxes in a few
+//cells. Back faces are skipped like the scene skips them. Depth is only sampled at pixel centers and occluders
+//are simplified, so a sliver of a mesh can still go missing in a gap thinner than a pixel
+class OcclusionCuller
+{
+public:
+	enum { WIDTH = 256, HEIGHT = 128, TILE_WIDTH = 32, TILE_HEIGHT = 16 };
+
+private:
+	enum { TILES_X = WIDTH / TILE_WIDTH, TILES_Y = HEIGHT / TILE_HEIGHT, TILE_COUNT = TILES_X * TILES_Y };
+
+	//Down to 2x1, the levels up to TILE_LEVELS fit in a tile and are built with it
+	enum { LEVELS = 8, TILE_LEVELS = 4 };
+
+	//Keeps a mesh from hiding behind itself when its box and its surface are the same depth, in [0, 1] depth
+	static constexpr float DEPTH_BIAS = 1e-6f;
+
+	//Positions of the level an occluder is drawn with, only the vertices that level uses
+	struct OccluderMesh
+	{
+		//Source the positions were taken from, a Geometry freed and made again at the same address is rebuilt
+		const Vertex* vertexArray;
+		unsigned nrOfIndices;
+
+		std::vector<glm::vec3> positions;
+		std::vector<GLuint> indices;
+	};
+
+	struct Occluder
+	{
+		const OccluderMesh* mesh;
+		glm::mat4 ModelViewProjectionMatrix;
+	};
+
+	//Screen space triangle with edge functions and its depth plane, all over pixel centers
+	struct Triangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		int minX;
+		int minY;
+		int maxX;
+		int maxY;
+	};
+
+	unsigned occluderTriangles;
+	glm::mat4 ViewProjectionMatrix;
+
+	std::unordered_map<const Geometry*, OccluderMesh> occluderMeshes;
+	std::vector<Occluder> occluders;
+
+	std::vector<Mesh*> meshes;
+	std::vector<AABB> bounds;
+	std::vector<unsigned char> results;
+
+	//Per job thread: its triangles, clip space scratch and one bin per tile of indices into its triangles
+	std::vector<std::vector<Triangle>> triangles;
+	std::vector<std::vector<glm::vec4>> clipPositions;
+	std::vector<std::vector<unsigned>> bins;
+
+	//Level 0 is the depth buffer, the hierarchy above it keeps the nearest and farthest depth of every cell
+	std::vector<float> depth;
+	std::vector<float> nearest[LEVELS];
+	std::vector<float> farthest[LEVELS];
+
+	OcclusionCullerStats stats;
+
+	static double now()
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static int getLevelWidth(const int level) { return std::max(WIDTH >> level, 1); }
+
+	static int getLevelHeight(const int level) { return std::max(HEIGHT >> level, 1); }
+
+	const float* getNearest(const int level) const { return level == 0 ? this->depth.data() : this->nearest[level].data(); }
+
+	const float* getFarthest(const int level) const { return level == 0 ? this->depth.data() : this->farthest[level].data(); }
+
+	//The finest level within the triangle budget, the coarsest when none is
+	const OccluderMesh& getOccluderMesh(Geometry* geometry)
+	{
+		OccluderMesh& mesh = this->occluderMeshes[geometry];
+		if (mesh.vertexArray == geometry->getVertexArray() && mesh.nrOfIndices == geometry->getNrOfIndices() && !mesh.indices.empty())
+			return mesh;
+
+		Geometry* level = geometry;
+		for (unsigned i = 0; i < geometry->getLODCount(); i++)
+		{
+			level = geometry->getLOD(i);
+			if (level->getNrOfTriangles() <= this->occluderTriangles)
+				break;
+		}
+
+		mesh.vertexArray = geometry->getVertexArray();
+		mesh.nrOfIndices = geometry->getNrOfIndices();
+		mesh.positions.clear();
+		mesh.indices.clear();
+
+		//Geometry without indices draws its vertices in order
+		const Vertex* vertices = level->getVertexArray();
+		const unsigned count = level->getNrOfIndices() > 0 ? level->getNrOfIndices() : level->getNrOfVertices() / 3 * 3;
+		std::vector<GLuint> remap(level->getNrOfVertices(), 0xFFFFFFFFu);
+		mesh.indices.reserve(count);
+		for (unsigned i = 0; i < count; i++)
+		{
+			const GLuint index = level->getNrOfIndices() > 0 ? level->getIndexArray()[i] : i;
+			if (remap[index] == 0xFFFFFFFFu)
+			{
+				remap[index] = static_cast<GLuint>(mesh.positions.size());
+				mesh.positions.push_back(vertices[index].position);
+			}
+
+			mesh.indices.push_back(remap[index]);
+		}
+
+		return mesh;
+	}
+
+	//Sutherland-Hodgman against the near plane, z >= -w in GL clip space. Returns the vertex count, 0 to 4
+	static int clipNear(const glm::vec4* in, glm::vec4* out)
+	{
+		int count = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec4& a = in[i];
+			const glm::vec4& b = in[(i + 1) % 3];
+			const float da = a.z + a.w;
+			const float db = b.z + b.w;
+
+			if (da >= 0.f)
+				out[count++] = a;
+			if ((da >= 0.f) != (db >= 0.f))
+				out[count++] = a + (b - a) * (da / (da - db));
+		}
+
+		return count;
+	}
+
+	//Screen position and depth of a clipped vertex, y up like GL
+	static glm::vec3 project(const glm::vec4& clip)
+	{
+		const float inverseW = 1.f / clip.w;
+		return glm::vec3((clip.x * inverseW * 0.5f + 0.5f) * WIDTH,
+			(clip.y * inverseW * 0.5f + 0.5f) * HEIGHT,
+			clip.z * inverseW * 0.5f + 0.5f);
+	}
+
+	void setup(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const unsigned thread)
+	{
+		//Counter clockwise in front like the scene draws them, a back face the scene culls hides nothing
+		const float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+		if (area < 1e-8f)
+			return;
+
+		//Pixels whose centers can be inside
+		Triangle triangle;
+		triangle.minX = std::max(static_cast<int>(std::ceil(std::min(v0.x, std::min(v1.x, v2.x)) - 0.5f)), 0);
+		triangle.minY = std::max(static_cast<int>(std::ceil(std::min(v0.y, std::min(v1.y, v2.y)) - 0.5f)), 0);
+		triangle.maxX = std::min(static_cast<int>(std::floor(std::max(v0.x, std::max(v1.x, v2.x)) - 0.5f)), WIDTH - 1);
+		triangle.maxY = std::min(static_cast<int>(std::floor(std::max(v0.y, std::max(v1.y, v2.y)) - 0.5f)), HEIGHT - 1);
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+			return;
+
+		//Edge i runs from vertex i to the next, positive inside
+		const glm::vec3* v[3] = { &v0, &v1, &v2 };
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec3& a = *v[i];
+			const glm::vec3& b = *v[(i + 1) % 3];
+			triangle.edgeA[i] = a.y - b.y;
+			triangle.edgeB[i] = b.x - a.x;
+			triangle.edgeC[i] = a.x * b.y - a.y * b.x;
+		}
+
+		triangle.depthA = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+		triangle.depthB = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+		triangle.depthC = v0.z - triangle.depthA * v0.x - triangle.depthB * v0.y;
+
+		std::vector<Triangle>& triangles = this->triangles[thread];
+		const unsigned index = static_cast<unsigned>(triangles.size());
+		triangles.push_back(triangle);
+
+		for (int y = triangle.minY / TILE_HEIGHT; y <= triangle.maxY / TILE_HEIGHT; y++)
+		{
+			for (int x = triangle.minX / TILE_WIDTH; x <= triangle.maxX / TILE_WIDTH; x++)
+				this->bins[thread * TILE_COUNT + y * TILES_X + x].push_back(index);
+		}
+	}
+
+	//Clip space on the calling thread, then every triangle clipped, projected and binned
+	void transform(const Occluder& occluder, const unsigned thread)
+	{
+		const OccluderMesh& mesh = *occluder.mesh;
+		std::vector<glm::vec4>& clip = this->clipPositions[thread];
+		clip.resize(mesh.positions.size());
+		for (size_t i = 0; i < mesh.positions.size(); i++)
+			clip[i] = occluder.ModelViewProjectionMatrix * glm::vec4(mesh.positions[i], 1.f);
+
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			const glm::vec4 corners[3] = { clip[mesh.indices[i]], clip[mesh.indices[i + 1]], clip[mesh.indices[i + 2]] };
+
+			//Clipping only when needed, most triangles are fully in front
+			if (corners[0].z + corners[0].w >= 0.f && corners[1].z + corners[1].w >= 0.f && corners[2].z + corners[2].w >= 0.f)
+			{
+				this->setup(project(corners[0]), project(corners[1]), project(corners[2]), thread);
+				continue;
+			}
+
+			glm::vec4 polygon[4];
+			const int count = clipNear(corners, polygon);
+			for (int j = 2; j < count; j++)
+				this->setup(project(polygon[0]), project(polygon[j - 1]), project(polygon[j]), thread);
+		}
+	}
+
+	void rasterizeSSE(const Triangle& triangle, const int x0, const int y0, const int x1, const int y1)
+	{
+		const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 edgeA0 = _mm_set1_ps(triangle.edgeA[0]);
+		const __m128 edgeA1 = _mm_set1_ps(triangle.edgeA[1]);
+		const __m128 edgeA2 = _mm_set1_ps(triangle.edgeA[2]);
+		const __m128 depthA = _mm_set1_ps(triangle.depthA);
+
+		for (int y = y0; y <= y1; y++)
+		{
+			const float py = y + 0.5f;
+			const __m128 row0 = _mm_set1_ps(triangle.edgeB[0] * py + triangle.edgeC[0]);
+			const __m128 row1 = _mm_set1_ps(triangle.edgeB[1] * py + triangle.edgeC[1]);
+			const __m128 row2 = _mm_set1_ps(triangle.edgeB[2] * py + triangle.edgeC[2]);
+			const __m128 rowDepth = _mm_set1_ps(triangle.depthB * py + triangle.depthC);
+			float* out = &this->depth[y * WIDTH];
+
+			for (int x = x0; x <= x1; x += 4)
+			{
+				const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+				const __m128 e0 = _mm_add_ps(_mm_mul_ps(edgeA0, px), row0);
+				const __m128 e1 = _mm_add_ps(_mm_mul_ps(edgeA1, px), row1);
+				const __m128 e2 = _mm_add_ps(_mm_mul_ps(edgeA2, px), row2);
+				const __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+
+				const __m128 z = _mm_max_ps(_mm_add_ps(_mm_mul_ps(depthA, px), rowDepth), zero);
+				const __m128 old = _mm_loadu_ps(out + x);
+				const __m128 closer = _mm_min_ps(old, z);
+				_mm_storeu_ps(out + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, old)));
+			}
+		}
+	}
+
+#ifdef __AVX__
+	void rasterizeAVX(const Triangle& triangle, const int x0, const int y0, const int x1, const int y1)
+	{
+		const __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 edgeA0 = _mm256_set1_ps(triangle.edgeA[0]);
+		const __m256 edgeA1 = _mm256_set1_ps(triangle.edgeA[1]);
+		const __m256 edgeA2 = _mm256_set1_ps(triangle.edgeA[2]);
+		const __m256 depthA = _mm256_set1_ps(triangle.depthA);
+
+		for (int y = y0; y <= y1; y++)
+		{
+			const float py = y + 0.5f;
+			const __m256 row0 = _mm256_set1_ps(triangle.edgeB[0] * py + triangle.edgeC[0]);
+			const __m256 row1 = _mm256_set1_ps(triangle.edgeB[1] * py + triangle.edgeC[1]);
+			const __m256 row2 = _mm256_set1_ps(triangle.edgeB[2] * py + triangle.edgeC[2]);
+			const __m256 rowDepth = _mm256_set1_ps(triangle.depthB * py + triangle.depthC);
+			float* out = &this->depth[y * WIDTH];
+
+			for (int x = x0; x <= x1; x += 8)
+			{
+				const __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), offsets);
+				const __m256 e0 = _mm256_add_ps(_mm256_mul_ps(edgeA0, px), row0);
+				const __m256 e1 = _mm256_add_ps(_mm256_mul_ps(edgeA1, px), row1);
+				const __m256 e2 = _mm256_add_ps(_mm256_mul_ps(edgeA2, px), row2);
+				const __m256 inside = _mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ),
+					_mm256_and_ps(_mm256_cmp_ps(e1, zero, _CMP_GE_OQ), _mm256_cmp_ps(e2, zero, _CMP_GE_OQ)));
+
+				const __m256 z = _mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(depthA, px), rowDepth), zero);
+				const __m256 old = _mm256_loadu_ps(out + x);
+				_mm256_storeu_ps(out + x, _mm256_blendv_ps(old, _mm256_min_ps(old, z), inside));
+			}
+		}
+	}
+#endif
+
+	//Cells [x0, x1] x [y0, y1] of a level from the one below it
+	void reduce(const int level, const int x0, const int y0, const int x1, const int y1)
+	{
+		const int below = getLevelWidth(level - 1);
+		const int width = getLevelWidth(level);
+		const float* nearest = this->getNearest(level - 1);
+		const float* farthest = this->getFarthest(level - 1);
+
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int x = x0; x <= x1; x++)
+			{
+				const int child = y * 2 * below + x * 2;
+				this->nearest[level][y * width + x] = std::min(std::min(nearest[child], nearest[child + 1]),
+					std::min(nearest[child + below], nearest[child + below + 1]));
+				this->farthest[level][y * width + x] = std::max(std::max(farthest[child], farthest[child + 1]),
+					std::max(farthest[child + below], farthest[child + below + 1]));
+			}
+		}
+	}
+
+	//Clears the tile, draws every triangle binned to it on any thread and builds the levels inside it
+	void rasterizeTile(const int tile, const unsigned threads)
+	{
+		const int x0 = tile % TILES_X * TILE_WIDTH;
+		const int y0 = tile / TILES_X * TILE_HEIGHT;
+		const int x1 = x0 + TILE_WIDTH - 1;
+		const int y1 = y0 + TILE_HEIGHT - 1;
+
+		for (int y = y0; y <= y1; y++)
+			std::fill(&this->depth[y * WIDTH + x0], &this->depth[y * WIDTH + x0] + TILE_WIDTH, 1.f);
+
+		for (unsigned thread = 0; thread < threads; thread++)
+		{
+			for (auto& i : this->bins[thread * TILE_COUNT + tile])
+			{
+				const Triangle& triangle = this->triangles[thread][i];
+
+				//Whole vectors only, the tile width is a multiple of the widest
+#ifdef __AVX__
+				const int first = std::max(triangle.minX, x0) & ~7;
+				this->rasterizeAVX(triangle, first, std::max(triangle.minY, y0), std::min(triangle.maxX, x1), std::min(triangle.maxY, y1));
+#else
+				const int first = std::max(triangle.minX, x0) & ~3;
+				this->rasterizeSSE(triangle, first, std::max(triangle.minY, y0), std::min(triangle.maxX, x1), std::min(triangle.maxY, y1));
+#endif
+			}
+		}
+
+		for (int level = 1; level <= TILE_LEVELS; level++)
+			this->reduce(level, x0 >> level, y0 >> level, x1 >> level, y1 >> level);
+	}
+
+	//Every cell of the level under the screen rectangle [x0, x1] x [y0, y1] of pixels is in front of depth
+	bool isHidden(const int level, const int cellX, const int cellY, const int x0, const int y0, const int x1, const int y1,
+		const float depth) const
+	{
+		const int cell = cellY * getLevelWidth(level) + cellX;
+		if (this->getFarthest(level)[cell] < depth)
+			return true;
+		if (level == 0)
+			return false;
+
+		//Nothing in a cell inside the rectangle is in front, so neither is a pixel of it
+		const bool inside = cellX << level >= x0 && ((cellX + 1) << level) - 1 <= x1
+			&& cellY << level >= y0 && ((cellY + 1) << level) - 1 <= y1;
+		if (inside && this->getNearest(level)[cell] >= depth)
+			return false;
+
+		const int below = level - 1;
+		for (int y = std::max(cellY * 2, y0 >> below); y <= std::min(cellY * 2 + 1, y1 >> below); y++)
+		{
+			for (int x = std::max(cellX * 2, x0 >> below); x <= std::min(cellX * 2 + 1, x1 >> below); x++)
+			{
+				if (!this->isHidden(below, x, y, x0, y0, x1, y1, depth))
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	void rasterize(JobSystem* jobs)
+	{
+		const unsigned threads = jobs != nullptr ? jobs->getThreadCount() : 1;
+		this->triangles.resize(threads);
+		this->clipPositions.resize(threads);
+		this->bins.resize(threads * TILE_COUNT);
+		for (auto& i : this->triangles)
+			i.clear();
+		for (auto& i : this->bins)
+			i.clear();
+
+		auto binning = [&](const size_t first, const size_t last)
+		{
+			const unsigned thread = jobs != nullptr ? jobs->getCurrentThread() : 0;
+			for (size_t i = first; i < last; i++)
+				this->transform(this->occluders[i], thread);
+		};
+
+		auto tiles = [&](const size_t first, const size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+				this->rasterizeTile(static_cast<int>(i), threads);
+		};
+
+		if (jobs != nullptr)
+		{
+			jobs->parallelFor(this->occluders.size(), binning, 4);
+			jobs->parallelFor(TILE_COUNT, tiles, 1);
+		}
+		else
+		{
+			binning(0, this->occluders.size());
+			tiles(0, TILE_COUNT);
+		}
+
+		//Cells above a tile need all of them
+		for (int level = TILE_LEVELS + 1; level < LEVELS; level++)
+			this->reduce(level, 0, 0, getLevelWidth(level) - 1, getLevelHeight(level) - 1);
+
+		this->stats.triangles = 0;
+		for (auto& i : this->triangles)
+			this->stats.triangles += static_cast<unsigned>(i.size());
+	}
+
+public:
+	//Occluders are drawn at the finest level of detail with at most occluderTriangles triangles
+	OcclusionCuller(const unsigned occluderTriangles = 512)
+	{
+		static_assert(TILE_WIDTH % 8 == 0 && (TILE_HEIGHT >> TILE_LEVELS) > 0 && (HEIGHT >> (LEVELS - 1)) > 0,
+			"OcclusionCuller: tiles hold whole vectors and their levels, every level at least one cell high");
+
+		this->occluderTriangles = occluderTriangles;
+		this->ViewProjectionMatrix = glm::mat4(1.f);
+		this->depth.assign(WIDTH * HEIGHT, 1.f);
+		for (int level = 1; level < LEVELS; level++)
+		{
+			this->nearest[level].assign(getLevelWidth(level) * getLevelHeight(level), 1.f);
+			this->farthest[level].assign(getLevelWidth(level) * getLevelHeight(level), 1.f);
+		}
+		this->stats = OcclusionCullerStats();
+	}
+
+	~OcclusionCuller()
+	{
+
+	}
+
+	//Accessors
+	const OcclusionCullerStats& getStats() const { return this->stats; }
+
+	size_t getCount() const { return this->meshes.size(); }
+
+	bool isVisible(const size_t index) const { return this->results[index] != 0; }
+
+	//WIDTH x HEIGHT depths in [0, 1] from the bottom row up, 1 where no occluder was drawn
+	const std::vector<float>& getDepthBuffer() const { return this->depth; }
+
+	//Functions
+	void begin(const glm::mat4& ViewProjectionMatrix)
+	{
+		this->ViewProjectionMatrix = ViewProjectionMatrix;
+		this->occluders.clear();
+		this->meshes.clear();
+		this->bounds.clear();
+	}
+
+	//Draws the mesh into the depth buffer, it should be in the frustum and solid
+	void addOccluder(Mesh* mesh)
+	{
+		Occluder occluder;
+		occluder.mesh = &this->getOccluderMesh(mesh->getGeometry());
+		occluder.ModelViewProjectionMatrix = this->ViewProjectionMatrix * mesh->getModelMatrix();
+		this->occluders.push_back(occluder);
+	}
+
+	//Expects the mesh to be updated this frame, returns its index in the results
+	size_t add(Mesh* mesh)
+	{
+		this->meshes.push_back(mesh);
+		this->bounds.push_back(mesh->getWorldBounds());
+
+		return this->meshes.size() - 1;
+	}
+
+	//After cull, whether the box is behind the occluders. Boxes reaching the near plane never are
+	bool isOccluded(const AABB& box) const
+	{
+		glm::vec2 low(FLT_MAX);
+		glm::vec2 high(-FLT_MAX);
+		float depth = 1.f;
+		for (int i = 0; i < 8; i++)
+		{
+			const glm::vec4 corner((i & 1) != 0 ? box.max.x : box.min.x,
+				(i & 2) != 0 ? box.max.y : box.min.y,
+				(i & 4) != 0 ? box.max.z : box.min.z, 1.f);
+			const glm::vec4 clip = this->ViewProjectionMatrix * corner;
+			if (clip.z < -clip.w || clip.w <= 0.f)
+				return false;
+
+			const glm::vec3 screen = project(clip);
+			low = glm::min(low, glm::vec2(screen.x, screen.y));
+			high = glm::max(high, glm::vec2(screen.x, screen.y));
+			depth = std::min(depth, screen.z);
+		}
+
+		//Every pixel with its center less than a pixel from the rectangle: depth is only known at centers,
+		//a point of the rectangle is hidden once the four centers around it are
+		const int x0 = std::max(static_cast<int>(std::floor(low.x - 0.5f)), 0);
+		const int y0 = std::max(static_cast<int>(std::floor(low.y - 0.5f)), 0);
+		const int x1 = std::min(static_cast<int>(std::ceil(high.x + 0.5f)) - 1, WIDTH - 1);
+		const int y1 = std::min(static_cast<int>(std::ceil(high.y + 0.5f)) - 1, HEIGHT - 1);
+		if (x0 > x1 || y0 > y1)
+			return false;
+
+		//Starts at the coarsest level where the rectangle covers at most 2x2 cells
+		int level = 0;
+		while (level < LEVELS - 1 && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+			++level;
+
+		depth -= DEPTH_BIAS;
+		for (int y = y0 >> level; y <= y1 >> level; y++)
+		{
+			for (int x = x0 >> level; x <= x1 >> level; x++)
+			{
+				if (!this->isHidden(level, x, y, x0, y0, x1, y1, depth))
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	//Draws the occluders, then tests every mesh added since begin and hides the occluded ones.
+	//Both are split over the job threads when given
+	void cull(JobSystem* jobs = nullptr)
+	{
+		const double start = now();
+		this->rasterize(jobs);
+		const double rasterized = now();
+
+		const size_t count = this->meshes.size();
+		this->results.resize(count);
+
+		auto kernel = [&](const size_t first, const size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+				this->results[i] = !this->isOccluded(this->bounds[i]);
+		};
+
+		if (jobs != nullptr)
+			jobs->parallelFor(count, kernel, 64);
+		else
+			kernel(0, count);
+
+		this->stats.occluders = static_cast<unsigned>(this->occluders.size());
+		this->stats.tested = static_cast<unsigned>(count);
+		this->stats.occluded = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!this->results[i])
+			{
+				++this->stats.occluded;
+				this->meshes[i]->setVisible(false);
+			}
+		}
+
+		this->stats.rasterizeTime = rasterized - start;
+		this->stats.testTime = now() - rasterized;
+	}
+
+	void printStats() const
+	{
+		std::cout << "OCCLUSIONCULLER::OCCLUDERS: " << this->stats.occluders
+			<< " TRIANGLES: " << this->stats.triangles
+			<< " TESTED: " << this->stats.tested
+			<< " OCCLUDED: " << this->stats.occluded
+			<< " RASTERIZE_MS: " << this->stats.rasterizeTime
+			<< " TEST_MS: " << this->stats.testTime << "\n";
+	}
+};
@@ -0,0 +1,500 @@
+#pragma once
+#include<iostream>
+#include<fstream>
+#include<iomanip>
+#include<vector>
+#include<memory>
+#include<algorithm>
+#include<mutex>
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+
+#include<glew.h>
+
+//Frame profiler.
+//CPU scopes go to a ring buffer owned by the recording thread, so recording never locks or allocates.
+//GPU passes are timed with GL_TIME_ELAPSED queries, two per pass used on alternate frames, and read back when
+//their slot comes around again so the CPU never waits on them. Counters are per frame values set by the systems themselves.
+//Recent frames can be written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+class Profiler
+{
+private:
+	struct Event
+	{
+		const char* name;
+		int64_t start;
+		int64_t end;
+		uint32_t frame;
+		uint32_t depth;
+	};
+
+	//Events of one thread, the oldest are overwritten once it is full
+	struct ThreadBuffer
+	{
+		std::vector<Event> events;
+		std::atomic<uint64_t> written;
+		uint32_t depth;
+		unsigned id;
+	};
+
+	struct GpuPass
+	{
+		const char* name;
+		GLuint queries[2];
+		int64_t starts[2];
+		uint32_t frames[2];
+		bool issued[2];
+
+		float lastMs;
+		unsigned dropped;
+	};
+
+	struct Counter
+	{
+		const char* name;
+		double value;
+	};
+
+	struct CounterSample
+	{
+		const char* name;
+		double value;
+		int64_t time;
+		uint32_t frame;
+	};
+
+	static const size_t EVENTS_PER_THREAD = 1 << 16;
+	static const size_t FRAME_HISTORY = 1024;
+
+	std::mutex threadsMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> threads;
+
+	std::vector<GpuPass> gpuPasses;
+	std::vector<Event> gpuEvents;
+	size_t gpuWritten;
+	int activeGpuPass;
+
+	std::vector<Counter> counters;
+	std::vector<CounterSample> counterSamples;
+	size_t counterWritten;
+
+	std::atomic<uint32_t> frame;
+	int64_t frameStart;
+	std::vector<float> frameTimes;
+	std::vector<float> sorted;
+	size_t frameCount;
+
+	bool enabled;
+
+	Profiler()
+	{
+		this->frame = 0;
+		this->frameStart = now();
+		this->frameTimes.resize(FRAME_HISTORY, 0.f);
+		this->sorted.reserve(FRAME_HISTORY);
+		this->frameCount = 0;
+		this->gpuEvents.resize(EVENTS_PER_THREAD);
+		this->gpuWritten = 0;
+		this->activeGpuPass = -1;
+		this->counterSamples.resize(EVENTS_PER_THREAD);
+		this->counterWritten = 0;
+		this->enabled = true;
+	}
+
+	~Profiler()
+	{
+
+	}
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	static ThreadBuffer*& getThreadBuffer()
+	{
+		thread_local ThreadBuffer* buffer = nullptr;
+		return buffer;
+	}
+
+	//First scope on a thread, the only time recording takes the lock
+	ThreadBuffer* registerThread()
+	{
+		std::lock_guard<std::mutex> lock(this->threadsMutex);
+
+		ThreadBuffer* buffer = new ThreadBuffer();
+		buffer->events.resize(EVENTS_PER_THREAD);
+		buffer->written = 0;
+		buffer->depth = 0;
+		buffer->id = static_cast<unsigned>(this->threads.size());
+		this->threads.push_back(std::unique_ptr<ThreadBuffer>(buffer));
+
+		getThreadBuffer() = buffer;
+		return buffer;
+	}
+
+	GpuPass& getGpuPass(const char* name)
+	{
+		for (auto& i : this->gpuPasses)
+		{
+			if (i.name == name)
+				return i;
+		}
+
+		GpuPass pass;
+		pass.name = name;
+		glGenQueries(2, pass.queries);
+		for (int i = 0; i < 2; i++)
+		{
+			pass.starts[i] = 0;
+			pass.frames[i] = 0;
+			pass.issued[i] = false;
+		}
+		pass.lastMs = 0.f;
+		pass.dropped = 0;
+
+		this->gpuPasses.push_back(pass);
+		return this->gpuPasses.back();
+	}
+
+	//Result of the query issued two frames ago, skipped instead of waited for when it is not there yet
+	void readGpuPass(GpuPass& pass, const int slot)
+	{
+		if (!pass.issued[slot])
+			return;
+
+		GLint available = 0;
+		glGetQueryObjectiv(pass.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		pass.issued[slot] = false;
+
+		if (!available)
+		{
+			++pass.dropped;
+			return;
+		}
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(pass.queries[slot], GL_QUERY_RESULT, &elapsed);
+		pass.lastMs = static_cast<float>(elapsed / 1000000.0);
+
+		//No GPU timestamps, the pass is placed where the CPU issued it
+		Event& event = this->gpuEvents[this->gpuWritten % this->gpuEvents.size()];
+		event.name = pass.name;
+		event.start = pass.starts[slot];
+		event.end = pass.starts[slot] + static_cast<int64_t>(elapsed);
+		event.frame = pass.frames[slot];
+		event.depth = 0;
+		++this->gpuWritten;
+	}
+
+	static void writeEvent(std::ofstream& out, const Event& event, const unsigned thread, bool& first)
+	{
+		out << (first ? "" : ",\n")
+			<< "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread
+			<< ",\"ts\":" << event.start / 1000.0
+			<< ",\"dur\":" << (event.end - event.start) / 1000.0
+			<< ",\"args\":{\"frame\":" << event.frame << "}}";
+		first = false;
+	}
+
+	static void writeThreadName(std::ofstream& out, const char* name, const unsigned thread, bool& first)
+	{
+		out << (first ? "" : ",\n")
+			<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread
+			<< ",\"args\":{\"name\":\"" << name << " " << thread << "\"}}";
+		first = false;
+	}
+
+public:
+	static Profiler& get()
+	{
+		static Profiler instance;
+		return instance;
+	}
+
+	//Nanoseconds
+	static int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	//Accessors
+	bool isEnabled() const { return this->enabled; }
+
+	uint32_t getFrame() const { return this->frame; }
+
+	//Milliseconds of the last read back result
+	float getGpuTime(const char* name) const
+	{
+		for (auto& i : this->gpuPasses)
+		{
+			if (i.name == name)
+				return i.lastMs;
+		}
+		return 0.f;
+	}
+
+	//Value of the last setCounter call
+	double getCounter(const char* name) const
+	{
+		for (auto& i : this->counters)
+		{
+			if (i.name == name)
+				return i.value;
+		}
+		return 0.0;
+	}
+
+	//p in [0, 1] over the last FRAME_HISTORY frames, in milliseconds
+	float getFrameTimePercentile(const float p)
+	{
+		const size_t count = std::min(this->frameCount, FRAME_HISTORY);
+		if (count == 0)
+			return 0.f;
+
+		this->sorted.assign(this->frameTimes.begin(), this->frameTimes.begin() + count);
+		const size_t n = std::min(count - 1, static_cast<size_t>(p * (count - 1) + 0.5f));
+		std::nth_element(this->sorted.begin(), this->sorted.begin() + n, this->sorted.end());
+
+		return this->sorted[n];
+	}
+
+	//Modifiers
+	void setEnabled(const bool enabled)
+	{
+		this->enabled = enabled;
+	}
+
+	//Functions
+	void beginScope(int64_t& start)
+	{
+		ThreadBuffer* buffer = getThreadBuffer();
+		if (buffer == nullptr)
+			buffer = this->registerThread();
+
+		++buffer->depth;
+		start = now();
+	}
+
+	void endScope(const char* name, const int64_t start)
+	{
+		const int64_t end = now();
+		ThreadBuffer* buffer = getThreadBuffer();
+
+		const uint64_t written = buffer->written.load(std::memory_order_relaxed);
+		Event& event = buffer->events[written % EVENTS_PER_THREAD];
+		event.name = name;
+		event.start = start;
+		event.end = end;
+		event.frame = this->frame.load(std::memory_order_relaxed);
+		event.depth = --buffer->depth;
+		buffer->written.store(written + 1, std::memory_order_release);
+	}
+
+	//GPU passes can not nest, GL only has one GL_TIME_ELAPSED query active at a time
+	void beginGpuPass(const char* name)
+	{
+		if (!this->enabled || this->activeGpuPass >= 0)
+			return;
+
+		GpuPass& pass = this->getGpuPass(name);
+		const int slot = this->frame % 2;
+		this->readGpuPass(pass, slot);
+
+		pass.starts[slot] = now();
+		pass.frames[slot] = this->frame;
+		glBeginQuery(GL_TIME_ELAPSED, pass.queries[slot]);
+
+		this->activeGpuPass = static_cast<int>(&pass - this->gpuPasses.data());
+	}
+
+	void endGpuPass()
+	{
+		if (this->activeGpuPass < 0)
+			return;
+
+		glEndQuery(GL_TIME_ELAPSED);
+
+		GpuPass& pass = this->gpuPasses[this->activeGpuPass];
+		pass.issued[this->frame % 2] = true;
+		this->activeGpuPass = -1;
+	}
+
+	//GL thread only, the value stays until it is set again
+	void setCounter(const char* name, const double value)
+	{
+		if (!this->enabled)
+			return;
+
+		Counter* counter = nullptr;
+		for (auto& i : this->counters)
+		{
+			if (i.name == name)
+				counter = &i;
+		}
+
+		if (counter == nullptr)
+		{
+			Counter created;
+			created.name = name;
+			this->counters.push_back(created);
+			counter = &this->counters.back();
+		}
+		counter->value = value;
+
+		CounterSample& sample = this->counterSamples[this->counterWritten % this->counterSamples.size()];
+		sample.name = name;
+		sample.value = value;
+		sample.time = now();
+		sample.frame = this->frame;
+		++this->counterWritten;
+	}
+
+	void beginFrame()
+	{
+		this->frameStart = now();
+	}
+
+	void endFrame()
+	{
+		const float ms = static_cast<float>((now() - this->frameStart) / 1000000.0);
+		this->frameTimes[this->frameCount % FRAME_HISTORY] = ms;
+		++this->frameCount;
+		++this->frame;
+	}
+
+	//Writes every event still in the buffers whose frame is in [firstFrame, lastFrame]
+	bool writeTrace(const char* fileName, const uint32_t firstFrame, const uint32_t lastFrame)
+	{
+		std::ofstream out(fileName);
+		if (!out.is_open())
+		{
+			std::cout << "ERROR::PROFILER::COULD_NOT_OPEN_FILE: " << fileName << "\n";
+			return false;
+		}
+
+		out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+		bool first = true;
+
+		std::lock_guard<std::mutex> lock(this->threadsMutex);
+		for (auto& i : this->threads)
+		{
+			writeThreadName(out, "CPU", i->id, first);
+
+			const uint64_t written = i->written.load(std::memory_order_acquire);
+			const uint64_t oldest = written > EVENTS_PER_THREAD ? written - EVENTS_PER_THREAD : 0;
+			for (uint64_t j = oldest; j < written; j++)
+			{
+				const Event& event = i->events[j % EVENTS_PER_THREAD];
+				if (event.frame >= firstFrame && event.frame <= lastFrame)
+					writeEvent(out, event, i->id, first);
+			}
+		}
+
+		//GPU passes get their own track after the CPU threads
+		const unsigned gpuTrack = static_cast<unsigned>(this->threads.size());
+		writeThreadName(out, "GPU", gpuTrack, first);
+
+		const size_t oldest = this->gpuWritten > this->gpuEvents.size() ? this->gpuWritten - this->gpuEvents.size() : 0;
+		for (size_t j = oldest; j < this->gpuWritten; j++)
+		{
+			const Event& event = this->gpuEvents[j % this->gpuEvents.size()];
+			if (event.frame >= firstFrame && event.frame <= lastFrame)
+				writeEvent(out, event, gpuTrack, first);
+		}
+
+		//Counters are drawn as graphs per process
+		const size_t oldestSample = this->counterWritten > this->counterSamples.size() ? this->counterWritten - this->counterSamples.size() : 0;
+		for (size_t j = oldestSample; j < this->counterWritten; j++)
+		{
+			const CounterSample& sample = this->counterSamples[j % this->counterSamples.size()];
+			if (sample.frame < firstFrame || sample.frame > lastFrame)
+				continue;
+
+			out << (first ? "" : ",\n")
+				<< "{\"name\":\"" << sample.name << "\",\"ph\":\"C\",\"pid\":0"
+				<< ",\"ts\":" << sample.time / 1000.0
+				<< ",\"args\":{\"value\":" << sample.value << "}}";
+			first = false;
+		}
+
+		out << "\n]}\n";
+		std::cout << "PROFILER::TRACE_WRITTEN: " << fileName << " FRAMES: " << firstFrame << "-" << lastFrame << "\n";
+		return true;
+	}
+
+	//The last frameCount finished frames
+	bool writeTrace(const char* fileName, const uint32_t frameCount)
+	{
+		const uint32_t last = this->frame > 0 ? this->frame - 1 : 0;
+		return this->writeTrace(fileName, last >= frameCount ? last - frameCount + 1 : 0, last);
+	}
+
+	void printStats()
+	{
+		std::cout << std::fixed << std::setprecision(2)
+			<< "PROFILER::FRAME_MS p50: " << this->getFrameTimePercentile(0.5f)
+			<< " p95: " << this->getFrameTimePercentile(0.95f)
+			<< " p99: " << this->getFrameTimePercentile(0.99f);
+
+		for (auto& i : this->gpuPasses)
+			std::cout << " GPU " << i.name << ": " << i.lastMs;
+
+		for (auto& i : this->counters)
+			std::cout << " " << i.name << ": " << i.value;
+
+		std::cout << "\n";
+	}
+};
+
+//Times the enclosing block on the calling thread
+class ProfileScope
+{
+private:
+	const char* name;
+	int64_t start;
+	bool active;
+
+public:
+	ProfileScope(const char* name)
+	{
+		this->name = name;
+		this->active = Profiler::get().isEnabled();
+		if (this->active)
+			Profiler::get().beginScope(this->start);
+	}
+
+	~ProfileScope()
+	{
+		if (this->active)
+			Profiler::get().endScope(this->name, this->start);
+	}
+};
+
+//Times the enclosing block on the GPU, GL thread only
+class GpuProfileScope
+{
+public:
+	GpuProfileScope(const char* name)
+	{
+		Profiler::get().beginGpuPass(name);
+	}
+
+	~GpuProfileScope()
+	{
+		Profiler::get().endGpuPass();
+	}
+};
+
+//Names must be string literals, only the pointer is stored
+#ifndef PROFILER_DISABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU(name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) Profiler::get().setCounter(name, static_cast<double>(value))
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU(name)
+#define PROFILE_COUNTER(name, value)
+#endif
@@ -0,0 +1,864 @@
+#pragma once
+#include<iostream>
+#include<fstream>
+#include<iomanip>
+#include<vector>
+#include<string>
+#include<random>
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<cstdint>
+
+#include "libs.h"
+#include "FrustumCuller.h"
+#include "RenderQueue.h"
+#include "InstanceRenderer.h"
+#include "GeometryRegistry.h"
+#include "TextureArray.h"
+#include "LODSelector.h"
+#include "GPUCuller.h"
+#include "OcclusionCuller.h"
+
+#ifdef __linux__
+#include<EGL/egl.h>
+#include<EGL/eglext.h>
+#endif
+
+//Frame time percentiles of one scene, in milliseconds
+struct RenderBenchmarkTimes
+{
+	double mean;
+	double p50;
+	double p95;
+	double p99;
+	double max;
+};
+
+//Where the models' textures come from: one pair for all, a pair per model from separate textures or from arrays
+enum render_benchmark_textures { TEXTURES_SHARED = 0, TEXTURES_SEPARATE, TEXTURES_ARRAY };
+
+//Culled on the CPU and drawn through the queue, the same instanced, culled and drawn by a GPUCuller,
+//or the queue once every model has been an occluder for the others in an OcclusionCuller
+enum render_benchmark_path { PATH_QUEUE = 0, PATH_INSTANCED, PATH_GPU, PATH_OCCLUSION };
+
+struct RenderBenchmarkResult
+{
+	int models;
+	const char* path;
+	const char* textures;
+	RenderBenchmarkTimes frame;
+	RenderBenchmarkTimes cpu;
+	double visible;
+	double draws;
+	double triangles;
+	double programBinds;
+	double textureBinds;
+	double uniformUploads;
+
+	//Meshes the OcclusionCuller hid and the time it took to draw the occluders
+	double occluded;
+	double rasterizeTime;
+	uint64_t imageHash;
+};
+
+//The sphere wall at one camera distance, at full detail or with levels picked by a LODSelector
+struct RenderBenchmarkLODResult
+{
+	float distance;
+	bool lod;
+	RenderBenchmarkTimes frame;
+	double visible;
+	double triangles;
+	double switches;
+};
+
+//Offscreen rendering benchmark, run with "ProjectInk --render-bench [results.json]".
+//Every run renders the same frames: scenes are seeded, the camera follows a path driven by the frame
+//number instead of the clock and the image goes to a fixed size framebuffer object. On Linux the context
+//is EGL surfaceless (Mesa llvmpipe works without a GPU or display), elsewhere it comes from a hidden window.
+//Frame time runs until glFinish returns, CPU time stops once the last draw is issued.
+class RenderBenchmark
+{
+private:
+	static const int WIDTH = 640;
+	static const int HEIGHT = 360;
+	static const int WARMUP_FRAMES = 10;
+	static const int FRAMES = 120;
+
+	//Constant density, so the camera sees about the same amount at every scene size
+	static constexpr float SPACING = 6.f;
+	static constexpr float FAR_PLANE = 40.f;
+
+	//Wall of LOD_GRID x LOD_GRID spheres LOD_SPACING apart for the level of detail sweep
+	static const int LOD_GRID = 12;
+	static constexpr float LOD_SPACING = 2.5f;
+
+#ifdef __linux__
+	EGLDisplay display;
+	EGLContext context;
+#endif
+	GLFWwindow* window;
+
+	GLuint fbo;
+	GLuint colorBuffer;
+	GLuint depthBuffer;
+
+	std::vector<Shader*> shaders;
+	std::vector<UniformCache*> uniformCaches;
+	StreamBuffer* streamBuffer;
+	UniformBuffer* frameBuffer;
+	UniformBuffer* drawBuffer;
+	FrameData frameData;
+	Texture* diffuse;
+	Texture* specular;
+	Material* material;
+
+	//Box and Ricardo_Kantov pairs, alternating between models in the textured scenes
+	std::vector<Texture*> textures;
+	std::vector<TextureLayer> layers;
+
+	//Pyramid, cube and sphere, scaled to a radius of one
+	std::vector<Mesh*> templates;
+
+	static double now()
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static RenderBenchmarkTimes percentiles(std::vector<double> times)
+	{
+		RenderBenchmarkTimes result = RenderBenchmarkTimes();
+		if (times.empty())
+			return result;
+
+		std::sort(times.begin(), times.end());
+		for (double i : times)
+			result.mean += i;
+		result.mean /= times.size();
+
+		auto at = [&times](const double p) { return times[static_cast<size_t>(p * (times.size() - 1) + 0.5)]; };
+		result.p50 = at(0.50);
+		result.p95 = at(0.95);
+		result.p99 = at(0.99);
+		result.max = times.back();
+
+		return result;
+	}
+
+	bool createContext()
+	{
+#ifdef __linux__
+		this->display = EGL_NO_DISPLAY;
+		this->context = EGL_NO_CONTEXT;
+
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if (getPlatformDisplay != nullptr)
+			this->display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		if (this->display == EGL_NO_DISPLAY)
+			this->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		EGLint major = 0;
+		EGLint minor = 0;
+		if (this->display == EGL_NO_DISPLAY || eglInitialize(this->display, &major, &minor) == EGL_FALSE
+			|| eglBindAPI(EGL_OPENGL_API) == EGL_FALSE)
+		{
+			std::cout << "ERROR::RENDERBENCHMARK::EGL_INIT_FAILED" << "\n";
+			return false;
+		}
+
+		//Newest core context the driver has, the shaders need 4.4
+		const EGLint versions[][2] = { { 4, 6 }, { 4, 5 }, { 4, 4 } };
+		for (auto& i : versions)
+		{
+			const EGLint attributes[] = {
+				EGL_CONTEXT_MAJOR_VERSION, i[0],
+				EGL_CONTEXT_MINOR_VERSION, i[1],
+				EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+				EGL_NONE };
+
+			this->context = eglCreateContext(this->display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+			if (this->context != EGL_NO_CONTEXT)
+				break;
+		}
+
+		if (this->context == EGL_NO_CONTEXT || eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, this->context) == EGL_FALSE)
+		{
+			std::cout << "ERROR::RENDERBENCHMARK::EGL_CONTEXT_FAILED" << "\n";
+			eglTerminate(this->display);
+			return false;
+		}
+#else
+		if (glfwInit() == GLFW_FALSE)
+		{
+			std::cout << "ERROR::RENDERBENCHMARK::GLFW_INIT_FAILED" << "\n";
+			return false;
+		}
+
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+		this->window = glfwCreateWindow(WIDTH, HEIGHT, "render benchmark", NULL, NULL);
+		if (this->window == nullptr)
+		{
+			std::cout << "ERROR::RENDERBENCHMARK::WINDOW_INIT_FAILED" << "\n";
+			glfwTerminate();
+			return false;
+		}
+
+		glfwMakeContextCurrent(this->window);
+		glfwSwapInterval(0);
+#endif
+
+		glewExperimental = GL_TRUE;
+		const GLenum error = glewInit();
+
+		//GLEW built for GLX still loads every GL function before it looks for the X display it does not need here
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+		if (error != GLEW_OK && error != GLEW_ERROR_NO_GLX_DISPLAY)
+#else
+		if (error != GLEW_OK)
+#endif
+		{
+			std::cout << "ERROR::RENDERBENCHMARK::GLEW_INIT_FAILED" << "\n";
+			this->destroyContext();
+			return false;
+		}
+
+		return true;
+	}
+
+	void destroyContext()
+	{
+#ifdef __linux__
+		eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(this->display, this->context);
+		eglTerminate(this->display);
+#else
+		glfwDestroyWindow(this->window);
+		glfwTerminate();
+#endif
+	}
+
+	//Same state, shaders and assets as Game, rendered into a framebuffer object of a fixed size
+	void initResources()
+	{
+		glGenFramebuffers(1, &this->fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+
+		glGenRenderbuffers(1, &this->colorBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->colorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, WIDTH, HEIGHT);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->colorBuffer);
+
+		glGenRenderbuffers(1, &this->depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, WIDTH, HEIGHT);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::RENDERBENCHMARK::FRAMEBUFFER_INCOMPLETE" << "\n";
+
+		glViewport(0, 0, WIDTH, HEIGHT);
+
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_BACK);
+		glFrontFace(GL_CCW);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		this->streamBuffer = new StreamBuffer(4 * 1024 * 1024);
+		this->frameBuffer = new UniformBuffer(sizeof(FrameData), BLOCK_FRAME, this->streamBuffer);
+		this->drawBuffer = new UniformBuffer(sizeof(DrawData), BLOCK_DRAW, this->streamBuffer);
+		this->frameBuffer->bind();
+		this->drawBuffer->bind();
+
+		this->shaders.push_back(new Shader(4, 4, "vertex_core.glsl", "fragment_core.glsl"));
+		this->shaders.push_back(new Shader(4, 4, "vertex_instanced.glsl", "fragment_core.glsl"));
+		this->shaders.push_back(new Shader(4, 4, "vertex_array.glsl", "fragment_array.glsl"));
+		this->shaders.push_back(new Shader(4, 4, "vertex_instanced.glsl", "fragment_array.glsl"));
+		for (auto& i : this->shaders)
+			this->uniformCaches.push_back(new UniformCache(i, this->drawBuffer));
+
+		this->diffuse = new Texture("Images/Box.png", GL_TEXTURE_2D);
+		this->specular = new Texture("Images/Box_specular.png", GL_TEXTURE_2D);
+		this->material = new Material(glm::vec3(0.1f), glm::vec3(1.f), glm::vec3(2.f), 0, 1);
+
+		const char* files[] = { "Images/Box.png", "Images/Box_specular.png",
+			"Images/Ricardo_Kantov.png", "Images/Ricardo_Kantov_specular.png" };
+		for (auto* i : files)
+		{
+			this->textures.push_back(new Texture(i, GL_TEXTURE_2D));
+			this->layers.push_back(TextureArrayRegistry::get().acquire(i, 512, 512));
+		}
+
+		Pyramid pyramid;
+		Geometry* geometries[] = {
+			GeometryRegistry::get().acquire(&pyramid),
+			GeometryRegistry::get().acquireOBJ("OBJFiles/cube.obj"),
+			GeometryRegistry::get().acquireOBJ("OBJFiles/sphere.obj") };
+
+		for (auto* i : geometries)
+		{
+			const float radius = i->getBoundingSphere().radius;
+			const float scale = radius > 0.f ? 1.f / radius : 1.f;
+			this->templates.push_back(new Mesh(i, glm::vec3(0.f), glm::vec3(0.f), glm::vec3(0.f), glm::vec3(scale)));
+		}
+	}
+
+	void destroyResources()
+	{
+		for (auto*& i : this->templates)
+			delete i;
+		this->templates.clear();
+
+		delete this->material;
+		MaterialTable::get().clear();
+		delete this->specular;
+		delete this->diffuse;
+		for (auto*& i : this->textures)
+			delete i;
+		this->textures.clear();
+		this->layers.clear();
+		TextureArrayRegistry::get().clear();
+		for (auto*& i : this->uniformCaches)
+			delete i;
+		for (auto*& i : this->shaders)
+			delete i;
+		this->uniformCaches.clear();
+		this->shaders.clear();
+		delete this->frameBuffer;
+		delete this->drawBuffer;
+		delete this->streamBuffer;
+
+		glDeleteRenderbuffers(1, &this->colorBuffer);
+		glDeleteRenderbuffers(1, &this->depthBuffer);
+		glDeleteFramebuffers(1, &this->fbo);
+	}
+
+	//Slow orbit through the middle of the scene while looking around, frame 0 and the last frame meet up
+	static glm::mat4 cameraPath(const int frame, const float extent)
+	{
+		const float t = static_cast<float>(frame) / FRAMES * 6.2831853f;
+		const float radius = extent * 0.5f;
+
+		const glm::vec3 position(std::cos(t) * radius, std::sin(t * 2.f) * radius * 0.25f, std::sin(t) * radius);
+		const glm::vec3 target = position + glm::vec3(-std::sin(t + 0.6f), -0.1f, std::cos(t + 0.6f));
+
+		return glm::lookAt(position, target, glm::vec3(0.f, 1.f, 0.f));
+	}
+
+	RenderBenchmarkResult scene(const int count, const render_benchmark_path path, JobSystem& jobs,
+		const render_benchmark_textures textures = TEXTURES_SHARED)
+	{
+		static const char* textureNames[] = { "shared", "separate", "array" };
+		static const char* pathNames[] = { "queue", "instanced", "gpu", "occlusion" };
+
+		RenderBenchmarkResult result = RenderBenchmarkResult();
+		result.models = count;
+		result.path = pathNames[path];
+		result.textures = textureNames[textures];
+
+		//Same seed for every path, so both draw the same scene
+		std::mt19937 random(13);
+		const float extent = SPACING * std::cbrt(static_cast<float>(count));
+		std::uniform_real_distribution<float> position(-extent * 0.5f, extent * 0.5f);
+
+		std::vector<Model*> models;
+		models.reserve(count);
+		for (int i = 0; i < count; i++)
+		{
+			std::vector<Mesh*> meshes(1, this->templates[i % this->templates.size()]);
+			const glm::vec3 at(position(random), position(random), position(random));
+			if (textures == TEXTURES_SHARED)
+			{
+				models.push_back(new Model(at, this->material, this->diffuse, this->specular, meshes));
+				continue;
+			}
+
+			const size_t pair = (i % 2) * 2;
+			models.push_back(new Model(at, this->material, this->textures[pair], this->textures[pair + 1], meshes));
+			if (textures == TEXTURES_ARRAY)
+				models.back()->setTextureLayers(this->layers[pair], this->layers[pair + 1]);
+		}
+		const size_t programOffset = textures == TEXTURES_ARRAY ? 2 : 0;
+
+		DynamicAABBTree<Model> tree;
+		TransformSystem::get().update(&jobs);
+		for (auto& i : models)
+		{
+			i->update();
+			i->setProxy(tree.insert(i));
+		}
+
+		FrustumCuller culler;
+		RenderQueue queue(this->streamBuffer);
+		InstanceRenderer instances(this->streamBuffer);
+		std::vector<DrawList> lists(jobs.getThreadCount());
+
+		OcclusionCuller occlusion;
+		if (path == PATH_OCCLUSION)
+		{
+			for (auto& i : models)
+				i->setOccluder(true);
+		}
+
+		GPUCuller gpu;
+		if (path == PATH_GPU)
+		{
+			for (auto& i : models)
+				i->addGPUObjects(gpu);
+		}
+
+		//One light at the camera reaching the whole view, like Game's default light
+		std::vector<Light> lights(1, Light(glm::vec3(0.f), glm::vec3(1.f), FAR_PLANE * 2.f, 1.f));
+		LightClusterer clusterer;
+		std::vector<Model*> visible;
+
+		const glm::mat4 ProjectionMatrix = glm::perspective(glm::radians(90.f),
+			static_cast<float>(WIDTH) / HEIGHT, 0.1f, FAR_PLANE);
+
+		std::vector<double> frameTimes;
+		std::vector<double> cpuTimes;
+		GLInterceptor& gl = GLInterceptor::get();
+		gl.endFrame();
+
+		for (int frame = -WARMUP_FRAMES; frame < FRAMES; frame++)
+		{
+			const double start = now();
+			this->streamBuffer->beginFrame();
+
+			//A tenth of the scene turns every frame
+			for (size_t i = 0; i < models.size(); i += 10)
+				models[i]->rotate(glm::vec3(0.f, 1.f, 0.f));
+
+			TransformSystem::get().update(&jobs);
+			jobs.parallelFor(models.size(), [&models](const size_t first, const size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+					models[i]->update();
+			}, 64);
+			for (auto& i : models)
+			{
+				if (path == PATH_GPU)
+					i->updateGPUObjects(gpu);
+				else if (i->hasMoved())
+					tree.move(i->getProxy());
+			}
+
+			const glm::mat4 ViewMatrix = cameraPath(std::max(frame, 0), extent);
+			this->frameData.ViewMatrix = ViewMatrix;
+			this->frameData.ProjectionMatrix = ProjectionMatrix;
+			this->frameData.cameraPos = glm::inverse(ViewMatrix)[3];
+			this->frameData.lightPos0 = this->frameData.cameraPos;
+			lights[0].setPosition(glm::vec3(this->frameData.cameraPos));
+			clusterer.build(lights, ViewMatrix, ProjectionMatrix, 0.1f, FAR_PLANE, WIDTH, HEIGHT, &jobs);
+			clusterer.upload();
+			clusterer.writeFrameData(this->frameData);
+			this->frameBuffer->update(&this->frameData, sizeof(FrameData));
+			for (auto& i : this->uniformCaches)
+			{
+				i->setMat4fv(ViewMatrix, UNIFORM_VIEW_MATRIX);
+				i->setMat4fv(ProjectionMatrix, UNIFORM_PROJECTION_MATRIX);
+			}
+
+			glClearColor(0.f, 0.f, 0.f, 1.f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+			if (path == PATH_GPU)
+			{
+				gpu.cull(ProjectionMatrix * ViewMatrix);
+				gpu.render(this->uniformCaches[programOffset + 1]);
+				gpu.buildDepthPyramid(WIDTH, HEIGHT);
+			}
+			else
+			{
+				const Frustum frustum(ProjectionMatrix * ViewMatrix);
+				visible.clear();
+				tree.queryFrustum(frustum, visible);
+				culler.begin();
+				for (auto& i : visible)
+					i->cull(culler);
+				culler.cull(frustum, &jobs);
+
+				if (path == PATH_OCCLUSION)
+				{
+					occlusion.begin(ProjectionMatrix * ViewMatrix);
+					for (auto& i : visible)
+						i->cull(occlusion);
+					occlusion.cull(&jobs);
+				}
+			}
+
+			queue.begin(glm::vec3(this->frameData.cameraPos), FAR_PLANE);
+			if (path == PATH_INSTANCED)
+			{
+				instances.begin();
+				for (auto& i : visible)
+					i->submit(instances);
+				instances.submit(queue, this->uniformCaches[programOffset + 1]);
+			}
+			else if (path == PATH_QUEUE || path == PATH_OCCLUSION)
+			{
+				UniformCache* program = this->uniformCaches[programOffset];
+				for (auto& i : lists)
+					i.clear();
+				jobs.parallelFor(visible.size(), [&](const size_t first, const size_t last)
+				{
+					DrawList& list = lists[jobs.getCurrentThread()];
+					for (size_t i = first; i < last; i++)
+						visible[i]->submit(list, program);
+				}, 64);
+				for (auto& i : lists)
+					queue.merge(i);
+			}
+			queue.execute();
+
+			const double submitted = now();
+			glFinish();
+			const double finished = now();
+
+			const GLFrameStats& stats = gl.getCurrentStats();
+			if (frame >= 0)
+			{
+				frameTimes.push_back(finished - start);
+				cpuTimes.push_back(submitted - start);
+				result.visible += path == PATH_GPU ? gpu.readVisibleCount() : culler.getStats().visible;
+				if (path == PATH_OCCLUSION)
+				{
+					result.visible -= occlusion.getStats().occluded;
+					result.occluded += occlusion.getStats().occluded;
+					result.rasterizeTime += occlusion.getStats().rasterizeTime;
+				}
+				result.draws += stats.draws;
+				result.triangles += static_cast<double>(stats.triangles);
+				result.programBinds += stats.programBinds;
+				result.textureBinds += stats.textureBinds;
+				result.uniformUploads += stats.uniformUploads;
+			}
+			gl.endFrame();
+		}
+
+		result.frame = percentiles(frameTimes);
+		result.cpu = percentiles(cpuTimes);
+		result.visible /= FRAMES;
+		result.draws /= FRAMES;
+		result.triangles /= FRAMES;
+		result.programBinds /= FRAMES;
+		result.textureBinds /= FRAMES;
+		result.uniformUploads /= FRAMES;
+		result.occluded /= FRAMES;
+		result.rasterizeTime /= FRAMES;
+
+		//Changes whenever the last image does, a cheap check that two runs rendered the same thing
+		std::vector<unsigned char> pixels(WIDTH * HEIGHT * 4);
+		glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		result.imageHash = 14695981039346656037ull;
+		for (unsigned char i : pixels)
+		{
+			result.imageHash ^= i;
+			result.imageHash *= 1099511628211ull;
+		}
+
+		for (auto*& i : models)
+			delete i;
+
+		return result;
+	}
+
+	//The camera faces the wall and drifts a tenth of the distance back and forth, so meshes keep crossing
+	//switching distances; with hysteresis they should not switch on every frame
+	RenderBenchmarkLODResult lodScene(const float distance, const bool useLOD, JobSystem& jobs)
+	{
+		RenderBenchmarkLODResult result = RenderBenchmarkLODResult();
+		result.distance = distance;
+		result.lod = useLOD;
+
+		std::vector<Model*> models;
+		const float half = (LOD_GRID - 1) * LOD_SPACING * 0.5f;
+		for (int y = 0; y < LOD_GRID; y++)
+		{
+			for (int x = 0; x < LOD_GRID; x++)
+			{
+				std::vector<Mesh*> meshes(1, this->templates[2]);
+				models.push_back(new Model(glm::vec3(x * LOD_SPACING - half, y * LOD_SPACING - half, 0.f),
+					this->material, this->diffuse, this->specular, meshes));
+			}
+		}
+
+		TransformSystem::get().update(&jobs);
+		for (auto& i : models)
+			i->update();
+
+		FrustumCuller culler;
+		RenderQueue queue(this->streamBuffer);
+		InstanceRenderer instances(this->streamBuffer);
+		LODSelector selector;
+
+		const float farPlane = distance * 1.1f + LOD_SPACING;
+		std::vector<Light> lights(1, Light(glm::vec3(0.f), glm::vec3(1.f), farPlane * 2.f, 1.f));
+		LightClusterer clusterer;
+
+		const glm::mat4 ProjectionMatrix = glm::perspective(glm::radians(90.f),
+			static_cast<float>(WIDTH) / HEIGHT, 0.1f, farPlane);
+
+		std::vector<double> frameTimes;
+		GLInterceptor& gl = GLInterceptor::get();
+		gl.endFrame();
+
+		for (int frame = -WARMUP_FRAMES; frame < FRAMES; frame++)
+		{
+			const double start = now();
+			this->streamBuffer->beginFrame();
+
+			const float t = static_cast<float>(std::max(frame, 0)) / FRAMES * 6.2831853f;
+			const glm::vec3 position(0.f, 0.f, distance * (1.f + 0.1f * std::sin(t)));
+			const glm::mat4 ViewMatrix = glm::lookAt(position, position - glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 1.f, 0.f));
+
+			this->frameData.ViewMatrix = ViewMatrix;
+			this->frameData.ProjectionMatrix = ProjectionMatrix;
+			this->frameData.cameraPos = glm::vec4(position, 1.f);
+			this->frameData.lightPos0 = this->frameData.cameraPos;
+			lights[0].setPosition(position);
+			clusterer.build(lights, ViewMatrix, ProjectionMatrix, 0.1f, farPlane, WIDTH, HEIGHT, &jobs);
+			clusterer.upload();
+			clusterer.writeFrameData(this->frameData);
+			this->frameBuffer->update(&this->frameData, sizeof(FrameData));
+
+			glClearColor(0.f, 0.f, 0.f, 1.f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+			const Frustum frustum(ProjectionMatrix * ViewMatrix);
+			culler.begin();
+			for (auto& i : models)
+				i->cull(culler);
+			culler.cull(frustum, &jobs);
+
+			selector.begin(position, ProjectionMatrix, HEIGHT);
+			if (useLOD)
+			{
+				for (auto& i : models)
+					i->selectLOD(selector);
+			}
+
+			queue.begin(position, farPlane);
+			instances.begin();
+			for (auto& i : models)
+				i->submit(instances);
+			instances.submit(queue, this->uniformCaches[1]);
+			queue.execute();
+
+			glFinish();
+			const double finished = now();
+
+			const GLFrameStats& stats = gl.getCurrentStats();
+			if (frame >= 0)
+			{
+				frameTimes.push_back(finished - start);
+				result.visible += culler.getStats().visible;
+				result.triangles += static_cast<double>(stats.triangles);
+				result.switches += selector.getSwitches();
+			}
+			gl.endFrame();
+		}
+
+		result.frame = percentiles(frameTimes);
+		result.visible /= FRAMES;
+		result.triangles /= FRAMES;
+		result.switches /= FRAMES;
+
+		for (auto*& i : models)
+			delete i;
+
+		return result;
+	}
+
+	static void writeTimes(std::ofstream& out, const char* name, const RenderBenchmarkTimes& times)
+	{
+		out << "\"" << name << "\":{\"mean\":" << times.mean << ",\"p50\":" << times.p50
+			<< ",\"p95\":" << times.p95 << ",\"p99\":" << times.p99 << ",\"max\":" << times.max << "}";
+	}
+
+	static bool writeResults(const char* fileName, const std::vector<RenderBenchmarkResult>& results,
+		const std::vector<RenderBenchmarkLODResult>& lodResults)
+	{
+		std::ofstream out(fileName);
+		if (!out.is_open())
+		{
+			std::cout << "ERROR::RENDERBENCHMARK::COULD_NOT_OPEN_FILE: " << fileName << "\n";
+			return false;
+		}
+
+		const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+		const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+
+		out << std::fixed << std::setprecision(4)
+			<< "{\"renderer\":\"" << (renderer ? renderer : "") << "\",\"version\":\"" << (version ? version : "")
+			<< "\",\"width\":" << WIDTH << ",\"height\":" << HEIGHT
+			<< ",\"warmup_frames\":" << WARMUP_FRAMES << ",\"frames\":" << FRAMES << ",\"scenes\":[\n";
+
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const RenderBenchmarkResult& result = results[i];
+			out << "{\"models\":" << result.models << ",\"path\":\"" << result.path
+				<< "\",\"textures\":\"" << result.textures << "\",";
+			writeTimes(out, "frame_ms", result.frame);
+			out << ",";
+			writeTimes(out, "cpu_ms", result.cpu);
+			out << ",\"visible\":" << result.visible
+				<< ",\"draws\":" << result.draws
+				<< ",\"triangles\":" << result.triangles
+				<< ",\"program_binds\":" << result.programBinds
+				<< ",\"texture_binds\":" << result.textureBinds
+				<< ",\"uniform_uploads\":" << result.uniformUploads
+				<< ",\"occluded\":" << result.occluded
+				<< ",\"rasterize_ms\":" << result.rasterizeTime
+				<< ",\"image_hash\":\"" << std::hex << result.imageHash << std::dec << "\"}"
+				<< (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		out << "],\"lod_sweep\":[\n";
+
+		for (size_t i = 0; i < lodResults.size(); i++)
+		{
+			const RenderBenchmarkLODResult& result = lodResults[i];
+			out << "{\"distance\":" << result.distance << ",\"lod\":" << (result.lod ? "true" : "false") << ",";
+			writeTimes(out, "frame_ms", result.frame);
+			out << ",\"visible\":" << result.visible
+				<< ",\"triangles\":" << result.triangles
+				<< ",\"switches\":" << result.switches << "}"
+				<< (i + 1 < lodResults.size() ? ",\n" : "\n");
+		}
+		out << "]}\n";
+
+		return true;
+	}
+
+	RenderBenchmark()
+	{
+		this->window = nullptr;
+		this->fbo = 0;
+		this->colorBuffer = 0;
+		this->depthBuffer = 0;
+		this->streamBuffer = nullptr;
+		this->frameBuffer = nullptr;
+		this->drawBuffer = nullptr;
+		this->frameData = FrameData();
+		this->diffuse = nullptr;
+		this->specular = nullptr;
+		this->material = nullptr;
+	}
+
+public:
+	static void run(const char* fileName = "render_bench.json")
+	{
+		RenderBenchmark benchmark;
+		if (!benchmark.createContext())
+			return;
+
+		std::vector<RenderBenchmarkResult> results;
+		{
+			benchmark.initResources();
+
+			JobSystem jobs;
+
+			std::cout << "Render benchmark, " << WIDTH << "x" << HEIGHT << ", " << FRAMES << " frames ("
+				<< glGetString(GL_RENDERER) << ")\n";
+			std::cout << std::right << std::setw(10) << "models"
+				<< std::setw(11) << "path"
+				<< std::setw(10) << "textures"
+				<< std::setw(10) << "visible"
+				<< std::setw(10) << "draws"
+				<< std::setw(10) << "p50 ms"
+				<< std::setw(10) << "p95 ms"
+				<< std::setw(10) << "p99 ms"
+				<< std::setw(10) << "cpu ms"
+				<< std::setw(10) << "tex bind"
+				<< std::setw(10) << "occluded"
+				<< "\n";
+
+			auto print = [](const RenderBenchmarkResult& result)
+			{
+				std::cout << std::right << std::setw(10) << result.models
+					<< std::setw(11) << result.path
+					<< std::setw(10) << result.textures
+					<< std::fixed << std::setprecision(0)
+					<< std::setw(10) << result.visible
+					<< std::setw(10) << result.draws
+					<< std::setprecision(3)
+					<< std::setw(10) << result.frame.p50
+					<< std::setw(10) << result.frame.p95
+					<< std::setw(10) << result.frame.p99
+					<< std::setw(10) << result.cpu.p50
+					<< std::setprecision(0)
+					<< std::setw(10) << result.textureBinds
+					<< std::setw(10) << result.occluded
+					<< "\n";
+			};
+
+			const int counts[] = { 1000, 10000, 100000 };
+			const render_benchmark_path paths[] = { PATH_GPU, PATH_INSTANCED, PATH_QUEUE, PATH_OCCLUSION };
+			for (int count : counts)
+			{
+				for (auto path : paths)
+				{
+					results.push_back(benchmark.scene(count, path, jobs));
+					print(results.back());
+				}
+			}
+
+			//Hundreds of models alternating between two texture pairs, bound separately or sampled from arrays
+			const render_benchmark_textures modes[] = { TEXTURES_SEPARATE, TEXTURES_ARRAY };
+			for (auto path : paths)
+			{
+				for (auto mode : modes)
+				{
+					results.push_back(benchmark.scene(500, path, jobs, mode));
+					print(results.back());
+				}
+			}
+
+			//Triangles and frame time of the sphere wall at growing distances, full detail against selected levels
+			std::vector<RenderBenchmarkLODResult> lodResults;
+			std::cout << std::right << std::setw(10) << "distance"
+				<< std::setw(11) << "levels"
+				<< std::setw(10) << "visible"
+				<< std::setw(12) << "triangles"
+				<< std::setw(10) << "switches"
+				<< std::setw(10) << "p50 ms"
+				<< std::setw(10) << "p95 ms"
+				<< "\n";
+
+			const float distances[] = { 5.f, 10.f, 20.f, 40.f, 80.f };
+			for (float distance : distances)
+			{
+				for (int lod = 0; lod <= 1; lod++)
+				{
+					lodResults.push_back(benchmark.lodScene(distance, lod != 0, jobs));
+					const RenderBenchmarkLODResult& result = lodResults.back();
+					std::cout << std::right << std::fixed << std::setprecision(0)
+						<< std::setw(10) << result.distance
+						<< std::setw(11) << (result.lod ? "selected" : "full")
+						<< std::setw(10) << result.visible
+						<< std::setw(12) << result.triangles
+						<< std::setprecision(2)
+						<< std::setw(10) << result.switches
+						<< std::setprecision(3)
+						<< std::setw(10) << result.frame.p50
+						<< std::setw(10) << result.frame.p95
+						<< "\n";
+				}
+			}
+
+			if (writeResults(fileName, results, lodResults))
+				std::cout << "RENDERBENCHMARK::RESULTS_WRITTEN: " << fileName << "\n";
+
+			benchmark.destroyResources();
+		}
+
+		benchmark.destroyContext();
+	}
+};
@@ -0,0 +1,487 @@
+#pragma once
+#include<iostream>
+#include<vector>
+#include<map>
+#include<tuple>
+#include<algorithm>
+#include<cstdint>
+#include<cstring>
+
+#include<glew.h>
+
+#include<glm.hpp>
+#include<vec3.hpp>
+#include<mat4x4.hpp>
+
+#include "Geometry.h"
+#include "Texture.h"
+#include "TextureArray.h"
+#include "Material.h"
+#include "UniformCache.h"
+#include "StreamBuffer.h"
+#include "GLInterceptor.h"
+
+enum render_pass { PASS_OPAQUE = 0, PASS_COUNT };
+
+//Binds issued against binds skipped because the state was already current, per frame
+struct RenderQueueStats
+{
+	unsigned packets;
+	unsigned drawCalls;
+
+	//Multi draws among drawCalls and the packets they drew
+	unsigned multiDraws;
+	unsigned indirectCommands;
+
+	unsigned programBinds;
+	unsigned programSkips;
+	unsigned textureBinds;
+	unsigned textureSkips;
+	unsigned arrayBinds;
+	unsigned arraySkips;
+	unsigned vaoBinds;
+	unsigned vaoSkips;
+};
+
+struct DrawPacket
+{
+	UniformCache* program;
+	Geometry* geometry;
+	Material* material;
+	Texture* diffuseTex;
+	Texture* specularTex;
+
+	//Set instead of the textures when they come from arrays
+	TextureArray* diffuseArray;
+	TextureArray* specularArray;
+
+	//Array layers and material entry, copied to DrawData
+	glm::ivec4 indices;
+
+	glm::mat4 ModelMatrix;
+
+	//0 for a plain draw, otherwise an instanced draw sourcing the bound instance buffer
+	GLsizei instances;
+	GLuint baseInstance;
+	render_pass pass;
+};
+
+//Packets built off the GL thread, one list per job thread, merged into the RenderQueue afterwards
+class DrawList
+{
+private:
+	std::vector<DrawPacket> packets;
+
+public:
+	//Accessors
+	const std::vector<DrawPacket>& getPackets() const { return this->packets; }
+
+	//Functions
+	void clear()
+	{
+		this->packets.clear();
+	}
+
+	void submit(UniformCache* program, Geometry* geometry, Material* material,
+		Texture* diffuseTex, Texture* specularTex, const glm::mat4& ModelMatrix,
+		const GLsizei instances = 0, const GLuint baseInstance = 0,
+		const render_pass pass = PASS_OPAQUE)
+	{
+		DrawPacket packet;
+		packet.program = program;
+		packet.geometry = geometry;
+		packet.material = material;
+		packet.diffuseTex = diffuseTex;
+		packet.specularTex = specularTex;
+		packet.diffuseArray = nullptr;
+		packet.specularArray = nullptr;
+		packet.indices = glm::ivec4(0, 0, material->getIndex(), 0);
+		packet.ModelMatrix = ModelMatrix;
+		packet.instances = instances;
+		packet.baseInstance = baseInstance;
+		packet.pass = pass;
+
+		this->packets.push_back(packet);
+	}
+
+	//Textures from arrays, packets that only differ in their layers share the same state
+	void submit(UniformCache* program, Geometry* geometry, Material* material,
+		const TextureLayer& diffuse, const TextureLayer& specular, const glm::mat4& ModelMatrix,
+		const GLsizei instances = 0, const GLuint baseInstance = 0,
+		const render_pass pass = PASS_OPAQUE)
+	{
+		DrawPacket packet;
+		packet.program = program;
+		packet.geometry = geometry;
+		packet.material = material;
+		packet.diffuseTex = nullptr;
+		packet.specularTex = nullptr;
+		packet.diffuseArray = diffuse.array;
+		packet.specularArray = specular.array;
+		packet.indices = glm::ivec4(diffuse.layer, specular.layer, material->getIndex(), 0);
+		packet.ModelMatrix = ModelMatrix;
+		packet.instances = instances;
+		packet.baseInstance = baseInstance;
+		packet.pass = pass;
+
+		this->packets.push_back(packet);
+	}
+};
+
+//Collects draw packets for a frame, sorts them by a 64 bit key and submits them while only
+//issuing the binds that differ from the previous packet.
+//Key layout, most significant first: pass (4) | program (8) | textures (20) | VAO (16) | depth (16)
+//Materials are not part of the state, a draw only passes the index of its MaterialTable entry.
+//Instanced packets of pooled geometry that end up next to each other with the same program, textures and VAO
+//are drawn with one glMultiDrawElementsIndirect, every packet a command. Their per draw data is already
+//per instance, the base instance of every command points at its own.
+class RenderQueue
+{
+private:
+	typedef std::tuple<Texture*, Texture*, TextureArray*, TextureArray*> StateKey;
+
+	//Packets keys[first, first + count) drawn by the commands from firstCommand on
+	struct MultiDraw
+	{
+		size_t first;
+		size_t count;
+		size_t firstCommand;
+	};
+
+	std::vector<DrawPacket> packets;
+	std::vector<std::pair<uint64_t, uint32_t>> keys;
+
+	std::vector<UniformCache*> programs;
+	std::map<StateKey, uint32_t> states;
+
+	glm::vec3 cameraPos;
+	float farPlane;
+
+	//Indirect commands of this frame, written to the ring when there is one
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<MultiDraw> multiDraws;
+	StreamBuffer* stream;
+	GLuint indirectBuffer;
+	size_t indirectCapacity;
+
+	RenderQueueStats stats;
+
+	uint32_t getProgramID(UniformCache* program)
+	{
+		auto found = std::find(this->programs.begin(), this->programs.end(), program);
+		if (found != this->programs.end())
+			return static_cast<uint32_t>(found - this->programs.begin());
+
+		this->programs.push_back(program);
+		return static_cast<uint32_t>(this->programs.size() - 1);
+	}
+
+	uint32_t getStateID(const DrawPacket& packet)
+	{
+		const StateKey key(packet.diffuseTex, packet.specularTex, packet.diffuseArray, packet.specularArray);
+
+		auto found = this->states.find(key);
+		if (found != this->states.end())
+			return found->second;
+
+		const uint32_t id = static_cast<uint32_t>(this->states.size());
+		this->states[key] = id;
+		return id;
+	}
+
+	//Front to back, so the depth test rejects as much as possible
+	uint64_t getDepth(const glm::mat4& ModelMatrix) const
+	{
+		const glm::vec3 position(ModelMatrix[3]);
+		float depth = glm::length(position - this->cameraPos) / this->farPlane;
+		depth = depth < 0.f ? 0.f : depth > 1.f ? 1.f : depth;
+
+		return static_cast<uint64_t>(depth * 65535.f);
+	}
+
+	void add(const DrawPacket& packet)
+	{
+		const uint64_t key =
+			(static_cast<uint64_t>(packet.pass) & 0xF) << 60 |
+			(static_cast<uint64_t>(this->getProgramID(packet.program)) & 0xFF) << 52 |
+			(static_cast<uint64_t>(this->getStateID(packet)) & 0xFFFFF) << 32 |
+			(static_cast<uint64_t>(packet.geometry->getVAO()) & 0xFFFF) << 16 |
+			(packet.instances > 0 ? 0 : this->getDepth(packet.ModelMatrix));
+
+		this->keys.push_back(std::make_pair(key, static_cast<uint32_t>(this->packets.size())));
+		this->packets.push_back(packet);
+	}
+
+	static bool isIndirect(const DrawPacket& packet)
+	{
+		return packet.instances > 0 && packet.geometry->isPooled();
+	}
+
+	//Without texture arrays the shader reads the material from DrawData, which holds the first packet of a run
+	static bool isSameState(const DrawPacket& a, const DrawPacket& b)
+	{
+		return a.pass == b.pass && a.program == b.program && a.geometry->getVAO() == b.geometry->getVAO()
+			&& a.diffuseTex == b.diffuseTex && a.specularTex == b.specularTex
+			&& a.diffuseArray == b.diffuseArray && a.specularArray == b.specularArray
+			&& (a.diffuseArray != nullptr || a.indices.z == b.indices.z);
+	}
+
+	//Finds the runs of sorted packets one multi draw can take and builds their commands
+	void buildMultiDraws()
+	{
+		this->commands.clear();
+		this->multiDraws.clear();
+
+		for (size_t i = 0; i < this->keys.size();)
+		{
+			const DrawPacket& first = this->packets[this->keys[i].second];
+			size_t end = i + 1;
+			if (isIndirect(first))
+			{
+				while (end < this->keys.size() && isIndirect(this->packets[this->keys[end].second])
+					&& isSameState(first, this->packets[this->keys[end].second]))
+					++end;
+			}
+
+			if (end - i > 1)
+			{
+				MultiDraw multiDraw;
+				multiDraw.first = i;
+				multiDraw.count = end - i;
+				multiDraw.firstCommand = this->commands.size();
+				this->multiDraws.push_back(multiDraw);
+
+				for (size_t j = i; j < end; j++)
+				{
+					const DrawPacket& packet = this->packets[this->keys[j].second];
+					this->commands.push_back(packet.geometry->getIndirectCommand(packet.instances, packet.baseInstance));
+				}
+			}
+
+			i = end;
+		}
+	}
+
+	//Binds the buffer holding this frame's commands to GL_DRAW_INDIRECT_BUFFER, returns where they start in it
+	GLintptr uploadCommands()
+	{
+		const GLsizeiptr size = this->commands.size() * sizeof(DrawElementsIndirectCommand);
+		if (this->stream != nullptr)
+		{
+			GLintptr offset = 0;
+			void* target = this->stream->allocate(size, sizeof(GLuint), offset);
+			if (target != nullptr)
+			{
+				std::memcpy(target, this->commands.data(), static_cast<size_t>(size));
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->stream->getID());
+				return offset;
+			}
+		}
+
+		//Grow geometrically and orphan the old storage, like the instance buffer
+		if (this->indirectBuffer == 0)
+			glGenBuffers(1, &this->indirectBuffer);
+		if (this->commands.size() > this->indirectCapacity)
+			this->indirectCapacity = this->commands.size() + this->commands.size() / 2;
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->indirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, this->indirectCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, this->commands.data());
+		return 0;
+	}
+
+public:
+	RenderQueue(StreamBuffer* stream = nullptr)
+	{
+		this->cameraPos = glm::vec3(0.f);
+		this->farPlane = 1000.f;
+		this->stream = stream;
+		this->indirectBuffer = 0;
+		this->indirectCapacity = 0;
+		this->stats = RenderQueueStats();
+	}
+
+	~RenderQueue()
+	{
+		if (this->indirectBuffer != 0)
+			glDeleteBuffers(1, &this->indirectBuffer);
+	}
+
+	//Accessors
+	const RenderQueueStats& getStats() const { return this->stats; }
+
+	//Functions
+	void begin(const glm::vec3& cameraPos, const float farPlane)
+	{
+		this->packets.clear();
+		this->keys.clear();
+		this->cameraPos = cameraPos;
+		this->farPlane = farPlane;
+	}
+
+	void submit(UniformCache* program, Geometry* geometry, Material* material,
+		Texture* diffuseTex, Texture* specularTex, const glm::mat4& ModelMatrix,
+		const GLsizei instances = 0, const GLuint baseInstance = 0,
+		const render_pass pass = PASS_OPAQUE)
+	{
+		DrawPacket packet;
+		packet.program = program;
+		packet.geometry = geometry;
+		packet.material = material;
+		packet.diffuseTex = diffuseTex;
+		packet.specularTex = specularTex;
+		packet.diffuseArray = nullptr;
+		packet.specularArray = nullptr;
+		packet.indices = glm::ivec4(0, 0, material->getIndex(), 0);
+		packet.ModelMatrix = ModelMatrix;
+		packet.instances = instances;
+		packet.baseInstance = baseInstance;
+		packet.pass = pass;
+
+		this->add(packet);
+	}
+
+	//Textures from arrays, packets that only differ in their layers share the same state
+	void submit(UniformCache* program, Geometry* geometry, Material* material,
+		const TextureLayer& diffuse, const TextureLayer& specular, const glm::mat4& ModelMatrix,
+		const GLsizei instances = 0, const GLuint baseInstance = 0,
+		const render_pass pass = PASS_OPAQUE)
+	{
+		DrawPacket packet;
+		packet.program = program;
+		packet.geometry = geometry;
+		packet.material = material;
+		packet.diffuseTex = nullptr;
+		packet.specularTex = nullptr;
+		packet.diffuseArray = diffuse.array;
+		packet.specularArray = specular.array;
+		packet.indices = glm::ivec4(diffuse.layer, specular.layer, material->getIndex(), 0);
+		packet.ModelMatrix = ModelMatrix;
+		packet.instances = instances;
+		packet.baseInstance = baseInstance;
+		packet.pass = pass;
+
+		this->add(packet);
+	}
+
+	//Keys are built here, on the GL thread, the program and state ids are not shared with the job threads
+	void merge(const DrawList& list)
+	{
+		for (auto& i : list.getPackets())
+			this->add(i);
+	}
+
+	void execute()
+	{
+		std::sort(this->keys.begin(), this->keys.end());
+
+		this->stats = RenderQueueStats();
+		this->stats.packets = static_cast<unsigned>(this->packets.size());
+
+		//Only uploads when a material changed since the last frame
+		MaterialTable::get().upload();
+
+		this->buildMultiDraws();
+		const GLintptr commandOffset = this->commands.empty() ? 0 : this->uploadCommands();
+		size_t nextMultiDraw = 0;
+
+		//Nothing is assumed to be bound at the start of a frame
+		UniformCache* program = nullptr;
+		Texture* textures[2] = { nullptr, nullptr };
+		TextureArray* arrays[2] = { nullptr, nullptr };
+		GLuint vao = 0;
+		bool vaoBound = false;
+
+		for (size_t k = 0; k < this->keys.size(); k++)
+		{
+			const DrawPacket& packet = this->packets[this->keys[k].second];
+
+			if (packet.program != program)
+			{
+				packet.program->getShader()->use();
+				program = packet.program;
+				++this->stats.programBinds;
+			}
+			else
+				++this->stats.programSkips;
+
+			//Plain textures on units 0 and 1, arrays on 2 and 3. Whatever a packet does not use stays bound
+			Texture* packetTextures[2] = { packet.diffuseTex, packet.specularTex };
+			TextureArray* packetArrays[2] = { packet.diffuseArray, packet.specularArray };
+			for (GLint unit = 0; unit < 2; unit++)
+			{
+				if (packetArrays[unit] != nullptr)
+				{
+					if (packetArrays[unit] != arrays[unit])
+					{
+						packetArrays[unit]->bind(2 + unit);
+						arrays[unit] = packetArrays[unit];
+						++this->stats.arrayBinds;
+					}
+					else
+						++this->stats.arraySkips;
+				}
+				else if (packetTextures[unit] != textures[unit])
+				{
+					packetTextures[unit]->bind(unit);
+					textures[unit] = packetTextures[unit];
+					++this->stats.textureBinds;
+				}
+				else
+					++this->stats.textureSkips;
+			}
+
+			if (!vaoBound || packet.geometry->getVAO() != vao)
+			{
+				vao = packet.geometry->getVAO();
+				vaoBound = true;
+				glBindVertexArray(vao);
+				++this->stats.vaoBinds;
+			}
+			else
+				++this->stats.vaoSkips;
+
+			//Per draw data always changes
+			program->getDrawData().ModelMatrix = packet.ModelMatrix;
+			program->getDrawData().indices = packet.indices;
+			program->setMat4fv(packet.ModelMatrix, UNIFORM_MODEL_MATRIX);
+			program->commitDrawData();
+
+			if (nextMultiDraw < this->multiDraws.size() && this->multiDraws[nextMultiDraw].first == k)
+			{
+				const MultiDraw& multiDraw = this->multiDraws[nextMultiDraw++];
+				for (size_t j = 0; j < multiDraw.count; j++)
+				{
+					const DrawElementsIndirectCommand& command = this->commands[multiDraw.firstCommand + j];
+					GLInterceptor::get().indirectCommand(GL_TRIANGLES, command.count, command.instanceCount);
+				}
+
+				glMultiDrawElementsIndirect(GL_TRIANGLES, packet.geometry->getIndexType(),
+					reinterpret_cast<const GLvoid*>(commandOffset + multiDraw.firstCommand * sizeof(DrawElementsIndirectCommand)),
+					static_cast<GLsizei>(multiDraw.count), 0);
+
+				++this->stats.multiDraws;
+				this->stats.indirectCommands += static_cast<unsigned>(multiDraw.count);
+				k += multiDraw.count - 1;
+			}
+			else if (packet.instances > 0)
+				packet.geometry->drawInstanced(packet.instances, packet.baseInstance);
+			else
+				packet.geometry->draw();
+
+			++this->stats.drawCalls;
+		}
+	}
+
+	void printStats() const
+	{
+		std::cout << "RENDERQUEUE::PACKETS: " << this->stats.packets
+			<< " DRAWS: " << this->stats.drawCalls
+			<< " MULTIDRAWS: " << this->stats.multiDraws << " (" << this->stats.indirectCommands << " packets)"
+			<< " PROGRAM: " << this->stats.programBinds << "/" << this->stats.programSkips
+			<< " TEXTURE: " << this->stats.textureBinds << "/" << this->stats.textureSkips
+			<< " ARRAY: " << this->stats.arrayBinds << "/" << this->stats.arraySkips
+			<< " VAO: " << this->stats.vaoBinds << "/" << this->stats.vaoSkips
+			<< " (issued/skipped)\n";
+	}
+};
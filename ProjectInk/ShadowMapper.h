@@ -0,0 +1,795 @@
+#pragma once
+#include<iostream>
+#include<vector>
+#include<algorithm>
+#include<cmath>
+#include<cstdint>
+
+#include<glew.h>
+
+#include<glm.hpp>
+#include<vec3.hpp>
+#include<vec4.hpp>
+#include<mat4x4.hpp>
+#include<gtc/matrix_transform.hpp>
+
+#include "Geometry.h"
+#include "Bounds.h"
+#include "Light.h"
+#include "UniformBuffer.h"
+#include "UniformCache.h"
+#include "Profiler.h"
+
+//Per frame counters of the shadow pass
+struct ShadowStats
+{
+	unsigned shadows;
+	unsigned views;
+	unsigned casters;
+	unsigned requested;
+	unsigned refreshed;
+	unsigned deferred;
+	unsigned unallocated;
+	unsigned staticPasses;
+	unsigned dynamicPasses;
+	unsigned copies;
+	unsigned drawCalls;
+};
+
+//std430 mirror of one entry of "ShadowTable" in the shaders
+struct ShadowViewData
+{
+	glm::mat4 ViewProjectionMatrix;
+
+	//xy scale and zw offset from the view's [0, 1] coordinates to its tile in the atlas
+	glm::vec4 atlasRect;
+};
+
+static_assert(sizeof(ShadowViewData) == 80, "ShadowViewData does not match the std430 layout");
+
+//Shadow maps of the sun (up to MAX_CASCADES cascades) and of every point light that casts shadows (a cube, six views),
+//each view a square tile of one depth atlas the fragment shaders sample through "ShadowTable".
+//Casters are split into static and dynamic ones. Static casters are rendered into a second atlas only when a view
+//changes, a refresh copies that tile into the sampled atlas and draws the dynamic casters on top of it.
+//Refreshes cost passes and a frame only spends its budget of them: shadows that want one are ranked by how much
+//of the screen their light covers times the frames they have waited, the rest keep their last map another frame.
+class ShadowMapper
+{
+public:
+	enum { MAX_CASCADES = 4, CUBE_FACES = 6 };
+
+	//Shader storage binding of the view table, after LightClusterer's, and the unit the atlas stays bound to
+	enum { BINDING_VIEWS = 4, TEXTURE_UNIT = 4 };
+
+private:
+	struct Caster
+	{
+		Geometry* geometry;
+		glm::mat4 ModelMatrix;
+		AABB bounds;
+		bool isStatic;
+	};
+
+	struct View
+	{
+		//Wanted this frame, and what the atlas tile actually holds
+		glm::mat4 ViewProjectionMatrix;
+		glm::mat4 renderedMatrix;
+		Frustum frustum;
+		int tile;
+
+		//Static tile matches ViewProjectionMatrix
+		bool cached;
+
+		//Dynamic casters are in the view this frame, and were drawn into the atlas tile at its last refresh
+		bool dynamic;
+		bool composited;
+	};
+
+	//A point light's cube or one sun cascade
+	struct Shadow
+	{
+		int light;
+		glm::vec3 position;
+		float radius;
+		View views[CUBE_FACES];
+		int viewCount;
+		int firstView;
+
+		float priority;
+		unsigned cost;
+		uint32_t lastRefresh;
+		bool requested;
+		bool refresh;
+	};
+
+	GLuint atlas;
+	GLuint staticAtlas;
+	GLuint framebuffers[2];
+	int atlasSize;
+	int tileSize;
+	std::vector<int> freeTiles;
+
+	GLuint viewBuffer;
+	size_t viewCapacity;
+	std::vector<ShadowViewData> viewData;
+
+	std::vector<Shadow> pointShadows;
+	std::vector<int> lightShadows;
+	Shadow cascades[MAX_CASCADES];
+	int cascadeCount;
+	int maxCascades;
+	float cascadeSplits[MAX_CASCADES];
+	float shadowDistance;
+	float casterDistance;
+
+	glm::vec3 sunDirection;
+	glm::vec4 sunColor;
+	int sunFirstView;
+
+	std::vector<Caster> casters;
+	std::vector<Shadow*> active;
+	bool staticMoved;
+
+	unsigned budget;
+	uint32_t frame;
+
+	ShadowStats stats;
+
+	//Near plane of the cube faces, the far plane is the light radius
+	static constexpr float POINT_NEAR = 0.05f;
+
+	//Cascades are fitted with this much room around their slice and only move when the slice leaves it
+	static constexpr float CASCADE_PADDING = 0.25f;
+
+	ShadowMapper(const ShadowMapper&) = delete;
+	ShadowMapper& operator=(const ShadowMapper&) = delete;
+
+	static Shadow createShadow(const int light, const int viewCount)
+	{
+		Shadow shadow;
+		shadow.light = light;
+		shadow.position = glm::vec3(0.f);
+		shadow.radius = -1.f;
+		shadow.viewCount = viewCount;
+		shadow.firstView = -1;
+		shadow.priority = 0.f;
+		shadow.cost = 0;
+		shadow.lastRefresh = 0;
+		shadow.requested = false;
+		shadow.refresh = false;
+
+		for (auto& i : shadow.views)
+		{
+			i.ViewProjectionMatrix = glm::mat4(1.f);
+			i.renderedMatrix = glm::mat4(1.f);
+			i.tile = -1;
+			i.cached = false;
+			i.dynamic = false;
+			i.composited = false;
+		}
+		return shadow;
+	}
+
+	GLuint createAtlas(const bool compare)
+	{
+		GLuint texture = 0;
+		glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+		glTextureStorage2D(texture, 1, GL_DEPTH_COMPONENT32F, this->atlasSize, this->atlasSize);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		//The sampled atlas compares in the sampler, linear filtering then averages four comparisons
+		glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+		glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+		if (compare)
+		{
+			glTextureParameteri(texture, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTextureParameteri(texture, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		}
+
+		//Tiles that were never rendered leave everything lit
+		const float one = 1.f;
+		glClearTexImage(texture, 0, GL_DEPTH_COMPONENT, GL_FLOAT, &one);
+		return texture;
+	}
+
+	//All views of a shadow get a tile or none does
+	bool allocate(Shadow& shadow)
+	{
+		if (static_cast<int>(this->freeTiles.size()) < shadow.viewCount)
+			return false;
+
+		for (int i = 0; i < shadow.viewCount; i++)
+		{
+			shadow.views[i].tile = this->freeTiles.back();
+			this->freeTiles.pop_back();
+		}
+		return true;
+	}
+
+	void release(Shadow& shadow)
+	{
+		for (int i = 0; i < shadow.viewCount; i++)
+		{
+			if (shadow.views[i].tile >= 0)
+				this->freeTiles.push_back(shadow.views[i].tile);
+			shadow.views[i].tile = -1;
+		}
+		shadow.viewCount = 0;
+	}
+
+	int getTileX(const int tile) const { return (tile % (this->atlasSize / this->tileSize)) * this->tileSize; }
+
+	int getTileY(const int tile) const { return (tile / (this->atlasSize / this->tileSize)) * this->tileSize; }
+
+	static void setView(View& view, const glm::mat4& ViewProjectionMatrix)
+	{
+		view.ViewProjectionMatrix = ViewProjectionMatrix;
+		view.frustum = Frustum(ViewProjectionMatrix);
+		view.cached = false;
+	}
+
+	//Six 90 degree faces reaching to the radius, only rebuilt when the light moved
+	void updatePointShadow(Shadow& shadow, const Light& light)
+	{
+		if (shadow.radius == light.getRadius() && glm::length(shadow.position - light.getPosition()) == 0.f)
+			return;
+
+		shadow.position = light.getPosition();
+		shadow.radius = light.getRadius();
+
+		static const glm::vec3 directions[CUBE_FACES] = {
+			glm::vec3(1.f, 0.f, 0.f), glm::vec3(-1.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f),
+			glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, 0.f, -1.f) };
+		static const glm::vec3 ups[CUBE_FACES] = {
+			glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, 0.f, 1.f),
+			glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, -1.f, 0.f) };
+
+		const float nearClip = shadow.radius * 0.5f < POINT_NEAR ? shadow.radius * 0.5f : POINT_NEAR;
+		const glm::mat4 ProjectionMatrix = glm::perspective(glm::radians(90.f), 1.f, nearClip, shadow.radius);
+		for (int i = 0; i < CUBE_FACES; i++)
+		{
+			setView(shadow.views[i], ProjectionMatrix *
+				glm::lookAt(shadow.position, shadow.position + directions[i], ups[i]));
+		}
+	}
+
+	//Orthographic box around the bounding sphere of the camera slice [sliceNear, sliceFar], reaching casterDistance
+	//further towards the sun. The box only moves once the sphere no longer fits, so its static map stays cached
+	//while the camera moves inside it
+	void updateCascade(Shadow& shadow, const glm::mat4& InverseViewMatrix, const float tanX, const float tanY,
+		const float sliceNear, const float sliceFar)
+	{
+		glm::vec3 corners[8];
+		glm::vec3 center(0.f);
+		for (int i = 0; i < 8; i++)
+		{
+			const float depth = i < 4 ? sliceNear : sliceFar;
+			const glm::vec4 corner((i & 1 ? 1.f : -1.f) * depth * tanX, (i & 2 ? 1.f : -1.f) * depth * tanY, -depth, 1.f);
+			corners[i] = glm::vec3(InverseViewMatrix * corner);
+			center += corners[i] * 0.125f;
+		}
+
+		float radius = 0.f;
+		for (auto& i : corners)
+			radius = std::max(radius, glm::length(i - center));
+
+		const float halfSize = radius * (1.f + CASCADE_PADDING);
+		if (shadow.radius == halfSize && glm::length(center - shadow.position) <= radius * CASCADE_PADDING)
+			return;
+
+		const glm::vec3 up = std::fabs(this->sunDirection.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+
+		//Centers snap to whole texels, the map does not swim when it has to move
+		const glm::mat4 LightMatrix = glm::lookAt(glm::vec3(0.f), this->sunDirection, up);
+		const float texel = 2.f * halfSize / this->tileSize;
+		glm::vec4 snapped = LightMatrix * glm::vec4(center, 1.f);
+		snapped.x = std::floor(snapped.x / texel) * texel;
+		snapped.y = std::floor(snapped.y / texel) * texel;
+
+		shadow.position = glm::vec3(glm::inverse(LightMatrix) * snapped);
+		shadow.radius = halfSize;
+
+		const glm::mat4 ProjectionMatrix = glm::ortho(-halfSize, halfSize, -halfSize, halfSize,
+			-(halfSize + this->casterDistance), halfSize);
+		setView(shadow.views[0], ProjectionMatrix *
+			glm::lookAt(shadow.position, shadow.position + this->sunDirection, up));
+	}
+
+	//Fraction of the screen a light's sphere covers, 0 when it is outside the view
+	static float getScreenImpact(const Light& light, const glm::vec3& cameraPos, const Frustum& frustum,
+		const float projectionScale)
+	{
+		if (!frustum.intersects(BoundingSphere(light.getPosition(), light.getRadius())))
+			return 0.f;
+
+		const float brightness = light.getIntensity() *
+			std::max(light.getColor().x, std::max(light.getColor().y, light.getColor().z));
+
+		const float distance = glm::length(light.getPosition() - cameraPos);
+		if (distance <= light.getRadius())
+			return brightness;
+
+		const float projected = light.getRadius() * projectionScale /
+			std::sqrt(distance * distance - light.getRadius() * light.getRadius());
+		return brightness * std::min(projected * projected, 1.f);
+	}
+
+	//What a refresh would have to render: every stale static view and every view with dynamic casters
+	void request(Shadow& shadow, const float impact)
+	{
+		shadow.cost = 0;
+		shadow.requested = false;
+		shadow.refresh = false;
+
+		for (int i = 0; i < shadow.viewCount; i++)
+		{
+			View& view = shadow.views[i];
+
+			view.dynamic = false;
+			for (auto& j : this->casters)
+			{
+				if (!j.isStatic && view.frustum.intersects(j.bounds))
+				{
+					view.dynamic = true;
+					break;
+				}
+			}
+
+			shadow.cost += (view.cached ? 0 : 1) + (view.dynamic ? 1 : 0);
+			if (!view.cached || view.dynamic || view.composited)
+				shadow.requested = true;
+		}
+
+		if (impact <= 0.f)
+			shadow.requested = false;
+
+		shadow.priority = impact * static_cast<float>(1 + this->frame - shadow.lastRefresh);
+	}
+
+	unsigned drawCasters(UniformCache* program, const View& view, const int tableIndex, const bool isStatic)
+	{
+		unsigned draws = 0;
+		GLuint vao = 0;
+		for (auto& i : this->casters)
+		{
+			if (i.isStatic != isStatic || !view.frustum.intersects(i.bounds))
+				continue;
+
+			program->getDrawData().ModelMatrix = i.ModelMatrix;
+			program->getDrawData().indices = glm::ivec4(0, 0, 0, tableIndex);
+			program->commitDrawData();
+
+			if (i.geometry->getVAO() != vao)
+			{
+				vao = i.geometry->getVAO();
+				glBindVertexArray(vao);
+			}
+			i.geometry->draw();
+			++draws;
+		}
+		return draws;
+	}
+
+	void renderView(UniformCache* program, View& view, const int tableIndex)
+	{
+		const int x = this->getTileX(view.tile);
+		const int y = this->getTileY(view.tile);
+		glViewport(x, y, this->tileSize, this->tileSize);
+
+		const bool renderStatic = !view.cached;
+		if (renderStatic)
+		{
+			const float one = 1.f;
+			glClearTexSubImage(this->staticAtlas, 0, x, y, 0, this->tileSize, this->tileSize, 1,
+				GL_DEPTH_COMPONENT, GL_FLOAT, &one);
+
+			glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[1]);
+			this->stats.drawCalls += this->drawCasters(program, view, tableIndex, true);
+			view.cached = true;
+			++this->stats.staticPasses;
+		}
+
+		//The sampled tile starts from the static one whenever it changed or dynamic casters were drawn over it
+		if (renderStatic || view.dynamic || view.composited)
+		{
+			glCopyImageSubData(this->staticAtlas, GL_TEXTURE_2D, 0, x, y, 0,
+				this->atlas, GL_TEXTURE_2D, 0, x, y, 0, this->tileSize, this->tileSize, 1);
+			++this->stats.copies;
+		}
+
+		if (view.dynamic)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffers[0]);
+			this->stats.drawCalls += this->drawCasters(program, view, tableIndex, false);
+			++this->stats.dynamicPasses;
+		}
+
+		view.composited = view.dynamic;
+	}
+
+	void appendViews(Shadow& shadow)
+	{
+		const float scale = static_cast<float>(this->tileSize) / this->atlasSize;
+
+		shadow.firstView = static_cast<int>(this->viewData.size());
+		for (int i = 0; i < shadow.viewCount; i++)
+		{
+			ShadowViewData data;
+			data.ViewProjectionMatrix = shadow.views[i].renderedMatrix;
+			data.atlasRect = glm::vec4(scale, scale,
+				static_cast<float>(this->getTileX(shadow.views[i].tile)) / this->atlasSize,
+				static_cast<float>(this->getTileY(shadow.views[i].tile)) / this->atlasSize);
+			this->viewData.push_back(data);
+		}
+	}
+
+public:
+	//atlasSize / tileSize squared tiles, a point light takes six and each cascade one
+	ShadowMapper(const int atlasSize = 4096, const int tileSize = 512, const unsigned budget = 12)
+	{
+		this->atlasSize = atlasSize;
+		this->tileSize = tileSize;
+		this->budget = budget;
+
+		const int tiles = (atlasSize / tileSize) * (atlasSize / tileSize);
+		for (int i = tiles - 1; i >= 0; i--)
+			this->freeTiles.push_back(i);
+
+		this->atlas = this->createAtlas(true);
+		this->staticAtlas = this->createAtlas(false);
+
+		GLuint textures[2] = { this->atlas, this->staticAtlas };
+		glCreateFramebuffers(2, this->framebuffers);
+		for (int i = 0; i < 2; i++)
+		{
+			glNamedFramebufferTexture(this->framebuffers[i], GL_DEPTH_ATTACHMENT, textures[i], 0);
+			glNamedFramebufferDrawBuffer(this->framebuffers[i], GL_NONE);
+			glNamedFramebufferReadBuffer(this->framebuffers[i], GL_NONE);
+
+			if (glCheckNamedFramebufferStatus(this->framebuffers[i], GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+				std::cout << "ERROR::SHADOWMAPPER::FRAMEBUFFER_INCOMPLETE: " << i << "\n";
+		}
+
+		glGenBuffers(1, &this->viewBuffer);
+		this->viewCapacity = 0;
+
+		for (int i = 0; i < MAX_CASCADES; i++)
+		{
+			this->cascades[i] = createShadow(i, 1);
+			this->cascadeSplits[i] = 0.f;
+		}
+		this->cascadeCount = 0;
+		this->maxCascades = MAX_CASCADES;
+		this->shadowDistance = 60.f;
+		this->casterDistance = 50.f;
+
+		this->sunDirection = glm::vec3(0.f, -1.f, 0.f);
+		this->sunColor = glm::vec4(0.f);
+		this->sunFirstView = -1;
+
+		this->staticMoved = false;
+		this->frame = 0;
+		this->stats = ShadowStats();
+	}
+
+	~ShadowMapper()
+	{
+		glDeleteFramebuffers(2, this->framebuffers);
+		glDeleteTextures(1, &this->atlas);
+		glDeleteTextures(1, &this->staticAtlas);
+		glDeleteBuffers(1, &this->viewBuffer);
+	}
+
+	//Accessors
+	const ShadowStats& getStats() const { return this->stats; }
+
+	GLuint getAtlas() const { return this->atlas; }
+
+	int getAtlasSize() const { return this->atlasSize; }
+
+	int getTileSize() const { return this->tileSize; }
+
+	unsigned getBudget() const { return this->budget; }
+
+	//Modifiers
+
+	//Shadow passes per frame, a static and a dynamic pass of one view count one each. The highest ranked shadow
+	//always gets its refresh, even when it alone costs more
+	void setBudget(const unsigned budget) { this->budget = budget; }
+
+	//Cascades cover the view up to this depth, nothing further away gets sun shadows
+	void setShadowDistance(const float shadowDistance)
+	{
+		this->shadowDistance = shadowDistance;
+		for (auto& i : this->cascades)
+			i.radius = -1.f;
+	}
+
+	void setCascadeCount(const int cascadeCount)
+	{
+		this->maxCascades = std::min(std::max(cascadeCount, 1), static_cast<int>(MAX_CASCADES));
+	}
+
+	//Functions
+
+	//Casters are gathered again every frame, before update
+	void begin()
+	{
+		this->casters.clear();
+		this->staticMoved = false;
+	}
+
+	//Static casters are only drawn when a view changes. One that moved anyway makes every cached map stale
+	void addCaster(Geometry* geometry, const glm::mat4& ModelMatrix, const AABB& bounds, const bool isStatic,
+		const bool moved = false)
+	{
+		Caster caster;
+		caster.geometry = geometry;
+		caster.ModelMatrix = ModelMatrix;
+		caster.bounds = bounds;
+		caster.isStatic = isStatic;
+		this->casters.push_back(caster);
+
+		if (isStatic && moved)
+			this->staticMoved = true;
+	}
+
+	//CPU part, decides which shadows are refreshed this frame and tells every light where its views are.
+	//Has to run before the lights are binned, the planes have to match the projection
+	void update(std::vector<Light>& lights, const DirectionalLight& sun,
+		const glm::mat4& ViewMatrix, const glm::mat4& ProjectionMatrix, const float nearPlane)
+	{
+		PROFILE_SCOPE("ShadowMapper::update");
+
+		++this->frame;
+		this->stats = ShadowStats();
+		this->stats.casters = static_cast<unsigned>(this->casters.size());
+
+		//Fewer VAO binds while drawing
+		std::sort(this->casters.begin(), this->casters.end(), [](const Caster& a, const Caster& b)
+		{
+			return a.geometry < b.geometry;
+		});
+
+		if (this->staticMoved)
+		{
+			for (auto& i : this->pointShadows)
+				for (auto& j : i.views)
+					j.cached = false;
+			for (auto& i : this->cascades)
+				i.views[0].cached = false;
+		}
+
+		const glm::mat4 InverseViewMatrix = glm::inverse(ViewMatrix);
+		const glm::vec3 cameraPos(InverseViewMatrix[3]);
+		const Frustum frustum(ProjectionMatrix * ViewMatrix);
+
+		this->active.clear();
+
+		//Point lights, a light that stops casting shadows or is gone gives its tiles back
+		if (this->lightShadows.size() > lights.size())
+		{
+			for (size_t i = lights.size(); i < this->lightShadows.size(); i++)
+			{
+				if (this->lightShadows[i] >= 0)
+					this->release(this->pointShadows[this->lightShadows[i]]);
+			}
+		}
+		this->lightShadows.resize(lights.size(), -1);
+
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			int& index = this->lightShadows[i];
+			if (!lights[i].castsShadows())
+			{
+				if (index >= 0)
+					this->release(this->pointShadows[index]);
+				index = -1;
+				continue;
+			}
+
+			if (index < 0)
+			{
+				Shadow shadow = createShadow(static_cast<int>(i), CUBE_FACES);
+				if (!this->allocate(shadow))
+				{
+					++this->stats.unallocated;
+					continue;
+				}
+
+				//Slots of released shadows are reused
+				for (size_t j = 0; j < this->pointShadows.size() && index < 0; j++)
+				{
+					if (this->pointShadows[j].viewCount == 0)
+						index = static_cast<int>(j);
+				}
+				if (index < 0)
+				{
+					index = static_cast<int>(this->pointShadows.size());
+					this->pointShadows.push_back(shadow);
+				}
+				else
+					this->pointShadows[index] = shadow;
+			}
+		}
+
+		//Only once every shadow is in place, the vector may have grown
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			if (this->lightShadows[i] < 0)
+				continue;
+
+			Shadow& shadow = this->pointShadows[this->lightShadows[i]];
+			this->updatePointShadow(shadow, lights[i]);
+			this->request(shadow, getScreenImpact(lights[i], cameraPos, frustum, ProjectionMatrix[1][1]));
+			this->active.push_back(&shadow);
+		}
+
+		//Sun cascades, split between uniform and logarithmic
+		this->sunColor = glm::vec4(sun.getColor(), sun.getIntensity());
+		if (glm::length(sun.getDirection() - this->sunDirection) > 0.f)
+		{
+			this->sunDirection = sun.getDirection();
+			for (auto& i : this->cascades)
+				i.radius = -1.f;
+		}
+
+		int cascadeCount = sun.castsShadows() && sun.getIntensity() > 0.f ? this->maxCascades : 0;
+		for (int i = cascadeCount; i < this->cascadeCount; i++)
+			this->release(this->cascades[i]);
+		for (int i = this->cascadeCount; i < cascadeCount; i++)
+		{
+			this->cascades[i] = createShadow(i, 1);
+			if (!this->allocate(this->cascades[i]))
+			{
+				//The sun goes without shadows rather than with cascades missing
+				++this->stats.unallocated;
+				for (int j = 0; j <= i; j++)
+					this->release(this->cascades[j]);
+				cascadeCount = 0;
+				break;
+			}
+		}
+		this->cascadeCount = cascadeCount;
+
+		const float tanX = 1.f / ProjectionMatrix[0][0];
+		const float tanY = 1.f / ProjectionMatrix[1][1];
+		float sliceNear = nearPlane;
+		for (int i = 0; i < this->cascadeCount; i++)
+		{
+			const float p = static_cast<float>(i + 1) / this->cascadeCount;
+			const float logarithmic = nearPlane * std::pow(this->shadowDistance / nearPlane, p);
+			const float uniform = nearPlane + (this->shadowDistance - nearPlane) * p;
+			this->cascadeSplits[i] = 0.75f * logarithmic + 0.25f * uniform;
+
+			this->updateCascade(this->cascades[i], InverseViewMatrix, tanX, tanY, sliceNear, this->cascadeSplits[i]);
+			sliceNear = this->cascadeSplits[i];
+
+			//Closer cascades cover more of the screen in detail
+			this->request(this->cascades[i], sun.getIntensity() / (1.f + i));
+			this->active.push_back(&this->cascades[i]);
+		}
+
+		//Most important first, until the budget is spent
+		std::vector<Shadow*> ranked;
+		for (auto& i : this->active)
+		{
+			if (i->requested)
+				ranked.push_back(i);
+		}
+		std::sort(ranked.begin(), ranked.end(), [](const Shadow* a, const Shadow* b)
+		{
+			return a->priority > b->priority;
+		});
+
+		unsigned spent = 0;
+		for (auto& i : ranked)
+		{
+			if (spent + i->cost > this->budget && spent > 0)
+			{
+				++this->stats.deferred;
+				continue;
+			}
+
+			i->refresh = true;
+			i->lastRefresh = this->frame;
+			spent += i->cost;
+			for (int j = 0; j < i->viewCount; j++)
+				i->views[j].renderedMatrix = i->views[j].ViewProjectionMatrix;
+		}
+		this->stats.requested = static_cast<unsigned>(ranked.size());
+		this->stats.refreshed = static_cast<unsigned>(ranked.size()) - this->stats.deferred;
+
+		//Table of what every tile holds, lights point at their first face
+		this->viewData.clear();
+		for (auto& i : this->active)
+			this->appendViews(*i);
+
+		for (size_t i = 0; i < lights.size(); i++)
+			lights[i].setShadowView(this->lightShadows[i] >= 0 ? this->pointShadows[this->lightShadows[i]].firstView : -1);
+
+		this->sunFirstView = this->cascadeCount > 0 ? this->cascades[0].firstView : -1;
+		this->stats.shadows = static_cast<unsigned>(this->active.size());
+		this->stats.views = static_cast<unsigned>(this->viewData.size());
+	}
+
+	//GL part, on the context thread after update. Leaves the default framebuffer bound with the given viewport
+	void render(UniformCache* program, const int width, const int height)
+	{
+		PROFILE_SCOPE("ShadowMapper::render");
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->viewBuffer);
+		const size_t bytes = std::max<size_t>(this->viewData.size() * sizeof(ShadowViewData), 16);
+		if (bytes > this->viewCapacity)
+			this->viewCapacity = bytes + bytes / 2;
+		glBufferData(GL_SHADER_STORAGE_BUFFER, this->viewCapacity, NULL, GL_STREAM_DRAW);
+		if (!this->viewData.empty())
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, this->viewData.size() * sizeof(ShadowViewData), this->viewData.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_VIEWS, this->viewBuffer);
+
+		if (this->stats.refreshed > 0)
+		{
+			PROFILE_GPU("Shadows");
+
+			const GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+			glDisable(GL_CULL_FACE);
+			glEnable(GL_DEPTH_TEST);
+			glDepthMask(GL_TRUE);
+
+			//Slope scaled bias against acne, the shaders add a small normal offset
+			glEnable(GL_POLYGON_OFFSET_FILL);
+			glPolygonOffset(2.f, 4.f);
+
+			program->getShader()->use();
+			for (auto& i : this->active)
+			{
+				if (!i->refresh)
+					continue;
+
+				for (int j = 0; j < i->viewCount; j++)
+					this->renderView(program, i->views[j], i->firstView + j);
+			}
+
+			glDisable(GL_POLYGON_OFFSET_FILL);
+			if (cullFace)
+				glEnable(GL_CULL_FACE);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, width, height);
+		}
+
+		//Units 0-3 belong to the material textures, leave unit 0 active for everyone else
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D, this->atlas);
+		glActiveTexture(GL_TEXTURE0);
+
+		PROFILE_COUNTER("Shadow passes", this->stats.staticPasses + this->stats.dynamicPasses);
+		PROFILE_COUNTER("Shadow draws", this->stats.drawCalls);
+		PROFILE_COUNTER("Shadow deferred", this->stats.deferred);
+	}
+
+	//The sun and where its cascades are, goes out with the rest of the frame block
+	void writeFrameData(FrameData& frameData) const
+	{
+		frameData.sunDirection = glm::vec4(this->sunDirection, 0.f);
+		frameData.sunColor = this->sunColor;
+		frameData.cascadeSplits = glm::vec4(this->cascadeSplits[0], this->cascadeSplits[1],
+			this->cascadeSplits[2], this->cascadeSplits[3]);
+		frameData.shadowInfo = glm::ivec4(this->sunFirstView, this->cascadeCount, this->tileSize, this->atlasSize);
+	}
+
+	void printStats() const
+	{
+		std::cout << "SHADOWMAPPER::SHADOWS: " << this->stats.shadows
+			<< " VIEWS: " << this->stats.views
+			<< " CASTERS: " << this->stats.casters
+			<< " REFRESHED: " << this->stats.refreshed << "/" << this->stats.requested
+			<< " DEFERRED: " << this->stats.deferred
+			<< " PASSES: " << this->stats.staticPasses << " static " << this->stats.dynamicPasses << " dynamic"
+			<< " COPIES: " << this->stats.copies
+			<< " DRAWS: " << this->stats.drawCalls
+			<< " UNALLOCATED: " << this->stats.unallocated << "\n";
+	}
+};
@@ -0,0 +1,178 @@
+#pragma once
+#include<iostream>
+#include<chrono>
+#include<cstdint>
+
+#include<glew.h>
+
+//Per frame data without driver copies: one buffer made with glBufferStorage and mapped once, persistent and
+//coherent, split into regions that take turns. The CPU fills one frame's region while the GPU still reads the
+//ones before it; every region is fenced when its frame is done, so beginFrame only has to wait when the GPU
+//falls a whole ring behind. allocate hands out aligned ranges of the current region as a write pointer plus
+//the offset to bind. A full region returns nullptr and the caller takes its old upload path for that frame
+class StreamBuffer
+{
+private:
+	enum { MAX_REGIONS = 4 };
+
+	GLuint id;
+	unsigned char* mapped;
+	GLsizeiptr regionSize;
+	unsigned regionCount;
+
+	//Region the current frame writes to and how much of it is handed out
+	unsigned region;
+	GLsizeiptr used;
+	GLsync fences[MAX_REGIONS];
+
+	//Counters, per frame
+	double waitTime;
+	unsigned allocations;
+	unsigned overflows;
+
+	//Counters, since creation
+	unsigned frames;
+	unsigned stalledFrames;
+	double totalWaitTime;
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	static double now()
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+public:
+	//regionSize bytes for every frame in flight, three regions let the GPU lag two frames without a wait
+	StreamBuffer(const GLsizeiptr regionSize, const unsigned regionCount = 3)
+	{
+		this->regionSize = regionSize;
+		this->regionCount = regionCount < 2 ? 2 : (regionCount > MAX_REGIONS ? static_cast<unsigned>(MAX_REGIONS) : regionCount);
+		this->region = 0;
+		this->used = 0;
+		for (auto& i : this->fences)
+			i = 0;
+
+		this->waitTime = 0.0;
+		this->allocations = 0;
+		this->overflows = 0;
+		this->frames = 0;
+		this->stalledFrames = 0;
+		this->totalWaitTime = 0.0;
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glCreateBuffers(1, &this->id);
+		glNamedBufferStorage(this->id, this->regionSize * this->regionCount, NULL, flags);
+		this->mapped = static_cast<unsigned char*>(glMapNamedBufferRange(this->id, 0, this->regionSize * this->regionCount, flags));
+
+		if (this->mapped == nullptr)
+			std::cout << "ERROR::STREAMBUFFER::MAP_FAILED" << "\n";
+	}
+
+	~StreamBuffer()
+	{
+		for (auto& i : this->fences)
+		{
+			if (i != 0)
+				glDeleteSync(i);
+		}
+
+		if (this->mapped != nullptr)
+			glUnmapNamedBuffer(this->id);
+		glDeleteBuffers(1, &this->id);
+	}
+
+	//Accessors
+	GLuint getID() const { return this->id; }
+
+	GLsizeiptr getRegionSize() const { return this->regionSize; }
+
+	unsigned getRegionCount() const { return this->regionCount; }
+
+	//Bytes handed out this frame
+	GLsizeiptr getUsed() const { return this->used; }
+
+	//Milliseconds this frame's beginFrame waited for the GPU
+	double getWaitTime() const { return this->waitTime; }
+
+	unsigned getOverflows() const { return this->overflows; }
+
+	//Functions
+
+	//Once per frame before anything is allocated. Fences what the last frame wrote and moves on to the next
+	//region, waiting until the GPU is done with what was written there regionCount frames ago
+	void beginFrame()
+	{
+		if (this->used > 0)
+		{
+			if (this->fences[this->region] != 0)
+				glDeleteSync(this->fences[this->region]);
+			this->fences[this->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		this->region = (this->region + 1) % this->regionCount;
+		this->used = 0;
+		this->allocations = 0;
+		this->overflows = 0;
+		++this->frames;
+
+		const double start = now();
+		GLsync& fence = this->fences[this->region];
+		if (fence != 0)
+		{
+			GLenum result = glClientWaitSync(fence, 0, 0);
+			if (result == GL_TIMEOUT_EXPIRED)
+			{
+				++this->stalledFrames;
+				do
+				{
+					result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+				} while (result == GL_TIMEOUT_EXPIRED);
+			}
+
+			if (result == GL_WAIT_FAILED)
+				std::cout << "ERROR::STREAMBUFFER::WAIT_FAILED" << "\n";
+
+			glDeleteSync(fence);
+			fence = 0;
+		}
+
+		this->waitTime = now() - start;
+		this->totalWaitTime += this->waitTime;
+	}
+
+	//size bytes to write this frame, offset receives where they are in the buffer, a multiple of alignment.
+	//Any alignment works, e.g. sizeof(InstanceData) so the offset can become a base instance
+	void* allocate(const GLsizeiptr size, const GLsizeiptr alignment, GLintptr& offset)
+	{
+		if (this->mapped == nullptr)
+			return nullptr;
+
+		const GLintptr base = static_cast<GLintptr>(this->region) * this->regionSize;
+		const GLsizeiptr align = alignment > 0 ? alignment : 1;
+		const GLintptr aligned = (base + this->used + align - 1) / align * align;
+
+		if (aligned + size > base + this->regionSize)
+		{
+			++this->overflows;
+			return nullptr;
+		}
+
+		this->used = aligned + size - base;
+		++this->allocations;
+
+		offset = aligned;
+		return this->mapped + aligned;
+	}
+
+	void printStats() const
+	{
+		std::cout << "STREAMBUFFER::USED: " << this->used << "/" << this->regionSize
+			<< " ALLOCATIONS: " << this->allocations
+			<< " OVERFLOWS: " << this->overflows
+			<< " WAIT_MS: " << this->waitTime
+			<< " STALLED_FRAMES: " << this->stalledFrames << "/" << this->frames
+			<< " TOTAL_WAIT_MS: " << this->totalWaitTime << "\n";
+	}
+};
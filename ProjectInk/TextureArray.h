@@ -0,0 +1,236 @@
+#pragma once
+#include<iostream>
+#include<string>
+#include<vector>
+#include<unordered_map>
+#include<cstdint>
+
+#include<glew.h>
+
+#include "TextureImporter.h"
+
+//Fixed size array of same sized, same format textures with immutable storage for the full mip chain.
+//Everything sampled through one array shares a single binding, so draws that only differ in their
+//textures keep the same render state and pass a layer index instead.
+class TextureArray
+{
+private:
+	GLuint id;
+	uint32_t width;
+	uint32_t height;
+	uint32_t levels;
+	uint32_t format;
+	GLint capacity;
+	std::vector<std::string> layers;
+	size_t bytes;
+
+public:
+	TextureArray(const uint32_t width, const uint32_t height, const GLint capacity = 16,
+		const uint32_t format = TextureImporter::FORMAT_BC3)
+	{
+		this->width = width;
+		this->height = height;
+		this->levels = TextureImporter::getLevelCount(width, height);
+		this->format = format;
+		this->capacity = capacity;
+		this->bytes = 0;
+
+		glGenTextures(1, &this->id);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, this->id);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, this->levels, TextureImporter::getInternalFormat(format),
+			width, height, capacity);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+
+	TextureArray(const TextureArray&) = delete;
+	TextureArray& operator=(const TextureArray&) = delete;
+
+	~TextureArray()
+	{
+		glDeleteTextures(1, &this->id);
+	}
+
+	//Accessors
+	GLuint getID() const { return this->id; }
+
+	uint32_t getWidth() const { return this->width; }
+
+	uint32_t getHeight() const { return this->height; }
+
+	uint32_t getFormat() const { return this->format; }
+
+	GLint getCapacity() const { return this->capacity; }
+
+	GLint getLayerCount() const { return static_cast<GLint>(this->layers.size()); }
+
+	bool isFull() const { return this->getLayerCount() >= this->capacity; }
+
+	size_t getSizeInBytes() const { return this->bytes; }
+
+	const std::string& getLayerName(const GLint layer) const { return this->layers[layer]; }
+
+	//Functions
+
+	//Converts the image to the array's size and format, returns its layer or -1
+	GLint add(const char* fileName)
+	{
+		if (this->isFull())
+		{
+			std::cout << "ERROR::TEXTUREARRAY::ARRAY_FULL: " << fileName << "\n";
+			return -1;
+		}
+
+		const GLint layer = this->getLayerCount();
+
+		TextureInfo info;
+		if (!TextureImporter::loadLayer(fileName, this->id, layer, this->format, this->width, this->height, &info))
+		{
+			std::cout << "ERROR::TEXTUREARRAY::LAYER_LOADING_FAILED: " << fileName << "\n";
+			return -1;
+		}
+
+		this->layers.push_back(fileName);
+		this->bytes += info.bytes;
+		return layer;
+	}
+
+	void bind(const GLint texture_unit)
+	{
+		glActiveTexture(GL_TEXTURE0 + texture_unit);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, this->id);
+	}
+
+	void unbind(const GLint texture_unit)
+	{
+		glActiveTexture(GL_TEXTURE0 + texture_unit);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+};
+
+//Where a material texture lives inside an array
+struct TextureLayer
+{
+	TextureArray* array;
+	GLint layer;
+
+	TextureLayer(TextureArray* array = nullptr, const GLint layer = 0)
+	{
+		this->array = array;
+		this->layer = layer;
+	}
+
+	bool isValid() const { return this->array != nullptr; }
+};
+
+//Owns every TextureArray. Images are grouped by layer size and format and loaded once per file name;
+//a new array is opened when the current one of a group is full.
+class TextureArrayRegistry
+{
+private:
+	std::vector<TextureArray*> arrays;
+	std::unordered_map<std::string, TextureLayer> layers;
+
+	//Counters
+	unsigned requests;
+	unsigned hits;
+
+	TextureArrayRegistry()
+	{
+		this->requests = 0;
+		this->hits = 0;
+	}
+
+	TextureArrayRegistry(const TextureArrayRegistry&) = delete;
+	TextureArrayRegistry& operator=(const TextureArrayRegistry&) = delete;
+
+	TextureArray* findOpen(const uint32_t width, const uint32_t height, const uint32_t format)
+	{
+		for (TextureArray* array : this->arrays)
+		{
+			if (array->getWidth() == width && array->getHeight() == height &&
+				array->getFormat() == format && !array->isFull())
+				return array;
+		}
+
+		return nullptr;
+	}
+
+public:
+	enum { DEFAULT_CAPACITY = 16 };
+
+	static TextureArrayRegistry& get()
+	{
+		static TextureArrayRegistry instance;
+		return instance;
+	}
+
+	//Accessors
+	size_t getArrayCount() const { return this->arrays.size(); }
+
+	size_t getLayerCount() const { return this->layers.size(); }
+
+	size_t getSizeInBytes() const
+	{
+		size_t bytes = 0;
+		for (const TextureArray* array : this->arrays)
+			bytes += array->getSizeInBytes();
+		return bytes;
+	}
+
+	//Functions
+
+	//The layer holding fileName at the given size, an invalid TextureLayer when it could not be loaded
+	TextureLayer acquire(const char* fileName, const uint32_t width, const uint32_t height,
+		const uint32_t format = TextureImporter::FORMAT_BC3)
+	{
+		++this->requests;
+
+		const std::string key = std::string(fileName) + "|" + std::to_string(width) + "x" + std::to_string(height) +
+			"|" + std::to_string(format);
+
+		auto found = this->layers.find(key);
+		if (found != this->layers.end())
+		{
+			++this->hits;
+			return found->second;
+		}
+
+		TextureArray* array = this->findOpen(width, height, format);
+		if (array == nullptr)
+		{
+			array = new TextureArray(width, height, DEFAULT_CAPACITY, format);
+			this->arrays.push_back(array);
+		}
+
+		const GLint layer = array->add(fileName);
+		if (layer < 0)
+			return TextureLayer();
+
+		TextureLayer result(array, layer);
+		this->layers[key] = result;
+		return result;
+	}
+
+	//Frees every array, must run while the context is still current
+	void clear()
+	{
+		for (TextureArray* array : this->arrays)
+			delete array;
+
+		this->arrays.clear();
+		this->layers.clear();
+	}
+
+	void printStats() const
+	{
+		std::cout << "TEXTUREARRAY::REQUESTS: " << this->requests
+			<< " ARRAYS: " << this->arrays.size()
+			<< " LAYERS: " << this->layers.size()
+			<< " SHARED: " << this->hits
+			<< " BYTES: " << this->getSizeInBytes() << "\n";
+	}
+};
@@ -0,0 +1,675 @@
+#pragma once
+#include<iostream>
+#include<fstream>
+#include<string>
+#include<vector>
+#include<algorithm>
+#include<cstring>
+#include<cstdlib>
+#include<cstdint>
+
+#include<emmintrin.h>
+
+#include<glew.h>
+#include<SOIL2.h>
+
+#include "MappedFile.h"
+
+//Mip chain of one image, every level tightly packed in the chosen format
+struct TextureData
+{
+	struct Level
+	{
+		uint32_t width;
+		uint32_t height;
+		std::vector<unsigned char> data;
+	};
+
+	uint32_t format;
+	std::vector<Level> levels;
+};
+
+//Size and video memory of an uploaded texture
+struct TextureInfo
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t levels;
+	uint32_t format;
+	size_t bytes;
+};
+
+//Offline texture conversion
+//An image is decoded once, its full mip chain is built on the CPU with an SSE2 box filter and optionally
+//block compressed to BC1 (opaque) or BC3 (with alpha). The result is written to a binary .tex file next
+//to the source which is memory mapped on later loads and uploaded level by level without any decoding,
+//as long as the source file and the format did not change.
+class TextureImporter
+{
+public:
+	enum texture_format { FORMAT_RGBA8 = 0, FORMAT_BC1, FORMAT_BC3, FORMAT_AUTO };
+
+private:
+	enum
+	{
+		CACHE_VERSION = 1,
+	};
+
+	struct CacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+		uint64_t sourceSize;
+		int64_t sourceModified;
+	};
+
+	struct CacheLevel
+	{
+		uint32_t width;
+		uint32_t height;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	//Mip generation
+	//2x2 box filter into the next level, an odd last row or column is averaged with itself
+	static void downsample(const unsigned char* src, const uint32_t width, const uint32_t height,
+		unsigned char* dst, const uint32_t dstWidth, const uint32_t dstHeight)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+
+		for (uint32_t y = 0; y < dstHeight; y++)
+		{
+			const unsigned char* row0 = src + static_cast<size_t>(std::min(y * 2, height - 1)) * width * 4;
+			const unsigned char* row1 = src + static_cast<size_t>(std::min(y * 2 + 1, height - 1)) * width * 4;
+			unsigned char* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+
+			//Two output texels from four input texels of both rows per step
+			uint32_t x = 0;
+			for (; x + 1 < dstWidth && x * 2 + 3 < width; x += 2)
+			{
+				const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+				const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+
+				const __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				const __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+				__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+				sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(sum, sum));
+			}
+
+			for (; x < dstWidth; x++)
+			{
+				const uint32_t x0 = std::min(x * 2, width - 1) * 4;
+				const uint32_t x1 = std::min(x * 2 + 1, width - 1) * 4;
+				for (uint32_t c = 0; c < 4; c++)
+					out[x * 4 + c] = static_cast<unsigned char>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+			}
+		}
+	}
+
+	//Bilinear resample of the source image, used when an image has to match a fixed layer size
+	static void resample(const unsigned char* src, const uint32_t width, const uint32_t height,
+		unsigned char* dst, const uint32_t dstWidth, const uint32_t dstHeight)
+	{
+		const float scaleX = static_cast<float>(width) / dstWidth;
+		const float scaleY = static_cast<float>(height) / dstHeight;
+
+		for (uint32_t y = 0; y < dstHeight; y++)
+		{
+			const float sy = std::max(0.f, (y + 0.5f) * scaleY - 0.5f);
+			const uint32_t y0 = std::min(static_cast<uint32_t>(sy), height - 1);
+			const uint32_t y1 = std::min(y0 + 1, height - 1);
+			const float fy = sy - y0;
+
+			for (uint32_t x = 0; x < dstWidth; x++)
+			{
+				const float sx = std::max(0.f, (x + 0.5f) * scaleX - 0.5f);
+				const uint32_t x0 = std::min(static_cast<uint32_t>(sx), width - 1);
+				const uint32_t x1 = std::min(x0 + 1, width - 1);
+				const float fx = sx - x0;
+
+				const unsigned char* a = src + (static_cast<size_t>(y0) * width + x0) * 4;
+				const unsigned char* b = src + (static_cast<size_t>(y0) * width + x1) * 4;
+				const unsigned char* c = src + (static_cast<size_t>(y1) * width + x0) * 4;
+				const unsigned char* d = src + (static_cast<size_t>(y1) * width + x1) * 4;
+				unsigned char* out = dst + (static_cast<size_t>(y) * dstWidth + x) * 4;
+
+				for (uint32_t i = 0; i < 4; i++)
+				{
+					const float top = a[i] + (b[i] - a[i]) * fx;
+					const float bottom = c[i] + (d[i] - c[i]) * fx;
+					out[i] = static_cast<unsigned char>(top + (bottom - top) * fy + 0.5f);
+				}
+			}
+		}
+	}
+
+	//Block compression
+	static uint16_t to565(const unsigned char* color)
+	{
+		return static_cast<uint16_t>((color[0] >> 3) << 11 | (color[1] >> 2) << 5 | color[2] >> 3);
+	}
+
+	static void from565(const uint16_t color, int* out)
+	{
+		out[0] = (color >> 11 & 31) * 255 / 31;
+		out[1] = (color >> 5 & 63) * 255 / 63;
+		out[2] = (color & 31) * 255 / 31;
+	}
+
+	//Endpoints are the corners of the colour bounding box, pulled in by 1/16 of its size. The box diagonal is
+	//flipped per channel to follow the colours that fall with the widest channel, every texel takes the nearest
+	//of the four palette entries
+	static void encodeColorBlock(const unsigned char* block, unsigned char* out)
+	{
+		unsigned char low[3] = { 255, 255, 255 };
+		unsigned char high[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				low[c] = std::min(low[c], block[i * 4 + c]);
+				high[c] = std::max(high[c], block[i * 4 + c]);
+			}
+		}
+
+		for (int c = 0; c < 3; c++)
+		{
+			const int inset = (high[c] - low[c]) >> 4;
+			low[c] = static_cast<unsigned char>(low[c] + inset);
+			high[c] = static_cast<unsigned char>(high[c] - inset);
+		}
+
+		int axis = 0;
+		int mean[3] = { 0, 0, 0 };
+		for (int c = 0; c < 3; c++)
+		{
+			if (high[c] - low[c] > high[axis] - low[axis])
+				axis = c;
+			for (int i = 0; i < 16; i++)
+				mean[c] += block[i * 4 + c];
+			mean[c] = (mean[c] + 8) >> 4;
+		}
+
+		for (int c = 0; c < 3; c++)
+		{
+			int covariance = 0;
+			for (int i = 0; i < 16; i++)
+				covariance += (block[i * 4 + axis] - mean[axis]) * (block[i * 4 + c] - mean[c]);
+			if (covariance < 0)
+				std::swap(low[c], high[c]);
+		}
+
+		uint16_t color0 = to565(high);
+		uint16_t color1 = to565(low);
+
+		//color0 > color1 selects the four colour mode, equal endpoints only need index 0
+		uint32_t indices = 0;
+		if (color0 < color1)
+			std::swap(color0, color1);
+
+		if (color0 != color1)
+		{
+			int palette[4][3];
+			from565(color0, palette[0]);
+			from565(color1, palette[1]);
+			for (int c = 0; c < 3; c++)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0;
+				int bestDistance = 0x7FFFFFFF;
+				for (int p = 0; p < 4; p++)
+				{
+					int distance = 0;
+					for (int c = 0; c < 3; c++)
+					{
+						const int d = block[i * 4 + c] - palette[p][c];
+						distance += d * d;
+					}
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= static_cast<uint32_t>(best) << (i * 2);
+			}
+		}
+
+		out[0] = static_cast<unsigned char>(color0 & 0xFF);
+		out[1] = static_cast<unsigned char>(color0 >> 8);
+		out[2] = static_cast<unsigned char>(color1 & 0xFF);
+		out[3] = static_cast<unsigned char>(color1 >> 8);
+		memcpy(out + 4, &indices, 4);
+	}
+
+	//Eight value mode between the smallest and largest alpha of the block
+	static void encodeAlphaBlock(const unsigned char* block, unsigned char* out)
+	{
+		int alpha0 = 0;
+		int alpha1 = 255;
+		for (int i = 0; i < 16; i++)
+		{
+			alpha0 = std::max(alpha0, static_cast<int>(block[i * 4 + 3]));
+			alpha1 = std::min(alpha1, static_cast<int>(block[i * 4 + 3]));
+		}
+
+		uint64_t indices = 0;
+		if (alpha0 != alpha1)
+		{
+			int palette[8];
+			palette[0] = alpha0;
+			palette[1] = alpha1;
+			for (int i = 1; i < 7; i++)
+				palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0;
+				int bestDistance = 256;
+				for (int p = 0; p < 8; p++)
+				{
+					const int distance = std::abs(block[i * 4 + 3] - palette[p]);
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= static_cast<uint64_t>(best) << (i * 3);
+			}
+		}
+
+		out[0] = static_cast<unsigned char>(alpha0);
+		out[1] = static_cast<unsigned char>(alpha1);
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = static_cast<unsigned char>(indices >> (i * 8) & 0xFF);
+	}
+
+	static std::vector<unsigned char> compress(const std::vector<unsigned char>& rgba, const uint32_t width, const uint32_t height, const uint32_t format)
+	{
+		const uint32_t blocksX = (width + 3) / 4;
+		const uint32_t blocksY = (height + 3) / 4;
+		const size_t blockSize = format == FORMAT_BC1 ? 8 : 16;
+
+		std::vector<unsigned char> result(blocksX * blocksY * blockSize);
+		unsigned char block[64];
+
+		for (uint32_t by = 0; by < blocksY; by++)
+		{
+			for (uint32_t bx = 0; bx < blocksX; bx++)
+			{
+				//Blocks past the edge repeat the last row and column
+				for (uint32_t y = 0; y < 4; y++)
+				{
+					const uint32_t sy = std::min(by * 4 + y, height - 1);
+					for (uint32_t x = 0; x < 4; x++)
+					{
+						const uint32_t sx = std::min(bx * 4 + x, width - 1);
+						memcpy(block + (y * 4 + x) * 4, &rgba[(static_cast<size_t>(sy) * width + sx) * 4], 4);
+					}
+				}
+
+				unsigned char* out = &result[(static_cast<size_t>(by) * blocksX + bx) * blockSize];
+				if (format == FORMAT_BC3)
+				{
+					encodeAlphaBlock(block, out);
+					out += 8;
+				}
+				encodeColorBlock(block, out);
+			}
+		}
+
+		return result;
+	}
+
+	static bool hasAlpha(const std::vector<unsigned char>& rgba)
+	{
+		for (size_t i = 3; i < rgba.size(); i += 4)
+		{
+			if (rgba[i] != 255)
+				return true;
+		}
+		return false;
+	}
+
+	//Cache
+	static bool writeCache(const char* fileName, const std::string& cacheFile, const TextureData& texture)
+	{
+		CacheHeader header;
+		memset(&header, 0, sizeof(CacheHeader));
+		memcpy(header.magic, "PKTX", 4);
+		header.version = CACHE_VERSION;
+		header.format = texture.format;
+		header.width = texture.levels[0].width;
+		header.height = texture.levels[0].height;
+		header.levelCount = static_cast<uint32_t>(texture.levels.size());
+
+		if (!MappedFile::getStamp(fileName, header.sourceSize, header.sourceModified))
+			return false;
+
+		//Level data starts 16 byte aligned behind the level table
+		std::vector<CacheLevel> levels(texture.levels.size());
+		uint64_t offset = (sizeof(CacheHeader) + sizeof(CacheLevel) * levels.size() + 15) & ~static_cast<uint64_t>(15);
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			levels[i].width = texture.levels[i].width;
+			levels[i].height = texture.levels[i].height;
+			levels[i].offset = offset;
+			levels[i].size = texture.levels[i].data.size();
+			offset = (offset + levels[i].size + 15) & ~static_cast<uint64_t>(15);
+		}
+
+		std::ofstream out(cacheFile.c_str(), std::ios::binary | std::ios::trunc);
+		if (!out.is_open())
+		{
+			std::cout << "ERROR::TEXTUREIMPORTER::COULD_NOT_WRITE_CACHE: " << cacheFile << "\n";
+			return false;
+		}
+
+		const char padding[16] = {};
+		out.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+		out.write(reinterpret_cast<const char*>(levels.data()), sizeof(CacheLevel) * levels.size());
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			out.write(padding, static_cast<std::streamsize>(levels[i].offset - static_cast<uint64_t>(out.tellp())));
+			out.write(reinterpret_cast<const char*>(texture.levels[i].data.data()), texture.levels[i].data.size());
+		}
+
+		return true;
+	}
+
+	//Points at the levels inside the mapping, nothing is copied
+	static bool readCache(const char* fileName, const MappedFile& file, const uint32_t format,
+		const uint32_t width, const uint32_t height, CacheHeader& header, const CacheLevel*& levels)
+	{
+		uint64_t sourceSize = 0;
+		int64_t sourceModified = 0;
+		if (!MappedFile::getStamp(fileName, sourceSize, sourceModified))
+			return false;
+
+		if (!file.isOpen() || file.getSize() < sizeof(CacheHeader))
+			return false;
+
+		memcpy(&header, file.getData(), sizeof(CacheHeader));
+
+		if (memcmp(header.magic, "PKTX", 4) != 0 ||
+			header.version != CACHE_VERSION ||
+			(format != FORMAT_AUTO && header.format != format) ||
+			(width != 0 && (header.width != width || header.height != height)) ||
+			header.levelCount == 0 ||
+			header.sourceSize != sourceSize ||
+			header.sourceModified != sourceModified)
+			return false;
+
+		if (file.getSize() < sizeof(CacheHeader) + sizeof(CacheLevel) * header.levelCount)
+			return false;
+
+		levels = reinterpret_cast<const CacheLevel*>(file.getData() + sizeof(CacheHeader));
+		for (uint32_t i = 0; i < header.levelCount; i++)
+		{
+			if (levels[i].offset + levels[i].size > file.getSize())
+				return false;
+		}
+
+		return true;
+	}
+
+	//Immutable storage for the whole chain, every level straight from the mapping
+	static GLuint upload(const MappedFile& file, const CacheHeader& header, const CacheLevel* levels, const GLenum target, TextureInfo* info)
+	{
+		const GLenum internalFormat = getInternalFormat(header.format);
+
+		GLuint id = 0;
+		glGenTextures(1, &id);
+		glBindTexture(target, id);
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexStorage2D(target, header.levelCount, internalFormat, header.width, header.height);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		size_t bytes = 0;
+		for (uint32_t i = 0; i < header.levelCount; i++)
+		{
+			const CacheLevel& level = levels[i];
+			const char* data = file.getData() + level.offset;
+
+			if (header.format == FORMAT_RGBA8)
+				glTexSubImage2D(target, i, 0, 0, level.width, level.height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+			else
+				glCompressedTexSubImage2D(target, i, 0, 0, level.width, level.height, internalFormat,
+					static_cast<GLsizei>(level.size), data);
+
+			bytes += static_cast<size_t>(level.size);
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(target, 0);
+
+		if (info != nullptr)
+		{
+			info->width = header.width;
+			info->height = header.height;
+			info->levels = header.levelCount;
+			info->format = header.format;
+			info->bytes = bytes;
+		}
+
+		return id;
+	}
+
+	//Fills one layer of an array that was allocated with the same format, size and level count
+	static bool uploadLayer(const MappedFile& file, const CacheHeader& header, const CacheLevel* levels,
+		const GLuint array, const GLint layer, TextureInfo* info)
+	{
+		const GLenum internalFormat = getInternalFormat(header.format);
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		size_t bytes = 0;
+		for (uint32_t i = 0; i < header.levelCount; i++)
+		{
+			const CacheLevel& level = levels[i];
+			const char* data = file.getData() + level.offset;
+
+			if (header.format == FORMAT_RGBA8)
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, level.width, level.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+			else
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, level.width, level.height, 1, internalFormat,
+					static_cast<GLsizei>(level.size), data);
+
+			bytes += static_cast<size_t>(level.size);
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		if (info != nullptr)
+		{
+			info->width = header.width;
+			info->height = header.height;
+			info->levels = header.levelCount;
+			info->format = header.format;
+			info->bytes = bytes;
+		}
+
+		return true;
+	}
+
+	//Maps an up to date .tex file, converting first when there is none, and hands it to uploadFunc
+	template<typename UploadFunc>
+	static bool mapCache(const char* fileName, const uint32_t format, const uint32_t width, const uint32_t height, UploadFunc uploadFunc)
+	{
+		const std::string cacheFile = getCachePath(fileName, width, height);
+
+		CacheHeader header;
+		const CacheLevel* levels = nullptr;
+		{
+			MappedFile file(cacheFile.c_str());
+			if (readCache(fileName, file, format, width, height, header, levels))
+				return uploadFunc(file, header, levels);
+		}
+
+		if (!convertToCache(fileName, format, width, height))
+			return false;
+
+		MappedFile file(cacheFile.c_str());
+		if (!readCache(fileName, file, format, width, height, header, levels))
+		{
+			std::cout << "ERROR::TEXTUREIMPORTER::COULD_NOT_READ_CACHE: " << cacheFile << "\n";
+			return false;
+		}
+
+		return uploadFunc(file, header, levels);
+	}
+
+public:
+	static GLenum getInternalFormat(const uint32_t format)
+	{
+		switch (format)
+		{
+		case FORMAT_BC1:
+			return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case FORMAT_BC3:
+			return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		default:
+			return GL_RGBA8;
+		}
+	}
+
+	//Number of levels down to 1x1
+	static uint32_t getLevelCount(uint32_t width, uint32_t height)
+	{
+		uint32_t count = 1;
+		while (width > 1 || height > 1)
+		{
+			width = std::max(1u, width / 2);
+			height = std::max(1u, height / 2);
+			count++;
+		}
+		return count;
+	}
+
+	//"Images/Box.png" -> "Images/Box.tex", resized conversions get their own file "Images/Box_512x512.tex"
+	static std::string getCachePath(const char* fileName, const uint32_t width = 0, const uint32_t height = 0)
+	{
+		std::string path(fileName);
+		const size_t slash = path.find_last_of("/\\");
+		const size_t dot = path.find_last_of('.');
+		if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+			path.erase(dot);
+
+		if (width != 0)
+			path += "_" + std::to_string(width) + "x" + std::to_string(height);
+
+		return path + ".tex";
+	}
+
+	//Decodes the image and builds every level down to 1x1, FORMAT_AUTO picks BC3 when any texel is not opaque.
+	//A non zero width and height resample the image to that size first
+	static bool convert(const char* fileName, TextureData& texture, uint32_t format = FORMAT_AUTO,
+		const uint32_t targetWidth = 0, const uint32_t targetHeight = 0)
+	{
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+		unsigned char* image = SOIL_load_image(fileName, &width, &height, &channels, SOIL_LOAD_RGBA);
+		if (image == nullptr || width <= 0 || height <= 0)
+		{
+			std::cout << "ERROR::TEXTUREIMPORTER::TEXTURE_LOADING_FAILED: " << fileName << "\n";
+			if (image != nullptr)
+				SOIL_free_image_data(image);
+			return false;
+		}
+
+		std::vector<unsigned char> level(image, image + static_cast<size_t>(width) * height * 4);
+		SOIL_free_image_data(image);
+
+		if (targetWidth != 0 && (targetWidth != static_cast<uint32_t>(width) || targetHeight != static_cast<uint32_t>(height)))
+		{
+			std::vector<unsigned char> resized(static_cast<size_t>(targetWidth) * targetHeight * 4);
+			resample(level.data(), width, height, resized.data(), targetWidth, targetHeight);
+			level.swap(resized);
+			width = static_cast<int>(targetWidth);
+			height = static_cast<int>(targetHeight);
+		}
+
+		if (format == FORMAT_AUTO)
+			format = hasAlpha(level) ? FORMAT_BC3 : FORMAT_BC1;
+
+		texture.format = format;
+		texture.levels.clear();
+
+		uint32_t levelWidth = static_cast<uint32_t>(width);
+		uint32_t levelHeight = static_cast<uint32_t>(height);
+		while (true)
+		{
+			TextureData::Level out;
+			out.width = levelWidth;
+			out.height = levelHeight;
+			out.data = format == FORMAT_RGBA8 ? level : compress(level, levelWidth, levelHeight, format);
+			texture.levels.push_back(out);
+
+			if (levelWidth == 1 && levelHeight == 1)
+				break;
+
+			const uint32_t nextWidth = std::max(1u, levelWidth / 2);
+			const uint32_t nextHeight = std::max(1u, levelHeight / 2);
+			std::vector<unsigned char> next(static_cast<size_t>(nextWidth) * nextHeight * 4);
+			downsample(level.data(), levelWidth, levelHeight, next.data(), nextWidth, nextHeight);
+
+			level.swap(next);
+			levelWidth = nextWidth;
+			levelHeight = nextHeight;
+		}
+
+		return true;
+	}
+
+	//Converts when there is no up to date .tex file yet
+	static bool convertToCache(const char* fileName, const uint32_t format = FORMAT_AUTO,
+		const uint32_t width = 0, const uint32_t height = 0)
+	{
+		TextureData texture;
+		if (!convert(fileName, texture, format, width, height))
+			return false;
+
+		return writeCache(fileName, getCachePath(fileName, width, height), texture);
+	}
+
+	//Returns the texture name, 0 on failure. The first load (or one after the source changed) converts the image
+	static GLuint load(const char* fileName, const uint32_t format = FORMAT_AUTO, TextureInfo* info = nullptr, const GLenum target = GL_TEXTURE_2D)
+	{
+		GLuint id = 0;
+		mapCache(fileName, format, 0, 0, [&](const MappedFile& file, const CacheHeader& header, const CacheLevel* levels)
+		{
+			id = upload(file, header, levels, target, info);
+			return id != 0;
+		});
+
+		return id;
+	}
+
+	//Converts the image to the array's size and format and fills the given layer with its whole mip chain
+	static bool loadLayer(const char* fileName, const GLuint array, const GLint layer, const uint32_t format,
+		const uint32_t width, const uint32_t height, TextureInfo* info = nullptr)
+	{
+		return mapCache(fileName, format, width, height, [&](const MappedFile& file, const CacheHeader& header, const CacheLevel* levels)
+		{
+			return uploadLayer(file, header, levels, array, layer, info);
+		});
+	}
+};
@@ -0,0 +1,431 @@
+#pragma once
+#include<iostream>
+#include<vector>
+#include<algorithm>
+#include<cmath>
+
+#include<glm.hpp>
+#include<vec3.hpp>
+#include<mat4x4.hpp>
+
+#include "JobSystem.h"
+
+//Position, origin, rotation (degrees) and scale of every transform in the scene, stored as structure of arrays.
+//Modifiers only mark a transform dirty; update() rebuilds the local matrices of the dirty ones in one batch and
+//then walks the arrays once to pass changes down to the children. Parents are always stored before their children.
+//A frame where nothing moved costs nothing.
+//Transforms are addressed by a handle that stays valid while the arrays are compacted and reordered.
+class TransformSystem
+{
+private:
+	enum flag_enum { FLAG_DIRTY = 1, FLAG_REMOVED = 2 };
+
+	//Dense arrays, indexed by slot
+	std::vector<float> positionX;
+	std::vector<float> positionY;
+	std::vector<float> positionZ;
+	std::vector<float> originX;
+	std::vector<float> originY;
+	std::vector<float> originZ;
+	std::vector<float> rotationX;
+	std::vector<float> rotationY;
+	std::vector<float> rotationZ;
+	std::vector<float> scaleX;
+	std::vector<float> scaleY;
+	std::vector<float> scaleZ;
+
+	std::vector<int> parents;
+	std::vector<unsigned char> flags;
+	std::vector<unsigned> changed;
+	std::vector<glm::mat4> localMatrices;
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<int> handles;
+
+	//Handle to slot
+	std::vector<int> slots;
+	std::vector<int> freeHandles;
+
+	//Handles marked since the last update
+	std::vector<int> dirty;
+
+	unsigned frame;
+	size_t removedCount;
+	bool unordered;
+
+	//Scratch of the batched pass
+	std::vector<int> batch;
+	std::vector<float> sines[3];
+	std::vector<float> cosines[3];
+
+	TransformSystem()
+	{
+		this->frame = 0;
+		this->removedCount = 0;
+		this->unordered = false;
+	}
+
+	TransformSystem(const TransformSystem&) = delete;
+	TransformSystem& operator=(const TransformSystem&) = delete;
+
+	void markDirty(const int handle)
+	{
+		const int slot = this->slots[handle];
+		if (this->flags[slot] & FLAG_DIRTY)
+			return;
+
+		this->flags[slot] |= FLAG_DIRTY;
+		this->dirty.push_back(handle);
+	}
+
+	template<typename Type>
+	static void permute(std::vector<Type>& values, const std::vector<int>& order)
+	{
+		std::vector<Type> sorted(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+			sorted[i] = values[order[i]];
+
+		values.swap(sorted);
+	}
+
+	//Drops removed transforms and sorts the rest by depth, so every parent comes before its children again
+	void rebuild()
+	{
+		const int count = static_cast<int>(this->flags.size());
+
+		//Children of a removed parent become roots, their world matrix is their local one from now on
+		for (int i = 0; i < count; i++)
+		{
+			if (this->parents[i] >= 0 && (this->flags[this->parents[i]] & FLAG_REMOVED))
+			{
+				this->parents[i] = -1;
+				if (!(this->flags[i] & FLAG_REMOVED))
+					this->markDirty(this->handles[i]);
+			}
+		}
+
+		std::vector<int> depths(count, 0);
+		std::vector<int> order;
+		order.reserve(count - this->removedCount);
+		for (int i = 0; i < count; i++)
+		{
+			if (this->flags[i] & FLAG_REMOVED)
+				continue;
+
+			for (int j = this->parents[i]; j >= 0; j = this->parents[j])
+				++depths[i];
+
+			order.push_back(i);
+		}
+
+		std::stable_sort(order.begin(), order.end(), [&](const int a, const int b) { return depths[a] < depths[b]; });
+
+		std::vector<int> newSlots(count, -1);
+		for (size_t i = 0; i < order.size(); i++)
+			newSlots[order[i]] = static_cast<int>(i);
+
+		permute(this->positionX, order);
+		permute(this->positionY, order);
+		permute(this->positionZ, order);
+		permute(this->originX, order);
+		permute(this->originY, order);
+		permute(this->originZ, order);
+		permute(this->rotationX, order);
+		permute(this->rotationY, order);
+		permute(this->rotationZ, order);
+		permute(this->scaleX, order);
+		permute(this->scaleY, order);
+		permute(this->scaleZ, order);
+		permute(this->parents, order);
+		permute(this->flags, order);
+		permute(this->changed, order);
+		permute(this->localMatrices, order);
+		permute(this->worldMatrices, order);
+		permute(this->handles, order);
+
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			if (this->parents[i] >= 0)
+				this->parents[i] = newSlots[this->parents[i]];
+
+			this->slots[this->handles[i]] = static_cast<int>(i);
+		}
+
+		this->removedCount = 0;
+		this->unordered = false;
+	}
+
+	//translate(origin) * rotateX * rotateY * rotateZ * translate(position - origin) * scale, for the batch entries [first, last)
+	void computeLocalMatrices(const size_t first, const size_t last)
+	{
+		const std::vector<float>* rotations[3] = { &this->rotationX, &this->rotationY, &this->rotationZ };
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			std::vector<float>& sine = this->sines[axis];
+			std::vector<float>& cosine = this->cosines[axis];
+
+			const std::vector<float>& rotation = *rotations[axis];
+			for (size_t i = first; i < last; i++)
+				sine[i] = glm::radians(rotation[this->batch[i]]);
+
+			//Contiguous, so the compiler can vectorize the trig
+			for (size_t i = first; i < last; i++)
+			{
+				cosine[i] = std::cos(sine[i]);
+				sine[i] = std::sin(sine[i]);
+			}
+		}
+
+		const float* sx = this->sines[0].data();
+		const float* cx = this->cosines[0].data();
+		const float* sy = this->sines[1].data();
+		const float* cy = this->cosines[1].data();
+		const float* sz = this->sines[2].data();
+		const float* cz = this->cosines[2].data();
+
+		for (size_t i = first; i < last; i++)
+		{
+			const int slot = this->batch[i];
+
+			//rotateX * rotateY
+			const glm::vec3 xy0(cy[i], sx[i] * sy[i], -cx[i] * sy[i]);
+			const glm::vec3 xy1(0.f, cx[i], sx[i]);
+			const glm::vec3 xy2(sy[i], -sx[i] * cy[i], cx[i] * cy[i]);
+
+			//* rotateZ
+			const glm::vec3 r0 = xy0 * cz[i] + xy1 * sz[i];
+			const glm::vec3 r1 = xy1 * cz[i] - xy0 * sz[i];
+			const glm::vec3& r2 = xy2;
+
+			const glm::vec3 origin(this->originX[slot], this->originY[slot], this->originZ[slot]);
+			const glm::vec3 offset = glm::vec3(this->positionX[slot], this->positionY[slot], this->positionZ[slot]) - origin;
+			const glm::vec3 translation = origin + r0 * offset.x + r1 * offset.y + r2 * offset.z;
+
+			glm::mat4& matrix = this->localMatrices[slot];
+			matrix[0] = glm::vec4(r0 * this->scaleX[slot], 0.f);
+			matrix[1] = glm::vec4(r1 * this->scaleY[slot], 0.f);
+			matrix[2] = glm::vec4(r2 * this->scaleZ[slot], 0.f);
+			matrix[3] = glm::vec4(translation, 1.f);
+		}
+	}
+
+public:
+	static TransformSystem& get()
+	{
+		static TransformSystem instance;
+		return instance;
+	}
+
+	//Accessors
+	size_t getCount() const { return this->flags.size() - this->removedCount; }
+
+	glm::vec3 getPosition(const int handle) const
+	{
+		const int slot = this->slots[handle];
+		return glm::vec3(this->positionX[slot], this->positionY[slot], this->positionZ[slot]);
+	}
+
+	glm::vec3 getOrigin(const int handle) const
+	{
+		const int slot = this->slots[handle];
+		return glm::vec3(this->originX[slot], this->originY[slot], this->originZ[slot]);
+	}
+
+	glm::vec3 getRotation(const int handle) const
+	{
+		const int slot = this->slots[handle];
+		return glm::vec3(this->rotationX[slot], this->rotationY[slot], this->rotationZ[slot]);
+	}
+
+	glm::vec3 getScale(const int handle) const
+	{
+		const int slot = this->slots[handle];
+		return glm::vec3(this->scaleX[slot], this->scaleY[slot], this->scaleZ[slot]);
+	}
+
+	//Valid after update()
+	const glm::mat4& getWorldMatrix(const int handle) const
+	{
+		return this->worldMatrices[this->slots[handle]];
+	}
+
+	//World matrix was rebuilt by the last update()
+	bool hasChanged(const int handle) const
+	{
+		return this->changed[this->slots[handle]] == this->frame;
+	}
+
+	//Modifiers
+	void setPosition(const int handle, const glm::vec3& position)
+	{
+		const int slot = this->slots[handle];
+		this->positionX[slot] = position.x;
+		this->positionY[slot] = position.y;
+		this->positionZ[slot] = position.z;
+		this->markDirty(handle);
+	}
+
+	void setOrigin(const int handle, const glm::vec3& origin)
+	{
+		const int slot = this->slots[handle];
+		this->originX[slot] = origin.x;
+		this->originY[slot] = origin.y;
+		this->originZ[slot] = origin.z;
+		this->markDirty(handle);
+	}
+
+	void setRotation(const int handle, const glm::vec3& rotation)
+	{
+		const int slot = this->slots[handle];
+		this->rotationX[slot] = rotation.x;
+		this->rotationY[slot] = rotation.y;
+		this->rotationZ[slot] = rotation.z;
+		this->markDirty(handle);
+	}
+
+	void setScale(const int handle, const glm::vec3& scale)
+	{
+		const int slot = this->slots[handle];
+		this->scaleX[slot] = scale.x;
+		this->scaleY[slot] = scale.y;
+		this->scaleZ[slot] = scale.z;
+		this->markDirty(handle);
+	}
+
+	//-1 detaches. The child's values become relative to the parent
+	void setParent(const int handle, const int parent)
+	{
+		const int slot = this->slots[handle];
+		const int parentSlot = parent >= 0 ? this->slots[parent] : -1;
+
+		this->parents[slot] = parentSlot;
+		if (parentSlot > slot)
+			this->unordered = true;
+
+		this->markDirty(handle);
+	}
+
+	//Functions
+	int create(const glm::vec3& position = glm::vec3(0.f),
+		const glm::vec3& origin = glm::vec3(0.f),
+		const glm::vec3& rotation = glm::vec3(0.f),
+		const glm::vec3& scale = glm::vec3(1.f))
+	{
+		int handle = 0;
+		if (!this->freeHandles.empty())
+		{
+			handle = this->freeHandles.back();
+			this->freeHandles.pop_back();
+		}
+		else
+		{
+			handle = static_cast<int>(this->slots.size());
+			this->slots.push_back(-1);
+		}
+
+		this->slots[handle] = static_cast<int>(this->flags.size());
+
+		this->positionX.push_back(position.x);
+		this->positionY.push_back(position.y);
+		this->positionZ.push_back(position.z);
+		this->originX.push_back(origin.x);
+		this->originY.push_back(origin.y);
+		this->originZ.push_back(origin.z);
+		this->rotationX.push_back(rotation.x);
+		this->rotationY.push_back(rotation.y);
+		this->rotationZ.push_back(rotation.z);
+		this->scaleX.push_back(scale.x);
+		this->scaleY.push_back(scale.y);
+		this->scaleZ.push_back(scale.z);
+		this->parents.push_back(-1);
+		this->flags.push_back(0);
+		this->changed.push_back(0);
+		this->localMatrices.push_back(glm::mat4(1.f));
+		this->worldMatrices.push_back(glm::mat4(1.f));
+		this->handles.push_back(handle);
+
+		this->markDirty(handle);
+
+		return handle;
+	}
+
+	//Children of a destroyed transform become roots
+	void destroy(const int handle)
+	{
+		const int slot = this->slots[handle];
+		this->flags[slot] = FLAG_REMOVED;
+		this->slots[handle] = -1;
+		this->freeHandles.push_back(handle);
+		++this->removedCount;
+	}
+
+	void move(const int handle, const glm::vec3& position)
+	{
+		this->setPosition(handle, this->getPosition(handle) + position);
+	}
+
+	void rotate(const int handle, const glm::vec3& rotation)
+	{
+		this->setRotation(handle, this->getRotation(handle) + rotation);
+	}
+
+	void scaleUp(const int handle, const glm::vec3& scale)
+	{
+		this->setScale(handle, this->getScale(handle) + scale);
+	}
+
+	//Once per frame, before anything reads world matrices. The local matrices are split over the job threads when given
+	void update(JobSystem* jobs = nullptr)
+	{
+		++this->frame;
+
+		if (this->removedCount > 0 || this->unordered)
+			this->rebuild();
+
+		if (this->dirty.empty())
+			return;
+
+		this->batch.clear();
+		int first = static_cast<int>(this->flags.size());
+		for (auto& i : this->dirty)
+		{
+			const int slot = this->slots[i];
+			if (slot < 0)
+				continue;
+
+			this->batch.push_back(slot);
+			first = std::min(first, slot);
+		}
+		this->dirty.clear();
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			this->sines[axis].resize(this->batch.size());
+			this->cosines[axis].resize(this->batch.size());
+		}
+
+		if (jobs != nullptr)
+			jobs->parallelFor(this->batch.size(), [this](const size_t begin, const size_t end) { this->computeLocalMatrices(begin, end); }, 256);
+		else
+			this->computeLocalMatrices(0, this->batch.size());
+
+		//Changes only flow towards higher slots, so one pass from the first dirty slot is enough
+		const int count = static_cast<int>(this->flags.size());
+		for (int i = first; i < count; i++)
+		{
+			const int parent = this->parents[i];
+			const bool parentChanged = parent >= 0 && this->changed[parent] == this->frame;
+
+			if (!(this->flags[i] & FLAG_DIRTY) && !parentChanged)
+				continue;
+
+			if (parent >= 0)
+				this->worldMatrices[i] = this->worldMatrices[parent] * this->localMatrices[i];
+			else
+				this->worldMatrices[i] = this->localMatrices[i];
+
+			this->changed[i] = this->frame;
+			this->flags[i] &= ~FLAG_DIRTY;
+		}
+	}
+};
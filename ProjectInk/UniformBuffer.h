@@ -0,0 +1,133 @@
+#pragma once
+#include<vector>
+#include<cstring>
+
+#include<glew.h>
+
+#include<glm.hpp>
+#include<vec4.hpp>
+#include<mat4x4.hpp>
+
+//Binding points of the std140 blocks shared by every shader
+enum uniform_block_enum { BLOCK_FRAME = 0, BLOCK_DRAW, BLOCK_COUNT };
+
+//std140 mirror of "FrameData", written once per frame
+struct FrameData
+{
+	glm::mat4 ViewMatrix;
+	glm::mat4 ProjectionMatrix;
+	glm::vec4 cameraPos;
+	glm::vec4 lightPos0;
+
+	//Froxel lookup, see LightClusterer::writeFrameData
+	glm::vec4 clusterScale;
+	glm::ivec4 clusterGrid;
+
+	//Sun and its shadow cascades, see ShadowMapper::writeFrameData
+	glm::vec4 sunDirection;
+	glm::vec4 sunColor;
+	glm::vec4 cascadeSplits;
+	glm::ivec4 shadowInfo;
+};
+
+//std140 mirror of "DrawData", written once per draw
+struct DrawData
+{
+	glm::mat4 ModelMatrix;
+
+	//x and y are the layers of the diffuse and specular texture arrays, z the MaterialTable entry,
+	//w the ShadowTable view a shadow pass renders
+	glm::ivec4 indices;
+};
+
+static_assert(sizeof(FrameData) == 256, "FrameData does not match the std140 layout");
+static_assert(sizeof(DrawData) == 80, "DrawData does not match the std140 layout");
+
+#include "StreamBuffer.h"
+
+//A std140 block at a fixed binding point. With a StreamBuffer every update writes the whole block to a fresh
+//range of the ring and binds that range, so a block rewritten per draw never waits for the draws that still
+//read its previous contents. The CPU copy keeps partial updates working, the rest of the block comes from it
+class UniformBuffer
+{
+private:
+	GLuint id;
+	GLsizeiptr size;
+	GLuint binding;
+
+	StreamBuffer* stream;
+	std::vector<unsigned char> shadow;
+	GLint alignment;
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	//Whole CPU copy to a fresh range, bound at the binding point
+	void commit()
+	{
+		GLintptr streamOffset = 0;
+		void* target = this->stream->allocate(this->size, this->alignment, streamOffset);
+		if (target == nullptr)
+		{
+			//Ring is full this frame, the own buffer takes the upload
+			glNamedBufferSubData(this->id, 0, this->size, this->shadow.data());
+			glBindBufferBase(GL_UNIFORM_BUFFER, this->binding, this->id);
+			return;
+		}
+
+		std::memcpy(target, this->shadow.data(), static_cast<size_t>(this->size));
+		glBindBufferRange(GL_UNIFORM_BUFFER, this->binding, this->stream->getID(), streamOffset, this->size);
+	}
+
+public:
+	UniformBuffer(const GLsizeiptr size, const GLuint binding, StreamBuffer* stream = nullptr)
+	{
+		this->size = size;
+		this->binding = binding;
+		this->stream = stream;
+		this->shadow.assign(static_cast<size_t>(size), 0);
+
+		this->alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &this->alignment);
+
+		//Also the fallback when the ring is full
+		glCreateBuffers(1, &this->id);
+		glNamedBufferData(this->id, this->size, NULL, GL_DYNAMIC_DRAW);
+	}
+
+	~UniformBuffer()
+	{
+		glDeleteBuffers(1, &this->id);
+	}
+
+	//Accessors
+	GLuint getID() const { return this->id; }
+
+	GLuint getBinding() const { return this->binding; }
+
+	bool isStreamed() const { return this->stream != nullptr; }
+
+	//Functions
+	void update(const void* data, const GLsizeiptr size, const GLintptr offset = 0)
+	{
+		if (this->stream == nullptr)
+		{
+			glNamedBufferSubData(this->id, offset, size, data);
+			return;
+		}
+
+		std::memcpy(this->shadow.data() + offset, data, static_cast<size_t>(size));
+		this->commit();
+	}
+
+	//The binding point keeps the buffer until something else is bound there, so once is enough.
+	//A streamed block binds a range on every update, binding it again writes the last contents anew
+	//since the range it had may already be reused
+	void bind()
+	{
+		if (this->stream != nullptr)
+			this->commit();
+		else
+			glBindBufferBase(GL_UNIFORM_BUFFER, this->binding, this->id);
+	}
+};
@@ -0,0 +1,165 @@
+#pragma once
+#include<iostream>
+#include<string>
+#include<vector>
+#include<unordered_map>
+
+#include<glew.h>
+
+#include<glm.hpp>
+#include<vec3.hpp>
+#include<mat4x4.hpp>
+#include<gtc/type_ptr.hpp>
+
+#include "Shader.h"
+#include "UniformBuffer.h"
+
+//Uniforms the engine sets every frame or every draw, resolved once instead of by name on every call
+enum uniform_enum {
+	UNIFORM_MODEL_MATRIX = 0, UNIFORM_VIEW_MATRIX, UNIFORM_PROJECTION_MATRIX,
+	UNIFORM_CAMERA_POS, UNIFORM_LIGHT_POS0,
+	UNIFORM_COUNT };
+
+//Reflects the active uniforms and uniform blocks of a linked Shader once and caches their locations.
+//Values are written with glProgramUniform*, so the program does not have to be bound.
+//The per draw block is staged here and uploaded with commitDrawData right before the draw.
+class UniformCache
+{
+private:
+	Shader* shader;
+	GLuint program;
+
+	GLint locations[UNIFORM_COUNT];
+	bool blocks[BLOCK_COUNT];
+	std::unordered_map<std::string, GLint> named;
+
+	UniformBuffer* drawBuffer;
+	DrawData drawData;
+
+	static const char* getUniformName(const int uniform)
+	{
+		static const char* names[UNIFORM_COUNT] = {
+			"ModelMatrix", "ViewMatrix", "ProjectionMatrix",
+			"cameraPos", "lightPos0" };
+
+		return names[uniform];
+	}
+
+	static const char* getBlockName(const int block)
+	{
+		static const char* names[BLOCK_COUNT] = { "FrameData", "DrawData" };
+
+		return names[block];
+	}
+
+	void reflect()
+	{
+		//Plain uniforms, block members have no location and are skipped
+		GLint count = 0;
+		GLint maxLength = 0;
+		glGetProgramiv(this->program, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(this->program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+		std::vector<GLchar> name(maxLength > 0 ? maxLength : 1);
+		for (GLint i = 0; i < count; i++)
+		{
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(this->program, i, static_cast<GLsizei>(name.size()), NULL, &size, &type, name.data());
+
+			const GLint location = glGetUniformLocation(this->program, name.data());
+			if (location >= 0)
+				this->named[name.data()] = location;
+		}
+
+		for (int i = 0; i < UNIFORM_COUNT; i++)
+			this->locations[i] = this->getLocation(getUniformName(i));
+
+		//Blocks, pinned to the engine wide binding points
+		glGetProgramiv(this->program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+		glGetProgramiv(this->program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+
+		name.resize(maxLength > 0 ? maxLength : 1);
+		for (GLint i = 0; i < count; i++)
+		{
+			glGetActiveUniformBlockName(this->program, i, static_cast<GLsizei>(name.size()), NULL, name.data());
+
+			for (int j = 0; j < BLOCK_COUNT; j++)
+			{
+				if (std::string(name.data()) == getBlockName(j))
+				{
+					glUniformBlockBinding(this->program, i, j);
+					this->blocks[j] = true;
+				}
+			}
+		}
+	}
+
+public:
+	UniformCache(Shader* shader, UniformBuffer* drawBuffer)
+	{
+		this->shader = shader;
+		this->drawBuffer = drawBuffer;
+		this->drawData = DrawData();
+
+		for (int i = 0; i < BLOCK_COUNT; i++)
+			this->blocks[i] = false;
+
+		//Shader keeps its id to itself, read it back from the binding
+		GLint current = 0;
+		this->shader->use();
+		glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+		glUseProgram(0);
+		this->program = static_cast<GLuint>(current);
+
+		this->reflect();
+	}
+
+	~UniformCache()
+	{
+
+	}
+
+	//Accessors
+	Shader* getShader() const { return this->shader; }
+
+	GLuint getProgram() const { return this->program; }
+
+	bool hasUniform(const uniform_enum uniform) const { return this->locations[uniform] >= 0; }
+
+	bool hasBlock(const uniform_block_enum block) const { return this->blocks[block]; }
+
+	GLint getLocation(const char* name) const
+	{
+		auto found = this->named.find(name);
+		return found == this->named.end() ? -1 : found->second;
+	}
+
+	DrawData& getDrawData() { return this->drawData; }
+
+	//Modifiers
+	void set1i(const GLint value, const uniform_enum uniform)
+	{
+		if (this->locations[uniform] >= 0)
+			glProgramUniform1i(this->program, this->locations[uniform], value);
+	}
+
+	void setVec3f(const glm::vec3& value, const uniform_enum uniform)
+	{
+		if (this->locations[uniform] >= 0)
+			glProgramUniform3fv(this->program, this->locations[uniform], 1, glm::value_ptr(value));
+	}
+
+	void setMat4fv(const glm::mat4& value, const uniform_enum uniform, const GLboolean transpose = GL_FALSE)
+	{
+		if (this->locations[uniform] >= 0)
+			glProgramUniformMatrix4fv(this->program, this->locations[uniform], 1, transpose, glm::value_ptr(value));
+	}
+
+	//Functions
+	void commitDrawData()
+	{
+		if (this->blocks[BLOCK_DRAW])
+			this->drawBuffer->update(&this->drawData, sizeof(DrawData));
+	}
+};
@@ -0,0 +1,413 @@
+#pragma once
+#include<iostream>
+#include<vector>
+#include<string>
+#include<cstring>
+#include<cstdint>
+#include<cstddef>
+#include<cmath>
+
+#include<glew.h>
+
+#include<glm.hpp>
+#include<vec2.hpp>
+#include<vec3.hpp>
+#include<vec4.hpp>
+#include<mat4x4.hpp>
+
+#include "Vertex.h"
+#include "Bounds.h"
+
+//The full format stores a Vertex as it is, attribute by attribute
+static_assert(sizeof(Vertex) == 44, "Vertex is expected to be four tightly packed float attributes");
+
+//Largest error a compact attribute may introduce, past it the attribute is kept as float
+struct VertexTolerance
+{
+	//Fraction of the largest half extent of the bounds
+	float position;
+
+	//Degrees
+	float normal;
+
+	//Texture coordinate units
+	float texcoord;
+
+	VertexTolerance(const float position = 1.f / 8192.f, const float normal = 0.5f, const float texcoord = 1.f / 2048.f)
+		: position(position), normal(normal), texcoord(texcoord) {}
+};
+
+//Largest error a format introduced, in the units of VertexTolerance
+struct VertexError
+{
+	float position;
+	float normal;
+	float texcoord;
+
+	VertexError() : position(0.f), normal(0.f), texcoord(0.f) {}
+};
+
+//How the attributes of a Vertex are stored in a vertex buffer. Compact encodings are fetched as normalized
+//integers or half floats, so the shaders read them unchanged:
+//positions as snorm16 in the cube around the bounds, scaled back by getDecodeMatrix which is folded into the
+//ModelMatrix, normals as GL_INT_2_10_10_10_REV and texcoords as half floats.
+//The color is read by no fragment shader, a mesh where it does not vary can drop it. Attribute 1 is left disabled then
+struct VertexFormat
+{
+	enum Position : unsigned char { POSITION_FLOAT, POSITION_SNORM16 };
+	enum Texcoord : unsigned char { TEXCOORD_FLOAT, TEXCOORD_HALF };
+	enum Normal : unsigned char { NORMAL_FLOAT, NORMAL_INT_2_10_10_10 };
+
+	Position position;
+	bool color;
+	Texcoord texcoord;
+	Normal normal;
+
+	VertexFormat(const Position position = POSITION_FLOAT, const bool color = true,
+		const Texcoord texcoord = TEXCOORD_FLOAT, const Normal normal = NORMAL_FLOAT)
+		: position(position), color(color), texcoord(texcoord), normal(normal) {}
+
+	//The smallest format there is
+	static VertexFormat compact()
+	{
+		return VertexFormat(POSITION_SNORM16, false, TEXCOORD_HALF, NORMAL_INT_2_10_10_10);
+	}
+
+	bool operator==(const VertexFormat& format) const
+	{
+		return this->position == format.position && this->color == format.color
+			&& this->texcoord == format.texcoord && this->normal == format.normal;
+	}
+
+	bool operator!=(const VertexFormat& format) const { return !(*this == format); }
+
+	//Accessors
+	bool isFull() const { return *this == VertexFormat(); }
+
+	bool isQuantized() const { return this->position != POSITION_FLOAT; }
+
+	//Attributes follow each other in Vertex order, every one of them 4 byte aligned.
+	//The snorm16 position takes 8 bytes, the fourth component is padding
+	GLsizei getColorOffset() const { return this->position == POSITION_FLOAT ? 12 : 8; }
+
+	GLsizei getTexcoordOffset() const { return this->getColorOffset() + (this->color ? 12 : 0); }
+
+	GLsizei getNormalOffset() const { return this->getTexcoordOffset() + (this->texcoord == TEXCOORD_FLOAT ? 8 : 4); }
+
+	GLsizei getStride() const { return this->getNormalOffset() + (this->normal == NORMAL_FLOAT ? 12 : 4); }
+
+	//Maps snorm16 positions back to model space: a uniform scale by the largest half extent, then the center.
+	//Uniform so the normals only change length, which the fragment shaders normalize away
+	static glm::mat4 getDecodeMatrix(const AABB& bounds)
+	{
+		const glm::vec3 extent = bounds.getExtent();
+		float scale = std::fmax(std::fmax(extent.x, extent.y), extent.z);
+		if (!(scale > 0.f))
+			scale = 1.f;
+
+		glm::mat4 decode(scale);
+		decode[3] = glm::vec4(bounds.isEmpty() ? glm::vec3(0.f) : bounds.getCenter(), 1.f);
+		return decode;
+	}
+
+	//Functions
+
+	//Attribute pointers 0-3, expects the VAO and the vertex buffer to be bound
+	void setAttributes() const
+	{
+		const GLsizei stride = this->getStride();
+
+		//position
+		if (this->position == POSITION_FLOAT)
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+		else
+			glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, stride, (GLvoid*)0);
+		glEnableVertexAttribArray(0);
+
+		//color
+		if (this->color)
+		{
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(size_t)this->getColorOffset());
+			glEnableVertexAttribArray(1);
+		}
+
+		//texcoord
+		glVertexAttribPointer(2, 2, this->texcoord == TEXCOORD_FLOAT ? GL_FLOAT : GL_HALF_FLOAT, GL_FALSE, stride,
+			(GLvoid*)(size_t)this->getTexcoordOffset());
+		glEnableVertexAttribArray(2);
+
+		//normal
+		if (this->normal == NORMAL_FLOAT)
+			glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(size_t)this->getNormalOffset());
+		else
+			glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (GLvoid*)(size_t)this->getNormalOffset());
+		glEnableVertexAttribArray(3);
+	}
+
+	//Vertex buffer contents in this format, decode from getDecodeMatrix of the same vertices
+	std::vector<unsigned char> pack(const Vertex* vertices, const size_t count, const glm::mat4& decode) const
+	{
+		const size_t stride = this->getStride();
+		const glm::vec3 center(decode[3]);
+		const float inverseScale = 1.f / decode[0][0];
+
+		std::vector<unsigned char> data(count * stride, 0);
+		for (size_t i = 0; i < count; i++)
+		{
+			unsigned char* out = &data[i * stride];
+			const Vertex& vertex = vertices[i];
+
+			if (this->position == POSITION_FLOAT)
+				memcpy(out, &vertex.position, sizeof(glm::vec3));
+			else
+			{
+				const glm::vec3 local = (vertex.position - center) * inverseScale;
+				const int16_t packed[4] = { toSnorm16(local.x), toSnorm16(local.y), toSnorm16(local.z), 0 };
+				memcpy(out, packed, sizeof(packed));
+			}
+
+			if (this->color)
+				memcpy(out + this->getColorOffset(), &vertex.color, sizeof(glm::vec3));
+
+			if (this->texcoord == TEXCOORD_FLOAT)
+				memcpy(out + this->getTexcoordOffset(), &vertex.texcoord, sizeof(glm::vec2));
+			else
+			{
+				const uint16_t packed[2] = { toHalf(vertex.texcoord.x), toHalf(vertex.texcoord.y) };
+				memcpy(out + this->getTexcoordOffset(), packed, sizeof(packed));
+			}
+
+			if (this->normal == NORMAL_FLOAT)
+				memcpy(out + this->getNormalOffset(), &vertex.normal, sizeof(glm::vec3));
+			else
+			{
+				const uint32_t packed = toInt2101010(vertex.normal);
+				memcpy(out + this->getNormalOffset(), &packed, sizeof(packed));
+			}
+		}
+
+		return data;
+	}
+
+	//What the shaders read back from one packed vertex. A dropped color reads as 0
+	Vertex unpack(const unsigned char* data, const glm::mat4& decode) const
+	{
+		Vertex vertex;
+
+		if (this->position == POSITION_FLOAT)
+			memcpy(&vertex.position, data, sizeof(glm::vec3));
+		else
+		{
+			int16_t packed[4];
+			memcpy(packed, data, sizeof(packed));
+			const glm::vec3 local(fromSnorm16(packed[0]), fromSnorm16(packed[1]), fromSnorm16(packed[2]));
+			vertex.position = glm::vec3(decode[3]) + local * decode[0][0];
+		}
+
+		if (this->color)
+			memcpy(&vertex.color, data + this->getColorOffset(), sizeof(glm::vec3));
+		else
+			vertex.color = glm::vec3(0.f);
+
+		if (this->texcoord == TEXCOORD_FLOAT)
+			memcpy(&vertex.texcoord, data + this->getTexcoordOffset(), sizeof(glm::vec2));
+		else
+		{
+			uint16_t packed[2];
+			memcpy(packed, data + this->getTexcoordOffset(), sizeof(packed));
+			vertex.texcoord = glm::vec2(fromHalf(packed[0]), fromHalf(packed[1]));
+		}
+
+		if (this->normal == NORMAL_FLOAT)
+			memcpy(&vertex.normal, data + this->getNormalOffset(), sizeof(glm::vec3));
+		else
+		{
+			uint32_t packed;
+			memcpy(&packed, data + this->getNormalOffset(), sizeof(packed));
+			vertex.normal = fromInt2101010(packed);
+		}
+
+		return vertex;
+	}
+
+	//Largest error of every attribute after a round trip through this format
+	VertexError measure(const Vertex* vertices, const size_t count, const AABB& bounds) const
+	{
+		const glm::mat4 decode = getDecodeMatrix(bounds);
+		const std::vector<unsigned char> data = this->pack(vertices, count, decode);
+		const size_t stride = this->getStride();
+		const float inverseScale = 1.f / decode[0][0];
+
+		VertexError error;
+		for (size_t i = 0; i < count; i++)
+		{
+			const Vertex& original = vertices[i];
+			const Vertex decoded = this->unpack(&data[i * stride], decode);
+
+			error.position = std::fmax(error.position, glm::length(decoded.position - original.position) * inverseScale);
+			error.texcoord = std::fmax(error.texcoord, std::fmax(std::fabs(decoded.texcoord.x - original.texcoord.x),
+				std::fabs(decoded.texcoord.y - original.texcoord.y)));
+			error.normal = std::fmax(error.normal, getAngle(original.normal, decoded.normal));
+		}
+
+		return error;
+	}
+
+	//Smallest format whose every attribute stays within tolerance. The color is dropped when it is the same everywhere
+	static VertexFormat choose(const Vertex* vertices, const size_t count, const AABB& bounds,
+		const VertexTolerance& tolerance = VertexTolerance(), VertexError* error = nullptr)
+	{
+		VertexFormat format = compact();
+		for (size_t i = 1; i < count && !format.color; i++)
+		{
+			if (vertices[i].color != vertices[0].color)
+				format.color = true;
+		}
+
+		//NaN errors fail the comparisons as well
+		const VertexError compactError = format.measure(vertices, count, bounds);
+		VertexError result = compactError;
+		if (!(compactError.position <= tolerance.position))
+		{
+			format.position = POSITION_FLOAT;
+			result.position = 0.f;
+		}
+		if (!(compactError.texcoord <= tolerance.texcoord))
+		{
+			format.texcoord = TEXCOORD_FLOAT;
+			result.texcoord = 0.f;
+		}
+		if (!(compactError.normal <= tolerance.normal))
+		{
+			format.normal = NORMAL_FLOAT;
+			result.normal = 0.f;
+		}
+
+		if (error)
+			*error = result;
+
+		return format;
+	}
+
+	//Short description for stats, e.g. "P16 T16 N10"
+	std::string getName() const
+	{
+		std::string name = this->position == POSITION_FLOAT ? "P32" : "P16";
+		name += this->color ? " C32" : "";
+		name += this->texcoord == TEXCOORD_FLOAT ? " T32" : " T16";
+		name += this->normal == NORMAL_FLOAT ? " N32" : " N10";
+		return name;
+	}
+
+private:
+	static int16_t toSnorm16(const float value)
+	{
+		const float clamped = std::fmin(std::fmax(value, -1.f), 1.f);
+		return static_cast<int16_t>(std::lround(clamped * 32767.f));
+	}
+
+	static float fromSnorm16(const int16_t value)
+	{
+		return std::fmax(value / 32767.f, -1.f);
+	}
+
+	//Signed normalized 10 bit x, y and z, w stays 0
+	static uint32_t toInt2101010(const glm::vec3& value)
+	{
+		uint32_t packed = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const float clamped = std::fmin(std::fmax(value[i], -1.f), 1.f);
+			const int32_t component = static_cast<int32_t>(std::lround(clamped * 511.f));
+			packed |= (static_cast<uint32_t>(component) & 0x3FF) << (10 * i);
+		}
+
+		return packed;
+	}
+
+	static glm::vec3 fromInt2101010(const uint32_t packed)
+	{
+		glm::vec3 value;
+		for (int i = 0; i < 3; i++)
+		{
+			int32_t component = static_cast<int32_t>((packed >> (10 * i)) & 0x3FF);
+			if (component & 0x200)
+				component -= 0x400;
+			value[i] = std::fmax(component / 511.f, -1.f);
+		}
+
+		return value;
+	}
+
+	//IEEE half, rounded to nearest even. Too large values become infinity and fail any tolerance
+	static uint16_t toHalf(const float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		const uint32_t sign = (bits >> 16) & 0x8000;
+		const uint32_t floatExponent = (bits >> 23) & 0xFF;
+		const int exponent = static_cast<int>(floatExponent) - 127 + 15;
+		uint32_t mantissa = bits & 0x7FFFFF;
+
+		if (floatExponent == 0xFF)
+			return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+		if (exponent >= 31)
+			return static_cast<uint16_t>(sign | 0x7C00);
+
+		uint32_t half = 0;
+		uint32_t rest = 0;
+		uint32_t halfway = 0;
+		if (exponent <= 0)
+		{
+			//Subnormal, anything below half the smallest one is 0
+			if (exponent < -10)
+				return static_cast<uint16_t>(sign);
+
+			mantissa |= 0x800000;
+			const int shift = 14 - exponent;
+			half = mantissa >> shift;
+			rest = mantissa & ((1u << shift) - 1);
+			halfway = 1u << (shift - 1);
+		}
+		else
+		{
+			half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+			rest = mantissa & 0x1FFF;
+			halfway = 0x1000;
+		}
+
+		//A carry out of the mantissa correctly moves into the exponent
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			++half;
+
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	static float fromHalf(const uint16_t half)
+	{
+		const int exponent = (half >> 10) & 0x1F;
+		const uint32_t mantissa = half & 0x3FF;
+
+		float value = 0.f;
+		if (exponent == 0)
+			value = std::ldexp(static_cast<float>(mantissa), -24);
+		else if (exponent == 31)
+			value = mantissa ? NAN : INFINITY;
+		else
+			value = std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25);
+
+		return (half & 0x8000) ? -value : value;
+	}
+
+	//Degrees between two directions, two zero vectors agree
+	static float getAngle(const glm::vec3& a, const glm::vec3& b)
+	{
+		const float lengths = glm::length(a) * glm::length(b);
+		if (!(lengths > 0.f))
+			return glm::length(a) == glm::length(b) ? 0.f : 180.f;
+
+		const float cosine = std::fmin(std::fmax(glm::dot(a, b) / lengths, -1.f), 1.f);
+		return std::acos(cosine) * 57.2957795f;
+	}
+};
@@ -0,0 +1,45 @@
+#version 440
+
+//One invocation per command after cull_compute.glsl: commands that got instances are packed to the front of
+//their group and counted, glMultiDrawElementsIndirectCount then only reads what is drawn
+layout (local_size_x = 64) in;
+
+//See GPUDrawCommand in GPUCuller.h
+struct DrawCommand
+{
+	uint count;
+	uint instanceCount;
+	uint first;
+	int baseVertex;
+	uint baseInstance;
+	uint instanceOffset;
+	uint group;
+	uint groupFirst;
+};
+
+layout (std430, binding = 6) readonly buffer CommandTable
+{
+	DrawCommand commands[];
+};
+
+layout (std430, binding = 8) buffer DrawCountTable
+{
+	uint drawCounts[];
+};
+
+layout (std430, binding = 9) writeonly buffer DrawTable
+{
+	DrawCommand draws[];
+};
+
+uniform int commandCount;
+
+void main()
+{
+	const uint index = gl_GlobalInvocationID.x;
+	if (index >= uint(commandCount) || commands[index].instanceCount == 0u)
+		return;
+
+	const uint slot = atomicAdd(drawCounts[commands[index].group], 1u);
+	draws[commands[index].groupFirst + slot] = commands[index];
+}
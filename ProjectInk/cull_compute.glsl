@@ -0,0 +1,145 @@
+#version 440
+
+//One invocation per object registered with GPUCuller: frustum test, then the depth pyramid of the last frame.
+//A visible object takes the next instance of its command and writes its instance data there
+layout (local_size_x = 64) in;
+
+//See GPUObject in GPUCuller.h
+struct ObjectData
+{
+	mat4 ModelMatrix;
+	ivec4 indices;
+	vec4 boundsMin;
+	vec4 boundsMax;
+	ivec4 command;
+};
+
+//See GPUDrawCommand in GPUCuller.h, the first five are what GL reads
+struct DrawCommand
+{
+	uint count;
+	uint instanceCount;
+	uint first;
+	int baseVertex;
+	uint baseInstance;
+	uint instanceOffset;
+	uint group;
+	uint groupFirst;
+};
+
+//See InstanceData in Geometry.h, read by vertex_instanced.glsl as per instance attributes
+struct InstanceData
+{
+	mat4 ModelMatrix;
+	ivec4 indices;
+};
+
+layout (std430, binding = 5) readonly buffer ObjectTable
+{
+	ObjectData objects[];
+};
+
+layout (std430, binding = 6) buffer CommandTable
+{
+	DrawCommand commands[];
+};
+
+layout (std430, binding = 7) writeonly buffer InstanceTable
+{
+	InstanceData instances[];
+};
+
+//Farthest depth of the last frame under every texel, see depth_pyramid_compute.glsl
+layout (binding = 5) uniform sampler2D depthPyramid;
+
+uniform vec4 planes[6];
+uniform mat4 pyramidViewProjection;
+uniform int objectCount;
+uniform int occlusion;
+
+//The box against the planes the way FrustumCuller tests it, precise so both get the same answer
+bool intersectsFrustum(const vec3 boxMin, const vec3 boxMax)
+{
+	for (int p = 0; p < 6; p++)
+	{
+		precise float distance = max(planes[p].x * boxMin.x, planes[p].x * boxMax.x);
+		distance = distance + max(planes[p].y * boxMin.y, planes[p].y * boxMax.y);
+		distance = distance + max(planes[p].z * boxMin.z, planes[p].z * boxMax.z);
+		distance = distance + planes[p].w;
+
+		if (distance < 0.f)
+			return false;
+	}
+
+	return true;
+}
+
+//The screen rectangle of the box covers at most 2x2 texels of the level it is tested against,
+//it is hidden when its nearest point is behind the farthest depth of all of them
+bool isOccluded(const vec3 boxMin, const vec3 boxMax)
+{
+	vec2 low = vec2(1.f);
+	vec2 high = vec2(-1.f);
+	float nearest = 1.f;
+
+	for (int i = 0; i < 8; i++)
+	{
+		const vec3 corner = vec3((i & 1) != 0 ? boxMax.x : boxMin.x,
+			(i & 2) != 0 ? boxMax.y : boxMin.y,
+			(i & 4) != 0 ? boxMax.z : boxMin.z);
+		const vec4 clip = pyramidViewProjection * vec4(corner, 1.f);
+
+		//Reaches behind the camera of that frame, nothing to compare against
+		if (clip.w <= 0.f)
+			return false;
+
+		const vec3 ndc = clip.xyz / clip.w;
+		low = min(low, ndc.xy);
+		high = max(high, ndc.xy);
+		nearest = min(nearest, ndc.z * 0.5f + 0.5f);
+	}
+
+	const ivec2 size = textureSize(depthPyramid, 0);
+	const vec2 lowTexel = clamp(low * 0.5f + 0.5f, 0.f, 1.f) * vec2(size);
+	const vec2 highTexel = clamp(high * 0.5f + 0.5f, 0.f, 1.f) * vec2(size);
+	const float extent = max(highTexel.x - lowTexel.x, highTexel.y - lowTexel.y);
+
+	const int level = clamp(int(ceil(log2(max(extent, 1.f)))), 0, textureQueryLevels(depthPyramid) - 1);
+	const ivec2 levelSize = max(size >> level, ivec2(1));
+	const ivec2 first = min(ivec2(lowTexel) >> level, levelSize - 1);
+	const ivec2 last = min(ivec2(highTexel) >> level, levelSize - 1);
+
+	float farthest = 0.f;
+	for (int y = first.y; y <= last.y; y++)
+	{
+		for (int x = first.x; x <= last.x; x++)
+			farthest = max(farthest, texelFetch(depthPyramid, ivec2(x, y), level).r);
+	}
+
+	return nearest > farthest;
+}
+
+void main()
+{
+	const uint index = gl_GlobalInvocationID.x;
+	if (index >= uint(objectCount))
+		return;
+
+	//Removed objects keep their place without a command
+	const int command = objects[index].command.x;
+	if (command < 0)
+		return;
+
+	const vec3 boxMin = objects[index].boundsMin.xyz;
+	const vec3 boxMax = objects[index].boundsMax.xyz;
+	if (!intersectsFrustum(boxMin, boxMax))
+		return;
+
+	if (occlusion != 0 && isOccluded(boxMin, boxMax))
+		return;
+
+	const uint slot = atomicAdd(commands[command].instanceCount, 1u);
+	const uint instance = commands[command].instanceOffset + slot;
+	instances[instance].ModelMatrix = objects[index].ModelMatrix;
+	instances[instance].indices = objects[index].indices;
+}
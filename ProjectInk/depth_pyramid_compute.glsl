@@ -0,0 +1,41 @@
+#version 440
+
+//One level of the depth pyramid GPUCuller tests against: every texel keeps the farthest depth of the texels
+//below it. Level 0 is copied from the depth buffer, every level above halves the one before it
+layout (local_size_x = 8, local_size_y = 8) in;
+
+//The depth buffer copy for level 0, the pyramid itself for the rest
+layout (binding = 5) uniform sampler2D source;
+layout (r32f, binding = 0) uniform writeonly image2D target;
+
+uniform int sourceLevel;
+
+//1 copies, 2 halves
+uniform int scale;
+
+void main()
+{
+	const ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	const ivec2 size = imageSize(target);
+	if (texel.x >= size.x || texel.y >= size.y)
+		return;
+
+	//The last row and column also take what an odd size leaves over, so nothing is left out
+	const ivec2 sourceSize = textureSize(source, sourceLevel);
+	const ivec2 first = texel * scale;
+	ivec2 last = first + scale - 1;
+	if (texel.x == size.x - 1)
+		last.x = sourceSize.x - 1;
+	if (texel.y == size.y - 1)
+		last.y = sourceSize.y - 1;
+	last = min(last, sourceSize - 1);
+
+	float farthest = 0.f;
+	for (int y = first.y; y <= last.y; y++)
+	{
+		for (int x = first.x; x <= last.x; x++)
+			farthest = max(farthest, texelFetch(source, ivec2(x, y), sourceLevel).r);
+	}
+
+	imageStore(target, texel, vec4(farthest));
+}
@@ -1,13 +1,73 @@
 #version 440
 
-struct Material
-{
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-	
-	sampler2D diffuseTex;
-	sampler2D specularTex;
+//Per frame, see FrameData in UniformBuffer.h
+layout (std140, binding = 0) uniform FrameData
+{
+	mat4 ViewMatrix;
+	mat4 ProjectionMatrix;
+	vec4 cameraPos;
+	vec4 lightPos0;
+	vec4 clusterScale;
+	ivec4 clusterGrid;
+	vec4 sunDirection;
+	vec4 sunColor;
+	vec4 cascadeSplits;
+	ivec4 shadowInfo;
+} frame;
+
+//Per draw, see DrawData in UniformBuffer.h
+layout (std140, binding = 1) uniform DrawData
+{
+	mat4 ModelMatrix;
+	ivec4 indices;
+} draw;
+//Every material, see MaterialTable.h
+struct MaterialData
+{
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+};
+
+layout (std430, binding = 0) readonly buffer MaterialTable
+{
+	MaterialData materials[];
+};
+
+//Point lights binned into view space froxels, see LightClusterer.h
+struct LightData
+{
+	vec4 positionRadius;
+	vec4 colorIntensity;
+	ivec4 shadow;
+};
+
+layout (std430, binding = 1) readonly buffer LightTable
+{
+	LightData lights[];
+};
+
+//Offset into lightIndices and light count of every froxel
+layout (std430, binding = 2) readonly buffer ClusterTable
+{
+	uvec2 clusters[];
+};
+
+layout (std430, binding = 3) readonly buffer LightIndexTable
+{
+	uint lightIndices[];
+};
+
+//Every shadow map view, see ShadowMapper.h. Point lights take six in a row, the sun one per cascade
+struct ShadowView
+{
+	mat4 ViewProjectionMatrix;
+	vec4 atlasRect;
+};
+
+layout (std430, binding = 4) readonly buffer ShadowTable
+{
+	ShadowView shadows[];
 };
 
 in vec3 vs_position;
@@ -17,33 +77,104 @@ in vec3 vs_normal;
 
 out vec4 fs_color;
 
-//Uniforms
-uniform Material material;
-uniform vec3 lightPos0;
-uniform vec3 cameraPos;
+//Material textures, bound by RenderQueue and Model to units 0 and 1
+layout (binding = 0) uniform sampler2D diffuseTex;
+layout (binding = 1) uniform sampler2D specularTex;
+
+//Depth atlas of every shadow map, bound by ShadowMapper to unit 4
+layout (binding = 4) uniform sampler2DShadow shadowAtlas;
 
-//Functions
-vec3 calculateAmbient(Material material)
+//Functions. Shader compiles every source as it is, so the lighting and shadow code below is the same
+//as in fragment_array.glsl, change both together
+vec3 calculateAmbient(MaterialData material)
 {
-	return material.ambient;
+	return material.ambient.rgb;
 }
 
-vec3 calculateDiffuse(Material material,vec3 vs_position,vec3 vs_normal, vec3 lightPos0)
+//Froxel of this fragment: screen tile from the pixel, depth slice from the log of the view depth
+uint calculateCluster(vec3 vs_position)
+{
+	float depth = -(frame.ViewMatrix * vec4(vs_position, 1.f)).z;
+	ivec3 froxel = ivec3(ivec2(gl_FragCoord.xy * frame.clusterScale.xy),
+		int(floor(log(max(depth, 0.0001f)) * frame.clusterScale.z + frame.clusterScale.w)));
+	froxel = clamp(froxel, ivec3(0), frame.clusterGrid.xyz - 1);
+
+	return uint((froxel.z * frame.clusterGrid.y + froxel.y) * frame.clusterGrid.x + froxel.x);
+}
+
+//Smooth falloff to zero at the radius
+float calculateAttenuation(LightData light, vec3 vs_position)
+{
+	float distanceRatio = length(light.positionRadius.xyz - vs_position) / light.positionRadius.w;
+	float window = clamp(1.f - pow(distanceRatio, 4.f), 0.f, 1.f);
+
+	return light.colorIntensity.w * window * window;
+}
+
+//Compares against one view's tile of the atlas, 1 where lit. The sampler filters four comparisons
+float calculateShadow(int view, vec3 position)
+{
+	vec4 clip = shadows[view].ViewProjectionMatrix * vec4(position, 1.f);
+	vec3 coords = clip.xyz / clip.w * 0.5f + 0.5f;
+	if (coords.z >= 1.f)
+		return 1.f;
+
+	//Half a texel inside the tile, filtering never reads a neighbour
+	float border = 0.5f / float(frame.shadowInfo.z);
+	vec2 uv = clamp(coords.xy, vec2(border), vec2(1.f - border)) * shadows[view].atlasRect.xy + shadows[view].atlasRect.zw;
+
+	return texture(shadowAtlas, vec3(uv, coords.z));
+}
+
+//Cube face from the dominant axis, the position moves a texel along the normal against acne
+float calculatePointShadow(LightData light, vec3 vs_position, vec3 normal)
+{
+	if (light.shadow.x < 0)
+		return 1.f;
+
+	vec3 toPosition = vs_position - light.positionRadius.xyz;
+	vec3 axis = abs(toPosition);
+	int face = axis.x >= axis.y && axis.x >= axis.z ? (toPosition.x > 0.f ? 0 : 1) :
+		axis.y >= axis.z ? (toPosition.y > 0.f ? 2 : 3) : (toPosition.z > 0.f ? 4 : 5);
+	float texel = 2.f * max(axis.x, max(axis.y, axis.z)) / float(frame.shadowInfo.z);
+
+	return calculateShadow(light.shadow.x + face, vs_position + normal * texel);
+}
+
+//First cascade reaching past the view depth, lit beyond the last one
+float calculateSunShadow(vec3 vs_position, vec3 normal)
+{
+	float depth = -(frame.ViewMatrix * vec4(vs_position, 1.f)).z;
+	for (int i = 0; i < frame.shadowInfo.y; i++)
+	{
+		if (depth < frame.cascadeSplits[i])
+		{
+			int view = frame.shadowInfo.x + i;
+			mat4 matrix = shadows[view].ViewProjectionMatrix;
+			float texel = 2.f / (length(vec3(matrix[0][0], matrix[1][0], matrix[2][0])) * float(frame.shadowInfo.z));
+			return calculateShadow(view, vs_position + normal * texel);
+		}
+	}
+
+	return 1.f;
+}
+
+vec3 calculateDiffuse(MaterialData material, vec3 vs_position,vec3 vs_normal, vec3 lightPos0)
 {
 	vec3 posToLightVec = normalize(lightPos0 -vs_position);
 	float diffuse = clamp(dot(posToLightVec, vs_normal),0,1);
-	vec3 diffuseFinal = material.diffuse * diffuse;
+	vec3 diffuseFinal = material.diffuse.rgb * diffuse;
 
 	return diffuseFinal;
 }
 
-vec3 calculateSpecular(Material material, vec3 vs_position, vec3 vs_normal, vec3 lightPos0, vec3 cameraPos)
+vec3 calculateSpecular(MaterialData material, vec3 vs_position, vec3 vs_normal, vec3 lightPos0, vec3 cameraPos)
 {
 	vec3 lightToPosDirVec = normalize(vs_position - lightPos0);
 	vec3 reflectDirVec = normalize(reflect(lightToPosDirVec, normalize(vs_normal)));
 	vec3 PosToViewDirVec = normalize(cameraPos - vs_position);
 	float specularConstant = pow(max(dot(PosToViewDirVec, reflectDirVec),0), 30);
-	vec3 specularFinal = material.specular * specularConstant * texture(material.specularTex, vs_texcoord).rgb;
+	vec3 specularFinal = material.specular.rgb * specularConstant * texture(specularTex, vs_texcoord).rgb;
 
 	return specularFinal;
 }
@@ -52,18 +183,45 @@ void main()
 {
 	//fs_color = vec4(vs_color, 1.f);
 
+	//One material per draw, the instanced path keeps a batch per material
+	MaterialData material = materials[draw.indices.z];
+
 	//Ambient light
 	vec3 ambientFinal = calculateAmbient(material);
 
-	//Diffuse light
-	vec3 diffuseFinal = calculateDiffuse(material,vs_position,vs_normal,lightPos0);
+	//Diffuse and specular light of every light in this fragment's froxel
+	vec3 diffuseFinal = vec3(0.f);
+	vec3 specularFinal = vec3(0.f);
+	vec3 normal = normalize(vs_normal);
+
+	uvec2 cluster = clusters[calculateCluster(vs_position)];
+	for (uint i = 0; i < cluster.y; i++)
+	{
+		LightData light = lights[lightIndices[cluster.x + i]];
+
+		//Attenuation
+		vec3 radiance = light.colorIntensity.rgb * calculateAttenuation(light, vs_position);
+		if (radiance == vec3(0.f))
+			continue;
+
+		//Shadow
+		radiance *= calculatePointShadow(light, vs_position, normal);
+
+		diffuseFinal += calculateDiffuse(material,vs_position,normal,light.positionRadius.xyz) * radiance;
+		specularFinal += calculateSpecular(material,vs_position,normal,light.positionRadius.xyz,frame.cameraPos.xyz) * radiance;
+	}
 
-	//Specular light
-	vec3 specularFinal = calculateSpecular(material,vs_position,vs_normal,lightPos0,cameraPos);
+	//The sun, a light position one unit against its direction gives the same vectors everywhere
+	if (frame.sunColor.w > 0.f)
+	{
+		vec3 radiance = frame.sunColor.rgb * frame.sunColor.w * calculateSunShadow(vs_position, normal);
+		vec3 sunPos = vs_position - frame.sunDirection.xyz;
 
-	//Attenuation
+		diffuseFinal += calculateDiffuse(material,vs_position,normal,sunPos) * radiance;
+		specularFinal += calculateSpecular(material,vs_position,normal,sunPos,frame.cameraPos.xyz) * radiance;
+	}
 
 	//Final light
 
-	fs_color = texture(material.diffuseTex, vs_texcoord) * (vec4(ambientFinal,1.f) + vec4(diffuseFinal,1.f) + vec4(specularFinal,1.f));
+	fs_color = texture(diffuseTex, vs_texcoord) * (vec4(ambientFinal,1.f) + vec4(diffuseFinal,1.f) + vec4(specularFinal,1.f));
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include<vector>
 #include<glew.h>
 #include<glfw3.h>
+#include "GLInterceptor.h"
 
 #include<glm.hpp>
 #include<vec2.hpp>
@@ -22,6 +23,16 @@
 #include "Primitives.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "StreamBuffer.h"
+#include "UniformBuffer.h"
+#include "UniformCache.h"
 #include "Material.h"
 #include "Mesh.h"
-#include "Model.h"
\ No newline at end of file
+#include "Model.h"
+#include "DynamicAABBTree.h"
+#include "JobSystem.h"
+#include "Light.h"
+#include "LightClusterer.h"
+#include "ShadowMapper.h"
+#include "LODSelector.h"
+#include "Profiler.h"
\ No newline at end of file
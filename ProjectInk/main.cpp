@@ -1,16 +1,31 @@
 #include"Game.h"
+#include"Benchmark.h"
+#include"RenderBenchmark.h"
 
-int main()
+int main(int argc, char* argv[])
 {
+	if (argc > 1 && std::string(argv[1]) == "--bench")
+	{
+		Benchmark::run();
+		return 0;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--render-bench")
+	{
+		RenderBenchmark::run(argc > 2 ? argv[2] : "render_bench.json");
+		return 0;
+	}
+
 	Game game("idk",1150,1100,4,6,false);
 
 	//Main loop
 	while (!game.getWindowShouldClose())
 	{
 		//uptade input 
+		Profiler::get().beginFrame();
 		game.update();
 		game.render();
-		
+		Profiler::get().endFrame();
 	}
 	return 0;
 }
@@ -0,0 +1,7 @@
+#version 440
+
+//Depth only, the shadow framebuffers have no color attachment
+void main()
+{
+
+}
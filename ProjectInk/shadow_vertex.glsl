@@ -0,0 +1,27 @@
+#version 440
+
+layout (location = 0) in vec3 vertex_position;
+
+//Per draw, see DrawData in UniformBuffer.h. indices.w is the ShadowTable view being rendered
+layout (std140, binding = 1) uniform DrawData
+{
+	mat4 ModelMatrix;
+	ivec4 indices;
+} draw;
+
+//Every shadow map view, see ShadowMapper.h
+struct ShadowView
+{
+	mat4 ViewProjectionMatrix;
+	vec4 atlasRect;
+};
+
+layout (std430, binding = 4) readonly buffer ShadowTable
+{
+	ShadowView shadows[];
+};
+
+void main()
+{
+	gl_Position = shadows[draw.indices.w].ViewProjectionMatrix * draw.ModelMatrix * vec4(vertex_position, 1.f);
+}
@@ -0,0 +1,42 @@
+#version 440
+
+layout (location = 0) in vec3 vertex_position;
+layout (location = 1) in vec3 vertex_color;
+layout (location = 2) in vec2 vertex_texcoord;
+layout (location = 3) in vec3 vertex_normal;
+
+//Per instance, filled by InstanceRenderer
+layout (location = 4) in mat4 instance_ModelMatrix;
+layout (location = 8) in ivec4 instance_indices;
+
+out vec3 vs_position;
+out vec3 vs_color;
+out vec2 vs_texcoord;
+out vec3 vs_normal;
+flat out ivec4 vs_indices;
+
+//Per frame, see FrameData in UniformBuffer.h
+layout (std140, binding = 0) uniform FrameData
+{
+	mat4 ViewMatrix;
+	mat4 ProjectionMatrix;
+	vec4 cameraPos;
+	vec4 lightPos0;
+	vec4 clusterScale;
+	ivec4 clusterGrid;
+	vec4 sunDirection;
+	vec4 sunColor;
+	vec4 cascadeSplits;
+	ivec4 shadowInfo;
+} frame;
+
+void main()
+{
+	vs_position = vec4(instance_ModelMatrix * vec4(vertex_position, 1.f)).xyz;
+	vs_color = vertex_color;
+	vs_texcoord = vec2(vertex_texcoord.x, vertex_texcoord.y * -1.f);
+	vs_normal = mat3(instance_ModelMatrix) * vertex_normal;
+	vs_indices = instance_indices;
+
+	gl_Position = frame.ProjectionMatrix * frame.ViewMatrix * instance_ModelMatrix * vec4(vertex_position, 1.f);
+}